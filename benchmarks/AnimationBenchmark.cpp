@@ -0,0 +1,186 @@
+#include "Benchmark.hpp"
+
+#include "Animation.hpp"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+static const uint32_t kJointCount = 64;
+static const uint32_t kFrameCount = 120;
+static const float kSampleRate = 30.0f;
+
+struct AnimationBenchmarkData {
+  TaskSystem *pTaskSystem;
+  AnimationInstance *pInstances;
+  uint32_t mCount;
+};
+
+static void UpdateInstances(void *pUserData) {
+  AnimationBenchmarkData &data =
+      *reinterpret_cast<AnimationBenchmarkData *>(pUserData);
+  UpdateAnimationInstances(data.pTaskSystem, data.pInstances, data.mCount,
+                           1.0f / 60.0f);
+}
+
+struct SkinningBenchmarkData {
+  const mat4 *pSkinningMatrices;
+  const float3 *pPositions;
+  const uint8_t (*pJoints)[4];
+  const uint8_t (*pWeights)[4];
+  uint32_t mVertexCount;
+  float3 *pSkinnedPositions;
+};
+
+static void SkinVertices(void *pUserData) {
+  SkinningBenchmarkData &data =
+      *reinterpret_cast<SkinningBenchmarkData *>(pUserData);
+  SkinPositions(data.pSkinningMatrices, data.pPositions, data.pJoints,
+                data.pWeights, data.mVertexCount, data.pSkinnedPositions);
+}
+
+/// xorshift, to get the same skeleton on every run.
+static uint32_t NextRandom(uint32_t &state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+static float NextUnit(uint32_t &state) {
+  return (float)(NextRandom(state) & 0xffffff) / (float)0xffffff;
+}
+
+/// A binary tree of joints swinging around random axes. Scales never change,
+/// as in most character rigs, and leaves don't translate.
+static void MakeClip(Skeleton &skeleton, JointPose *pPoses) {
+  skeleton.mJointCount = kJointCount;
+  skeleton.pParents =
+      reinterpret_cast<int32_t *>(tf_calloc(kJointCount, sizeof(int32_t)));
+  skeleton.pInverseBindPoses =
+      reinterpret_cast<mat4 *>(tf_calloc(kJointCount, sizeof(mat4)));
+  uint32_t random = 0x9e3779b9u;
+  for (uint32_t joint = 0; joint < kJointCount; ++joint) {
+    skeleton.pParents[joint] = joint == 0 ? -1 : (int32_t)(joint - 1) / 2;
+    skeleton.pInverseBindPoses[joint] =
+        mat4::translation(vec3(0.0f, -1.0f, 0.0f));
+    vec3 axis = normalize(vec3(NextUnit(random) - 0.5f,
+                               NextUnit(random) - 0.5f,
+                               NextUnit(random) - 0.5f));
+    float amplitude = NextUnit(random);
+    float phase = NextUnit(random) * 2.0f * PI;
+    bool leaf = joint * 2 + 1 >= kJointCount;
+    for (uint32_t frame = 0; frame < kFrameCount; ++frame) {
+      float t = frame * 2.0f * PI / (kFrameCount - 1);
+      JointPose &pose = pPoses[frame * kJointCount + joint];
+      pose.mRotation = Quat::rotation(amplitude * sinf(t + phase), axis);
+      pose.mTranslation =
+          leaf ? vec3(0.0f, 1.0f, 0.0f)
+               : vec3(0.0f, 1.0f + 0.1f * cosf(t + phase), 0.0f);
+      pose.mScale = vec3(1.0f);
+    }
+  }
+}
+
+/// Largest rotation error, in degrees, over every sampled frame.
+static float MeasureRotationError(const AnimationClip &clip,
+                                  const JointPose *pPoses) {
+  JointPose sampled[kJointCount];
+  float minDot = 1.0f;
+  for (uint32_t frame = 0; frame < kFrameCount; ++frame) {
+    clip.Sample(frame / kSampleRate, sampled);
+    for (uint32_t joint = 0; joint < kJointCount; ++joint) {
+      float d = fabsf(dot(sampled[joint].mRotation,
+                          pPoses[frame * kJointCount + joint].mRotation));
+      minDot = min(minDot, d);
+    }
+  }
+  return 2.0f * acosf(min(minDot, 1.0f)) * 180.0f / PI;
+}
+
+static void RunSkinningBenchmark(const mat4 *pSkinningMatrices) {
+  const uint32_t kVertexCount = 100000;
+  float3 *pPositions =
+      reinterpret_cast<float3 *>(tf_calloc(kVertexCount, sizeof(float3)));
+  float3 *pSkinned =
+      reinterpret_cast<float3 *>(tf_calloc(kVertexCount, sizeof(float3)));
+  uint8_t(*pJoints)[4] = reinterpret_cast<uint8_t(*)[4]>(
+      tf_calloc(kVertexCount, 4 * sizeof(uint8_t)));
+  uint8_t(*pWeights)[4] = reinterpret_cast<uint8_t(*)[4]>(
+      tf_calloc(kVertexCount, 4 * sizeof(uint8_t)));
+  uint32_t random = 0x9e3779b9u;
+  for (uint32_t i = 0; i < kVertexCount; ++i) {
+    pPositions[i] = float3(NextUnit(random), NextUnit(random) * 8.0f,
+                           NextUnit(random));
+    // Two influences, as typical of character meshes.
+    pJoints[i][0] = (uint8_t)(NextRandom(random) % kJointCount);
+    pJoints[i][1] = (uint8_t)(NextRandom(random) % kJointCount);
+    pWeights[i][0] = (uint8_t)(128 + NextRandom(random) % 128);
+    pWeights[i][1] = (uint8_t)(255 - pWeights[i][0]);
+  }
+
+  SkinningBenchmarkData data = {pSkinningMatrices, pPositions, pJoints,
+                                pWeights, kVertexCount, pSkinned};
+  double ms = MeasureMedianMs(SkinVertices, &data, 11);
+  LOGF(eINFO, "CPU skinning: %u vertices in %.3f ms (%.1f Mvertices/s)",
+       kVertexCount, ms, kVertexCount / (ms * 1000.0));
+
+  tf_free(pWeights);
+  tf_free(pJoints);
+  tf_free(pSkinned);
+  tf_free(pPositions);
+}
+
+void RunAnimationBenchmark() {
+  const uint32_t kInstanceCounts[] = {1, 10, 100, 1000};
+
+  TaskSystem taskSystem;
+  if (!taskSystem.Init()) {
+    LOGF(eERROR, "Failed to start the task system");
+    return;
+  }
+
+  Skeleton skeleton;
+  JointPose *pPoses = reinterpret_cast<JointPose *>(
+      tf_calloc(kFrameCount * kJointCount, sizeof(JointPose)));
+  MakeClip(skeleton, pPoses);
+  AnimationClip clip;
+  clip.Build(pPoses, kFrameCount, kJointCount, kSampleRate);
+  LOGF(eINFO,
+       "Clip: %u joints, %u frames, %.1f KB (%.1f KB raw), max rotation "
+       "error %.3f degrees",
+       kJointCount, kFrameCount, clip.GetSizeBytes() / 1024.0,
+       kFrameCount * kJointCount * sizeof(JointPose) / 1024.0,
+       MeasureRotationError(clip, pPoses));
+
+  uint32_t maxCount = kInstanceCounts[TF_ARRAY_COUNT(kInstanceCounts) - 1];
+  AnimationInstance *pInstances = reinterpret_cast<AnimationInstance *>(
+      tf_calloc(maxCount, sizeof(AnimationInstance)));
+  mat4 *pMatrices = reinterpret_cast<mat4 *>(
+      tf_calloc(maxCount * kJointCount, sizeof(mat4)));
+  uint32_t random = 0x9e3779b9u;
+  for (uint32_t i = 0; i < maxCount; ++i) {
+    // Desynchronized, so that instances don't sample the same frames.
+    pInstances[i] = {&skeleton, &clip, NextUnit(random) * clip.GetDuration(),
+                     1.0f, &pMatrices[i * kJointCount]};
+  }
+
+  for (uint32_t c = 0; c < TF_ARRAY_COUNT(kInstanceCounts); ++c) {
+    uint32_t count = kInstanceCounts[c];
+    AnimationBenchmarkData serialData = {NULL, pInstances, count};
+    AnimationBenchmarkData parallelData = {&taskSystem, pInstances, count};
+    double serialMs = MeasureMedianMs(UpdateInstances, &serialData, 21);
+    double parallelMs = MeasureMedianMs(UpdateInstances, &parallelData, 21);
+    LOGF(eINFO,
+         "%4u characters: serial %.3f ms (%.2f us each), %u threads %.3f ms",
+         count, serialMs, serialMs * 1000.0 / count,
+         taskSystem.GetThreadCount(), parallelMs);
+  }
+
+  RunSkinningBenchmark(pMatrices);
+
+  tf_free(pMatrices);
+  tf_free(pInstances);
+  clip.Destroy();
+  tf_free(pPoses);
+  skeleton.Destroy();
+  taskSystem.Exit();
+}
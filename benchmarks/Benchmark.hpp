@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Utilities/Interfaces/ILog.h"
+#include "Utilities/Interfaces/ITime.h"
+
+/// Every benchmark is a free function registered in \c BenchmarkMain.cpp and
+/// selected by name on the command line. They run headless: no window, no
+/// renderer, only The Forge's OS layer.
+void RunDrawListBenchmark();
+void RunLightBinningBenchmark();
+void RunAnimationBenchmark();
+void RunBlendShapeBenchmark();
+void RunTransformBenchmark();
+void RunGeometryCodecBenchmark();
+void RunOffsetAllocatorBenchmark();
+void RunGlbBenchmark();
+void RunTangentSpaceBenchmark();
+void RunImageBasedLightingBenchmark();
+
+typedef void (*BenchmarkBody)(void *pUserData);
+
+/// Runs \c pBody \c repetitions times after one warmup run and returns the
+/// median wall time in milliseconds.
+double MeasureMedianMs(BenchmarkBody pBody, void *pUserData,
+                       uint32_t repetitions);
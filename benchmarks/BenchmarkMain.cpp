@@ -0,0 +1,76 @@
+#include "Benchmark.hpp"
+
+#include "Utilities/Interfaces/IFileSystem.h"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+struct BenchmarkEntry {
+  const char *pName;
+  void (*pRun)();
+};
+
+static const BenchmarkEntry kBenchmarks[] = {
+    {"drawlist", RunDrawListBenchmark},
+    {"lightbinning", RunLightBinningBenchmark},
+    {"animation", RunAnimationBenchmark},
+    {"blendshapes", RunBlendShapeBenchmark},
+    {"transforms", RunTransformBenchmark},
+    {"geometrycodec", RunGeometryCodecBenchmark},
+    {"offsetallocator", RunOffsetAllocatorBenchmark},
+    {"glb", RunGlbBenchmark},
+    {"tangents", RunTangentSpaceBenchmark},
+    {"ibl", RunImageBasedLightingBenchmark},
+};
+
+double MeasureMedianMs(BenchmarkBody pBody, void *pUserData,
+                       uint32_t repetitions) {
+  pBody(pUserData);
+  double *pSamples =
+      reinterpret_cast<double *>(tf_calloc(repetitions, sizeof(double)));
+  for (uint32_t i = 0; i < repetitions; ++i) {
+    int64_t start = getUSec(true);
+    pBody(pUserData);
+    pSamples[i] = (double)(getUSec(true) - start) / 1000.0;
+  }
+  // Insertion sort; repetitions are few.
+  for (uint32_t i = 1; i < repetitions; ++i) {
+    for (uint32_t j = i; j > 0 && pSamples[j - 1] > pSamples[j]; --j) {
+      double tmp = pSamples[j];
+      pSamples[j] = pSamples[j - 1];
+      pSamples[j - 1] = tmp;
+    }
+  }
+  double median = pSamples[repetitions / 2];
+  tf_free(pSamples);
+  return median;
+}
+
+int main(int argc, char **argv) {
+  if (!initMemAlloc("ModelViewerBenchmarks")) {
+    return 1;
+  }
+  FileSystemInitDesc fsDesc = {};
+  fsDesc.pAppName = "ModelViewerBenchmarks";
+  if (!initFileSystem(&fsDesc)) {
+    return 1;
+  }
+  fsSetPathForResourceDir(pSystemFileIO, RM_DEBUG, RD_LOG, "");
+  initLog("ModelViewerBenchmarks", DEFAULT_LOG_LEVEL);
+
+  // Without arguments every benchmark runs.
+  for (uint32_t i = 0; i < TF_ARRAY_COUNT(kBenchmarks); ++i) {
+    bool selected = argc <= 1;
+    for (int arg = 1; arg < argc; ++arg) {
+      selected |= strcmp(argv[arg], kBenchmarks[i].pName) == 0;
+    }
+    if (selected) {
+      LOGF(eINFO, "Running benchmark \"%s\"", kBenchmarks[i].pName);
+      kBenchmarks[i].pRun();
+    }
+  }
+
+  exitLog();
+  exitFileSystem();
+  exitMemAlloc();
+  return 0;
+}
@@ -0,0 +1,136 @@
+#include "Benchmark.hpp"
+
+#include "BlendShapes.hpp"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+static const uint32_t kVertexCount = 20000;
+static const uint32_t kTargetCount = 50;
+/// Facial targets usually move a small region of the head.
+static const uint32_t kRegionSize = 1200;
+
+struct BlendShapeBenchmarkData {
+  const BlendShapeSet *pBlendShapes;
+  const float *pWeights;
+  const float3 *pBasePositions;
+  const float3 *pBaseNormals;
+  float3 *pPositions;
+  float3 *pNormals;
+};
+
+/// Includes restoring the undeformed vertices, as the GPU pass does.
+static void ApplyBlendShapes(void *pUserData) {
+  BlendShapeBenchmarkData &data =
+      *reinterpret_cast<BlendShapeBenchmarkData *>(pUserData);
+  ActiveBlendShape active[BlendShapeSet::kMaxTargetCount];
+  uint32_t activeCount = data.pBlendShapes->GatherActive(data.pWeights, active);
+  memcpy(data.pPositions, data.pBasePositions, kVertexCount * sizeof(float3));
+  memcpy(data.pNormals, data.pBaseNormals, kVertexCount * sizeof(float3));
+  data.pBlendShapes->Apply(active, activeCount, data.pPositions,
+                           data.pNormals);
+}
+
+/// xorshift, to get the same targets on every run.
+static uint32_t NextRandom(uint32_t &state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+static float NextUnit(uint32_t &state) {
+  return (float)(NextRandom(state) & 0xffffff) / (float)0xffffff;
+}
+
+void RunBlendShapeBenchmark() {
+  const uint32_t kActiveCounts[] = {0, 1, 5, 10, 50};
+
+  float3 *pBasePositions =
+      reinterpret_cast<float3 *>(tf_calloc(kVertexCount, sizeof(float3)));
+  float3 *pBaseNormals =
+      reinterpret_cast<float3 *>(tf_calloc(kVertexCount, sizeof(float3)));
+  float3 *pPositions =
+      reinterpret_cast<float3 *>(tf_calloc(kVertexCount, sizeof(float3)));
+  float3 *pNormals =
+      reinterpret_cast<float3 *>(tf_calloc(kVertexCount, sizeof(float3)));
+  // Dense offsets, kept to measure the quantization error.
+  float3 *pDenseOffsets = reinterpret_cast<float3 *>(
+      tf_calloc(kTargetCount * kVertexCount, sizeof(float3)));
+  float3 *pNormalOffsets =
+      reinterpret_cast<float3 *>(tf_calloc(kVertexCount, sizeof(float3)));
+
+  uint32_t random = 0x9e3779b9u;
+  for (uint32_t i = 0; i < kVertexCount; ++i) {
+    pBasePositions[i] = float3(NextUnit(random), NextUnit(random),
+                               NextUnit(random));
+    pBaseNormals[i] = float3(0.0f, 0.0f, 1.0f);
+  }
+
+  BlendShapeSet blendShapes;
+  for (uint32_t t = 0; t < kTargetCount; ++t) {
+    float3 *pOffsets = &pDenseOffsets[t * kVertexCount];
+    uint32_t regionBegin = NextRandom(random) % (kVertexCount - kRegionSize);
+    vec3 direction = normalize(vec3(NextUnit(random) - 0.5f,
+                                    NextUnit(random) - 0.5f,
+                                    NextUnit(random) - 0.5f));
+    for (uint32_t i = 0; i < kVertexCount; ++i) {
+      pNormalOffsets[i] = float3(0.0f, 0.0f, 0.0f);
+    }
+    for (uint32_t i = 0; i < kRegionSize; ++i) {
+      // Falls off towards the edges of the region.
+      float falloff = sinf(PI * i / kRegionSize) * 0.05f;
+      pOffsets[regionBegin + i] = v3ToF3(direction * falloff);
+      pNormalOffsets[regionBegin + i] = v3ToF3(direction * (falloff * 2.0f));
+    }
+    blendShapes.AddTarget(pOffsets, pNormalOffsets, 0, kVertexCount, 0.0f);
+  }
+
+  BlendShapeStats memory = blendShapes.ComputeStats(NULL, 0);
+  LOGF(eINFO,
+       "%u targets over %u vertices: %.1f KB per target sparse, %.1f KB "
+       "dense; %.1f KB total (%.1f KB dense)",
+       kTargetCount, kVertexCount,
+       memory.mSparseBytes / 1024.0 / kTargetCount,
+       memory.mDenseBytes / 1024.0 / kTargetCount,
+       memory.mSparseBytes / 1024.0, memory.mDenseBytes / 1024.0);
+
+  float weights[kTargetCount] = {};
+  BlendShapeBenchmarkData data = {&blendShapes, weights,    pBasePositions,
+                                  pBaseNormals, pPositions, pNormals};
+  for (uint32_t c = 0; c < TF_ARRAY_COUNT(kActiveCounts); ++c) {
+    uint32_t activeCount = kActiveCounts[c];
+    // Active targets are spread over the set, the rest stay at zero.
+    uint32_t stride = kTargetCount / max(activeCount, 1u);
+    for (uint32_t t = 0; t < kTargetCount; ++t) {
+      bool active = t % stride == 0 && t / stride < activeCount;
+      weights[t] = active ? 0.75f : 0.0f;
+    }
+    double ms = MeasureMedianMs(ApplyBlendShapes, &data, 51);
+
+    float maxError = 0.0f;
+    for (uint32_t i = 0; i < kVertexCount; ++i) {
+      vec3 expected = f3Tov3(pBasePositions[i]);
+      for (uint32_t t = 0; t < kTargetCount; ++t) {
+        expected += f3Tov3(pDenseOffsets[t * kVertexCount + i]) * weights[t];
+      }
+      vec3 error = absPerElem(expected - f3Tov3(pPositions[i]));
+      maxError = max(maxError, maxElem(error));
+    }
+
+    ActiveBlendShape active[BlendShapeSet::kMaxTargetCount];
+    BlendShapeStats stats = blendShapes.ComputeStats(
+        active, blendShapes.GatherActive(weights, active));
+    LOGF(eINFO,
+         "%2u active targets: %.3f ms, %u deltas applied, max position error "
+         "%.2e",
+         stats.mActiveTargetCount, ms, stats.mAppliedDeltaCount, maxError);
+  }
+
+  blendShapes.Destroy();
+  tf_free(pNormalOffsets);
+  tf_free(pDenseOffsets);
+  tf_free(pNormals);
+  tf_free(pPositions);
+  tf_free(pBaseNormals);
+  tf_free(pBasePositions);
+}
@@ -0,0 +1,217 @@
+#include "Benchmark.hpp"
+
+#include "Utilities/Math/MathTypes.h"
+
+#include "GeometryCodec.hpp"
+#include "TaskSystem.hpp"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+/// Same layout as the viewer's vertices: a position, then a normal and a UV
+/// packed into 16-bit pairs.
+struct CodecBenchmarkVertex {
+  float mPosition[3];
+  uint32_t mNormal;
+  uint32_t mUv;
+};
+
+static const uint32_t kGridSize = 1024;
+
+struct CodecBenchmarkBlock {
+  size_t mOffset;
+  size_t mSize;
+  uint32_t mFirst;
+  uint32_t mCount;
+  uint32_t mBaseIndex;
+  uint32_t mCodeSize;
+};
+
+struct CodecBenchmarkData {
+  TaskSystem *pTaskSystem;
+  const CodecBenchmarkBlock *pBlocks;
+  uint32_t mBlockCount;
+  uint32_t mVertexBlockCount;
+  const uint8_t *pEncoded;
+  uint32_t mVertexCount;
+  CodecBenchmarkVertex *pVertices;
+  uint32_t *pIndices;
+  tfrg_atomic32_t mFailed;
+};
+
+static size_t GetScratchSize() {
+  return max(kGeometryBlockVertexCount * sizeof(CodecBenchmarkVertex),
+             GetIndexCodeBound(kGeometryBlockIndexCount));
+}
+
+static void DecodeBlocks(void *pUserData, uint32_t begin, uint32_t end) {
+  CodecBenchmarkData &data = *reinterpret_cast<CodecBenchmarkData *>(pUserData);
+  void *pScratch = tf_malloc(GetScratchSize());
+  for (uint32_t i = begin; i < end; ++i) {
+    const CodecBenchmarkBlock &block = data.pBlocks[i];
+    bool decoded =
+        i < data.mVertexBlockCount
+            ? DecodeVertexBlock(data.pEncoded + block.mOffset, block.mSize,
+                                block.mCount, sizeof(CodecBenchmarkVertex),
+                                pScratch, data.pVertices + block.mFirst)
+            : DecodeIndexBlock(data.pEncoded + block.mOffset, block.mSize,
+                               block.mCount, block.mBaseIndex,
+                               block.mCodeSize, data.mVertexCount, pScratch,
+                               data.pIndices + block.mFirst);
+    if (!decoded) {
+      tfrg_atomic32_store_relaxed(&data.mFailed, 1);
+    }
+  }
+  tf_free(pScratch);
+}
+
+static void DecodeAll(void *pUserData) {
+  CodecBenchmarkData &data = *reinterpret_cast<CodecBenchmarkData *>(pUserData);
+  if (data.pTaskSystem) {
+    data.pTaskSystem->ParallelFor(data.mBlockCount, 1, DecodeBlocks,
+                                  pUserData);
+  } else {
+    DecodeBlocks(pUserData, 0, data.mBlockCount);
+  }
+}
+
+/// Triangles may come back rotated, so they're compared as such.
+static bool MatchesTriangles(const uint32_t *pExpected,
+                             const uint32_t *pDecoded, uint32_t indexCount) {
+  for (uint32_t t = 0; t < indexCount; t += 3) {
+    bool matches = false;
+    for (uint32_t r = 0; r < 3; ++r) {
+      matches |= pExpected[t] == pDecoded[t + r] &&
+                 pExpected[t + 1] == pDecoded[t + (r + 1) % 3] &&
+                 pExpected[t + 2] == pDecoded[t + (r + 2) % 3];
+    }
+    if (!matches) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// Encodes a displaced grid the size of a large scanned model, then decodes
+/// it on one thread and on the task system.
+void RunGeometryCodecBenchmark() {
+  TaskSystem taskSystem;
+  if (!taskSystem.Init()) {
+    LOGF(eERROR, "Failed to start the task system");
+    return;
+  }
+
+  const uint32_t vertexCount = kGridSize * kGridSize;
+  const uint32_t indexCount = (kGridSize - 1) * (kGridSize - 1) * 6;
+  CodecBenchmarkVertex *pVertices = reinterpret_cast<CodecBenchmarkVertex *>(
+      tf_malloc(vertexCount * sizeof(CodecBenchmarkVertex)));
+  uint32_t *pIndices =
+      reinterpret_cast<uint32_t *>(tf_malloc(indexCount * sizeof(uint32_t)));
+  for (uint32_t y = 0; y < kGridSize; ++y) {
+    for (uint32_t x = 0; x < kGridSize; ++x) {
+      float u = (float)x / (kGridSize - 1);
+      float v = (float)y / (kGridSize - 1);
+      float height = 0.05f * sinf(u * 40.0f) * cosf(v * 25.0f);
+      vec3 normal = normalize(vec3(-2.0f * cosf(u * 40.0f) * cosf(v * 25.0f),
+                                   1.0f,
+                                   1.25f * sinf(u * 40.0f) * sinf(v * 25.0f)));
+      CodecBenchmarkVertex &vertex = pVertices[y * kGridSize + x];
+      vertex.mPosition[0] = u;
+      vertex.mPosition[1] = height;
+      vertex.mPosition[2] = v;
+      vertex.mNormal =
+          (uint32_t)((normal.getX() * 0.5f + 0.5f) * 65535.0f) |
+          ((uint32_t)((normal.getZ() * 0.5f + 0.5f) * 65535.0f) << 16);
+      vertex.mUv = (uint32_t)(u * 65535.0f) | ((uint32_t)(v * 65535.0f) << 16);
+    }
+  }
+  uint32_t *pIndex = pIndices;
+  for (uint32_t y = 0; y + 1 < kGridSize; ++y) {
+    for (uint32_t x = 0; x + 1 < kGridSize; ++x) {
+      uint32_t corner = y * kGridSize + x;
+      const uint32_t quad[6] = {corner,     corner + kGridSize,
+                                corner + 1, corner + 1,
+                                corner + kGridSize, corner + kGridSize + 1};
+      memcpy(pIndex, quad, sizeof(quad));
+      pIndex += 6;
+    }
+  }
+
+  uint32_t vertexBlockCount =
+      (vertexCount + kGeometryBlockVertexCount - 1) / kGeometryBlockVertexCount;
+  uint32_t blockCount =
+      vertexBlockCount +
+      (indexCount + kGeometryBlockIndexCount - 1) / kGeometryBlockIndexCount;
+  CodecBenchmarkBlock *pBlocks = reinterpret_cast<CodecBenchmarkBlock *>(
+      tf_calloc(blockCount, sizeof(CodecBenchmarkBlock)));
+  size_t rawVertexBytes = vertexCount * sizeof(CodecBenchmarkVertex);
+  size_t rawIndexBytes = indexCount * sizeof(uint32_t);
+  size_t blockBound = GetGeometryEncodedBound(GetScratchSize());
+  uint8_t *pEncoded = reinterpret_cast<uint8_t *>(
+      tf_malloc((size_t)blockCount * blockBound));
+  void *pScratch = tf_malloc(GetScratchSize());
+  size_t encodedVertexBytes = 0;
+  size_t encodedIndexBytes = 0;
+  int64_t encodeStart = getUSec(true);
+  for (uint32_t i = 0; i < blockCount; ++i) {
+    CodecBenchmarkBlock &block = pBlocks[i];
+    block.mOffset = encodedVertexBytes + encodedIndexBytes;
+    if (i < vertexBlockCount) {
+      block.mFirst = i * kGeometryBlockVertexCount;
+      block.mCount = min(kGeometryBlockVertexCount, vertexCount - block.mFirst);
+      block.mSize = EncodeVertexBlock(
+          pVertices + block.mFirst, block.mCount, sizeof(CodecBenchmarkVertex),
+          pScratch, pEncoded + block.mOffset, blockBound);
+      encodedVertexBytes += block.mSize;
+    } else {
+      block.mFirst = (i - vertexBlockCount) * kGeometryBlockIndexCount;
+      block.mCount = min(kGeometryBlockIndexCount, indexCount - block.mFirst);
+      block.mSize = EncodeIndexBlock(
+          pIndices + block.mFirst, block.mCount, pScratch,
+          pEncoded + block.mOffset, blockBound, &block.mBaseIndex,
+          &block.mCodeSize);
+      encodedIndexBytes += block.mSize;
+    }
+  }
+  double encodeMs = (double)(getUSec(true) - encodeStart) / 1000.0;
+  tf_free(pScratch);
+  size_t rawBytes = rawVertexBytes + rawIndexBytes;
+  size_t encodedBytes = encodedVertexBytes + encodedIndexBytes;
+  LOGF(eINFO,
+       "%u vertices, %u indices in %u blocks: %.1f MB packed into %.1f MB "
+       "(%.2fx; vertices %.2fx, indices %.2fx), encoded in %.1f ms",
+       vertexCount, indexCount, blockCount, rawBytes / (1024.0 * 1024.0),
+       encodedBytes / (1024.0 * 1024.0), (double)rawBytes / encodedBytes,
+       (double)rawVertexBytes / encodedVertexBytes,
+       (double)rawIndexBytes / encodedIndexBytes, encodeMs);
+
+  CodecBenchmarkData data = {};
+  data.pBlocks = pBlocks;
+  data.mBlockCount = blockCount;
+  data.mVertexBlockCount = vertexBlockCount;
+  data.pEncoded = pEncoded;
+  data.mVertexCount = vertexCount;
+  data.pVertices = reinterpret_cast<CodecBenchmarkVertex *>(
+      tf_malloc(rawVertexBytes));
+  data.pIndices = reinterpret_cast<uint32_t *>(tf_malloc(rawIndexBytes));
+  double serialMs = MeasureMedianMs(DecodeAll, &data, 11);
+  data.pTaskSystem = &taskSystem;
+  double parallelMs = MeasureMedianMs(DecodeAll, &data, 11);
+  bool matches =
+      !tfrg_atomic32_load_relaxed(&data.mFailed) &&
+      memcmp(data.pVertices, pVertices, rawVertexBytes) == 0 &&
+      MatchesTriangles(pIndices, data.pIndices, indexCount);
+  LOGF(eINFO,
+       "  decoded: serial %.3f ms (%.2f GB/s), %u threads %.3f ms "
+       "(%.2f GB/s), %s",
+       serialMs, rawBytes / (serialMs * 1e6), taskSystem.GetThreadCount(),
+       parallelMs, rawBytes / (parallelMs * 1e6),
+       matches ? "matching the input" : "NOT matching the input");
+
+  taskSystem.Exit();
+  tf_free(data.pIndices);
+  tf_free(data.pVertices);
+  tf_free(pEncoded);
+  tf_free(pBlocks);
+  tf_free(pIndices);
+  tf_free(pVertices);
+}
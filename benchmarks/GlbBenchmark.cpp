@@ -0,0 +1,228 @@
+#include "Benchmark.hpp"
+
+#include "Utilities/Math/MathTypes.h"
+
+#include "GlbFile.hpp"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+static const uint32_t kGridSize = 1024;
+
+/// One mesh holding a displaced grid. Quantized files store positions as
+/// signed 16-bit integers scaled by the node, normals as normalized bytes and
+/// UVs as normalized shorts, like gltfpack's output.
+struct GlbBenchmarkFile {
+  uint8_t *pData;
+  size_t mSize;
+  bool mQuantized;
+};
+
+struct GlbBenchmarkData {
+  const GlbBenchmarkFile *pFile;
+  uint32_t mVertexCount;
+  uint32_t mIndexCount;
+  float *pPositions;
+  float *pNormals;
+  float *pUvs;
+  uint32_t *pIndices;
+  bool mFailed;
+};
+
+static inline uint32_t Align4(uint32_t size) { return (size + 3) & ~3u; }
+
+static void WriteGrid(bool quantized, GlbBenchmarkFile &file) {
+  const uint32_t vertexCount = kGridSize * kGridSize;
+  const uint32_t indexCount = (kGridSize - 1) * (kGridSize - 1) * 6;
+  const uint32_t positionStride = quantized ? 8 : 12;
+  const uint32_t normalStride = quantized ? 4 : 12;
+  const uint32_t uvStride = quantized ? 4 : 8;
+  const uint32_t positionOffset = 0;
+  const uint32_t normalOffset = positionOffset + vertexCount * positionStride;
+  const uint32_t uvOffset = normalOffset + vertexCount * normalStride;
+  const uint32_t indexOffset = uvOffset + vertexCount * uvStride;
+  const uint32_t binSize = indexOffset + indexCount * sizeof(uint32_t);
+
+  char json[2048];
+  int jsonSize = snprintf(
+      json, sizeof(json),
+      "{\"asset\":{\"version\":\"2.0\"},%s"
+      "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],"
+      "\"nodes\":[{\"mesh\":0,\"scale\":[%s,1,%s]}],"
+      "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,"
+      "\"NORMAL\":1,\"TEXCOORD_0\":2},\"indices\":3}]}],"
+      "\"buffers\":[{\"byteLength\":%u}],"
+      "\"bufferViews\":["
+      "{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u,\"byteStride\":%u},"
+      "{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u,\"byteStride\":%u},"
+      "{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u,\"byteStride\":%u},"
+      "{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u}],"
+      "\"accessors\":["
+      "{\"bufferView\":0,\"componentType\":%u,\"count\":%u,\"type\":\"VEC3\"},"
+      "{\"bufferView\":1,\"componentType\":%u,\"count\":%u,\"type\":\"VEC3\""
+      "%s},"
+      "{\"bufferView\":2,\"componentType\":%u,\"count\":%u,\"type\":\"VEC2\""
+      "%s},"
+      "{\"bufferView\":3,\"componentType\":5125,\"count\":%u,"
+      "\"type\":\"SCALAR\"}]}",
+      quantized ? "\"extensionsRequired\":[\"KHR_mesh_quantization\"],"
+                  "\"extensionsUsed\":[\"KHR_mesh_quantization\"],"
+                : "",
+      quantized ? "0.0000305185095" : "1", quantized ? "0.0000305185095" : "1",
+      binSize, positionOffset, vertexCount * positionStride, positionStride,
+      normalOffset, vertexCount * normalStride, normalStride, uvOffset,
+      vertexCount * uvStride, uvStride, indexOffset,
+      indexCount * (uint32_t)sizeof(uint32_t),
+      quantized ? kGlbShort : kGlbFloat, vertexCount,
+      quantized ? kGlbByte : kGlbFloat, vertexCount,
+      quantized ? ",\"normalized\":true" : "",
+      quantized ? kGlbUnsignedShort : kGlbFloat, vertexCount,
+      quantized ? ",\"normalized\":true" : "", indexCount);
+  uint32_t jsonChunkSize = Align4((uint32_t)jsonSize);
+
+  file.mQuantized = quantized;
+  file.mSize = 12 + 8 + jsonChunkSize + 8 + binSize;
+  file.pData = reinterpret_cast<uint8_t *>(tf_calloc(file.mSize, 1));
+  const uint32_t header[5] = {0x46546C67, 2, (uint32_t)file.mSize,
+                              jsonChunkSize, 0x4E4F534A};
+  memcpy(file.pData, header, sizeof(header));
+  memset(file.pData + 20, ' ', jsonChunkSize);
+  memcpy(file.pData + 20, json, (size_t)jsonSize);
+  const uint32_t binHeader[2] = {binSize, 0x004E4942};
+  memcpy(file.pData + 20 + jsonChunkSize, binHeader, sizeof(binHeader));
+  uint8_t *pBin = file.pData + 28 + jsonChunkSize;
+
+  for (uint32_t y = 0; y < kGridSize; ++y) {
+    for (uint32_t x = 0; x < kGridSize; ++x) {
+      uint32_t vertex = y * kGridSize + x;
+      float u = (float)x / (kGridSize - 1);
+      float v = (float)y / (kGridSize - 1);
+      float height = 0.05f * sinf(u * 40.0f) * cosf(v * 25.0f);
+      vec3 normal = normalize(vec3(-2.0f * cosf(u * 40.0f) * cosf(v * 25.0f),
+                                   1.0f,
+                                   1.25f * sinf(u * 40.0f) * sinf(v * 25.0f)));
+      uint8_t *pPosition = pBin + positionOffset + vertex * positionStride;
+      uint8_t *pNormal = pBin + normalOffset + vertex * normalStride;
+      uint8_t *pUv = pBin + uvOffset + vertex * uvStride;
+      if (quantized) {
+        const int16_t position[3] = {(int16_t)lroundf(u * 32767.0f),
+                                     (int16_t)lroundf(height * 32767.0f),
+                                     (int16_t)lroundf(v * 32767.0f)};
+        const int8_t packedNormal[3] = {(int8_t)(normal.getX() * 127.0f),
+                                        (int8_t)(normal.getY() * 127.0f),
+                                        (int8_t)(normal.getZ() * 127.0f)};
+        const uint16_t uv[2] = {(uint16_t)(u * 65535.0f + 0.5f),
+                                (uint16_t)(v * 65535.0f + 0.5f)};
+        memcpy(pPosition, position, sizeof(position));
+        memcpy(pNormal, packedNormal, sizeof(packedNormal));
+        memcpy(pUv, uv, sizeof(uv));
+      } else {
+        const float position[3] = {u, height, v};
+        const float unpackedNormal[3] = {normal.getX(), normal.getY(),
+                                         normal.getZ()};
+        const float uv[2] = {u, v};
+        memcpy(pPosition, position, sizeof(position));
+        memcpy(pNormal, unpackedNormal, sizeof(unpackedNormal));
+        memcpy(pUv, uv, sizeof(uv));
+      }
+    }
+  }
+  uint8_t *pIndex = pBin + indexOffset;
+  for (uint32_t y = 0; y + 1 < kGridSize; ++y) {
+    for (uint32_t x = 0; x + 1 < kGridSize; ++x) {
+      uint32_t corner = y * kGridSize + x;
+      const uint32_t quad[6] = {corner,     corner + kGridSize,
+                                corner + 1, corner + 1,
+                                corner + kGridSize, corner + kGridSize + 1};
+      memcpy(pIndex, quad, sizeof(quad));
+      pIndex += sizeof(quad);
+    }
+  }
+}
+
+static bool ParseFile(const GlbBenchmarkFile &file, GlbFile &glb) {
+  return glb.Parse(file.pData, file.mSize) && glb.GetMeshCount() == 1 &&
+         glb.GetMesh(0).mPrimitiveCount == 1;
+}
+
+static void Parse(void *pUserData) {
+  GlbBenchmarkData &data = *reinterpret_cast<GlbBenchmarkData *>(pUserData);
+  GlbFile glb;
+  data.mFailed |= !ParseFile(*data.pFile, glb);
+  glb.Destroy();
+}
+
+/// What the scene importer reads from a primitive before packing vertices.
+static void ParseAndRead(void *pUserData) {
+  GlbBenchmarkData &data = *reinterpret_cast<GlbBenchmarkData *>(pUserData);
+  GlbFile glb;
+  if (!ParseFile(*data.pFile, glb)) {
+    data.mFailed = true;
+    return;
+  }
+  const GlbPrimitive &primitive = glb.GetPrimitive(0);
+  data.mFailed |=
+      !glb.ReadFloats(primitive.mPosition, 3, data.pPositions) ||
+      !glb.ReadFloats(primitive.mNormal, 3, data.pNormals) ||
+      !glb.ReadFloats(primitive.mTexCoord, 2, data.pUvs) ||
+      !glb.ReadIndices(primitive.mIndices, 0, data.mVertexCount,
+                       data.pIndices);
+  glb.Destroy();
+}
+
+/// Largest difference between the positions read and the grid's, before the
+/// node's scale.
+static float GetPositionError(const GlbBenchmarkData &data) {
+  float scale = data.pFile->mQuantized ? 32767.0f : 1.0f;
+  float error = 0.0f;
+  for (uint32_t y = 0; y < kGridSize; ++y) {
+    for (uint32_t x = 0; x < kGridSize; ++x) {
+      const float *pPosition = data.pPositions + (y * kGridSize + x) * 3;
+      float u = (float)x / (kGridSize - 1);
+      float v = (float)y / (kGridSize - 1);
+      float height = 0.05f * sinf(u * 40.0f) * cosf(v * 25.0f);
+      error = max(error, fabsf(pPosition[0] / scale - u));
+      error = max(error, fabsf(pPosition[1] / scale - height));
+      error = max(error, fabsf(pPosition[2] / scale - v));
+    }
+  }
+  return error;
+}
+
+/// Parses a GLB of a 1M vertex grid and converts its accessors to floats,
+/// once with float attributes and once quantized. The FBX importer can't run
+/// headless; the viewer logs both importers' times when loading a model.
+void RunGlbBenchmark() {
+  GlbBenchmarkData data = {};
+  data.mVertexCount = kGridSize * kGridSize;
+  data.mIndexCount = (kGridSize - 1) * (kGridSize - 1) * 6;
+  data.pPositions = reinterpret_cast<float *>(
+      tf_malloc(data.mVertexCount * 3 * sizeof(float)));
+  data.pNormals = reinterpret_cast<float *>(
+      tf_malloc(data.mVertexCount * 3 * sizeof(float)));
+  data.pUvs = reinterpret_cast<float *>(
+      tf_malloc(data.mVertexCount * 2 * sizeof(float)));
+  data.pIndices = reinterpret_cast<uint32_t *>(
+      tf_malloc(data.mIndexCount * sizeof(uint32_t)));
+
+  for (uint32_t quantized = 0; quantized < 2; ++quantized) {
+    GlbBenchmarkFile file = {};
+    WriteGrid(quantized != 0, file);
+    data.pFile = &file;
+    data.mFailed = false;
+    double parseMs = MeasureMedianMs(Parse, &data, 11);
+    double readMs = MeasureMedianMs(ParseAndRead, &data, 11);
+    float error = data.mFailed ? 0.0f : GetPositionError(data);
+    LOGF(eINFO,
+         "%s: %.1f MB, parsed in %.3f ms, parsed and read in %.3f ms "
+         "(%.2f GB/s), %s, largest position error %g",
+         quantized ? "quantized" : "float", file.mSize / (1024.0 * 1024.0),
+         parseMs, readMs, file.mSize / (readMs * 1e6),
+         data.mFailed ? "FAILED" : "read", error);
+    tf_free(file.pData);
+  }
+
+  tf_free(data.pIndices);
+  tf_free(data.pUvs);
+  tf_free(data.pNormals);
+  tf_free(data.pPositions);
+}
@@ -0,0 +1,111 @@
+#include "Benchmark.hpp"
+
+#include "ImageBasedLighting.hpp"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+static const char *const kCacheFileName = "ImageBasedLightingBenchmark.ibl";
+
+/// A sky of a few gradients and a small bright sun, so that every mip of the
+/// specular map differs.
+static uint8_t *CreateFace(uint32_t face, uint32_t size) {
+  uint8_t *pPixels =
+      reinterpret_cast<uint8_t *>(tf_malloc((size_t)size * size * 4));
+  for (uint32_t y = 0; y < size; ++y) {
+    for (uint32_t x = 0; x < size; ++x) {
+      uint8_t *pTexel = pPixels + ((size_t)y * size + x) * 4;
+      float u = (float)x / (float)size, v = (float)y / (float)size;
+      bool sun =
+          face == 2 && fabsf(u - 0.3f) < 0.03f && fabsf(v - 0.6f) < 0.03f;
+      pTexel[0] = sun ? 255 : (uint8_t)(40 * face + 50 * u);
+      pTexel[1] = sun ? 255 : (uint8_t)(120 + 100 * (1.0f - v));
+      pTexel[2] = sun ? 240 : (uint8_t)(200 - 30 * face * u);
+      pTexel[3] = 255;
+    }
+  }
+  return pPixels;
+}
+
+struct ImageBasedLightingBenchmarkData {
+  TaskSystem *pTaskSystem;
+  const IblSourceFace *pFaces;
+  ImageBasedLighting mLighting;
+};
+
+static void BakeLighting(void *pUserData) {
+  ImageBasedLightingBenchmarkData &data =
+      *reinterpret_cast<ImageBasedLightingBenchmarkData *>(pUserData);
+  data.mLighting.Bake(data.pFaces, data.pTaskSystem);
+}
+
+static void ReadLighting(void *pUserData) {
+  ImageBasedLightingBenchmarkData &data =
+      *reinterpret_cast<ImageBasedLightingBenchmarkData *>(pUserData);
+  if (!data.mLighting.Read(RD_LOG, kCacheFileName)) {
+    LOGF(eERROR, "Failed to read %s back", kCacheFileName);
+  }
+}
+
+static bool IsSameLighting(const ImageBasedLighting &a,
+                           const ImageBasedLighting &b) {
+  if (memcmp(a.GetIrradianceSh(), b.GetIrradianceSh(),
+             9 * 4 * sizeof(float)) != 0 ||
+      memcmp(a.GetBrdfLut(), b.GetBrdfLut(),
+             ImageBasedLighting::kBrdfLutSize *
+                 ImageBasedLighting::kBrdfLutSize * 2 * sizeof(uint16_t)) !=
+          0) {
+    return false;
+  }
+  for (uint32_t mip = 0; mip < ImageBasedLighting::kSpecularMipCount; ++mip) {
+    uint32_t size = ImageBasedLighting::kSpecularSize >> mip;
+    for (uint32_t face = 0; face < ImageBasedLighting::kFaceCount; ++face) {
+      if (memcmp(a.GetSpecularFace(mip, face), b.GetSpecularFace(mip, face),
+                 (size_t)size * size * 4) != 0) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+void RunImageBasedLightingBenchmark() {
+  // As large as the faces of The Forge's sky box.
+  const uint32_t kFaceSize = 1024;
+
+  TaskSystem taskSystem;
+  if (!taskSystem.Init()) {
+    LOGF(eERROR, "Failed to start the task system");
+    return;
+  }
+
+  IblSourceFace faces[ImageBasedLighting::kFaceCount];
+  for (uint32_t i = 0; i < ImageBasedLighting::kFaceCount; ++i) {
+    faces[i] = {CreateFace(i, kFaceSize), kFaceSize, kFaceSize};
+  }
+  ImageBasedLightingBenchmarkData serialData = {NULL, faces, {}};
+  ImageBasedLightingBenchmarkData parallelData = {&taskSystem, faces, {}};
+  ImageBasedLightingBenchmarkData readData = {NULL, faces, {}};
+
+  double serialMs = MeasureMedianMs(BakeLighting, &serialData, 3);
+  double parallelMs = MeasureMedianMs(BakeLighting, &parallelData, 3);
+  bool identical = IsSameLighting(serialData.mLighting, parallelData.mLighting);
+  bool written = parallelData.mLighting.Write(RD_LOG, kCacheFileName);
+  double readMs = written ? MeasureMedianMs(ReadLighting, &readData, 5) : 0.0;
+  bool readBack =
+      written && IsSameLighting(parallelData.mLighting, readData.mLighting);
+
+  LOGF(eINFO,
+       "6 faces of %u^2: bake serial %.1f ms, %u threads %.1f ms, %s; cache "
+       "read %.2f ms, %s",
+       kFaceSize, serialMs, taskSystem.GetThreadCount(), parallelMs,
+       identical ? "identical" : "DIFFERENT", readMs,
+       readBack ? "identical" : "DIFFERENT");
+
+  serialData.mLighting.Destroy();
+  parallelData.mLighting.Destroy();
+  readData.mLighting.Destroy();
+  for (uint32_t i = 0; i < ImageBasedLighting::kFaceCount; ++i) {
+    tf_free(const_cast<uint8_t *>(faces[i].pPixels));
+  }
+  taskSystem.Exit();
+}
@@ -0,0 +1,100 @@
+#include "Benchmark.hpp"
+
+#include "ClusteredLighting.hpp"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+struct LightBinningBenchmarkData {
+  ClusteredLighting *pLighting;
+  const Light *pLights;
+  uint32_t mCount;
+  mat4 mViewMat;
+};
+
+static void BinLights(void *pUserData) {
+  LightBinningBenchmarkData &data =
+      *reinterpret_cast<LightBinningBenchmarkData *>(pUserData);
+  data.pLighting->Bin(data.pLights, data.mCount, data.mViewMat);
+}
+
+/// xorshift, to get the same lights on every run.
+static uint32_t NextRandom(uint32_t &state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+static float NextUnit(uint32_t &state) {
+  return (float)(NextRandom(state) & 0xffffff) / (float)0xffffff;
+}
+
+/// The threaded result must match the single-threaded one exactly, as every
+/// cluster is binned by a single thread in light order.
+static bool SameBins(const ClusteredLighting &a, const ClusteredLighting &b) {
+  if (a.GetStats().mIndexCount != b.GetStats().mIndexCount) {
+    return false;
+  }
+  return memcmp(a.GetClusterRanges(), b.GetClusterRanges(),
+                ClusteredLighting::kClusterCount * sizeof(uint32_t)) == 0 &&
+         memcmp(a.GetLightIndices(), b.GetLightIndices(),
+                a.GetStats().mIndexCount * sizeof(uint32_t)) == 0;
+}
+
+void RunLightBinningBenchmark() {
+  const uint32_t kLightCounts[] = {64, 256, 1024, 4096};
+
+  TaskSystem taskSystem;
+  if (!taskSystem.Init()) {
+    LOGF(eERROR, "Failed to start the task system");
+    return;
+  }
+
+  ClusteredLighting serial;
+  ClusteredLighting parallel;
+  serial.Init(NULL);
+  parallel.Init(&taskSystem);
+
+  // A 90 degree, 16:9 view looking down +Z at a 100 unit cube of lights.
+  const float projScaleY = 1.0f / tanf(PI / 4.0f) * (16.0f / 9.0f);
+  serial.SetProjection(1.0f, projScaleY, 0.1f, 1000.0f);
+  parallel.SetProjection(1.0f, projScaleY, 0.1f, 1000.0f);
+  mat4 viewMat = mat4::translation(vec3(0.0f, 0.0f, 60.0f));
+
+  for (uint32_t c = 0; c < TF_ARRAY_COUNT(kLightCounts); ++c) {
+    uint32_t count = kLightCounts[c];
+    Light *pLights =
+        reinterpret_cast<Light *>(tf_calloc(count, sizeof(Light)));
+    uint32_t random = 0x9e3779b9u;
+    for (uint32_t i = 0; i < count; ++i) {
+      pLights[i].mPosition = float3(NextUnit(random) * 100.0f - 50.0f,
+                                    NextUnit(random) * 100.0f - 50.0f,
+                                    NextUnit(random) * 100.0f - 50.0f);
+      pLights[i].mRadius = 2.0f + NextUnit(random) * 6.0f;
+      pLights[i].mColor = float3(1.0f, 1.0f, 1.0f);
+      pLights[i].mType = LightType::Point;
+    }
+
+    LightBinningBenchmarkData serialData = {&serial, pLights, count, viewMat};
+    LightBinningBenchmarkData parallelData = {&parallel, pLights, count,
+                                              viewMat};
+    double serialMs = MeasureMedianMs(BinLights, &serialData, 21);
+    double parallelMs = MeasureMedianMs(BinLights, &parallelData, 21);
+    if (!SameBins(serial, parallel)) {
+      LOGF(eERROR, "%u lights: threaded binning differs from serial", count);
+    }
+
+    const ClusterStats &stats = parallel.GetStats();
+    LOGF(eINFO,
+         "%4u lights: serial %.3f ms, %u threads %.3f ms, %u indices, max "
+         "%u per cluster, %u dropped",
+         count, serialMs, taskSystem.GetThreadCount(), parallelMs,
+         stats.mIndexCount, stats.mMaxLightsPerCluster, stats.mDroppedCount);
+
+    tf_free(pLights);
+  }
+
+  parallel.Exit();
+  serial.Exit();
+  taskSystem.Exit();
+}
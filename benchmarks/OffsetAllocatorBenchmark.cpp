@@ -0,0 +1,107 @@
+#include "Benchmark.hpp"
+
+#include "OffsetAllocator.hpp"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+/// Same sizing as the viewer's index pool: 32M indices, at most 32768 live
+/// allocations.
+static const uint32_t kPoolSize = 32 * 1024 * 1024;
+static const uint32_t kMaxAllocationCount = 32768;
+static const uint32_t kOperationCount = 1000000;
+
+/// xorshift, to get the same sequence on every run.
+static uint32_t NextRandom(uint32_t &state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+/// Mostly chunk-sized allocations, with the odd whole model among them.
+static uint32_t NextSize(uint32_t &random) {
+  if ((NextRandom(random) & 63) == 0) {
+    return 65536 + NextRandom(random) % (1024 * 1024);
+  }
+  return 64 + NextRandom(random) % 12288;
+}
+
+struct OffsetAllocatorBenchmarkData {
+  OffsetAllocator *pAllocator;
+  OffsetAllocation *pLive;
+  uint32_t mLiveCount;
+  uint64_t mLiveSize;
+};
+
+/// Allocates and frees at random, keeping the pool between half and 7/8
+/// allocated, as streaming does once the budget is spent.
+static void ChurnOperations(OffsetAllocatorBenchmarkData &data,
+                            uint32_t operationCount) {
+  OffsetAllocator &allocator = *data.pAllocator;
+  uint32_t random = 0x9e3779b9;
+  for (uint32_t i = 0; i < operationCount; ++i) {
+    bool full = data.mLiveCount == kMaxAllocationCount ||
+                data.mLiveSize > kPoolSize - kPoolSize / 8;
+    bool allocate = !full && (data.mLiveSize < kPoolSize / 2 ||
+                              (NextRandom(random) & 1) != 0);
+    if (allocate || data.mLiveCount == 0) {
+      uint32_t size = NextSize(random);
+      OffsetAllocation allocation = allocator.Allocate(size);
+      if (allocation.mOffset != OffsetAllocator::kInvalidOffset) {
+        data.pLive[data.mLiveCount++] = allocation;
+        data.mLiveSize += size;
+      }
+    } else {
+      uint32_t index = NextRandom(random) % data.mLiveCount;
+      data.mLiveSize -= allocator.GetAllocationSize(data.pLive[index]);
+      allocator.Free(data.pLive[index]);
+      data.pLive[index] = data.pLive[--data.mLiveCount];
+    }
+  }
+}
+
+static void FreeAll(OffsetAllocatorBenchmarkData &data) {
+  for (uint32_t i = 0; i < data.mLiveCount; ++i) {
+    data.pAllocator->Free(data.pLive[i]);
+  }
+  data.mLiveCount = 0;
+  data.mLiveSize = 0;
+}
+
+static void Churn(void *pUserData) {
+  OffsetAllocatorBenchmarkData &data =
+      *reinterpret_cast<OffsetAllocatorBenchmarkData *>(pUserData);
+  ChurnOperations(data, kOperationCount);
+  FreeAll(data);
+}
+
+/// Churns an allocator sized like the geometry pool's index buffer.
+void RunOffsetAllocatorBenchmark() {
+  OffsetAllocator allocator;
+  if (!allocator.Init(kPoolSize, kMaxAllocationCount)) {
+    LOGF(eERROR, "Failed to initialize the allocator");
+    return;
+  }
+  OffsetAllocatorBenchmarkData data = {};
+  data.pAllocator = &allocator;
+  data.pLive = reinterpret_cast<OffsetAllocation *>(
+      tf_malloc(kMaxAllocationCount * sizeof(OffsetAllocation)));
+  double churnMs = MeasureMedianMs(Churn, &data, 11);
+  // Fragmentation is measured halfway through a run, while the pool is busy.
+  ChurnOperations(data, kOperationCount / 2);
+  uint32_t freeSize = allocator.GetFreeSize();
+  double fragmentation =
+      freeSize ? 1.0 - (double)allocator.GetLargestFreeSize() / freeSize : 0.0;
+  FreeAll(data);
+  bool whole = allocator.GetAllocationCount() == 0 &&
+               allocator.GetFreeSize() == kPoolSize &&
+               allocator.GetLargestFreeSize() == kPoolSize;
+  LOGF(eINFO,
+       "%u operations in %.3f ms (%.1f ns each), %.1f%% of the free space "
+       "outside the largest region halfway, %s",
+       kOperationCount, churnMs, churnMs * 1e6 / kOperationCount,
+       fragmentation * 100.0,
+       whole ? "whole again once freed" : "NOT whole again once freed");
+  tf_free(data.pLive);
+  allocator.Destroy();
+}
@@ -0,0 +1,205 @@
+#include "Benchmark.hpp"
+
+#include "TangentSpace.hpp"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+/// A wavy height field, so that normals vary everywhere. Indexed grids share
+/// vertices; unrolled ones give every triangle its own, welded by position
+/// ids like unrolled FBX polygons.
+struct TangentSpaceBenchmarkMesh {
+  float *pPositions;
+  float *pUvs;
+  uint32_t *pIndices;
+  uint32_t *pPositionIds;
+  uint32_t mVertexCount;
+  uint32_t mIndexCount;
+  uint32_t mGridSize;
+};
+
+static float GetHeight(float x, float y) {
+  return 0.05f * sinf(x * 9.0f) * cosf(y * 7.0f);
+}
+
+/// Analytic normal of \c GetHeight.
+static vec3 GetHeightNormal(float x, float y) {
+  float dx = 0.05f * 9.0f * cosf(x * 9.0f) * cosf(y * 7.0f);
+  float dy = -0.05f * 7.0f * sinf(x * 9.0f) * sinf(y * 7.0f);
+  return normalize(vec3(-dx, -dy, 1.0f));
+}
+
+static void WriteGridVertex(TangentSpaceBenchmarkMesh &mesh, uint32_t vertex,
+                            uint32_t gridVertex) {
+  uint32_t size = mesh.mGridSize;
+  float x = (float)(gridVertex % size) / (float)(size - 1);
+  float y = (float)(gridVertex / size) / (float)(size - 1);
+  mesh.pPositions[vertex * 3] = x;
+  mesh.pPositions[vertex * 3 + 1] = y;
+  mesh.pPositions[vertex * 3 + 2] = GetHeight(x, y);
+  mesh.pUvs[vertex * 2] = x * 4.0f;
+  mesh.pUvs[vertex * 2 + 1] = y * 4.0f;
+}
+
+static TangentSpaceBenchmarkMesh CreateGrid(uint32_t size, bool unrolled) {
+  TangentSpaceBenchmarkMesh mesh = {};
+  mesh.mGridSize = size;
+  mesh.mIndexCount = (size - 1) * (size - 1) * 6;
+  mesh.mVertexCount = unrolled ? mesh.mIndexCount : size * size;
+  mesh.pPositions = reinterpret_cast<float *>(
+      tf_malloc((size_t)mesh.mVertexCount * 3 * sizeof(float)));
+  mesh.pUvs = reinterpret_cast<float *>(
+      tf_malloc((size_t)mesh.mVertexCount * 2 * sizeof(float)));
+  uint32_t *pGridIndices = reinterpret_cast<uint32_t *>(
+      tf_malloc((size_t)mesh.mIndexCount * sizeof(uint32_t)));
+  uint32_t index = 0;
+  for (uint32_t y = 0; y + 1 < size; ++y) {
+    for (uint32_t x = 0; x + 1 < size; ++x) {
+      uint32_t v = y * size + x;
+      const uint32_t quad[6] = {v, v + 1, v + size, v + 1, v + size + 1,
+                                v + size};
+      for (uint32_t k = 0; k < 6; ++k) {
+        pGridIndices[index++] = quad[k];
+      }
+    }
+  }
+  if (unrolled) {
+    for (uint32_t i = 0; i < mesh.mIndexCount; ++i) {
+      WriteGridVertex(mesh, i, pGridIndices[i]);
+    }
+    mesh.pPositionIds = pGridIndices;
+  } else {
+    for (uint32_t i = 0; i < mesh.mVertexCount; ++i) {
+      WriteGridVertex(mesh, i, i);
+    }
+    mesh.pIndices = pGridIndices;
+  }
+  return mesh;
+}
+
+static void DestroyGrid(TangentSpaceBenchmarkMesh &mesh) {
+  tf_free(mesh.pPositions);
+  tf_free(mesh.pUvs);
+  tf_free(mesh.pIndices);
+  tf_free(mesh.pPositionIds);
+  mesh = {};
+}
+
+struct TangentSpaceBenchmarkData {
+  TaskSystem *pTaskSystem;
+  const TangentSpaceBenchmarkMesh *pMesh;
+  float *pNormals;
+  float *pTangents;
+};
+
+static void GenerateTangentSpace(void *pUserData) {
+  TangentSpaceBenchmarkData &data =
+      *reinterpret_cast<TangentSpaceBenchmarkData *>(pUserData);
+  const TangentSpaceBenchmarkMesh &grid = *data.pMesh;
+  TangentSpaceMesh mesh = {};
+  mesh.pIndices = grid.pIndices;
+  mesh.mIndexCount = grid.mIndexCount;
+  mesh.mVertexCount = grid.mVertexCount;
+  mesh.pPositions = grid.pPositions;
+  mesh.mPositionStride = 3 * sizeof(float);
+  mesh.pUvs = grid.pUvs;
+  mesh.mUvStride = 2 * sizeof(float);
+  mesh.pPositionIds = grid.pPositionIds;
+  mesh.mPositionIdCount =
+      grid.pPositionIds ? grid.mGridSize * grid.mGridSize : 0;
+  TangentSpaceGenerator generator;
+  if (!generator.Init(mesh, data.pTaskSystem)) {
+    LOGF(eERROR, "The benchmark mesh was rejected");
+    return;
+  }
+  generator.GenerateNormals(PI / 3.0f, data.pNormals);
+  generator.GenerateTangents(data.pNormals, data.pTangents);
+  generator.Destroy();
+}
+
+/// Largest angle in degrees between the generated and analytic normals, and
+/// largest |n.t|.
+static void MeasureErrors(const TangentSpaceBenchmarkMesh &mesh,
+                          const float *pNormals, const float *pTangents,
+                          float &maxNormalDegrees, float &maxNormalDotTangent) {
+  maxNormalDegrees = 0.0f;
+  maxNormalDotTangent = 0.0f;
+  for (uint32_t i = 0; i < mesh.mVertexCount; ++i) {
+    vec3 normal(pNormals[i * 3], pNormals[i * 3 + 1], pNormals[i * 3 + 2]);
+    vec3 tangent(pTangents[i * 4], pTangents[i * 4 + 1],
+                 pTangents[i * 4 + 2]);
+    vec3 expected =
+        GetHeightNormal(mesh.pPositions[i * 3], mesh.pPositions[i * 3 + 1]);
+    float cosAngle = min(max((float)dot(normal, expected), -1.0f), 1.0f);
+    maxNormalDegrees = max(maxNormalDegrees, acosf(cosAngle) * 180.0f / PI);
+    maxNormalDotTangent =
+        max(maxNormalDotTangent, fabsf((float)dot(normal, tangent)));
+  }
+}
+
+void RunTangentSpaceBenchmark() {
+  // About 10M triangles indexed, and 2M unrolled into 6M vertices.
+  const uint32_t kGridSizes[] = {2237, 1000};
+  const bool kUnrolled[] = {false, true};
+
+  TaskSystem taskSystem;
+  if (!taskSystem.Init()) {
+    LOGF(eERROR, "Failed to start the task system");
+    return;
+  }
+
+  for (uint32_t g = 0; g < TF_ARRAY_COUNT(kGridSizes); ++g) {
+    TangentSpaceBenchmarkMesh mesh = CreateGrid(kGridSizes[g], kUnrolled[g]);
+    size_t normalsSize = (size_t)mesh.mVertexCount * 3 * sizeof(float);
+    size_t tangentsSize = (size_t)mesh.mVertexCount * 4 * sizeof(float);
+    TangentSpaceBenchmarkData serialData = {
+        NULL, &mesh, reinterpret_cast<float *>(tf_malloc(normalsSize)),
+        reinterpret_cast<float *>(tf_malloc(tangentsSize))};
+    TangentSpaceBenchmarkData parallelData = {
+        &taskSystem, &mesh, reinterpret_cast<float *>(tf_malloc(normalsSize)),
+        reinterpret_cast<float *>(tf_malloc(tangentsSize))};
+    // What background imports run on.
+    TangentSpaceBenchmarkData loadData = {
+        taskSystem.GetLoadTasks(), &mesh,
+        reinterpret_cast<float *>(tf_malloc(normalsSize)),
+        reinterpret_cast<float *>(tf_malloc(tangentsSize))};
+
+    double serialMs = MeasureMedianMs(GenerateTangentSpace, &serialData, 3);
+    double parallelMs =
+        MeasureMedianMs(GenerateTangentSpace, &parallelData, 5);
+    double loadMs = MeasureMedianMs(GenerateTangentSpace, &loadData, 5);
+    uint32_t triangleCount = mesh.mIndexCount / 3;
+    // Sums run in a fixed order, so results must match bit for bit.
+    bool identical =
+        memcmp(serialData.pNormals, parallelData.pNormals, normalsSize) == 0 &&
+        memcmp(serialData.pTangents, parallelData.pTangents, tangentsSize) ==
+            0 &&
+        memcmp(serialData.pNormals, loadData.pNormals, normalsSize) == 0 &&
+        memcmp(serialData.pTangents, loadData.pTangents, tangentsSize) == 0;
+    float maxNormalDegrees, maxNormalDotTangent;
+    MeasureErrors(mesh, parallelData.pNormals, parallelData.pTangents,
+                  maxNormalDegrees, maxNormalDotTangent);
+    LOGF(eINFO,
+         "%s, %u triangles, %u vertices: serial %.1f ms (%.1f Mtri/s), %u "
+         "threads %.1f ms (%.1f Mtri/s), %s",
+         kUnrolled[g] ? "unrolled" : "indexed", triangleCount,
+         mesh.mVertexCount, serialMs, triangleCount / (serialMs * 1000.0),
+         taskSystem.GetThreadCount(), parallelMs,
+         triangleCount / (parallelMs * 1000.0),
+         identical ? "identical" : "DIFFERENT");
+    LOGF(eINFO, "  %u load workers %.1f ms (%.1f Mtri/s)",
+         taskSystem.GetLoadTasks()->GetThreadCount(), loadMs,
+         triangleCount / (loadMs * 1000.0));
+    LOGF(eINFO, "  max normal error %.3f degrees, max |n.t| %g",
+         maxNormalDegrees, maxNormalDotTangent);
+
+    tf_free(serialData.pNormals);
+    tf_free(serialData.pTangents);
+    tf_free(parallelData.pNormals);
+    tf_free(parallelData.pTangents);
+    tf_free(loadData.pNormals);
+    tf_free(loadData.pTangents);
+    DestroyGrid(mesh);
+  }
+
+  taskSystem.Exit();
+}
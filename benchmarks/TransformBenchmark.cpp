@@ -0,0 +1,154 @@
+#include "Benchmark.hpp"
+
+#include "TransformHierarchy.hpp"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+/// xorshift, to get the same hierarchy on every run.
+static uint32_t NextRandom(uint32_t &state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+static float NextUnit(uint32_t &state) {
+  return (float)(NextRandom(state) & 0xffffff) / (float)0xffffff;
+}
+
+static JointPose RandomPose(uint32_t &random) {
+  vec3 axis = normalize(vec3(NextUnit(random) - 0.5f, NextUnit(random) - 0.5f,
+                             NextUnit(random) - 0.5f));
+  return {Quat::rotation(NextUnit(random) * PI, axis),
+          vec3(NextUnit(random), NextUnit(random), NextUnit(random)),
+          vec3(1.0f)};
+}
+
+struct TransformBenchmarkData {
+  TaskSystem *pTaskSystem;
+  TransformHierarchy *pHierarchy;
+  /// Nodes whose local transform changes before each update.
+  const uint32_t *pMovedNodes;
+  uint32_t mMovedCount;
+  const JointPose *pPoses;
+};
+
+static void MoveAndUpdate(void *pUserData) {
+  TransformBenchmarkData &data =
+      *reinterpret_cast<TransformBenchmarkData *>(pUserData);
+  for (uint32_t i = 0; i < data.mMovedCount; ++i) {
+    data.pHierarchy->SetLocal(data.pMovedNodes[i], data.pPoses[i]);
+  }
+  data.pHierarchy->Update(data.pTaskSystem);
+}
+
+/// Largest difference between the updated world matrices of a sample of
+/// nodes and their product recomputed up to the root.
+static float MeasureWorldError(const TransformHierarchy &hierarchy) {
+  float maxError = 0.0f;
+  for (uint32_t node = 0; node < hierarchy.GetNodeCount(); node += 997) {
+    mat4 world = mat4::identity();
+    for (int32_t n = (int32_t)node; n >= 0; n = hierarchy.GetParent(n)) {
+      JointPose pose = hierarchy.GetLocal(n);
+      world = mat4(Matrix3(pose.mRotation) * Matrix3::scale(pose.mScale),
+                   pose.mTranslation) *
+              world;
+    }
+    for (uint32_t column = 0; column < 4; ++column) {
+      vec4 difference =
+          world.getCol(column) - hierarchy.GetWorld(node).getCol(column);
+      maxError = max(maxError, maxElem(absPerElem(difference)));
+    }
+  }
+  return maxError;
+}
+
+void RunTransformBenchmark() {
+  const uint32_t kNodeCounts[] = {100000, 1000000};
+  // Fraction of the nodes moved per update.
+  const float kMovedFractions[] = {0.001f, 0.01f, 1.0f};
+  const uint32_t kBranching = 4;
+
+  TaskSystem taskSystem;
+  if (!taskSystem.Init()) {
+    LOGF(eERROR, "Failed to start the task system");
+    return;
+  }
+
+  for (uint32_t c = 0; c < TF_ARRAY_COUNT(kNodeCounts); ++c) {
+    uint32_t count = kNodeCounts[c];
+    // A tree of fixed branching, shuffled so that Build has to sort it.
+    uint32_t *pShuffle =
+        reinterpret_cast<uint32_t *>(tf_malloc(count * sizeof(uint32_t)));
+    for (uint32_t i = 0; i < count; ++i) {
+      pShuffle[i] = i;
+    }
+    uint32_t random = 0x9e3779b9u;
+    for (uint32_t i = count - 1; i > 0; --i) {
+      uint32_t j = NextRandom(random) % (i + 1);
+      uint32_t tmp = pShuffle[i];
+      pShuffle[i] = pShuffle[j];
+      pShuffle[j] = tmp;
+    }
+    int32_t *pParents =
+        reinterpret_cast<int32_t *>(tf_malloc(count * sizeof(int32_t)));
+    JointPose *pPoses =
+        reinterpret_cast<JointPose *>(tf_malloc(count * sizeof(JointPose)));
+    for (uint32_t i = 0; i < count; ++i) {
+      pParents[pShuffle[i]] =
+          i == 0 ? -1 : (int32_t)pShuffle[(i - 1) / kBranching];
+      pPoses[i] = RandomPose(random);
+    }
+
+    TransformHierarchy hierarchy;
+    int64_t buildStart = getUSec(true);
+    hierarchy.Build(pParents, pPoses, count, NULL);
+    double buildMs = (double)(getUSec(true) - buildStart) / 1000.0;
+    hierarchy.Update(NULL);
+    LOGF(eINFO,
+         "%u nodes, %u levels: built in %.3f ms, %.1f MB, max world error "
+         "%g",
+         count, hierarchy.GetLevelCount(), buildMs,
+         hierarchy.GetSizeBytes() / (1024.0 * 1024.0),
+         MeasureWorldError(hierarchy));
+
+    uint32_t *pMovedNodes =
+        reinterpret_cast<uint32_t *>(tf_malloc(count * sizeof(uint32_t)));
+    for (uint32_t f = 0; f < TF_ARRAY_COUNT(kMovedFractions); ++f) {
+      uint32_t movedCount = (uint32_t)(count * kMovedFractions[f]);
+      for (uint32_t i = 0; i < movedCount; ++i) {
+        pMovedNodes[i] =
+            movedCount == count ? i : NextRandom(random) % count;
+      }
+      TransformBenchmarkData serialData = {NULL, &hierarchy, pMovedNodes,
+                                           movedCount, pPoses};
+      TransformBenchmarkData parallelData = {&taskSystem, &hierarchy,
+                                             pMovedNodes, movedCount, pPoses};
+      double serialMs = MeasureMedianMs(MoveAndUpdate, &serialData, 11);
+      double parallelMs = MeasureMedianMs(MoveAndUpdate, &parallelData, 11);
+      for (uint32_t i = 0; i < movedCount; ++i) {
+        hierarchy.SetLocal(pMovedNodes[i], pPoses[i]);
+      }
+      uint32_t updatedCount = hierarchy.Update(NULL);
+      LOGF(eINFO,
+           "  %7u moved, %7u updated: serial %.3f ms, %u threads %.3f ms",
+           movedCount, updatedCount, serialMs, taskSystem.GetThreadCount(),
+           parallelMs);
+    }
+
+    TransformBenchmarkData cleanData = {&taskSystem, &hierarchy, NULL, 0,
+                                        pPoses};
+    LOGF(eINFO, "  nothing moved: %.3f ms",
+         MeasureMedianMs(MoveAndUpdate, &cleanData, 11));
+    LOGF(eINFO, "  max world error after updates %g",
+         MeasureWorldError(hierarchy));
+
+    hierarchy.Destroy();
+    tf_free(pMovedNodes);
+    tf_free(pPoses);
+    tf_free(pParents);
+    tf_free(pShuffle);
+  }
+
+  taskSystem.Exit();
+}
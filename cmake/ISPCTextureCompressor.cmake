@@ -22,7 +22,7 @@ set(ISPC_ARCH_CXXFLAGS -msse2)
 # ispc_texcomp/ispc_texcomp_astc.o \
 # ispc_texcomp/ispc_texcomp.o
 
-set(ISPC_FLAGS -O2 --arch=${ISPC_ARCH} "--target=${ISPC_TARGETS}" --opt=fast-math --pic)
+set(ISPC_FLAGS -O2 --arch=${ISPC_ARCH} "--target=${ISPC_TARGET}" --opt=fast-math --pic)
 
 set(ISPC_CXX_SRC ${ISPC_DIR}/ispc_texcomp/ispc_texcomp.cpp ${ISPC_DIR}/ispc_texcomp/ispc_texcomp_astc.cpp)
 set(ISPC_ISPC_SRC ${ISPC_DIR}/ispc_texcomp/kernel.ispc ${ISPC_DIR}/ispc_texcomp/kernel_astc.ispc)
@@ -0,0 +1,11 @@
+# Reports how many compiled shaders start with SHADER_PREFIX in SHADER_DIR,
+# and their total size. Run with cmake -P after the shaders are compiled.
+file(GLOB_RECURSE shader_variants "${SHADER_DIR}/${SHADER_PREFIX}*")
+list(LENGTH shader_variants shader_variant_count)
+set(shader_variant_bytes 0)
+foreach(shader_variant ${shader_variants})
+	file(SIZE ${shader_variant} shader_variant_size)
+	math(EXPR shader_variant_bytes "${shader_variant_bytes} + ${shader_variant_size}")
+endforeach()
+math(EXPR shader_variant_kb "(${shader_variant_bytes} + 1023) / 1024")
+message(STATUS "${shader_variant_count} compiled ${SHADER_PREFIX} shader variants, ${shader_variant_kb} KB")
@@ -0,0 +1,204 @@
+#include "AmbientOcclusionSystem.hpp"
+
+#include "RenderStats.hpp"
+
+struct AmbientOcclusionPreset {
+  uint32_t mDownscale;
+  uint32_t mSampleCount;
+};
+
+static const AmbientOcclusionPreset
+    kAmbientOcclusionPresets[kAmbientOcclusionQualityCount] = {
+        {4, 8},
+        {2, 8},
+        {2, 16},
+};
+
+void AmbientOcclusionSystem::Init(RenderContext &renderContext) {
+  SamplerDesc samplerDesc = {FILTER_NEAREST,
+                             FILTER_NEAREST,
+                             MIPMAP_MODE_NEAREST,
+                             ADDRESS_MODE_CLAMP_TO_EDGE,
+                             ADDRESS_MODE_CLAMP_TO_EDGE,
+                             ADDRESS_MODE_CLAMP_TO_EDGE};
+  pPointSampler = renderContext.CreateSampler(&samplerDesc);
+}
+void AmbientOcclusionSystem::Exit(RenderContext &renderContext) {
+  renderContext.DestroySampler(pPointSampler);
+}
+
+void AmbientOcclusionSystem::Load(RenderContext &renderContext,
+                                  ReloadDesc *pReloadDesc) {
+  if (pReloadDesc->mType & RELOAD_TYPE_SHADER) {
+    ShaderLoadDesc occlusionShader = {};
+    occlusionShader.mVert.pFileName = "ambientocclusion.vert";
+    occlusionShader.mFrag.pFileName = "ambientocclusion.frag";
+    pOcclusionShader = renderContext.LoadShader(&occlusionShader);
+
+    ShaderLoadDesc compositeShader = {};
+    compositeShader.mVert.pFileName = "ambientocclusion.vert";
+    compositeShader.mFrag.pFileName = "ambientocclusion_composite.frag";
+    pCompositeShader = renderContext.LoadShader(&compositeShader);
+
+    Shader *shaders[] = {pOcclusionShader, pCompositeShader};
+    RootSignatureDesc rootDesc = {};
+    rootDesc.mShaderCount = 2;
+    rootDesc.ppShaders = shaders;
+    pRootSignature = renderContext.CreateRootSignature(&rootDesc);
+    mRootConstantIndex =
+        getDescriptorIndexFromName(pRootSignature, "aoRootConstant");
+
+    DescriptorSetDesc desc = {pRootSignature, DESCRIPTOR_UPDATE_FREQ_NONE, 1};
+    pDescriptorSetTexture = renderContext.CreateDescriptorSet(&desc);
+  }
+
+  if (pReloadDesc->mType & (RELOAD_TYPE_SHADER | RELOAD_TYPE_RENDERTARGET)) {
+    RasterizerStateDesc rasterizerStateDesc = {};
+    rasterizerStateDesc.mCullMode = CULL_MODE_NONE;
+
+    TinyImageFormat occlusionFormat =
+        renderContext.GetAmbientOcclusion()->mFormat;
+    PipelineDesc desc = {};
+    desc.mType = PIPELINE_TYPE_GRAPHICS;
+    GraphicsPipelineDesc &pipelineSettings = desc.mGraphicsDesc;
+    pipelineSettings.mPrimitiveTopo = PRIMITIVE_TOPO_TRI_LIST;
+    pipelineSettings.mRenderTargetCount = 1;
+    pipelineSettings.pColorFormats = &occlusionFormat;
+    pipelineSettings.mSampleCount = SAMPLE_COUNT_1;
+    pipelineSettings.mSampleQuality = 0;
+    pipelineSettings.mDepthStencilFormat = TinyImageFormat_UNDEFINED;
+    pipelineSettings.pRootSignature = pRootSignature;
+    pipelineSettings.pShaderProgram = pOcclusionShader;
+    pipelineSettings.pVertexLayout = NULL;
+    pipelineSettings.pRasterizerState = &rasterizerStateDesc;
+    pOcclusionPipeline = renderContext.CreatePipeline(&desc);
+
+    // Multiplies the filtered occlusion into the scene color.
+    BlendStateDesc blendStateDesc = {};
+    blendStateDesc.mSrcFactors[0] = BC_ZERO;
+    blendStateDesc.mDstFactors[0] = BC_SRC_COLOR;
+    blendStateDesc.mBlendModes[0] = BM_ADD;
+    blendStateDesc.mSrcAlphaFactors[0] = BC_ZERO;
+    blendStateDesc.mDstAlphaFactors[0] = BC_ONE;
+    blendStateDesc.mBlendAlphaModes[0] = BM_ADD;
+    blendStateDesc.mColorWriteMasks[0] = COLOR_MASK_ALL;
+    blendStateDesc.mRenderTargetMask = BLEND_STATE_TARGET_0;
+
+    TinyImageFormat sceneColorFormat = renderContext.GetSceneColorFormat();
+    pipelineSettings.pColorFormats = &sceneColorFormat;
+    pipelineSettings.pBlendState = &blendStateDesc;
+    pipelineSettings.pShaderProgram = pCompositeShader;
+    pCompositePipeline = renderContext.CreatePipeline(&desc);
+  }
+
+  // Both targets are recreated with the swapchain.
+  RenderTarget *pDepthBuffer = renderContext.GetDepthBuffer();
+  RenderTarget *pAmbientOcclusion = renderContext.GetAmbientOcclusion();
+  DescriptorData params[3] = {};
+  params[0].pName = "DepthBuffer";
+  params[0].ppTextures = &pDepthBuffer->pTexture;
+  params[1].pName = "AmbientOcclusion";
+  params[1].ppTextures = &pAmbientOcclusion->pTexture;
+  params[2].pName = "uPointSampler";
+  params[2].ppSamplers = &pPointSampler;
+  renderContext.UpdateDescriptorSet(pDescriptorSetTexture, 0, 3, params);
+}
+void AmbientOcclusionSystem::Unload(RenderContext &renderContext,
+                                    ReloadDesc *pReloadDesc) {
+  if (pReloadDesc->mType & (RELOAD_TYPE_SHADER | RELOAD_TYPE_RENDERTARGET)) {
+    renderContext.DestroyPipeline(pCompositePipeline);
+    renderContext.DestroyPipeline(pOcclusionPipeline);
+  }
+  if (pReloadDesc->mType & RELOAD_TYPE_SHADER) {
+    renderContext.DestroyDescriptorSet(pDescriptorSetTexture);
+    renderContext.DestroyRootSignature(pRootSignature);
+    renderContext.DestroyShader(pCompositeShader);
+    renderContext.DestroyShader(pOcclusionShader);
+  }
+}
+
+void AmbientOcclusionSystem::UpdateProjection(const CameraMatrix &projMat) {
+  // Clip z is a * z + b and clip w is z, so depth = a + b / z.
+  const mat4 &primary = projMat.getPrimaryMatrix();
+  mProjParams = float4(primary.getCol0().getX(), primary.getCol1().getY(),
+                       primary.getCol2().getZ(), primary.getCol3().getZ());
+}
+
+void AmbientOcclusionSystem::Draw(RenderContext::Frame &frame,
+                                  const AmbientOcclusionSettings &settings) {
+  Cmd *cmd = frame.mCmdRingElement.pCmds[0];
+  RenderTarget *pAmbientOcclusion = frame.pAmbientOcclusion;
+  const AmbientOcclusionPreset &preset = kAmbientOcclusionPresets[min(
+      settings.mQuality, (uint32_t)kAmbientOcclusionQualityCount - 1)];
+
+  // The occlusion viewport follows the scene's, so dynamic resolution scales
+  // this pass too.
+  uint32_t occlusionWidth =
+      (frame.mSceneWidth + preset.mDownscale - 1) / preset.mDownscale;
+  uint32_t occlusionHeight =
+      (frame.mSceneHeight + preset.mDownscale - 1) / preset.mDownscale;
+
+  AmbientOcclusionRootConstant constant = {};
+  constant.mProjParams = mProjParams;
+  constant.mViewportParams =
+      float4(1.0f / occlusionWidth, 1.0f / occlusionHeight,
+             (float)frame.mSceneWidth / frame.pDepthBuffer->mWidth,
+             (float)frame.mSceneHeight / frame.pDepthBuffer->mHeight);
+  constant.mOcclusionParams =
+      float4((float)occlusionWidth / pAmbientOcclusion->mWidth,
+             (float)occlusionHeight / pAmbientOcclusion->mHeight,
+             1.0f / pAmbientOcclusion->mWidth,
+             1.0f / pAmbientOcclusion->mHeight);
+  constant.mSettings = float4(settings.mRadius, settings.mIntensity,
+                              (float)preset.mSampleCount, 0.0f);
+
+  RenderTargetBarrier barriers[] = {
+      {frame.pDepthBuffer, RESOURCE_STATE_DEPTH_WRITE,
+       RESOURCE_STATE_SHADER_RESOURCE},
+      {pAmbientOcclusion, RESOURCE_STATE_SHADER_RESOURCE,
+       RESOURCE_STATE_RENDER_TARGET},
+  };
+  cmdResourceBarrier(cmd, 0, NULL, 0, NULL, 2, barriers);
+
+  BindRenderTargetsDesc bindRenderTargets = {};
+  bindRenderTargets.mRenderTargetCount = 1;
+  bindRenderTargets.mRenderTargets[0] = {pAmbientOcclusion,
+                                         LOAD_ACTION_DONTCARE};
+  bindRenderTargets.mDepthStencil = {NULL, LOAD_ACTION_DONTCARE};
+  cmdBindRenderTargets(cmd, &bindRenderTargets);
+  cmdSetViewport(cmd, 0.0f, 0.0f, (float)occlusionWidth,
+                 (float)occlusionHeight, 0.0f, 1.0f);
+  cmdSetScissor(cmd, 0, 0, occlusionWidth, occlusionHeight);
+  cmdBindPipeline(cmd, pOcclusionPipeline);
+  cmdBindDescriptorSet(cmd, 0, pDescriptorSetTexture);
+  cmdBindPushConstants(cmd, pRootSignature, mRootConstantIndex, &constant);
+  cmdDraw(cmd, 3, 0);
+  cmdBindRenderTargets(cmd, NULL);
+
+  barriers[0] = {pAmbientOcclusion, RESOURCE_STATE_RENDER_TARGET,
+                 RESOURCE_STATE_SHADER_RESOURCE};
+  cmdResourceBarrier(cmd, 0, NULL, 0, NULL, 1, barriers);
+
+  constant.mViewportParams.x = 1.0f / frame.mSceneWidth;
+  constant.mViewportParams.y = 1.0f / frame.mSceneHeight;
+  bindRenderTargets.mRenderTargets[0] = {frame.pSceneColor, LOAD_ACTION_LOAD};
+  cmdBindRenderTargets(cmd, &bindRenderTargets);
+  cmdSetViewport(cmd, 0.0f, 0.0f, (float)frame.mSceneWidth,
+                 (float)frame.mSceneHeight, 0.0f, 1.0f);
+  cmdSetScissor(cmd, 0, 0, frame.mSceneWidth, frame.mSceneHeight);
+  cmdBindPipeline(cmd, pCompositePipeline);
+  cmdBindDescriptorSet(cmd, 0, pDescriptorSetTexture);
+  cmdBindPushConstants(cmd, pRootSignature, mRootConstantIndex, &constant);
+  cmdDraw(cmd, 3, 0);
+  cmdBindRenderTargets(cmd, NULL);
+  // Two fullscreen triangles.
+  RenderStatsAdd(kRenderCounterDrawCalls, 2);
+  RenderStatsAdd(kRenderCounterTriangles, 2);
+  RenderStatsAdd(kRenderCounterVertices, 6);
+  RenderStatsAdd(kRenderCounterPipelineBinds, 2);
+  RenderStatsAdd(kRenderCounterDescriptorBinds, 2);
+
+  barriers[0] = {frame.pDepthBuffer, RESOURCE_STATE_SHADER_RESOURCE,
+                 RESOURCE_STATE_DEPTH_WRITE};
+  cmdResourceBarrier(cmd, 0, NULL, 0, NULL, 1, barriers);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "Graphics/Interfaces/IGraphics.h"
+#include "Resources/ResourceLoader/Interfaces/IResourceLoader.h"
+#include "Utilities/Math/MathTypes.h"
+
+#include "RenderContext.hpp"
+
+enum AmbientOcclusionQuality : uint32_t {
+  kAmbientOcclusionLow = 0,
+  kAmbientOcclusionMedium,
+  kAmbientOcclusionHigh,
+  kAmbientOcclusionQualityCount,
+};
+
+struct AmbientOcclusionSettings {
+  /// An \c AmbientOcclusionQuality. Low runs at quarter resolution, the
+  /// others at half resolution with more samples.
+  uint32_t mQuality;
+  /// Sampling radius in view space units.
+  float mRadius;
+  float mIntensity;
+};
+
+/// Screen-space ambient occlusion from the scene depth buffer.
+///
+/// Occlusion is estimated at reduced resolution into the ambient occlusion
+/// target, then a depth-aware 3x3 bilateral filter upsamples and blurs it in
+/// one pass, multiplying the result into the scene color.
+class AmbientOcclusionSystem {
+public:
+  void Init(RenderContext &renderContext);
+  void Exit(RenderContext &renderContext);
+
+  void Load(RenderContext &renderContext, ReloadDesc *pReloadDesc);
+  void Unload(RenderContext &renderContext, ReloadDesc *pReloadDesc);
+
+  void UpdateProjection(const CameraMatrix &projMat);
+
+  /// Expects the depth buffer in the depth write state and the scene color
+  /// target in the render target state, and leaves them so.
+  void Draw(RenderContext::Frame &frame,
+            const AmbientOcclusionSettings &settings);
+
+private:
+  RootSignature *pRootSignature = NULL;
+  Shader *pOcclusionShader = NULL;
+  Shader *pCompositeShader = NULL;
+  Pipeline *pOcclusionPipeline = NULL;
+  Pipeline *pCompositePipeline = NULL;
+  DescriptorSet *pDescriptorSetTexture = NULL;
+  Sampler *pPointSampler = NULL;
+  uint32_t mRootConstantIndex = 0;
+
+  struct AmbientOcclusionRootConstant {
+    /// xy: projection scale, zw: \c a and \c b in \c z = b / (depth - a).
+    float4 mProjParams;
+    /// xy: reciprocal of the pass's viewport size, zw: scene viewport over
+    /// depth buffer size.
+    float4 mViewportParams;
+    /// xy: occlusion viewport over occlusion target size, zw: occlusion
+    /// texel size.
+    float4 mOcclusionParams;
+    /// x: radius, y: intensity, z: sample count.
+    float4 mSettings;
+  };
+  float4 mProjParams = float4(1.0f, 1.0f, 0.0f, 1.0f);
+};
@@ -0,0 +1,307 @@
+#include "Animation.hpp"
+
+#include "Utilities/Interfaces/ILog.h"
+
+#include "Trace.hpp"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+static const uint16_t kConstantChannel = 0xffff;
+static const float kConstantTolerance = 1e-5f;
+
+struct AnimationClip::JointTrack {
+  // Constant channels keep their value in these; animated channels keep the
+  // base and step of their quantization range.
+  Quat mRotation;
+  vec3 mTranslationMin;
+  vec3 mTranslationStep;
+  vec3 mScaleMin;
+  vec3 mScaleStep;
+  // Offsets within a frame, or kConstantChannel.
+  uint16_t mRotationOffset;
+  uint16_t mTranslationOffset;
+  uint16_t mScaleOffset;
+};
+
+void Skeleton::Destroy() {
+  tf_free(pParents);
+  tf_free(pInverseBindPoses);
+  pParents = NULL;
+  pInverseBindPoses = NULL;
+  mJointCount = 0;
+}
+
+/// Drops the largest component, which the others and the unit length give
+/// back, and stores its index in the low bits of the first two words.
+static void EncodeRotation(Quat rotation, uint16_t *pOut) {
+  float components[4] = {rotation.getX(), rotation.getY(), rotation.getZ(),
+                         rotation.getW()};
+  uint32_t largest = 0;
+  for (uint32_t i = 1; i < 4; ++i) {
+    if (fabsf(components[i]) > fabsf(components[largest])) {
+      largest = i;
+    }
+  }
+  // q and -q are the same rotation, so the dropped component can be positive.
+  float sign = components[largest] < 0.0f ? -1.0f : 1.0f;
+  uint32_t word = 0;
+  for (uint32_t i = 0; i < 4; ++i) {
+    if (i == largest) {
+      continue;
+    }
+    // The other components lie within +-1/sqrt(2).
+    float normalized =
+        clamp(components[i] * sign * 0.70710678f + 0.5f, 0.0f, 1.0f);
+    uint16_t quantized = (uint16_t)(normalized * 32767.0f + 0.5f);
+    pOut[word] = (uint16_t)(quantized << 1);
+    ++word;
+  }
+  pOut[0] |= (uint16_t)(largest & 1);
+  pOut[1] |= (uint16_t)(largest >> 1);
+}
+
+static Quat DecodeRotation(const uint16_t *pIn) {
+  uint32_t largest = (pIn[0] & 1) | ((pIn[1] & 1) << 1);
+  float components[4];
+  float sum = 0.0f;
+  uint32_t word = 0;
+  for (uint32_t i = 0; i < 4; ++i) {
+    if (i == largest) {
+      continue;
+    }
+    float normalized = (float)(pIn[word] >> 1) / 32767.0f;
+    components[i] = (normalized - 0.5f) * 1.41421356f;
+    sum += components[i] * components[i];
+    ++word;
+  }
+  components[largest] = sqrtf(max(1.0f - sum, 0.0f));
+  return Quat(components[0], components[1], components[2], components[3]);
+}
+
+void AnimationClip::Build(const JointPose *pPoses, uint32_t frameCount,
+                          uint32_t jointCount, float sampleRate) {
+  ASSERT(frameCount > 0 && sampleRate > 0.0f);
+  mJointCount = jointCount;
+  mFrameCount = frameCount;
+  mSampleRate = sampleRate;
+  mDuration = (frameCount - 1) / sampleRate;
+  pTracks = reinterpret_cast<JointTrack *>(
+      tf_calloc(jointCount, sizeof(JointTrack)));
+
+  mFrameStride = 0;
+  for (uint32_t joint = 0; joint < jointCount; ++joint) {
+    JointTrack &track = pTracks[joint];
+    const JointPose &first = pPoses[joint];
+    vec3 translationMin = first.mTranslation;
+    vec3 translationMax = first.mTranslation;
+    vec3 scaleMin = first.mScale;
+    vec3 scaleMax = first.mScale;
+    bool constantRotation = true;
+    for (uint32_t frame = 1; frame < frameCount; ++frame) {
+      const JointPose &pose = pPoses[frame * jointCount + joint];
+      translationMin = minPerElem(translationMin, pose.mTranslation);
+      translationMax = maxPerElem(translationMax, pose.mTranslation);
+      scaleMin = minPerElem(scaleMin, pose.mScale);
+      scaleMax = maxPerElem(scaleMax, pose.mScale);
+      constantRotation &= fabsf(dot(pose.mRotation, first.mRotation)) >
+                          1.0f - kConstantTolerance;
+    }
+
+    track.mRotation = first.mRotation;
+    track.mRotationOffset = kConstantChannel;
+    if (!constantRotation) {
+      track.mRotationOffset = (uint16_t)mFrameStride;
+      mFrameStride += 3;
+    }
+
+    vec3 translationRange = translationMax - translationMin;
+    track.mTranslationMin = translationMin;
+    track.mTranslationOffset = kConstantChannel;
+    if (maxElem(translationRange) > kConstantTolerance) {
+      track.mTranslationStep = translationRange / 65535.0f;
+      track.mTranslationOffset = (uint16_t)mFrameStride;
+      mFrameStride += 3;
+    }
+
+    vec3 scaleRange = scaleMax - scaleMin;
+    track.mScaleMin = scaleMin;
+    track.mScaleOffset = kConstantChannel;
+    if (maxElem(scaleRange) > kConstantTolerance) {
+      track.mScaleStep = scaleRange / 65535.0f;
+      track.mScaleOffset = (uint16_t)mFrameStride;
+      mFrameStride += 3;
+    }
+  }
+  ASSERT(mFrameStride < kConstantChannel);
+
+  pSamples = reinterpret_cast<uint16_t *>(
+      tf_calloc(max(mFrameStride * frameCount, 1u), sizeof(uint16_t)));
+  for (uint32_t frame = 0; frame < frameCount; ++frame) {
+    uint16_t *pFrame = pSamples + frame * mFrameStride;
+    for (uint32_t joint = 0; joint < jointCount; ++joint) {
+      const JointTrack &track = pTracks[joint];
+      const JointPose &pose = pPoses[frame * jointCount + joint];
+      if (track.mRotationOffset != kConstantChannel) {
+        EncodeRotation(pose.mRotation, pFrame + track.mRotationOffset);
+      }
+      if (track.mTranslationOffset != kConstantChannel) {
+        vec3 range = track.mTranslationStep * 65535.0f;
+        vec3 t = divPerElem(pose.mTranslation - track.mTranslationMin,
+                            maxPerElem(range, vec3(1e-20f)));
+        for (uint32_t i = 0; i < 3; ++i) {
+          pFrame[track.mTranslationOffset + i] =
+              (uint16_t)(clamp(t.getElem(i), 0.0f, 1.0f) * 65535.0f + 0.5f);
+        }
+      }
+      if (track.mScaleOffset != kConstantChannel) {
+        vec3 range = track.mScaleStep * 65535.0f;
+        vec3 s = divPerElem(pose.mScale - track.mScaleMin,
+                            maxPerElem(range, vec3(1e-20f)));
+        for (uint32_t i = 0; i < 3; ++i) {
+          pFrame[track.mScaleOffset + i] =
+              (uint16_t)(clamp(s.getElem(i), 0.0f, 1.0f) * 65535.0f + 0.5f);
+        }
+      }
+    }
+  }
+}
+
+void AnimationClip::Destroy() {
+  tf_free(pTracks);
+  tf_free(pSamples);
+  pTracks = NULL;
+  pSamples = NULL;
+  mJointCount = 0;
+  mFrameCount = 0;
+}
+
+uint64_t AnimationClip::GetSizeBytes() const {
+  return (uint64_t)mJointCount * sizeof(JointTrack) +
+         (uint64_t)mFrameStride * mFrameCount * sizeof(uint16_t);
+}
+
+static inline vec3 DecodeVector(const uint16_t *pIn, const vec3 &base,
+                                const vec3 &step) {
+  return base + mulPerElem(step, vec3((float)pIn[0], (float)pIn[1],
+                                      (float)pIn[2]));
+}
+
+void AnimationClip::Sample(float time, JointPose *pPoses) const {
+  float frame = 0.0f;
+  if (mDuration > 0.0f) {
+    time = fmodf(time, mDuration);
+    frame = (time < 0.0f ? time + mDuration : time) * mSampleRate;
+  }
+  uint32_t frame0 = min((uint32_t)frame, mFrameCount - 1);
+  uint32_t frame1 = min(frame0 + 1, mFrameCount - 1);
+  float alpha = frame - (float)frame0;
+  const uint16_t *pFrame0 = pSamples + frame0 * mFrameStride;
+  const uint16_t *pFrame1 = pSamples + frame1 * mFrameStride;
+
+  for (uint32_t joint = 0; joint < mJointCount; ++joint) {
+    const JointTrack &track = pTracks[joint];
+    JointPose &pose = pPoses[joint];
+
+    if (track.mRotationOffset == kConstantChannel) {
+      pose.mRotation = track.mRotation;
+    } else {
+      Quat a = DecodeRotation(pFrame0 + track.mRotationOffset);
+      Quat b = DecodeRotation(pFrame1 + track.mRotationOffset);
+      // Samples are close together, so a normalized lerp is enough.
+      if (dot(a, b) < 0.0f) {
+        b = -b;
+      }
+      pose.mRotation = normalize(lerp(alpha, a, b));
+    }
+
+    if (track.mTranslationOffset == kConstantChannel) {
+      pose.mTranslation = track.mTranslationMin;
+    } else {
+      pose.mTranslation = lerp(
+          alpha,
+          DecodeVector(pFrame0 + track.mTranslationOffset,
+                       track.mTranslationMin, track.mTranslationStep),
+          DecodeVector(pFrame1 + track.mTranslationOffset,
+                       track.mTranslationMin, track.mTranslationStep));
+    }
+
+    if (track.mScaleOffset == kConstantChannel) {
+      pose.mScale = track.mScaleMin;
+    } else {
+      pose.mScale =
+          lerp(alpha,
+               DecodeVector(pFrame0 + track.mScaleOffset, track.mScaleMin,
+                            track.mScaleStep),
+               DecodeVector(pFrame1 + track.mScaleOffset, track.mScaleMin,
+                            track.mScaleStep));
+    }
+  }
+}
+
+struct AnimationUpdate {
+  AnimationInstance *pInstances;
+  float mDeltaTime;
+};
+
+static void UpdateInstances(void *pUserData, uint32_t begin, uint32_t end) {
+  AnimationUpdate &update = *reinterpret_cast<AnimationUpdate *>(pUserData);
+  JointPose *pPoses = reinterpret_cast<JointPose *>(
+      tf_malloc(Skeleton::kMaxJointCount * sizeof(JointPose)));
+  mat4 *pModel = reinterpret_cast<mat4 *>(
+      tf_malloc(Skeleton::kMaxJointCount * sizeof(mat4)));
+
+  for (uint32_t i = begin; i < end; ++i) {
+    AnimationInstance &instance = update.pInstances[i];
+    const Skeleton &skeleton = *instance.pSkeleton;
+    uint32_t jointCount = min(skeleton.mJointCount, Skeleton::kMaxJointCount);
+    ASSERT(instance.pClip->GetJointCount() == skeleton.mJointCount);
+
+    instance.mTime += update.mDeltaTime * instance.mSpeed;
+    if (instance.pClip->GetDuration() > 0.0f) {
+      instance.mTime = fmodf(instance.mTime, instance.pClip->GetDuration());
+    }
+    instance.pClip->Sample(instance.mTime, pPoses);
+
+    for (uint32_t joint = 0; joint < jointCount; ++joint) {
+      const JointPose &pose = pPoses[joint];
+      mat4 local(Matrix3(pose.mRotation) * Matrix3::scale(pose.mScale),
+                 pose.mTranslation);
+      int32_t parent = skeleton.pParents[joint];
+      pModel[joint] = parent < 0 ? local : pModel[parent] * local;
+      instance.pSkinningMatrices[joint] =
+          pModel[joint] * skeleton.pInverseBindPoses[joint];
+    }
+  }
+
+  tf_free(pModel);
+  tf_free(pPoses);
+}
+
+void UpdateAnimationInstances(TaskSystem *pTaskSystem,
+                              AnimationInstance *pInstances, uint32_t count,
+                              float deltaTime) {
+  TRACE_SCOPE("Update Animation");
+  AnimationUpdate update = {pInstances, deltaTime};
+  if (pTaskSystem) {
+    pTaskSystem->ParallelFor(count, 4, UpdateInstances, &update);
+  } else {
+    UpdateInstances(&update, 0, count);
+  }
+}
+
+void SkinPositions(const mat4 *pSkinningMatrices, const float3 *pPositions,
+                   const uint8_t (*pJoints)[4], const uint8_t (*pWeights)[4],
+                   uint32_t vertexCount, float3 *pSkinnedPositions) {
+  for (uint32_t i = 0; i < vertexCount; ++i) {
+    const uint8_t *pJoint = pJoints[i];
+    const uint8_t *pWeight = pWeights[i];
+    mat4 blended = pSkinningMatrices[pJoint[0]] * (pWeight[0] / 255.0f);
+    for (uint32_t j = 1; j < 4; ++j) {
+      if (pWeight[j] != 0) {
+        blended += pSkinningMatrices[pJoint[j]] * (pWeight[j] / 255.0f);
+      }
+    }
+    vec4 position = blended * vec4(f3Tov3(pPositions[i]), 1.0f);
+    pSkinnedPositions[i] = v3ToF3(position.getXYZ());
+  }
+}
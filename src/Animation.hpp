@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Utilities/Math/MathTypes.h"
+
+#include "TaskSystem.hpp"
+
+/// Joints are ordered so that every parent precedes its children, which lets
+/// local-to-model conversion run in a single forward pass.
+struct Skeleton {
+  static const uint32_t kMaxJointCount = 256;
+
+  uint32_t mJointCount = 0;
+  /// -1 for roots.
+  int32_t *pParents = NULL;
+  /// Takes a skinned mesh's vertices from bind space to each joint's space.
+  mat4 *pInverseBindPoses = NULL;
+
+  void Destroy();
+};
+
+struct JointPose {
+  Quat mRotation;
+  vec3 mTranslation;
+  vec3 mScale;
+};
+
+/// A clip stored as uniformly spaced samples. Channels that don't change
+/// over the clip are stored once. Animated rotations are quantized to 48 bits
+/// with the smallest-three encoding, and translations and scales to 16 bits
+/// per component within their track's range. Samples are frame-major, so
+/// sampling touches two contiguous blocks.
+class AnimationClip {
+public:
+  /// \c pPoses holds \c frameCount poses of \c jointCount joints, frame after
+  /// frame.
+  void Build(const JointPose *pPoses, uint32_t frameCount, uint32_t jointCount,
+             float sampleRate);
+  void Destroy();
+
+  /// Writes the local pose of every joint at \c time, which wraps around.
+  void Sample(float time, JointPose *pPoses) const;
+
+  inline float GetDuration() const { return mDuration; }
+  inline uint32_t GetJointCount() const { return mJointCount; }
+  uint64_t GetSizeBytes() const;
+
+  struct JointTrack;
+
+private:
+  JointTrack *pTracks = NULL;
+  uint16_t *pSamples = NULL;
+  uint32_t mJointCount = 0;
+  uint32_t mFrameCount = 0;
+  /// In \c uint16_t, between consecutive frames.
+  uint32_t mFrameStride = 0;
+  float mSampleRate = 0.0f;
+  float mDuration = 0.0f;
+};
+
+struct AnimationInstance {
+  const Skeleton *pSkeleton;
+  const AnimationClip *pClip;
+  float mTime;
+  float mSpeed;
+  /// One per joint, owned by the caller.
+  mat4 *pSkinningMatrices;
+};
+
+/// Advances each instance by \c deltaTime, samples its clip and computes its
+/// skinning matrices. Instances are spread over \c pTaskSystem, or run on the
+/// calling thread when it's \c NULL.
+void UpdateAnimationInstances(TaskSystem *pTaskSystem,
+                              AnimationInstance *pInstances, uint32_t count,
+                              float deltaTime);
+
+/// Reference linear blend skinning on the CPU, used to validate the GPU path.
+/// Weights are normalized 8-bit values.
+void SkinPositions(const mat4 *pSkinningMatrices, const float3 *pPositions,
+                   const uint8_t (*pJoints)[4], const uint8_t (*pWeights)[4],
+                   uint32_t vertexCount, float3 *pSkinnedPositions);
@@ -0,0 +1,129 @@
+#include "BlendShapeSystem.hpp"
+
+#include "RenderStats.hpp"
+
+static const uint32_t kThreadGroupSize = 64;
+/// Between dispatches, the morphed vertices are drawn from, and read by the
+/// visibility buffer's resolve.
+static const ResourceState kMorphedVertexState =
+    RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | RESOURCE_STATE_SHADER_RESOURCE;
+
+void BlendShapeSystem::Load(RenderContext &renderContext,
+                            ReloadDesc *pReloadDesc) {
+  if (pReloadDesc->mType & RELOAD_TYPE_SHADER) {
+    ShaderLoadDesc resetShader = {};
+    resetShader.mComp.pFileName = "blendshapes_reset.comp";
+    pResetShader = renderContext.LoadShader(&resetShader);
+    ShaderLoadDesc applyShader = {};
+    applyShader.mComp.pFileName = "blendshapes.comp";
+    pApplyShader = renderContext.LoadShader(&applyShader);
+
+    Shader *shaders[2] = {pResetShader, pApplyShader};
+    RootSignatureDesc rootDesc = {};
+    rootDesc.mShaderCount = 2;
+    rootDesc.ppShaders = shaders;
+    pRootSignature = renderContext.CreateRootSignature(&rootDesc);
+    mRootConstantIndex =
+        getDescriptorIndexFromName(pRootSignature, "blendShapeRootConstant");
+
+    DescriptorSetDesc desc = {pRootSignature, DESCRIPTOR_UPDATE_FREQ_NONE,
+                              RenderContext::kDataBufferCount};
+    pDescriptorSet = renderContext.CreateDescriptorSet(&desc);
+    for (uint32_t i = 0; i < RenderContext::kDataBufferCount; ++i) {
+      mSceneId[i] = 0;
+    }
+
+    PipelineDesc pipelineDesc = {};
+    pipelineDesc.mType = PIPELINE_TYPE_COMPUTE;
+    pipelineDesc.mComputeDesc.pRootSignature = pRootSignature;
+    pipelineDesc.mComputeDesc.pShaderProgram = pResetShader;
+    pResetPipeline = renderContext.CreatePipeline(&pipelineDesc);
+    pipelineDesc.mComputeDesc.pShaderProgram = pApplyShader;
+    pApplyPipeline = renderContext.CreatePipeline(&pipelineDesc);
+  }
+}
+void BlendShapeSystem::Unload(RenderContext &renderContext,
+                              ReloadDesc *pReloadDesc) {
+  if (pReloadDesc->mType & RELOAD_TYPE_SHADER) {
+    renderContext.DestroyPipeline(pApplyPipeline);
+    renderContext.DestroyPipeline(pResetPipeline);
+    renderContext.DestroyDescriptorSet(pDescriptorSet);
+    renderContext.DestroyRootSignature(pRootSignature);
+    renderContext.DestroyShader(pApplyShader);
+    renderContext.DestroyShader(pResetShader);
+  }
+}
+
+void BlendShapeSystem::Draw(RenderContext &renderContext,
+                            RenderContext::Frame &frame, const Scene &scene,
+                            const float *pWeights) {
+  const BlendShapeSet &blendShapes = scene.GetBlendShapes();
+  Buffer *pMorphedVertices = scene.GetMorphedVertexBuffer();
+  if (pMorphedVertices == NULL) {
+    mStats = {};
+    return;
+  }
+  // This frame's previous submission has completed, so its slice can be
+  // rewritten when the scene changed.
+  if (mSceneId[frame.index] != scene.GetId()) {
+    mSceneId[frame.index] = scene.GetId();
+    Buffer *pBaseVertices = scene.GetBaseVertexBuffer();
+    Buffer *pDeltas = scene.GetBlendShapeDeltaBuffer();
+    DescriptorData params[3] = {};
+    params[0].pName = "BaseVertices";
+    params[0].ppBuffers = &pBaseVertices;
+    params[1].pName = "BlendShapeDeltas";
+    params[1].ppBuffers = &pDeltas;
+    params[2].pName = "MorphedVertices";
+    params[2].ppBuffers = &pMorphedVertices;
+    renderContext.UpdateDescriptorSet(pDescriptorSet, frame.index, 3, params);
+  }
+
+  uint32_t activeCount = blendShapes.GatherActive(pWeights, mActive);
+  mStats = blendShapes.ComputeStats(mActive, activeCount);
+
+  Cmd *cmd = frame.mCmdRingElement.pCmds[0];
+  BufferBarrier barrier = {pMorphedVertices, kMorphedVertexState,
+                           RESOURCE_STATE_UNORDERED_ACCESS};
+  cmdResourceBarrier(cmd, 1, &barrier, 0, NULL, 0, NULL);
+  // Between dispatches, so that targets moving the same vertex accumulate.
+  BufferBarrier uavBarrier = {pMorphedVertices,
+                              RESOURCE_STATE_UNORDERED_ACCESS,
+                              RESOURCE_STATE_UNORDERED_ACCESS};
+
+  BlendShapeRootConstant constant = {};
+  constant.mOffset = blendShapes.GetVertexBegin();
+  constant.mCount = blendShapes.GetVertexEnd() - blendShapes.GetVertexBegin();
+  cmdBindPipeline(cmd, pResetPipeline);
+  cmdBindDescriptorSet(cmd, frame.index, pDescriptorSet);
+  cmdBindPushConstants(cmd, pRootSignature, mRootConstantIndex, &constant);
+  cmdDispatch(cmd, (constant.mCount + kThreadGroupSize - 1) / kThreadGroupSize,
+              1, 1);
+
+  if (activeCount > 0) {
+    cmdResourceBarrier(cmd, 1, &uavBarrier, 0, NULL, 0, NULL);
+    cmdBindPipeline(cmd, pApplyPipeline);
+    cmdBindDescriptorSet(cmd, frame.index, pDescriptorSet);
+  }
+  // Dispatches aren't draws, only their binds are counted.
+  RenderStatsAdd(kRenderCounterPipelineBinds, activeCount > 0 ? 2 : 1);
+  RenderStatsAdd(kRenderCounterDescriptorBinds, activeCount > 0 ? 2 : 1);
+  for (uint32_t i = 0; i < activeCount; ++i) {
+    const BlendShapeTarget &target = blendShapes.GetTarget(mActive[i].mTarget);
+    constant.mOffset = target.mFirstDelta;
+    constant.mCount = target.mDeltaCount;
+    constant.mPositionScale = mActive[i].mWeight * target.mPositionScale;
+    constant.mNormalScale = mActive[i].mWeight * BlendShapeSet::kNormalScale;
+    cmdBindPushConstants(cmd, pRootSignature, mRootConstantIndex, &constant);
+    cmdDispatch(cmd,
+                (constant.mCount + kThreadGroupSize - 1) / kThreadGroupSize, 1,
+                1);
+    if (i + 1 < activeCount) {
+      cmdResourceBarrier(cmd, 1, &uavBarrier, 0, NULL, 0, NULL);
+    }
+  }
+
+  barrier = {pMorphedVertices, RESOURCE_STATE_UNORDERED_ACCESS,
+             kMorphedVertexState};
+  cmdResourceBarrier(cmd, 1, &barrier, 0, NULL, 0, NULL);
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Graphics/Interfaces/IGraphics.h"
+#include "Resources/ResourceLoader/Interfaces/IResourceLoader.h"
+
+#include "RenderContext.hpp"
+#include "Scene.hpp"
+
+/// Deforms the scene's morphed vertex buffer on the GPU: the range of
+/// vertices blend shapes touch is reset to the undeformed vertices, then each
+/// target with a non-zero weight adds its sparse offsets in its own dispatch.
+class BlendShapeSystem {
+public:
+  void Load(RenderContext &renderContext, ReloadDesc *pReloadDesc);
+  void Unload(RenderContext &renderContext, ReloadDesc *pReloadDesc);
+
+  /// \c pWeights holds one weight per target of the scene. Does nothing for
+  /// scenes without blend shapes. Leaves the morphed vertex buffer ready to
+  /// be drawn.
+  void Draw(RenderContext &renderContext, RenderContext::Frame &frame,
+            const Scene &scene, const float *pWeights);
+
+  inline const BlendShapeStats &GetStats() const { return mStats; }
+
+private:
+  RootSignature *pRootSignature = NULL;
+  Shader *pResetShader = NULL;
+  Shader *pApplyShader = NULL;
+  Pipeline *pResetPipeline = NULL;
+  Pipeline *pApplyPipeline = NULL;
+  DescriptorSet *pDescriptorSet = NULL;
+  uint32_t mRootConstantIndex = 0;
+  // Scene each frame's descriptor set slice was written with.
+  uint32_t mSceneId[RenderContext::kDataBufferCount] = {};
+
+  ActiveBlendShape mActive[BlendShapeSet::kMaxTargetCount];
+  BlendShapeStats mStats = {};
+
+  struct BlendShapeRootConstant {
+    uint32_t mOffset;
+    uint32_t mCount;
+    float mPositionScale;
+    float mNormalScale;
+  };
+};
@@ -0,0 +1,142 @@
+#include "BlendShapes.hpp"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+static_assert(sizeof(BlendShapeDelta) == 16,
+              "BlendShapeDelta must match the uint4 read by the GPU");
+
+static inline int16_t Quantize(float value, float inverseScale) {
+  float q = value * inverseScale;
+  q = q > 32767.0f ? 32767.0f : (q < -32767.0f ? -32767.0f : q);
+  return (int16_t)(q < 0.0f ? q - 0.5f : q + 0.5f);
+}
+
+void BlendShapeSet::Destroy() {
+  tf_free(pTargets);
+  tf_free(pDeltas);
+  pTargets = NULL;
+  pDeltas = NULL;
+  mTargetCount = 0;
+  mDeltaCount = 0;
+  mDeltaCapacity = 0;
+  mVertexBegin = ~0u;
+  mVertexEnd = 0;
+}
+
+bool BlendShapeSet::AddTarget(const float3 *pPositionDeltas,
+                              const float3 *pNormalDeltas,
+                              uint32_t vertexOffset, uint32_t vertexCount,
+                              float defaultWeight) {
+  if (mTargetCount == kMaxTargetCount) {
+    return false;
+  }
+  if (pTargets == NULL) {
+    pTargets = reinterpret_cast<BlendShapeTarget *>(
+        tf_calloc(kMaxTargetCount, sizeof(BlendShapeTarget)));
+  }
+
+  float maxOffset = 0.0f;
+  for (uint32_t i = 0; i < vertexCount; ++i) {
+    const float3 &d = pPositionDeltas[i];
+    maxOffset = max(maxOffset, max(fabsf(d.x), max(fabsf(d.y), fabsf(d.z))));
+  }
+  float positionScale = maxOffset > 0.0f ? maxOffset / 32767.0f : 1.0f;
+  float inversePositionScale = 1.0f / positionScale;
+  float inverseNormalScale = 1.0f / kNormalScale;
+
+  BlendShapeTarget &target = pTargets[mTargetCount++];
+  target.mFirstDelta = mDeltaCount;
+  target.mMeshVertexCount = vertexCount;
+  target.mPositionScale = positionScale;
+  target.mDefaultWeight = defaultWeight;
+  for (uint32_t i = 0; i < vertexCount; ++i) {
+    BlendShapeDelta delta = {vertexOffset + i};
+    const float3 &position = pPositionDeltas[i];
+    delta.mPosition[0] = Quantize(position.x, inversePositionScale);
+    delta.mPosition[1] = Quantize(position.y, inversePositionScale);
+    delta.mPosition[2] = Quantize(position.z, inversePositionScale);
+    if (pNormalDeltas) {
+      const float3 &normal = pNormalDeltas[i];
+      delta.mNormal[0] = Quantize(normal.x, inverseNormalScale);
+      delta.mNormal[1] = Quantize(normal.y, inverseNormalScale);
+      delta.mNormal[2] = Quantize(normal.z, inverseNormalScale);
+    }
+    if ((delta.mPosition[0] | delta.mPosition[1] | delta.mPosition[2] |
+         delta.mNormal[0] | delta.mNormal[1] | delta.mNormal[2]) == 0) {
+      continue;
+    }
+    if (mDeltaCount == mDeltaCapacity) {
+      mDeltaCapacity = max(mDeltaCapacity * 2, 4096u);
+      pDeltas = reinterpret_cast<BlendShapeDelta *>(
+          tf_realloc(pDeltas, mDeltaCapacity * sizeof(BlendShapeDelta)));
+    }
+    pDeltas[mDeltaCount++] = delta;
+    mVertexBegin = min(mVertexBegin, delta.mVertex);
+    mVertexEnd = max(mVertexEnd, delta.mVertex + 1);
+  }
+  target.mDeltaCount = mDeltaCount - target.mFirstDelta;
+  return true;
+}
+
+uint32_t BlendShapeSet::GatherActive(const float *pWeights,
+                                     ActiveBlendShape *pActive) const {
+  uint32_t activeCount = 0;
+  for (uint32_t i = 0; i < mTargetCount; ++i) {
+    if (fabsf(pWeights[i]) > kMinWeight && pTargets[i].mDeltaCount > 0) {
+      pActive[activeCount++] = {i, pWeights[i]};
+    }
+  }
+  return activeCount;
+}
+
+void BlendShapeSet::Apply(const ActiveBlendShape *pActive, uint32_t activeCount,
+                          float3 *pPositions, float3 *pNormals) const {
+  for (uint32_t a = 0; a < activeCount; ++a) {
+    const BlendShapeTarget &target = pTargets[pActive[a].mTarget];
+    const BlendShapeDelta *pTargetDeltas = pDeltas + target.mFirstDelta;
+    // Offsets are widened to four lanes so that the scale and accumulation
+    // are single SIMD operations.
+    const vec4 positionScale(pActive[a].mWeight * target.mPositionScale);
+    const vec4 normalScale(pActive[a].mWeight * kNormalScale);
+    for (uint32_t i = 0; i < target.mDeltaCount; ++i) {
+      const BlendShapeDelta &delta = pTargetDeltas[i];
+      float3 &position = pPositions[delta.mVertex];
+      vec4 offset = mulPerElem(vec4((float)delta.mPosition[0],
+                                    (float)delta.mPosition[1],
+                                    (float)delta.mPosition[2], 0.0f),
+                               positionScale);
+      vec4 result = vec4(f3Tov3(position), 0.0f) + offset;
+      position = v3ToF3(result.getXYZ());
+      if (pNormals) {
+        float3 &normal = pNormals[delta.mVertex];
+        offset = mulPerElem(vec4((float)delta.mNormal[0],
+                                 (float)delta.mNormal[1],
+                                 (float)delta.mNormal[2], 0.0f),
+                            normalScale);
+        result = vec4(f3Tov3(normal), 0.0f) + offset;
+        normal = v3ToF3(result.getXYZ());
+      }
+    }
+  }
+}
+
+BlendShapeStats BlendShapeSet::ComputeStats(const ActiveBlendShape *pActive,
+                                            uint32_t activeCount) const {
+  BlendShapeStats stats = {};
+  stats.mTargetCount = mTargetCount;
+  stats.mActiveTargetCount = activeCount;
+  for (uint32_t a = 0; a < activeCount; ++a) {
+    stats.mAppliedDeltaCount += pTargets[pActive[a].mTarget].mDeltaCount;
+  }
+  for (uint32_t i = 0; i < mTargetCount; ++i) {
+    stats.mSparseBytes += GetTargetSizeBytes(i);
+    stats.mDenseBytes +=
+        (uint64_t)pTargets[i].mMeshVertexCount * 2 * sizeof(float3);
+  }
+  return stats;
+}
+
+uint64_t BlendShapeSet::GetTargetSizeBytes(uint32_t i) const {
+  return sizeof(BlendShapeTarget) +
+         (uint64_t)pTargets[i].mDeltaCount * sizeof(BlendShapeDelta);
+}
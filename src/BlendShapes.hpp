@@ -0,0 +1,93 @@
+#pragma once
+
+#include "Utilities/Math/MathTypes.h"
+
+/// A quantized vertex offset, laid out as the \c uint4 read by
+/// blendshapes.comp: the vertex, then six signed 16-bit components.
+struct BlendShapeDelta {
+  uint32_t mVertex;
+  int16_t mPosition[3];
+  int16_t mNormal[3];
+};
+
+struct BlendShapeTarget {
+  uint32_t mFirstDelta;
+  uint32_t mDeltaCount;
+  /// Vertices of the mesh the target deforms, for the dense comparison.
+  uint32_t mMeshVertexCount;
+  /// Dequantizes the position offsets.
+  float mPositionScale;
+  float mDefaultWeight;
+};
+
+struct ActiveBlendShape {
+  uint32_t mTarget;
+  float mWeight;
+};
+
+struct BlendShapeStats {
+  uint32_t mTargetCount;
+  uint32_t mActiveTargetCount;
+  uint32_t mAppliedDeltaCount;
+  uint64_t mSparseBytes;
+  /// What the same targets would take as full-mesh \c float3 offsets.
+  uint64_t mDenseBytes;
+};
+
+/// Morph targets of the whole scene, stored sparsely: a target only keeps the
+/// vertices it moves, with offsets quantized to 16 bits per component.
+/// Positions are scaled per target, normals use a fixed [-2, 2] range.
+class BlendShapeSet {
+public:
+  static const uint32_t kMaxTargetCount = 256;
+  static constexpr float kNormalScale = 2.0f / 32767.0f;
+  /// Weights closer to zero than this don't contribute.
+  static constexpr float kMinWeight = 1e-4f;
+
+  void Destroy();
+
+  /// Quantizes the offsets of vertices \c vertexOffset onwards and keeps the
+  /// ones that aren't zero once quantized. \c pNormalDeltas may be \c NULL.
+  /// Returns false once \c kMaxTargetCount targets exist.
+  bool AddTarget(const float3 *pPositionDeltas, const float3 *pNormalDeltas,
+                 uint32_t vertexOffset, uint32_t vertexCount,
+                 float defaultWeight);
+
+  /// Lists the targets with a non-zero weight, returning their count.
+  uint32_t GatherActive(const float *pWeights,
+                        ActiveBlendShape *pActive) const;
+
+  /// CPU reference of the GPU pass: adds the weighted offsets of
+  /// \c pActive to \c pPositions and, unless \c NULL, \c pNormals, which hold
+  /// the undeformed scene vertices. Normals aren't renormalized.
+  void Apply(const ActiveBlendShape *pActive, uint32_t activeCount,
+             float3 *pPositions, float3 *pNormals) const;
+
+  BlendShapeStats ComputeStats(const ActiveBlendShape *pActive,
+                               uint32_t activeCount) const;
+
+  inline uint32_t GetTargetCount() const { return mTargetCount; }
+  inline const BlendShapeTarget &GetTarget(uint32_t i) const {
+    return pTargets[i];
+  }
+  inline uint32_t GetDeltaCount() const { return mDeltaCount; }
+  /// Allocated bytes, including unused capacity.
+  inline uint64_t GetSizeBytes() const {
+    return (pTargets ? kMaxTargetCount * sizeof(BlendShapeTarget) : 0) +
+           (uint64_t)mDeltaCapacity * sizeof(BlendShapeDelta);
+  }
+  inline const BlendShapeDelta *GetDeltas() const { return pDeltas; }
+  /// Range of vertices any target moves.
+  inline uint32_t GetVertexBegin() const { return mVertexBegin; }
+  inline uint32_t GetVertexEnd() const { return mVertexEnd; }
+  uint64_t GetTargetSizeBytes(uint32_t i) const;
+
+private:
+  BlendShapeTarget *pTargets = NULL;
+  uint32_t mTargetCount = 0;
+  BlendShapeDelta *pDeltas = NULL;
+  uint32_t mDeltaCount = 0;
+  uint32_t mDeltaCapacity = 0;
+  uint32_t mVertexBegin = ~0u;
+  uint32_t mVertexEnd = 0;
+};
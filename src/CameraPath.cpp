@@ -0,0 +1,190 @@
+#include "CameraPath.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "Utilities/Interfaces/IFileSystem.h"
+#include "Utilities/Interfaces/ILog.h"
+#include "Utilities/ThirdParty/OpenSource/Nothings/stb_ds.h"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+static const uint32_t kCameraPathMagic = 0x48545043; // "CPTH"
+static const uint32_t kCameraPathVersion = 1;
+
+struct CameraPathHeader {
+  uint32_t mMagic;
+  uint32_t mVersion;
+  uint32_t mFrameCount;
+};
+
+void CameraPath::Destroy() { arrfree(pViews); }
+
+void CameraPath::Record(const mat4 &viewMat) { arrpush(pViews, viewMat); }
+
+uint32_t CameraPath::GetFrameCount() const {
+  return (uint32_t)arrlenu(pViews);
+}
+
+bool CameraPath::Save(const char *pFileName) const {
+  FileStream file = {};
+  if (!fsOpenStreamFromPath(RD_LOG, pFileName, FM_WRITE, &file)) {
+    LOGF(eERROR, "Failed to open camera path %s", pFileName);
+    return false;
+  }
+  CameraPathHeader header = {kCameraPathMagic, kCameraPathVersion,
+                             GetFrameCount()};
+  fsWriteToStream(&file, &header, sizeof(header));
+  for (uint32_t i = 0; i < header.mFrameCount; ++i) {
+    float values[16];
+    for (uint32_t column = 0; column < 4; ++column) {
+      for (uint32_t row = 0; row < 4; ++row) {
+        values[column * 4 + row] = pViews[i][column][row];
+      }
+    }
+    fsWriteToStream(&file, values, sizeof(values));
+  }
+  fsCloseStream(&file);
+  LOGF(eINFO, "Saved %u camera frames to %s", header.mFrameCount, pFileName);
+  return true;
+}
+
+bool CameraPath::Load(const char *pFileName) {
+  FileStream file = {};
+  if (!fsOpenStreamFromPath(RD_LOG, pFileName, FM_READ, &file)) {
+    LOGF(eERROR, "Failed to open camera path %s", pFileName);
+    return false;
+  }
+  CameraPathHeader header = {};
+  fsReadFromStream(&file, &header, sizeof(header));
+  size_t expectedSize =
+      sizeof(header) + (size_t)header.mFrameCount * 16 * sizeof(float);
+  if (header.mMagic != kCameraPathMagic ||
+      header.mVersion != kCameraPathVersion || header.mFrameCount == 0 ||
+      (size_t)fsGetStreamFileSize(&file) != expectedSize) {
+    LOGF(eERROR, "%s isn't a valid camera path", pFileName);
+    fsCloseStream(&file);
+    return false;
+  }
+  arrsetlen(pViews, header.mFrameCount);
+  for (uint32_t i = 0; i < header.mFrameCount; ++i) {
+    float values[16];
+    fsReadFromStream(&file, values, sizeof(values));
+    for (uint32_t column = 0; column < 4; ++column) {
+      pViews[i].setCol(column, vec4(values[column * 4], values[column * 4 + 1],
+                                    values[column * 4 + 2],
+                                    values[column * 4 + 3]));
+    }
+  }
+  fsCloseStream(&file);
+  return true;
+}
+
+void CameraPathBenchmark::Start(const CameraPath &path,
+                                const CameraPathBenchmarkDesc &desc) {
+  Destroy();
+  pPath = &path;
+  mDesc = desc;
+  LOGF(eINFO, "Benchmarking %u frames, %u warmup and %u measured passes",
+       path.GetFrameCount(), desc.mWarmupPassCount, desc.mPassCount);
+}
+
+void CameraPathBenchmark::Destroy() {
+  arrfree(pCpuMs);
+  arrfree(pGpuMs);
+  *this = CameraPathBenchmark();
+}
+
+void CameraPathBenchmark::EndFrame(
+    const RenderStatsFrame &stats,
+    const RenderContext::GpuScopeTiming *pGpuScopes, uint32_t gpuScopeCount) {
+  if (mPass >= mDesc.mWarmupPassCount) {
+    arrpush(pCpuMs, stats.mCpuMs);
+    arrpush(pGpuMs, stats.mGpuMs);
+    for (uint32_t i = 0; i < kRenderCounterCount; ++i) {
+      mCounterTotals[i] += (double)stats.mCounters[i];
+    }
+    for (uint32_t i = 0; i < gpuScopeCount; ++i) {
+      uint32_t scope = 0;
+      while (scope < mScopeCount &&
+             strcmp(pScopeNames[scope], pGpuScopes[i].pName) != 0) {
+        ++scope;
+      }
+      if (scope == kMaxScopeCount) {
+        continue;
+      }
+      if (scope == mScopeCount) {
+        pScopeNames[mScopeCount++] = pGpuScopes[i].pName;
+      }
+      mScopeTotalMs[scope] += pGpuScopes[i].mMs;
+    }
+  }
+  if (++mFrame == pPath->GetFrameCount()) {
+    mFrame = 0;
+    ++mPass;
+  }
+}
+
+static int CompareFloats(const void *pA, const void *pB) {
+  float a = *(const float *)pA;
+  float b = *(const float *)pB;
+  return (a > b) - (a < b);
+}
+
+/// Mean, nearest-rank percentiles and maximum of \c pSamples, which are
+/// sorted in place.
+static void PrintDistribution(FileStream &file, const char *pName,
+                              float *pSamples, uint32_t count) {
+  qsort(pSamples, count, sizeof(float), CompareFloats);
+  double sum = 0.0;
+  for (uint32_t i = 0; i < count; ++i) {
+    sum += pSamples[i];
+  }
+  const float kPercentiles[] = {0.5f, 0.95f, 0.99f};
+  const char *kPercentileNames[] = {"p50", "p95", "p99"};
+  fsPrintToStream(&file, "  \"%s\": {\"mean\": %.3f", pName, sum / count);
+  for (uint32_t i = 0; i < TF_ARRAY_COUNT(kPercentiles); ++i) {
+    uint32_t rank = (uint32_t)ceilf(kPercentiles[i] * count);
+    fsPrintToStream(&file, ", \"%s\": %.3f", kPercentileNames[i],
+                    pSamples[max(rank, 1u) - 1]);
+  }
+  fsPrintToStream(&file, ", \"max\": %.3f},\n", pSamples[count - 1]);
+}
+
+bool CameraPathBenchmark::WriteReport(const char *pFileName,
+                                      const char *pModelName) {
+  uint32_t frameCount = (uint32_t)arrlenu(pCpuMs);
+  if (frameCount == 0) {
+    LOGF(eERROR, "No frames were measured");
+    return false;
+  }
+  FileStream file = {};
+  if (!fsOpenStreamFromPath(RD_LOG, pFileName, FM_WRITE, &file)) {
+    LOGF(eERROR, "Failed to open benchmark report %s", pFileName);
+    return false;
+  }
+  fsPrintToStream(&file, "{\n  \"model\": \"%s\",\n", pModelName);
+  fsPrintToStream(&file,
+                  "  \"pathFrames\": %u,\n  \"warmupPasses\": %u,\n"
+                  "  \"passes\": %u,\n  \"timeStepMs\": %.3f,\n",
+                  pPath->GetFrameCount(), mDesc.mWarmupPassCount,
+                  mDesc.mPassCount, mDesc.mTimeStep * 1000.0f);
+  PrintDistribution(file, "cpuFrameMs", pCpuMs, frameCount);
+  PrintDistribution(file, "gpuFrameMs", pGpuMs, frameCount);
+
+  fsPrintToStream(&file, "  \"gpuScopesMeanMs\": {");
+  for (uint32_t i = 0; i < mScopeCount; ++i) {
+    fsPrintToStream(&file, "%s\n    \"%s\": %.3f", i == 0 ? "" : ",",
+                    pScopeNames[i], mScopeTotalMs[i] / frameCount);
+  }
+  fsPrintToStream(&file, "\n  },\n  \"countersPerFrame\": {");
+  for (uint32_t i = 0; i < kRenderCounterCount; ++i) {
+    fsPrintToStream(&file, "%s\n    \"%s\": %.1f", i == 0 ? "" : ",",
+                    GetRenderCounterName((RenderCounter)i),
+                    mCounterTotals[i] / frameCount);
+  }
+  fsPrintToStream(&file, "\n  }\n}\n");
+  fsCloseStream(&file);
+  LOGF(eINFO, "Wrote the benchmark report to %s", pFileName);
+  return true;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Utilities/Math/MathTypes.h"
+
+#include "RenderContext.hpp"
+#include "RenderStats.hpp"
+
+/// View matrices recorded once per frame. Replaying one per frame at a fixed
+/// timestep shows the same frames whatever the frame rate was while
+/// recording, so that runs can be compared.
+class CameraPath {
+public:
+  void Destroy();
+
+  void Record(const mat4 &viewMat);
+  /// Paths are binary files in \c RD_LOG.
+  bool Save(const char *pFileName) const;
+  bool Load(const char *pFileName);
+
+  uint32_t GetFrameCount() const;
+  inline const mat4 &GetView(uint32_t frame) const { return pViews[frame]; }
+
+private:
+  // stb_ds array.
+  mat4 *pViews = NULL;
+};
+
+struct CameraPathBenchmarkDesc {
+  uint32_t mWarmupPassCount;
+  uint32_t mPassCount;
+  float mTimeStep;
+};
+
+/// Replays a \c CameraPath \c mWarmupPassCount times, then measures it over
+/// \c mPassCount more passes and reports frame time percentiles, the GPU
+/// scopes and the render counters to a JSON file.
+class CameraPathBenchmark {
+public:
+  void Start(const CameraPath &path, const CameraPathBenchmarkDesc &desc);
+  void Destroy();
+
+  inline bool IsRunning() const { return pPath != NULL; }
+  inline bool IsFinished() const {
+    return pPath && mPass == mDesc.mWarmupPassCount + mDesc.mPassCount;
+  }
+  /// Animated state is reset at the start of each pass, so that every pass
+  /// renders the same frames.
+  inline bool IsPassStart() const { return mFrame == 0; }
+  inline float GetTimeStep() const { return mDesc.mTimeStep; }
+  inline const mat4 &GetView() const { return pPath->GetView(mFrame); }
+
+  /// Accounts for the frame just submitted and moves to the next one. GPU
+  /// times lag the CPU by the frames in flight, which the warmup absorbs.
+  void EndFrame(const RenderStatsFrame &stats,
+                const RenderContext::GpuScopeTiming *pGpuScopes,
+                uint32_t gpuScopeCount);
+
+  /// Writes the report to \c pFileName, in \c RD_LOG.
+  bool WriteReport(const char *pFileName, const char *pModelName);
+
+private:
+  static const uint32_t kMaxScopeCount = 64;
+
+  const CameraPath *pPath = NULL;
+  CameraPathBenchmarkDesc mDesc = {};
+  uint32_t mPass = 0;
+  uint32_t mFrame = 0;
+
+  // stb_ds arrays, one entry per measured frame.
+  float *pCpuMs = NULL;
+  float *pGpuMs = NULL;
+  double mCounterTotals[kRenderCounterCount] = {};
+  const char *pScopeNames[kMaxScopeCount] = {};
+  double mScopeTotalMs[kMaxScopeCount] = {};
+  uint32_t mScopeCount = 0;
+};
@@ -0,0 +1,352 @@
+#include "ChunkStreamer.hpp"
+
+#include "Utilities/Interfaces/ILog.h"
+#include "Utilities/Interfaces/IThread.h"
+
+#include "RenderStats.hpp"
+#include "Trace.hpp"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+enum ChunkState : uint8_t {
+  kChunkMissing = 0,
+  kChunkLoading,
+  kChunkResident,
+  /// Its read failed; it's never retried.
+  kChunkFailed,
+};
+
+enum StagingState : uint32_t {
+  kStagingFree = 0,
+  kStagingReading,
+  kStagingReady,
+  kStagingFailed,
+};
+
+static const uint32_t kInvalidChunk = ~0u;
+
+struct ChunkStreamer::StagingSlot {
+  /// Each slot reads through its own stream, so reads never contend.
+  FileStream mFile;
+  /// Holds the largest chunk, \c NULL if the stream failed to open.
+  uint8_t *pData;
+
+  // Written by the main thread before the read is queued.
+  uint32_t mChunk;
+  uint64_t mOffset;
+  uint32_t mSize;
+
+  tfrg_atomic32_t mState;
+};
+
+bool ReadChunkFileHeader(FileStream &file, const char *pFileName,
+                         uint32_t vertexStride, ChunkFileHeader &header) {
+  header = {};
+  if (fsReadFromStream(&file, &header, sizeof(header)) != sizeof(header) ||
+      header.mMagic != kChunkFileMagic ||
+      header.mVersion != kChunkFileVersion) {
+    LOGF(eERROR, "%s isn't a valid chunk file", pFileName);
+    return false;
+  }
+  if (header.mVertexStride != vertexStride || header.mMaxIndexCount > 65536) {
+    LOGF(eERROR, "%s was converted with another vertex format", pFileName);
+    return false;
+  }
+  // The table is allocated from its count, so it must fit in the file.
+  uint64_t fileSize = (uint64_t)fsGetStreamFileSize(&file);
+  if (header.mTableOffset > fileSize ||
+      header.mChunkCount >
+          (fileSize - header.mTableOffset) / sizeof(ChunkInfo)) {
+    LOGF(eERROR, "%s is truncated", pFileName);
+    return false;
+  }
+  return true;
+}
+
+static void ReadChunk(void *pUserData) {
+  TRACE_SCOPE("Read Chunk");
+  ChunkStreamer::StagingSlot &slot =
+      *reinterpret_cast<ChunkStreamer::StagingSlot *>(pUserData);
+  bool read = fsSeekStream(&slot.mFile, SBO_START_OF_FILE,
+                           (ssize_t)slot.mOffset) &&
+              fsReadFromStream(&slot.mFile, slot.pData, slot.mSize) ==
+                  slot.mSize;
+  tfrg_atomic32_store_release(&slot.mState,
+                              read ? kStagingReady : kStagingFailed);
+}
+
+/// Distance from \c position to the nearest point of a box, zero inside it.
+static float DistanceToBounds(const vec3 &position, const float3 &boundsMin,
+                              const float3 &boundsMax) {
+  vec3 nearest =
+      minPerElem(maxPerElem(position, f3Tov3(boundsMin)), f3Tov3(boundsMax));
+  return length(position - nearest);
+}
+
+bool ChunkStreamer::Init(RenderContext &renderContext, TaskSystem &taskSystem,
+                         const char *pFileName, uint32_t vertexStride,
+                         const ChunkStreamerDesc &desc) {
+  pTaskSystem = &taskSystem;
+  pGeometryPool = &renderContext.GetGeometryPool();
+  mVertexStride = vertexStride;
+  mGpuBudgetBytes = desc.mGpuBudgetBytes;
+  if (vertexStride != pGeometryPool->GetVertexStride()) {
+    LOGF(eERROR, "Chunks don't have the geometry pool's vertex format");
+    return false;
+  }
+
+  FileStream file = {};
+  if (!fsOpenStreamFromPath(RD_MESHES, pFileName, FileMode::FM_READ, &file)) {
+    LOGF(eERROR, "Failed to open chunk file %s", pFileName);
+    return false;
+  }
+  ChunkFileHeader header;
+  if (!ReadChunkFileHeader(file, pFileName, vertexStride, header)) {
+    fsCloseStream(&file);
+    return false;
+  }
+  if (header.mChunkCount == 0) {
+    LOGF(eERROR, "%s has no chunks", pFileName);
+    fsCloseStream(&file);
+    return false;
+  }
+  mChunkCount = header.mChunkCount;
+  size_t tableSize = mChunkCount * sizeof(ChunkInfo);
+  pChunks = reinterpret_cast<ChunkInfo *>(
+      MemoryAlloc(kMemoryCategoryChunkStreamer, tableSize));
+  uint64_t fileSize = (uint64_t)fsGetStreamFileSize(&file);
+  bool read = fsSeekStream(&file, SBO_START_OF_FILE,
+                           (ssize_t)header.mTableOffset) &&
+              (size_t)fsReadFromStream(&file, pChunks, tableSize) == tableSize;
+  fsCloseStream(&file);
+  if (!read) {
+    LOGF(eERROR, "%s is truncated", pFileName);
+    Exit(renderContext);
+    return false;
+  }
+  // Chunks are read into staging slots sized from the header's maxima, on
+  // worker threads.
+  for (uint32_t i = 0; i < mChunkCount; ++i) {
+    const ChunkInfo &chunk = pChunks[i];
+    uint64_t chunkBytes = (uint64_t)chunk.mVertexCount * vertexStride +
+                          (uint64_t)chunk.mIndexCount * sizeof(uint16_t);
+    if (chunk.mVertexCount > header.mMaxVertexCount ||
+        chunk.mIndexCount > header.mMaxIndexCount ||
+        chunk.mOffset > fileSize || chunkBytes > fileSize - chunk.mOffset) {
+      LOGF(eERROR, "%s has a corrupted chunk table", pFileName);
+      Exit(renderContext);
+      return false;
+    }
+  }
+  pChunkStates = reinterpret_cast<uint8_t *>(
+      MemoryCalloc(kMemoryCategoryChunkStreamer, mChunkCount, 1));
+  pChunkAllocations = reinterpret_cast<uint32_t *>(MemoryCalloc(
+      kMemoryCategoryChunkStreamer, mChunkCount, sizeof(uint32_t)));
+  pDistances = reinterpret_cast<float *>(
+      MemoryAlloc(kMemoryCategoryChunkStreamer, mChunkCount * sizeof(float)));
+
+  // Indices are padded to 4 bytes in the file.
+  uint64_t stagingSlotBytes =
+      (uint64_t)header.mMaxVertexCount * vertexStride +
+      (uint64_t)((header.mMaxIndexCount + 1) & ~1u) * sizeof(uint16_t);
+  mStagingSlotCount = (uint32_t)min(
+      max(desc.mCpuBudgetBytes / stagingSlotBytes, (uint64_t)1),
+      (uint64_t)kMaxStagingSlotCount);
+  pStagingSlots = reinterpret_cast<StagingSlot *>(MemoryCalloc(
+      kMemoryCategoryChunkStreamer, mStagingSlotCount, sizeof(StagingSlot)));
+  for (uint32_t i = 0; i < mStagingSlotCount; ++i) {
+    StagingSlot &slot = pStagingSlots[i];
+    if (!fsOpenStreamFromPath(RD_MESHES, pFileName, FileMode::FM_READ,
+                              &slot.mFile)) {
+      LOGF(eERROR, "Failed to open chunk file %s", pFileName);
+      Exit(renderContext);
+      return false;
+    }
+    slot.pData = reinterpret_cast<uint8_t *>(
+        MemoryAlloc(kMemoryCategoryChunkStreamer, stagingSlotBytes));
+    tfrg_atomic32_store_relaxed(&slot.mState, kStagingFree);
+  }
+
+  const double kMB = 1024.0 * 1024.0;
+  LOGF(eINFO,
+       "Streaming %u chunks of %s into %.1f MB of the geometry pool through "
+       "%u staging slots (%.1f MB)",
+       mChunkCount, pFileName, mGpuBudgetBytes / kMB, mStagingSlotCount,
+       mStagingSlotCount * stagingSlotBytes / kMB);
+  return true;
+}
+
+void ChunkStreamer::Exit(RenderContext &renderContext) {
+  // Other streamers may share the read worker, so only this one's reads are
+  // waited for.
+  for (uint32_t i = 0; i < mStagingSlotCount; ++i) {
+    StagingSlot &slot = pStagingSlots[i];
+    while (tfrg_atomic32_load_acquire(&slot.mState) == kStagingReading) {
+      threadSleep(1);
+    }
+    if (slot.pData) {
+      fsCloseStream(&slot.mFile);
+      MemoryFree(slot.pData);
+    }
+  }
+  MemoryFree(pStagingSlots);
+
+  // The frame being recorded may still draw resident chunks.
+  for (uint32_t i = 0; pChunkAllocations && i < mChunkCount; ++i) {
+    pGeometryPool->Free(pChunkAllocations[i],
+                        renderContext.GetLastSubmission() + 1);
+  }
+  MemoryFree(pChunks);
+  MemoryFree(pChunkStates);
+  MemoryFree(pChunkAllocations);
+  MemoryFree(pDistances);
+  *this = ChunkStreamer();
+}
+
+bool ChunkStreamer::IsResident(uint32_t chunk) const {
+  return pChunkStates[chunk] == kChunkResident;
+}
+
+uint64_t ChunkStreamer::GetChunkGpuBytes(uint32_t chunk) const {
+  return (uint64_t)pChunks[chunk].mVertexCount * mVertexStride +
+         (uint64_t)pChunks[chunk].mIndexCount * sizeof(uint32_t);
+}
+
+bool ChunkStreamer::FitsBudget(uint64_t gpuBytes) const {
+  uint64_t usedBytes = mResidentBytes + mLoadingBytes;
+  return usedBytes == 0 || usedBytes + gpuBytes <= mGpuBudgetBytes;
+}
+
+uint32_t ChunkStreamer::FindNearestMissingChunk() const {
+  uint32_t nearest = kInvalidChunk;
+  for (uint32_t i = 0; i < mChunkCount; ++i) {
+    if (pChunkStates[i] == kChunkMissing &&
+        (nearest == kInvalidChunk || pDistances[i] < pDistances[nearest])) {
+      nearest = i;
+    }
+  }
+  return nearest;
+}
+
+uint32_t ChunkStreamer::FindFarthestResidentChunk() const {
+  uint32_t farthest = kInvalidChunk;
+  for (uint32_t i = 0; i < mChunkCount; ++i) {
+    if (pChunkStates[i] == kChunkResident &&
+        (farthest == kInvalidChunk || pDistances[i] > pDistances[farthest])) {
+      farthest = i;
+    }
+  }
+  return farthest;
+}
+
+void ChunkStreamer::Evict(RenderContext &renderContext, uint32_t chunk) {
+  // Evictions happen before the frame is recorded, so the last frame that
+  // may draw the chunk is the one submitted last.
+  pGeometryPool->Free(pChunkAllocations[chunk],
+                      renderContext.GetLastSubmission());
+  pChunkAllocations[chunk] = GeometryPool::kNoAllocation;
+  pChunkStates[chunk] = kChunkMissing;
+  mResidentBytes -= GetChunkGpuBytes(chunk);
+  mResidentCount--;
+  mVersion++;
+}
+
+void ChunkStreamer::Update(RenderContext &renderContext,
+                           const vec3 &viewPosition) {
+  TRACE_SCOPE("Update Chunk Streaming");
+  // Finished reads are copied into the pool through the resource loader,
+  // whose updates are flushed before the frame is submitted.
+  for (uint32_t i = 0; i < mStagingSlotCount; ++i) {
+    StagingSlot &slot = pStagingSlots[i];
+    uint32_t state = tfrg_atomic32_load_acquire(&slot.mState);
+    if (state == kStagingFailed) {
+      LOGF(eWARNING, "Failed to read chunk %u", slot.mChunk);
+      pChunkStates[slot.mChunk] = kChunkFailed;
+      mLoadingBytes -= GetChunkGpuBytes(slot.mChunk);
+      tfrg_atomic32_store_relaxed(&slot.mState, kStagingFree);
+      continue;
+    }
+    if (state != kStagingReady) {
+      continue;
+    }
+    const ChunkInfo &chunk = pChunks[slot.mChunk];
+    // The pool may be short of space until evicted ranges are released, so
+    // the upload is retried next frame.
+    uint32_t allocation =
+        pGeometryPool->Allocate(chunk.mVertexCount, chunk.mIndexCount);
+    if (allocation == GeometryPool::kNoAllocation) {
+      continue;
+    }
+    uint64_t vertexBytes = (uint64_t)chunk.mVertexCount * mVertexStride;
+    BufferUpdateDesc vertexUpdate = {pGeometryPool->GetVertexBuffers()[0]};
+    vertexUpdate.mDstOffset =
+        (uint64_t)pGeometryPool->GetFirstVertex(allocation) * mVertexStride;
+    vertexUpdate.mSize = vertexBytes;
+    beginUpdateResource(&vertexUpdate);
+    memcpy(vertexUpdate.pMappedData, slot.pData, vertexBytes);
+    endUpdateResource(&vertexUpdate);
+    BufferUpdateDesc indexUpdate = {pGeometryPool->GetIndexBuffer()};
+    indexUpdate.mDstOffset =
+        (uint64_t)pGeometryPool->GetFirstIndex(allocation) * sizeof(uint32_t);
+    indexUpdate.mSize = (uint64_t)chunk.mIndexCount * sizeof(uint32_t);
+    beginUpdateResource(&indexUpdate);
+    const uint16_t *pSource =
+        reinterpret_cast<const uint16_t *>(slot.pData + vertexBytes);
+    uint32_t *pIndices = reinterpret_cast<uint32_t *>(indexUpdate.pMappedData);
+    for (uint32_t j = 0; j < chunk.mIndexCount; ++j) {
+      pIndices[j] = pSource[j];
+    }
+    endUpdateResource(&indexUpdate);
+    pGeometryPool->SetMovable(allocation);
+    uint64_t gpuBytes = GetChunkGpuBytes(slot.mChunk);
+    RenderStatsAdd(kRenderCounterUploadedBytes, gpuBytes);
+
+    pChunkStates[slot.mChunk] = kChunkResident;
+    pChunkAllocations[slot.mChunk] = allocation;
+    mLoadingBytes -= gpuBytes;
+    mResidentBytes += gpuBytes;
+    mResidentCount++;
+    mVersion++;
+    tfrg_atomic32_store_relaxed(&slot.mState, kStagingFree);
+  }
+
+  for (uint32_t i = 0; i < mChunkCount; ++i) {
+    pDistances[i] = DistanceToBounds(viewPosition, pChunks[i].mBoundsMin,
+                                     pChunks[i].mBoundsMax);
+  }
+
+  // Reads in flight already count against the budget, so a new one only
+  // starts if what's left fits it, or once the resident chunks farther than
+  // it were evicted to make room.
+  for (uint32_t i = 0; i < mStagingSlotCount; ++i) {
+    StagingSlot &slot = pStagingSlots[i];
+    if (tfrg_atomic32_load_relaxed(&slot.mState) != kStagingFree) {
+      continue;
+    }
+    uint32_t chunk = FindNearestMissingChunk();
+    if (chunk == kInvalidChunk) {
+      break;
+    }
+    uint64_t gpuBytes = GetChunkGpuBytes(chunk);
+    while (!FitsBudget(gpuBytes)) {
+      uint32_t farthest = FindFarthestResidentChunk();
+      if (farthest == kInvalidChunk ||
+          pDistances[farthest] <= pDistances[chunk]) {
+        break;
+      }
+      Evict(renderContext, farthest);
+    }
+    if (!FitsBudget(gpuBytes)) {
+      break;
+    }
+    const ChunkInfo &info = pChunks[chunk];
+    pChunkStates[chunk] = kChunkLoading;
+    slot.mChunk = chunk;
+    slot.mOffset = info.mOffset;
+    slot.mSize = info.mVertexCount * mVertexStride +
+                 info.mIndexCount * (uint32_t)sizeof(uint16_t);
+    mLoadingBytes += gpuBytes;
+    tfrg_atomic32_store_relaxed(&slot.mState, kStagingReading);
+    pTaskSystem->AsyncRead(ReadChunk, &slot);
+  }
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "Graphics/Interfaces/IGraphics.h"
+#include "Resources/ResourceLoader/Interfaces/IResourceLoader.h"
+#include "Utilities/Interfaces/IFileSystem.h"
+#include "Utilities/Math/MathTypes.h"
+#include "Utilities/Threading/Atomics.h"
+
+#include "RenderContext.hpp"
+#include "TaskSystem.hpp"
+
+/// Chunk files start with this header. The chunks' vertices and indices
+/// follow, then, at \c mTableOffset, the \c ChunkInfo table, the material
+/// colors (one \c float4 each) and the scene's texture requests.
+struct ChunkFileHeader {
+  uint32_t mMagic;
+  uint32_t mVersion;
+  uint32_t mVertexStride;
+  uint32_t mChunkCount;
+  uint32_t mMaterialCount;
+  uint32_t mTextureRequestCount;
+  /// Largest vertex and index counts of any chunk, which size the staging
+  /// slots.
+  uint32_t mMaxVertexCount;
+  uint32_t mMaxIndexCount;
+  uint64_t mTableOffset;
+};
+
+/// A spatially coherent group of triangles sharing a material, in model
+/// space. Its \c mVertexCount vertices are followed by as many 16-bit
+/// indices as \c mIndexCount, padded to 4 bytes. They're widened to 32 bits
+/// on upload, as the geometry pool's indices are.
+struct ChunkInfo {
+  uint64_t mOffset;
+  uint32_t mVertexCount;
+  uint32_t mIndexCount;
+  uint32_t mMaterialIndex;
+  float3 mBoundsMin;
+  float3 mBoundsMax;
+};
+
+static const uint32_t kChunkFileMagic = 0x4b4e4843; // "CHNK"
+static const uint32_t kChunkFileVersion = 2;
+
+/// Reads and validates the header of an open chunk file.
+bool ReadChunkFileHeader(FileStream &file, const char *pFileName,
+                         uint32_t vertexStride, ChunkFileHeader &header);
+
+struct ChunkStreamerDesc {
+  /// Geometry pool bytes the resident chunks may take. At least one chunk is
+  /// always resident.
+  uint64_t mGpuBudgetBytes;
+  /// Size of the CPU staging ring, at least one slot.
+  uint64_t mCpuBudgetBytes;
+};
+
+/// \c ChunkStreamer keeps the chunks of a chunk file nearest to the camera
+/// resident in the geometry pool, one allocation each, so that only the
+/// chunk table grows with the model.
+///
+/// Chunks are read into a ring of staging slots on the task system's read
+/// worker, which imports and texture conversions on the background pool
+/// never hold up, and copied from there into their allocation through the
+/// resource loader. When the budget is spent, the farthest resident chunks
+/// are evicted in favour of a nearer one; the pool only reuses their ranges
+/// once every frame that may have drawn them has completed on the GPU.
+class ChunkStreamer {
+public:
+  static const uint32_t kMaxStagingSlotCount = 16;
+
+  bool Init(RenderContext &renderContext, TaskSystem &taskSystem,
+            const char *pFileName, uint32_t vertexStride,
+            const ChunkStreamerDesc &desc);
+  void Exit(RenderContext &renderContext);
+
+  /// Uploads finished reads, then queues reads of the nearest missing chunks
+  /// to \c viewPosition, given in model space. Must be called once per frame
+  /// from the main thread, before the frame is recorded.
+  void Update(RenderContext &renderContext, const vec3 &viewPosition);
+
+  inline uint32_t GetChunkCount() const { return mChunkCount; }
+  inline const ChunkInfo &GetChunk(uint32_t i) const { return pChunks[i]; }
+  bool IsResident(uint32_t chunk) const;
+  /// Geometry pool allocation of a resident chunk.
+  inline uint32_t GetAllocation(uint32_t chunk) const {
+    return pChunkAllocations[chunk];
+  }
+  /// Incremented whenever a chunk becomes resident or is evicted.
+  inline uint32_t GetVersion() const { return mVersion; }
+
+  inline Buffer *const *GetVertexBuffers() const {
+    return pGeometryPool->GetVertexBuffers();
+  }
+  inline Buffer *GetIndexBuffer() const {
+    return pGeometryPool->GetIndexBuffer();
+  }
+
+  inline uint32_t GetResidentCount() const { return mResidentCount; }
+  /// Geometry pool bytes of the resident chunks.
+  inline uint64_t GetGpuBytes() const { return mResidentBytes; }
+
+  struct StagingSlot;
+
+private:
+  TaskSystem *pTaskSystem = NULL;
+  GeometryPool *pGeometryPool = NULL;
+  uint32_t mVertexStride = 0;
+  uint64_t mGpuBudgetBytes = 0;
+
+  ChunkInfo *pChunks = NULL;
+  uint32_t mChunkCount = 0;
+  /// Per chunk: its state, pool allocation and distance to the camera.
+  uint8_t *pChunkStates = NULL;
+  uint32_t *pChunkAllocations = NULL;
+  float *pDistances = NULL;
+
+  StagingSlot *pStagingSlots = NULL;
+  uint32_t mStagingSlotCount = 0;
+  /// Pool bytes of the chunks being read, which count against the budget.
+  uint64_t mLoadingBytes = 0;
+
+  uint32_t mResidentCount = 0;
+  uint64_t mResidentBytes = 0;
+  uint32_t mVersion = 0;
+
+  uint64_t GetChunkGpuBytes(uint32_t chunk) const;
+  /// Whether a chunk of \c gpuBytes can be read without exceeding the
+  /// budget. With nothing resident or loading, any chunk fits.
+  bool FitsBudget(uint64_t gpuBytes) const;
+  uint32_t FindNearestMissingChunk() const;
+  uint32_t FindFarthestResidentChunk() const;
+  void Evict(RenderContext &renderContext, uint32_t chunk);
+};
@@ -0,0 +1,334 @@
+#include "ClusteredLighting.hpp"
+
+#include "Utilities/Interfaces/ILog.h"
+#include "Utilities/Interfaces/ITime.h"
+
+#include "Trace.hpp"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+struct ClusteredLighting::BinContext {
+  ClusteredLighting *pLighting;
+  const Light *pLights;
+  uint32_t mLightCount;
+  mat4 mViewMat;
+
+  static void BoundLights(void *pUserData, uint32_t begin, uint32_t end);
+  static void BinRows(void *pUserData, uint32_t begin, uint32_t end);
+  static void CompactClusters(void *pUserData, uint32_t begin, uint32_t end);
+};
+
+static void RunRange(TaskSystem *pTaskSystem, uint32_t count,
+                     uint32_t minBatchSize, TaskSystem::RangeFunc pFunc,
+                     void *pUserData) {
+  if (pTaskSystem) {
+    pTaskSystem->ParallelFor(count, minBatchSize, pFunc, pUserData);
+  } else {
+    pFunc(pUserData, 0, count);
+  }
+}
+
+static inline uint32_t ClusterIndex(uint32_t x, uint32_t y, uint32_t slice) {
+  return (slice * ClusteredLighting::kTileCountY + y) *
+             ClusteredLighting::kTileCountX +
+         x;
+}
+
+static inline uint32_t ToTile(float ndc, uint32_t tileCount) {
+  float tile = floorf((ndc * 0.5f + 0.5f) * tileCount);
+  return (uint32_t)clamp(tile, 0.0f, (float)(tileCount - 1));
+}
+
+void ClusteredLighting::Init(TaskSystem *pTaskSystem) {
+  this->pTaskSystem = pTaskSystem;
+  pClusterMin =
+      reinterpret_cast<float *>(tf_calloc(kClusterCount * 3, sizeof(float)));
+  pClusterMax =
+      reinterpret_cast<float *>(tf_calloc(kClusterCount * 3, sizeof(float)));
+
+  pLightX =
+      reinterpret_cast<float *>(tf_calloc(kMaxLightCount, sizeof(float)));
+  pLightY =
+      reinterpret_cast<float *>(tf_calloc(kMaxLightCount, sizeof(float)));
+  pLightZ =
+      reinterpret_cast<float *>(tf_calloc(kMaxLightCount, sizeof(float)));
+  pLightRadius =
+      reinterpret_cast<float *>(tf_calloc(kMaxLightCount, sizeof(float)));
+  pLightRanges = reinterpret_cast<uint8_t(*)[6]>(
+      tf_calloc(kMaxLightCount, sizeof(uint8_t[6])));
+
+  pClusterLights = reinterpret_cast<uint16_t *>(
+      tf_calloc(kClusterCount * kMaxLightsPerCluster, sizeof(uint16_t)));
+  pClusterCounts =
+      reinterpret_cast<uint32_t *>(tf_calloc(kClusterCount, sizeof(uint32_t)));
+
+  pGpuLights =
+      reinterpret_cast<GpuLight *>(tf_calloc(kMaxLightCount, sizeof(GpuLight)));
+  pClusterRanges =
+      reinterpret_cast<uint32_t *>(tf_calloc(kClusterCount, sizeof(uint32_t)));
+  pLightIndices = reinterpret_cast<uint32_t *>(
+      tf_calloc(kMaxLightIndexCount, sizeof(uint32_t)));
+}
+
+void ClusteredLighting::Exit() {
+  tf_free(pClusterMin);
+  tf_free(pClusterMax);
+  tf_free(pLightX);
+  tf_free(pLightY);
+  tf_free(pLightZ);
+  tf_free(pLightRadius);
+  tf_free(pLightRanges);
+  tf_free(pClusterLights);
+  tf_free(pClusterCounts);
+  tf_free(pGpuLights);
+  tf_free(pClusterRanges);
+  tf_free(pLightIndices);
+  pClusterMin = pClusterMax = NULL;
+  pLightX = pLightY = pLightZ = pLightRadius = NULL;
+  pLightRanges = NULL;
+  pClusterLights = NULL;
+  pClusterCounts = NULL;
+  pGpuLights = NULL;
+  pClusterRanges = NULL;
+  pLightIndices = NULL;
+}
+
+void ClusteredLighting::SetProjection(float projScaleX, float projScaleY,
+                                      float nearZ, float farZ) {
+  if (projScaleX == mProjScaleX && projScaleY == mProjScaleY &&
+      nearZ == mNearZ && farZ == mFarZ) {
+    return;
+  }
+  mProjScaleX = projScaleX;
+  mProjScaleY = projScaleY;
+  mNearZ = nearZ;
+  mFarZ = farZ;
+  mSliceScale = kSliceCount / logf(farZ / nearZ);
+  mSliceBias = -logf(nearZ) * mSliceScale;
+
+  for (uint32_t slice = 0; slice < kSliceCount; ++slice) {
+    float zNear = nearZ * powf(farZ / nearZ, (float)slice / kSliceCount);
+    float zFar = nearZ * powf(farZ / nearZ, (float)(slice + 1) / kSliceCount);
+    for (uint32_t y = 0; y < kTileCountY; ++y) {
+      // Tile rows go top to bottom, NDC goes bottom to top.
+      float ndcTop = 1.0f - 2.0f * y / kTileCountY;
+      float ndcBottom = ndcTop - 2.0f / kTileCountY;
+      for (uint32_t x = 0; x < kTileCountX; ++x) {
+        float ndcLeft = -1.0f + 2.0f * x / kTileCountX;
+        float ndcRight = ndcLeft + 2.0f / kTileCountX;
+        uint32_t cluster = ClusterIndex(x, y, slice);
+        pClusterMin[cluster * 3 + 0] =
+            min(ndcLeft * zNear, ndcLeft * zFar) / projScaleX;
+        pClusterMax[cluster * 3 + 0] =
+            max(ndcRight * zNear, ndcRight * zFar) / projScaleX;
+        pClusterMin[cluster * 3 + 1] =
+            min(ndcBottom * zNear, ndcBottom * zFar) / projScaleY;
+        pClusterMax[cluster * 3 + 1] =
+            max(ndcTop * zNear, ndcTop * zFar) / projScaleY;
+        pClusterMin[cluster * 3 + 2] = zNear;
+        pClusterMax[cluster * 3 + 2] = zFar;
+      }
+    }
+  }
+}
+
+void ClusteredLighting::BinContext::BoundLights(void *pUserData,
+                                                uint32_t begin, uint32_t end) {
+  BinContext &context = *reinterpret_cast<BinContext *>(pUserData);
+  ClusteredLighting &lighting = *context.pLighting;
+  for (uint32_t i = begin; i < end; ++i) {
+    const Light &light = context.pLights[i];
+    vec4 position = context.mViewMat * vec4(f3Tov3(light.mPosition), 1.0f);
+    vec4 direction = context.mViewMat * vec4(f3Tov3(light.mDirection), 0.0f);
+    float x = position.getX(), y = position.getY(), z = position.getZ();
+    float r = light.mRadius;
+
+    GpuLight &gpuLight = lighting.pGpuLights[i];
+    gpuLight.mPositionRadius = float4(x, y, z, r);
+    gpuLight.mColorType = float4(light.mColor.x, light.mColor.y,
+                                 light.mColor.z, (float)light.mType);
+    gpuLight.mDirectionCosOuter =
+        float4(direction.getX(), direction.getY(), direction.getZ(),
+               light.mSpotCosOuter);
+    gpuLight.mSpotCosInner = float4(light.mSpotCosInner, 0.0f, 0.0f, 0.0f);
+
+    lighting.pLightX[i] = x;
+    lighting.pLightY[i] = y;
+    lighting.pLightZ[i] = z;
+    lighting.pLightRadius[i] = r;
+
+    uint8_t *pRange = lighting.pLightRanges[i];
+    if (z + r < lighting.mNearZ || z - r > lighting.mFarZ) {
+      // An empty range: min above max.
+      pRange[0] = pRange[2] = pRange[4] = 1;
+      pRange[1] = pRange[3] = pRange[5] = 0;
+      continue;
+    }
+
+    // Project the light's bounding box; its extremes lie on its corners.
+    float zMin = max(z - r, lighting.mNearZ);
+    float zMax = min(z + r, lighting.mFarZ);
+    float ndcMinX = min((x - r) / zMin, (x - r) / zMax) * lighting.mProjScaleX;
+    float ndcMaxX = max((x + r) / zMin, (x + r) / zMax) * lighting.mProjScaleX;
+    float ndcMinY = min((y - r) / zMin, (y - r) / zMax) * lighting.mProjScaleY;
+    float ndcMaxY = max((y + r) / zMin, (y + r) / zMax) * lighting.mProjScaleY;
+    if (ndcMaxX < -1.0f || ndcMinX > 1.0f || ndcMaxY < -1.0f ||
+        ndcMinY > 1.0f) {
+      pRange[0] = pRange[2] = pRange[4] = 1;
+      pRange[1] = pRange[3] = pRange[5] = 0;
+      continue;
+    }
+    pRange[0] = (uint8_t)ToTile(ndcMinX, kTileCountX);
+    pRange[1] = (uint8_t)ToTile(ndcMaxX, kTileCountX);
+    pRange[2] = (uint8_t)(kTileCountY - 1 - ToTile(ndcMaxY, kTileCountY));
+    pRange[3] = (uint8_t)(kTileCountY - 1 - ToTile(ndcMinY, kTileCountY));
+    pRange[4] = (uint8_t)clamp(
+        floorf(logf(zMin) * lighting.mSliceScale + lighting.mSliceBias), 0.0f,
+        (float)(kSliceCount - 1));
+    pRange[5] = (uint8_t)clamp(
+        floorf(logf(zMax) * lighting.mSliceScale + lighting.mSliceBias), 0.0f,
+        (float)(kSliceCount - 1));
+  }
+}
+
+void ClusteredLighting::BinContext::BinRows(void *pUserData, uint32_t begin,
+                                            uint32_t end) {
+  BinContext &context = *reinterpret_cast<BinContext *>(pUserData);
+  ClusteredLighting &lighting = *context.pLighting;
+
+  // Candidates of the current row, padded to a multiple of four with lights
+  // too far away to touch any cluster.
+  uint32_t capacity = (context.mLightCount + 3) & ~3u;
+  float *pScratch =
+      reinterpret_cast<float *>(tf_malloc(capacity * 4 * sizeof(float)));
+  float *pCandidateX = pScratch;
+  float *pCandidateY = pCandidateX + capacity;
+  float *pCandidateZ = pCandidateY + capacity;
+  float *pCandidateRadius = pCandidateZ + capacity;
+  uint16_t *pCandidates =
+      reinterpret_cast<uint16_t *>(tf_malloc(capacity * sizeof(uint16_t)));
+
+  for (uint32_t row = begin; row < end; ++row) {
+    uint32_t slice = row / kTileCountY;
+    uint32_t y = row % kTileCountY;
+
+    uint32_t candidateCount = 0;
+    for (uint32_t i = 0; i < context.mLightCount; ++i) {
+      const uint8_t *pRange = lighting.pLightRanges[i];
+      if (pRange[2] <= y && y <= pRange[3] && pRange[4] <= slice &&
+          slice <= pRange[5]) {
+        pCandidateX[candidateCount] = lighting.pLightX[i];
+        pCandidateY[candidateCount] = lighting.pLightY[i];
+        pCandidateZ[candidateCount] = lighting.pLightZ[i];
+        pCandidateRadius[candidateCount] = lighting.pLightRadius[i];
+        pCandidates[candidateCount++] = (uint16_t)i;
+      }
+    }
+    uint32_t paddedCount = (candidateCount + 3) & ~3u;
+    for (uint32_t c = candidateCount; c < paddedCount; ++c) {
+      pCandidateX[c] = pCandidateY[c] = pCandidateZ[c] = 1e30f;
+      pCandidateRadius[c] = 0.0f;
+    }
+
+    const vec4 zero(0.0f);
+    for (uint32_t x = 0; x < kTileCountX; ++x) {
+      uint32_t cluster = ClusterIndex(x, y, slice);
+      const float *pMin = &lighting.pClusterMin[cluster * 3];
+      const float *pMax = &lighting.pClusterMax[cluster * 3];
+      vec4 minX(pMin[0]), minY(pMin[1]), minZ(pMin[2]);
+      vec4 maxX(pMax[0]), maxY(pMax[1]), maxZ(pMax[2]);
+
+      uint16_t *pClusterLights =
+          &lighting.pClusterLights[cluster * kMaxLightsPerCluster];
+      uint32_t count = 0;
+      for (uint32_t c = 0; c < paddedCount; c += 4) {
+        // Squared distance from each sphere center to the cluster box.
+        vec4 cx(pCandidateX[c], pCandidateX[c + 1], pCandidateX[c + 2],
+                pCandidateX[c + 3]);
+        vec4 cy(pCandidateY[c], pCandidateY[c + 1], pCandidateY[c + 2],
+                pCandidateY[c + 3]);
+        vec4 cz(pCandidateZ[c], pCandidateZ[c + 1], pCandidateZ[c + 2],
+                pCandidateZ[c + 3]);
+        vec4 radius(pCandidateRadius[c], pCandidateRadius[c + 1],
+                    pCandidateRadius[c + 2], pCandidateRadius[c + 3]);
+        vec4 dx = maxPerElem(maxPerElem(minX - cx, cx - maxX), zero);
+        vec4 dy = maxPerElem(maxPerElem(minY - cy, cy - maxY), zero);
+        vec4 dz = maxPerElem(maxPerElem(minZ - cz, cz - maxZ), zero);
+        vec4 margin = mulPerElem(radius, radius) -
+                      (mulPerElem(dx, dx) + mulPerElem(dy, dy) +
+                       mulPerElem(dz, dz));
+        for (uint32_t lane = 0; lane < 4; ++lane) {
+          if (margin.getElem(lane) < 0.0f) {
+            continue;
+          }
+          uint16_t light = pCandidates[c + lane];
+          const uint8_t *pRange = lighting.pLightRanges[light];
+          if (x < pRange[0] || x > pRange[1]) {
+            continue;
+          }
+          // Keep counting past the capacity so that drops can be reported.
+          if (count < kMaxLightsPerCluster) {
+            pClusterLights[count] = light;
+          }
+          ++count;
+        }
+      }
+      lighting.pClusterCounts[cluster] = count;
+    }
+  }
+
+  tf_free(pCandidates);
+  tf_free(pScratch);
+}
+
+void ClusteredLighting::BinContext::CompactClusters(void *pUserData,
+                                                    uint32_t begin,
+                                                    uint32_t end) {
+  BinContext &context = *reinterpret_cast<BinContext *>(pUserData);
+  ClusteredLighting &lighting = *context.pLighting;
+  for (uint32_t cluster = begin; cluster < end; ++cluster) {
+    uint32_t range = lighting.pClusterRanges[cluster];
+    uint32_t offset = range & ((1u << kRangeOffsetBits) - 1);
+    uint32_t count = range >> kRangeOffsetBits;
+    const uint16_t *pSrc =
+        &lighting.pClusterLights[cluster * kMaxLightsPerCluster];
+    for (uint32_t i = 0; i < count; ++i) {
+      lighting.pLightIndices[offset + i] = pSrc[i];
+    }
+  }
+}
+
+void ClusteredLighting::Bin(const Light *pLights, uint32_t lightCount,
+                            const mat4 &viewMat) {
+  ASSERT(mSliceScale != 0.0f && "SetProjection must be called before Bin");
+  TRACE_SCOPE("Bin Lights");
+  int64_t start = getUSec(true);
+
+  lightCount = min(lightCount, kMaxLightCount);
+  BinContext context = {this, pLights, lightCount, viewMat};
+  RunRange(pTaskSystem, lightCount, 64, BinContext::BoundLights, &context);
+  RunRange(pTaskSystem, kTileCountY * kSliceCount, 1, BinContext::BinRows,
+           &context);
+
+  // The prefix sum is serial, but only walks the cluster counts.
+  uint32_t offset = 0;
+  uint32_t maxCount = 0;
+  uint32_t dropped = 0;
+  for (uint32_t cluster = 0; cluster < kClusterCount; ++cluster) {
+    uint32_t wanted = pClusterCounts[cluster];
+    uint32_t count = min(wanted, kMaxLightsPerCluster);
+    count = min(count, kMaxLightIndexCount - offset);
+    pClusterRanges[cluster] = offset | (count << kRangeOffsetBits);
+    offset += count;
+    maxCount = max(maxCount, wanted);
+    dropped += wanted - count;
+  }
+  RunRange(pTaskSystem, kClusterCount, 256, BinContext::CompactClusters,
+           &context);
+
+  mStats.mLightCount = lightCount;
+  mStats.mIndexCount = offset;
+  mStats.mMaxLightsPerCluster = maxCount;
+  mStats.mDroppedCount = dropped;
+  mStats.mBinningMs = (float)(getUSec(true) - start) / 1000.0f;
+}
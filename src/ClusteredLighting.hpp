@@ -0,0 +1,115 @@
+#pragma once
+
+#include "Utilities/Math/MathTypes.h"
+
+#include "TaskSystem.hpp"
+
+enum class LightType : uint32_t {
+  Point = 0,
+  Spot = 1,
+};
+
+/// A dynamic light in world space.
+struct Light {
+  float3 mPosition;
+  float mRadius;
+  /// Linear color, premultiplied by the intensity.
+  float3 mColor;
+  LightType mType;
+  /// Spot lights only.
+  float3 mDirection;
+  float mSpotCosOuter;
+  float mSpotCosInner;
+};
+
+/// Layout of the \c Lights buffer read by \c basic.frag, in view space.
+struct GpuLight {
+  float4 mPositionRadius;
+  float4 mColorType;
+  float4 mDirectionCosOuter;
+  float4 mSpotCosInner;
+};
+
+struct ClusterStats {
+  uint32_t mLightCount;
+  uint32_t mIndexCount;
+  uint32_t mMaxLightsPerCluster;
+  /// Light references dropped because a cluster or the index list was full.
+  uint32_t mDroppedCount;
+  float mBinningMs;
+};
+
+/// Bins lights into a froxel grid: the view frustum is split into screen
+/// tiles and exponentially distributed depth slices. Each cluster gets a range
+/// of a compact light index list, which forward shading walks per pixel.
+///
+/// Binning runs on the CPU each frame, in three \c TaskSystem passes: lights
+/// are transformed and bounded in parallel, then every row of clusters tests
+/// the lights overlapping it, four at a time, against its cluster boxes, and
+/// finally the per-cluster lists are compacted. Spot lights are bounded by
+/// their sphere. Nothing here touches the GPU.
+class ClusteredLighting {
+public:
+  static const uint32_t kTileCountX = 16;
+  static const uint32_t kTileCountY = 9;
+  static const uint32_t kSliceCount = 24;
+  static const uint32_t kClusterCount = kTileCountX * kTileCountY * kSliceCount;
+  static const uint32_t kMaxLightCount = 4096;
+  static const uint32_t kMaxLightsPerCluster = 255;
+  static const uint32_t kMaxLightIndexCount = kClusterCount * 64;
+  /// Cluster ranges pack the offset in the low bits and the count above.
+  static const uint32_t kRangeOffsetBits = 20;
+
+  /// \c pTaskSystem may be \c NULL, in which case binning is single-threaded.
+  void Init(TaskSystem *pTaskSystem);
+  void Exit();
+
+  /// \c projScaleX and \c projScaleY are the projection's first two diagonal
+  /// entries. Cluster bounds are only rebuilt when these change.
+  void SetProjection(float projScaleX, float projScaleY, float nearZ,
+                     float farZ);
+
+  void Bin(const Light *pLights, uint32_t lightCount, const mat4 &viewMat);
+
+  inline const GpuLight *GetGpuLights() const { return pGpuLights; }
+  inline const uint32_t *GetClusterRanges() const { return pClusterRanges; }
+  inline const uint32_t *GetLightIndices() const { return pLightIndices; }
+  inline const ClusterStats &GetStats() const { return mStats; }
+
+  /// Depth slice of view depth \c z is \c log(z) * scale + bias.
+  inline float GetSliceScale() const { return mSliceScale; }
+  inline float GetSliceBias() const { return mSliceBias; }
+
+  struct BinContext;
+
+private:
+  TaskSystem *pTaskSystem = NULL;
+
+  float mProjScaleX = 0.0f;
+  float mProjScaleY = 0.0f;
+  float mNearZ = 0.0f;
+  float mFarZ = 0.0f;
+  float mSliceScale = 0.0f;
+  float mSliceBias = 0.0f;
+
+  // View-space cluster boxes, three floats each.
+  float *pClusterMin = NULL;
+  float *pClusterMax = NULL;
+
+  // Per light, structure of arrays so that four lights test at once.
+  float *pLightX = NULL;
+  float *pLightY = NULL;
+  float *pLightZ = NULL;
+  float *pLightRadius = NULL;
+  // Inclusive cluster coordinate ranges, empty when the light is culled.
+  uint8_t (*pLightRanges)[6] = NULL;
+
+  uint16_t *pClusterLights = NULL;
+  uint32_t *pClusterCounts = NULL;
+
+  GpuLight *pGpuLights = NULL;
+  uint32_t *pClusterRanges = NULL;
+  uint32_t *pLightIndices = NULL;
+
+  ClusterStats mStats = {};
+};
@@ -0,0 +1,119 @@
+#include "DrawList.hpp"
+
+#include "Utilities/Interfaces/ITime.h"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+static const uint32_t kRadixBits = 8;
+static const uint32_t kRadixSize = 1u << kRadixBits;
+static const uint32_t kPassCount = 64 / kRadixBits;
+
+void DrawList::Destroy() {
+  tf_free(pKeys);
+  tf_free(pPayloads);
+  tf_free(pScratchKeys);
+  tf_free(pScratchPayloads);
+  pKeys = NULL;
+  pPayloads = NULL;
+  pScratchKeys = NULL;
+  pScratchPayloads = NULL;
+  mCount = 0;
+  mCapacity = 0;
+}
+
+void DrawList::Add(uint64_t key, uint32_t payload) {
+  if (mCount == mCapacity) {
+    mCapacity = max(mCapacity * 2, 1024u);
+    pKeys = reinterpret_cast<uint64_t *>(
+        tf_realloc(pKeys, mCapacity * sizeof(uint64_t)));
+    pPayloads = reinterpret_cast<uint32_t *>(
+        tf_realloc(pPayloads, mCapacity * sizeof(uint32_t)));
+    tf_free(pScratchKeys);
+    tf_free(pScratchPayloads);
+    pScratchKeys =
+        reinterpret_cast<uint64_t *>(tf_malloc(mCapacity * sizeof(uint64_t)));
+    pScratchPayloads =
+        reinterpret_cast<uint32_t *>(tf_malloc(mCapacity * sizeof(uint32_t)));
+  }
+  pKeys[mCount] = key;
+  pPayloads[mCount] = payload;
+  mCount++;
+}
+
+void DrawList::Sort() {
+  int64_t startUSec = getUSec(false);
+
+  // All histograms are built in a single read of the keys.
+  uint32_t histograms[kPassCount][kRadixSize] = {};
+  for (uint32_t i = 0; i < mCount; ++i) {
+    uint64_t key = pKeys[i];
+    for (uint32_t pass = 0; pass < kPassCount; ++pass) {
+      histograms[pass][(key >> (pass * kRadixBits)) & (kRadixSize - 1)]++;
+    }
+  }
+
+  uint64_t *pSrcKeys = pKeys;
+  uint32_t *pSrcPayloads = pPayloads;
+  uint64_t *pDstKeys = pScratchKeys;
+  uint32_t *pDstPayloads = pScratchPayloads;
+  for (uint32_t pass = 0; pass < kPassCount; ++pass) {
+    uint32_t *histogram = histograms[pass];
+    uint32_t shift = pass * kRadixBits;
+    if (mCount == 0 ||
+        histogram[(pSrcKeys[0] >> shift) & (kRadixSize - 1)] == mCount) {
+      continue;
+    }
+
+    uint32_t offset = 0;
+    for (uint32_t digit = 0; digit < kRadixSize; ++digit) {
+      uint32_t count = histogram[digit];
+      histogram[digit] = offset;
+      offset += count;
+    }
+    for (uint32_t i = 0; i < mCount; ++i) {
+      uint64_t key = pSrcKeys[i];
+      uint32_t dst = histogram[(key >> shift) & (kRadixSize - 1)]++;
+      pDstKeys[dst] = key;
+      pDstPayloads[dst] = pSrcPayloads[i];
+    }
+
+    uint64_t *pTmpKeys = pSrcKeys;
+    uint32_t *pTmpPayloads = pSrcPayloads;
+    pSrcKeys = pDstKeys;
+    pSrcPayloads = pDstPayloads;
+    pDstKeys = pTmpKeys;
+    pDstPayloads = pTmpPayloads;
+  }
+
+  // An odd number of passes leaves the result in the scratch buffers, which
+  // are then simply swapped in.
+  if (pSrcKeys != pKeys) {
+    pScratchKeys = pKeys;
+    pScratchPayloads = pPayloads;
+    pKeys = pSrcKeys;
+    pPayloads = pSrcPayloads;
+  }
+
+  mSortMs = (float)(getUSec(false) - startUSec) / 1000.0f;
+}
+
+DrawListStats DrawList::ComputeStats() const {
+  DrawListStats stats = {};
+  stats.mDrawCount = mCount;
+  stats.mSortMs = mSortMs;
+  for (uint32_t i = 0; i < mCount; ++i) {
+    uint64_t key = pKeys[i];
+    uint64_t previous = i > 0 ? pKeys[i - 1] : ~key;
+    if (DrawKey::GetPipeline(key) != DrawKey::GetPipeline(previous)) {
+      stats.mPipelineChanges++;
+    }
+    if (DrawKey::GetDescriptorSet(key) !=
+        DrawKey::GetDescriptorSet(previous)) {
+      stats.mDescriptorSetChanges++;
+    }
+    if (DrawKey::GetMaterial(key) != DrawKey::GetMaterial(previous)) {
+      stats.mMaterialChanges++;
+    }
+  }
+  return stats;
+}
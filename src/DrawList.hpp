@@ -0,0 +1,95 @@
+#pragma once
+
+#include "Utilities/Interfaces/ILog.h"
+
+/// Sort key layout, from most to least significant bits. Draws sharing a
+/// prefix share the corresponding GPU state, so sorting by key minimizes
+/// state changes, and within a material, draws go front to back.
+///
+/// | pipeline (6) | descriptor set (14) | material (16) | view depth (28) |
+struct DrawKey {
+  static const uint32_t kPipelineBits = 6;
+  static const uint32_t kDescriptorSetBits = 14;
+  static const uint32_t kMaterialBits = 16;
+  static const uint32_t kDepthBits = 28;
+
+  static const uint32_t kDepthShift = 0;
+  static const uint32_t kMaterialShift = kDepthShift + kDepthBits;
+  static const uint32_t kDescriptorSetShift = kMaterialShift + kMaterialBits;
+  static const uint32_t kPipelineShift =
+      kDescriptorSetShift + kDescriptorSetBits;
+
+  static const uint32_t kPipelineMask = (1u << kPipelineBits) - 1;
+  static const uint32_t kDescriptorSetMask = (1u << kDescriptorSetBits) - 1;
+  static const uint32_t kMaterialMask = (1u << kMaterialBits) - 1;
+
+  /// Positive IEEE floats order like their bit patterns, so the view depth is
+  /// quantized by keeping the top bits of its representation. Fields are
+  /// masked, so that a value too wide for its field can't spill into the
+  /// next one in release builds.
+  static inline uint64_t Make(uint32_t pipeline, uint32_t descriptorSet,
+                              uint32_t material, float viewDepth) {
+    ASSERT(pipeline <= kPipelineMask);
+    ASSERT(descriptorSet <= kDescriptorSetMask);
+    ASSERT(material <= kMaterialMask);
+    union {
+      float f;
+      uint32_t u;
+    } depth;
+    depth.f = viewDepth > 0.0f ? viewDepth : 0.0f;
+    return ((uint64_t)(pipeline & kPipelineMask) << kPipelineShift) |
+           ((uint64_t)(descriptorSet & kDescriptorSetMask)
+            << kDescriptorSetShift) |
+           ((uint64_t)(material & kMaterialMask) << kMaterialShift) |
+           ((uint64_t)(depth.u >> (32 - kDepthBits)) << kDepthShift);
+  }
+
+  static inline uint32_t GetPipeline(uint64_t key) {
+    return (uint32_t)(key >> kPipelineShift) & kPipelineMask;
+  }
+  static inline uint32_t GetDescriptorSet(uint64_t key) {
+    return (uint32_t)(key >> kDescriptorSetShift) & kDescriptorSetMask;
+  }
+  static inline uint32_t GetMaterial(uint64_t key) {
+    return (uint32_t)(key >> kMaterialShift) & kMaterialMask;
+  }
+};
+
+struct DrawListStats {
+  uint32_t mDrawCount;
+  uint32_t mPipelineChanges;
+  uint32_t mDescriptorSetChanges;
+  uint32_t mMaterialChanges;
+  float mSortMs;
+};
+
+/// A per-frame list of (key, payload) pairs, where the payload identifies
+/// the draw (e.g. a submesh index). Storage grows but is never shrunk, so a
+/// steady-state frame doesn't allocate.
+class DrawList {
+public:
+  void Destroy();
+
+  void Clear() { mCount = 0; }
+  void Add(uint64_t key, uint32_t payload);
+
+  /// Stable LSD radix sort on 8-bit digits. Digits that are equal across all
+  /// keys, which is common for the high bits, are skipped.
+  void Sort();
+
+  /// Counts the state transitions a submission in the current order incurs.
+  DrawListStats ComputeStats() const;
+
+  inline uint32_t GetCount() const { return mCount; }
+  inline uint64_t GetKey(uint32_t i) const { return pKeys[i]; }
+  inline uint32_t GetPayload(uint32_t i) const { return pPayloads[i]; }
+
+private:
+  uint64_t *pKeys = NULL;
+  uint32_t *pPayloads = NULL;
+  uint64_t *pScratchKeys = NULL;
+  uint32_t *pScratchPayloads = NULL;
+  uint32_t mCount = 0;
+  uint32_t mCapacity = 0;
+  float mSortMs = 0.0f;
+};
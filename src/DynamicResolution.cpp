@@ -0,0 +1,68 @@
+#include "DynamicResolution.hpp"
+
+#include "Utilities/Math/MathTypes.h"
+
+// Fraction of the target the frame time may drift before acting.
+static const float kUpperBand = 0.05f;
+static const float kLowerBand = 0.15f;
+static const uint32_t kOverBudgetFrames = 3;
+static const uint32_t kUnderBudgetFrames = 30;
+// Frames to wait after a change for its effect to show in the timings.
+static const uint32_t kCooldownFrames = 8;
+static const float kFilterWeight = 0.1f;
+// Largest relative change per step, downwards and upwards.
+static const float kMaxStepDown = 0.85f;
+static const float kMaxStepUp = 1.05f;
+
+void DynamicResolutionController::Reset() {
+  mFilteredMs = 0.0f;
+  mOverBudgetFrames = 0;
+  mUnderBudgetFrames = 0;
+  mCooldownFrames = 0;
+}
+
+float DynamicResolutionController::Update(
+    float gpuFrameMs, float currentScale,
+    const DynamicResolutionSettings &settings) {
+  float scale = clamp(currentScale, settings.mMinScale, settings.mMaxScale);
+  if (gpuFrameMs <= 0.0f || settings.mTargetFrameMs <= 0.0f) {
+    return scale;
+  }
+
+  mFilteredMs = mFilteredMs > 0.0f
+                    ? mFilteredMs + (gpuFrameMs - mFilteredMs) * kFilterWeight
+                    : gpuFrameMs;
+  if (mCooldownFrames > 0) {
+    --mCooldownFrames;
+    return scale;
+  }
+
+  float target = settings.mTargetFrameMs;
+  if (mFilteredMs > target * (1.0f + kUpperBand)) {
+    ++mOverBudgetFrames;
+    mUnderBudgetFrames = 0;
+  } else if (mFilteredMs < target * (1.0f - kLowerBand)) {
+    ++mUnderBudgetFrames;
+    mOverBudgetFrames = 0;
+  } else {
+    mOverBudgetFrames = 0;
+    mUnderBudgetFrames = 0;
+  }
+
+  if (mOverBudgetFrames < kOverBudgetFrames &&
+      mUnderBudgetFrames < kUnderBudgetFrames) {
+    return scale;
+  }
+
+  // Pixel cost grows with the square of the scale.
+  float step = clamp(sqrtf(target / mFilteredMs), kMaxStepDown, kMaxStepUp);
+  float newScale = clamp(scale * step, settings.mMinScale, settings.mMaxScale);
+  if (newScale != scale) {
+    // The filtered time no longer reflects the new scale, so restart it.
+    mFilteredMs = 0.0f;
+    mCooldownFrames = kCooldownFrames;
+  }
+  mOverBudgetFrames = 0;
+  mUnderBudgetFrames = 0;
+  return newScale;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "Utilities/Interfaces/ILog.h"
+
+struct DynamicResolutionSettings {
+  float mTargetFrameMs;
+  float mMinScale;
+  float mMaxScale;
+};
+
+/// Picks a render scale that holds the GPU frame time near a target.
+///
+/// GPU timings arrive a few frames late and are noisy, so the measurement is
+/// smoothed and the scale only moves after it has stayed outside a dead band
+/// for several frames. Going down reacts quickly to avoid hitches, going up
+/// waits longer so the scale doesn't oscillate around the budget.
+class DynamicResolutionController {
+public:
+  void Reset();
+
+  /// Returns the scale to render the next frame at.
+  float Update(float gpuFrameMs, float currentScale,
+               const DynamicResolutionSettings &settings);
+
+private:
+  float mFilteredMs = 0.0f;
+  uint32_t mOverBudgetFrames = 0;
+  uint32_t mUnderBudgetFrames = 0;
+  uint32_t mCooldownFrames = 0;
+};
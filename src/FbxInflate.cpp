@@ -0,0 +1,326 @@
+#include "FbxInflate.hpp"
+
+#include <string.h>
+
+#include "Utilities/Interfaces/ITime.h"
+#include "Utilities/ThirdParty/OpenSource/Nothings/stb_ds.h"
+
+#include "libdeflate.h"
+
+#include "Trace.hpp"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+/// "Kaydara FBX Binary  ", a null, 0x1A and 0x00, then the version.
+static const char kBinaryMagic[] = "Kaydara FBX Binary  ";
+static const uint64_t kHeaderSize = 27;
+/// From this version on, node records hold 64-bit offsets and sizes.
+static const uint32_t kWideRecordVersion = 7500;
+/// Deeper nesting only comes from corrupted files.
+static const uint32_t kMaxNodeDepth = 64;
+
+struct FbxArray {
+  /// Of the array's length, followed by its encoding and its stored size.
+  uint64_t mHeaderOffset;
+  uint64_t mDataOffset;
+  uint32_t mCompressedSize;
+  uint32_t mInflatedSize;
+};
+
+/// Array indices delimit the arrays stored before the node's record, before
+/// the end of its properties, and before its end, which shift its fields.
+struct FbxNode {
+  uint64_t mHeaderOffset;
+  uint64_t mEndOffset;
+  uint64_t mPropertyBytes;
+  uint32_t mFirstArray;
+  uint32_t mPropertyArrayEnd;
+  uint32_t mArrayEnd;
+};
+
+struct FbxScan {
+  const uint8_t *pData;
+  uint64_t mSize;
+  bool mWide;
+  FbxArray *pArrays;
+  FbxNode *pNodes;
+};
+
+static uint64_t ReadField(const uint8_t *pData, bool wide) {
+  if (wide) {
+    uint64_t value;
+    memcpy(&value, pData, sizeof(value));
+    return value;
+  }
+  uint32_t value;
+  memcpy(&value, pData, sizeof(value));
+  return value;
+}
+
+static void WriteField(uint8_t *pData, bool wide, uint64_t value) {
+  if (wide) {
+    memcpy(pData, &value, sizeof(value));
+  } else {
+    uint32_t narrow = (uint32_t)value;
+    memcpy(pData, &narrow, sizeof(narrow));
+  }
+}
+
+static bool ScanProperty(FbxScan &scan, uint64_t &cursor, uint64_t end) {
+  if (cursor >= end) {
+    return false;
+  }
+  uint8_t type = scan.pData[cursor++];
+  uint32_t elementSize = 0;
+  switch (type) {
+  case 'C':
+    cursor += 1;
+    return cursor <= end;
+  case 'Y':
+    cursor += 2;
+    return cursor <= end;
+  case 'I':
+  case 'F':
+    cursor += 4;
+    return cursor <= end;
+  case 'D':
+  case 'L':
+    cursor += 8;
+    return cursor <= end;
+  case 'S':
+  case 'R': {
+    if (cursor + 4 > end) {
+      return false;
+    }
+    uint32_t length;
+    memcpy(&length, scan.pData + cursor, sizeof(length));
+    cursor += 4 + (uint64_t)length;
+    return cursor <= end;
+  }
+  case 'b':
+    elementSize = 1;
+    break;
+  case 'i':
+  case 'f':
+    elementSize = 4;
+    break;
+  case 'l':
+  case 'd':
+    elementSize = 8;
+    break;
+  default:
+    return false;
+  }
+
+  if (cursor + 12 > end) {
+    return false;
+  }
+  uint32_t header[3];
+  memcpy(header, scan.pData + cursor, sizeof(header));
+  uint64_t inflatedSize = (uint64_t)header[0] * elementSize;
+  if (header[1] == 1) {
+    if (inflatedSize > UINT32_MAX) {
+      return false;
+    }
+    FbxArray array = {cursor, cursor + 12, header[2], (uint32_t)inflatedSize};
+    arrpush(scan.pArrays, array);
+  } else if (header[1] != 0) {
+    return false;
+  }
+  cursor += 12 + (uint64_t)header[2];
+  return cursor <= end;
+}
+
+/// Reads the record at \c offset and its children, moving \c offset past
+/// them. Returns false on malformed records; a null record, which closes a
+/// list of records, sets \c *pNull.
+static bool ScanNode(FbxScan &scan, uint64_t &offset, uint32_t depth,
+                     bool *pNull) {
+  uint64_t fieldSize = scan.mWide ? 8 : 4;
+  uint64_t recordSize = fieldSize * 3 + 1;
+  if (depth > kMaxNodeDepth || offset + recordSize > scan.mSize) {
+    return false;
+  }
+  const uint8_t *pRecord = scan.pData + offset;
+  uint64_t endOffset = ReadField(pRecord, scan.mWide);
+  uint64_t propertyCount = ReadField(pRecord + fieldSize, scan.mWide);
+  uint64_t propertyBytes = ReadField(pRecord + fieldSize * 2, scan.mWide);
+  uint8_t nameLength = pRecord[fieldSize * 3];
+  *pNull = endOffset == 0;
+  if (*pNull) {
+    offset += recordSize;
+    return true;
+  }
+  uint64_t cursor = offset + recordSize + nameLength;
+  if (endOffset > scan.mSize || cursor + propertyBytes > endOffset) {
+    return false;
+  }
+
+  // Children may grow the array, so the node is only referred to by index.
+  uint32_t node = (uint32_t)arrlenu(scan.pNodes);
+  uint32_t arrayCount = (uint32_t)arrlenu(scan.pArrays);
+  FbxNode record = {offset,     endOffset,  propertyBytes,
+                    arrayCount, arrayCount, arrayCount};
+  arrpush(scan.pNodes, record);
+  uint64_t propertyEnd = cursor + propertyBytes;
+  for (uint64_t i = 0; i < propertyCount; ++i) {
+    if (!ScanProperty(scan, cursor, propertyEnd)) {
+      return false;
+    }
+  }
+  if (cursor != propertyEnd) {
+    return false;
+  }
+  scan.pNodes[node].mPropertyArrayEnd = (uint32_t)arrlenu(scan.pArrays);
+
+  // Children run up to the null record closing them, as OpenFBX reads them.
+  while (cursor + recordSize < endOffset) {
+    bool null = false;
+    if (!ScanNode(scan, cursor, depth + 1, &null) || null) {
+      return false;
+    }
+  }
+  if (cursor > endOffset) {
+    return false;
+  }
+  scan.pNodes[node].mArrayEnd = (uint32_t)arrlenu(scan.pArrays);
+  offset = endOffset;
+  return true;
+}
+
+struct FbxInflateJob {
+  const uint8_t *pData;
+  uint8_t *pInflated;
+  const FbxArray *pArrays;
+  /// How far each array's data moves, the sum of the size changes of the
+  /// arrays before it. One more entry than arrays, for the end of the file.
+  const int64_t *pShifts;
+  tfrg_atomic32_t mFailed;
+};
+
+static void InflateArrays(void *pUserData, uint32_t begin, uint32_t end) {
+  FbxInflateJob &job = *reinterpret_cast<FbxInflateJob *>(pUserData);
+  libdeflate_decompressor *pDecompressor = libdeflate_alloc_decompressor();
+  if (pDecompressor == NULL) {
+    tfrg_atomic32_store_relaxed(&job.mFailed, 1);
+    return;
+  }
+  for (uint32_t i = begin; i < end; ++i) {
+    const FbxArray &array = job.pArrays[i];
+    // Each array brings along the records since the previous one, which are
+    // patched once every array is in place.
+    uint64_t copyBegin =
+        i == 0 ? 0
+               : job.pArrays[i - 1].mDataOffset +
+                     job.pArrays[i - 1].mCompressedSize;
+    memcpy(job.pInflated + copyBegin + job.pShifts[i], job.pData + copyBegin,
+           array.mDataOffset - copyBegin);
+    size_t inflatedSize = 0;
+    if (libdeflate_zlib_decompress(
+            pDecompressor, job.pData + array.mDataOffset,
+            array.mCompressedSize,
+            job.pInflated + array.mDataOffset + job.pShifts[i],
+            array.mInflatedSize, &inflatedSize) != LIBDEFLATE_SUCCESS ||
+        inflatedSize != array.mInflatedSize) {
+      tfrg_atomic32_store_relaxed(&job.mFailed, 1);
+    }
+  }
+  libdeflate_free_decompressor(pDecompressor);
+}
+
+uint8_t *InflateFbxArrays(const uint8_t *pData, uint64_t size,
+                          MemoryCategory category, TaskSystem *pTaskSystem,
+                          uint64_t *pInflatedSize, FbxInflateStats *pStats) {
+  if (size < kHeaderSize ||
+      memcmp(pData, kBinaryMagic, sizeof(kBinaryMagic)) != 0) {
+    return NULL;
+  }
+  TRACE_SCOPE("Inflate FBX Arrays");
+  int64_t start = getUSec(false);
+  uint32_t version;
+  memcpy(&version, pData + 23, sizeof(version));
+  FbxScan scan = {pData, size, version >= kWideRecordVersion, NULL, NULL};
+  uint64_t offset = kHeaderSize;
+  bool scanned = true;
+  bool null = false;
+  while (scanned && !null && offset < size) {
+    scanned = ScanNode(scan, offset, 0, &null);
+  }
+  uint32_t arrayCount = (uint32_t)arrlenu(scan.pArrays);
+  if (!scanned || arrayCount == 0) {
+    arrfree(scan.pArrays);
+    arrfree(scan.pNodes);
+    return NULL;
+  }
+
+  int64_t *pShifts = reinterpret_cast<int64_t *>(
+      tf_malloc((arrayCount + 1) * sizeof(int64_t)));
+  pShifts[0] = 0;
+  uint64_t compressedBytes = 0;
+  for (uint32_t i = 0; i < arrayCount; ++i) {
+    pShifts[i + 1] = pShifts[i] + (int64_t)scan.pArrays[i].mInflatedSize -
+                     (int64_t)scan.pArrays[i].mCompressedSize;
+    compressedBytes += scan.pArrays[i].mCompressedSize;
+  }
+  uint64_t inflatedSize = size + pShifts[arrayCount];
+  // Older files can't address past 4 GB.
+  if (!scan.mWide && inflatedSize > UINT32_MAX) {
+    tf_free(pShifts);
+    arrfree(scan.pArrays);
+    arrfree(scan.pNodes);
+    return NULL;
+  }
+  int64_t scanEnd = getUSec(false);
+
+  uint8_t *pInflated =
+      reinterpret_cast<uint8_t *>(MemoryAlloc(category, inflatedSize));
+  FbxInflateJob job = {pData, pInflated, scan.pArrays, pShifts, {}};
+  // Few arrays hold most of the data, so each batch is a single array.
+  if (pTaskSystem) {
+    pTaskSystem->ParallelFor(arrayCount, 1, InflateArrays, &job);
+  } else {
+    InflateArrays(&job, 0, arrayCount);
+  }
+  const FbxArray &last = scan.pArrays[arrayCount - 1];
+  uint64_t tailBegin = last.mDataOffset + last.mCompressedSize;
+  memcpy(pInflated + tailBegin + pShifts[arrayCount], pData + tailBegin,
+         size - tailBegin);
+
+  if (!tfrg_atomic32_load_relaxed(&job.mFailed)) {
+    for (uint32_t i = 0; i < arrayCount; ++i) {
+      const FbxArray &array = scan.pArrays[i];
+      const uint32_t encoding[2] = {0, array.mInflatedSize};
+      memcpy(pInflated + array.mHeaderOffset + pShifts[i] + 4, encoding,
+             sizeof(encoding));
+    }
+    uint64_t fieldSize = scan.mWide ? 8 : 4;
+    for (uint32_t i = 0; i < (uint32_t)arrlenu(scan.pNodes); ++i) {
+      const FbxNode &node = scan.pNodes[i];
+      uint8_t *pRecord =
+          pInflated + node.mHeaderOffset + pShifts[node.mFirstArray];
+      WriteField(pRecord, scan.mWide,
+                 node.mEndOffset + pShifts[node.mArrayEnd]);
+      WriteField(pRecord + fieldSize * 2, scan.mWide,
+                 node.mPropertyBytes + pShifts[node.mPropertyArrayEnd] -
+                     pShifts[node.mFirstArray]);
+    }
+  }
+  bool failed = tfrg_atomic32_load_relaxed(&job.mFailed) != 0;
+  tf_free(pShifts);
+  arrfree(scan.pArrays);
+  arrfree(scan.pNodes);
+  if (failed) {
+    MemoryFree(pInflated);
+    return NULL;
+  }
+
+  *pInflatedSize = inflatedSize;
+  if (pStats) {
+    pStats->mArrayCount = arrayCount;
+    pStats->mCompressedBytes = compressedBytes;
+    pStats->mInflatedBytes = compressedBytes + (inflatedSize - size);
+    pStats->mScanUSec = scanEnd - start;
+    pStats->mInflateUSec = getUSec(false) - scanEnd;
+  }
+  return pInflated;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "MemoryAccounting.hpp"
+#include "TaskSystem.hpp"
+
+struct FbxInflateStats {
+  uint32_t mArrayCount;
+  uint64_t mCompressedBytes;
+  uint64_t mInflatedBytes;
+  /// In microseconds: walking the node records, then inflating the arrays
+  /// and copying the rest.
+  int64_t mScanUSec;
+  int64_t mInflateUSec;
+};
+
+/// Binary FBX files deflate their larger property arrays (vertices, indices,
+/// normals, UVs...), which OpenFBX inflates one at a time as it parses each
+/// object. This inflates all of them up front instead, spread over
+/// \c pTaskSystem, into a copy of the file in which every array is stored
+/// raw, so that OpenFBX only copies them. Node records are moved and their
+/// offsets patched to match.
+///
+/// Returns the copy, allocated under \c category, with its size in
+/// \c *pInflatedSize. Returns \c NULL if the file isn't a binary FBX, has no
+/// compressed array, or is malformed, in which case the original is meant to
+/// be parsed as is and reports its own errors. Runs on the calling thread
+/// when \c pTaskSystem is \c NULL. \c pStats may be \c NULL.
+uint8_t *InflateFbxArrays(const uint8_t *pData, uint64_t size,
+                          MemoryCategory category, TaskSystem *pTaskSystem,
+                          uint64_t *pInflatedSize, FbxInflateStats *pStats);
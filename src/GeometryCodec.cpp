@@ -0,0 +1,361 @@
+#include "GeometryCodec.hpp"
+
+#include <string.h>
+
+static const uint32_t kLzMinMatch = 4;
+static const uint32_t kLzMaxOffset = 65535;
+static const uint32_t kLzHashBits = 12;
+static const uint32_t kMaxVertexWords = 64;
+
+static inline uint32_t Read32(const uint8_t *p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static inline void Write32(uint8_t *p, uint32_t value) {
+  memcpy(p, &value, sizeof(value));
+}
+
+static inline uint32_t ZigZag(uint32_t delta) {
+  return (delta << 1) ^ (uint32_t)((int32_t)delta >> 31);
+}
+
+static inline uint32_t UnZigZag(uint32_t value) {
+  return (value >> 1) ^ (0u - (value & 1));
+}
+
+/// Lengths past a token's nibble continue in bytes of 255 and a remainder.
+static inline uint8_t *WriteLength(uint8_t *pOut, size_t length) {
+  for (; length >= 255; length -= 255) {
+    *pOut++ = 255;
+  }
+  *pOut++ = (uint8_t)length;
+  return pOut;
+}
+
+static inline bool ReadLength(const uint8_t *pSrc, size_t srcSize,
+                              size_t &in, size_t &length) {
+  uint8_t byte;
+  do {
+    if (in >= srcSize) {
+      return false;
+    }
+    byte = pSrc[in++];
+    length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+/// Each sequence is a token holding the literal and match lengths in its
+/// nibbles, the literals, then the match's 16-bit offset. The last sequence
+/// only has literals. \c pDst must hold \c GetGeometryEncodedBound bytes.
+static size_t LzCompress(const uint8_t *pSrc, size_t size, uint8_t *pDst) {
+  // Positions plus one, so that zero marks an empty slot.
+  uint32_t table[1u << kLzHashBits];
+  memset(table, 0, sizeof(table));
+  uint8_t *pOut = pDst;
+  size_t anchor = 0;
+  size_t pos = 0;
+  while (pos + kLzMinMatch <= size) {
+    uint32_t sequence = Read32(pSrc + pos);
+    uint32_t hash = (sequence * 2654435761u) >> (32 - kLzHashBits);
+    size_t candidate = table[hash];
+    table[hash] = (uint32_t)(pos + 1);
+    if (candidate == 0 || pos - (candidate - 1) > kLzMaxOffset ||
+        Read32(pSrc + candidate - 1) != sequence) {
+      pos++;
+      continue;
+    }
+    size_t match = candidate - 1;
+    size_t length = kLzMinMatch;
+    while (pos + length < size && pSrc[match + length] == pSrc[pos + length]) {
+      length++;
+    }
+
+    size_t literals = pos - anchor;
+    size_t extra = length - kLzMinMatch;
+    *pOut++ = (uint8_t)(((literals < 15 ? literals : 15) << 4) |
+                        (extra < 15 ? extra : 15));
+    if (literals >= 15) {
+      pOut = WriteLength(pOut, literals - 15);
+    }
+    memcpy(pOut, pSrc + anchor, literals);
+    pOut += literals;
+    size_t offset = pos - match;
+    *pOut++ = (uint8_t)offset;
+    *pOut++ = (uint8_t)(offset >> 8);
+    if (extra >= 15) {
+      pOut = WriteLength(pOut, extra - 15);
+    }
+    pos += length;
+    anchor = pos;
+  }
+
+  size_t literals = size - anchor;
+  *pOut++ = (uint8_t)((literals < 15 ? literals : 15) << 4);
+  if (literals >= 15) {
+    pOut = WriteLength(pOut, literals - 15);
+  }
+  memcpy(pOut, pSrc + anchor, literals);
+  pOut += literals;
+  return (size_t)(pOut - pDst);
+}
+
+/// Fails unless the sequences are well formed and produce exactly
+/// \c dstSize bytes.
+static bool LzDecompress(const uint8_t *pSrc, size_t srcSize, uint8_t *pDst,
+                         size_t dstSize) {
+  size_t in = 0;
+  size_t out = 0;
+  while (in < srcSize) {
+    uint8_t token = pSrc[in++];
+    size_t literals = token >> 4;
+    if (literals == 15 && !ReadLength(pSrc, srcSize, in, literals)) {
+      return false;
+    }
+    if (literals > srcSize - in || literals > dstSize - out) {
+      return false;
+    }
+    memcpy(pDst + out, pSrc + in, literals);
+    in += literals;
+    out += literals;
+    if (in == srcSize) {
+      break;
+    }
+
+    if (srcSize - in < 2) {
+      return false;
+    }
+    size_t offset = pSrc[in] | ((size_t)pSrc[in + 1] << 8);
+    in += 2;
+    size_t length = token & 15;
+    if (length == 15 && !ReadLength(pSrc, srcSize, in, length)) {
+      return false;
+    }
+    length += kLzMinMatch;
+    if (offset == 0 || offset > out || length > dstSize - out) {
+      return false;
+    }
+    uint8_t *pMatch = pDst + out - offset;
+    if (offset >= length) {
+      memcpy(pDst + out, pMatch, length);
+    } else if (offset == 1) {
+      // Runs of a repeated byte, most often zeros from the codecs.
+      memset(pDst + out, *pMatch, length);
+    } else {
+      for (size_t i = 0; i < length; ++i) {
+        pDst[out + i] = pMatch[i];
+      }
+    }
+    out += length;
+  }
+  return out == dstSize;
+}
+
+size_t GetGeometryEncodedBound(size_t size) { return size + size / 255 + 16; }
+
+size_t GetIndexCodeBound(uint32_t indexCount) {
+  // A code byte per triangle, and at most three 5-byte varints.
+  return (size_t)indexCount / 3 * 16;
+}
+
+size_t EncodeVertexBlock(const void *pVertices, uint32_t count,
+                         uint32_t stride, void *pScratch, void *pDst,
+                         size_t dstCapacity) {
+  uint32_t wordCount = stride / 4;
+  size_t size = (size_t)count * stride;
+  if (stride % 4 != 0 || wordCount > kMaxVertexWords ||
+      dstCapacity < GetGeometryEncodedBound(size)) {
+    return 0;
+  }
+  const uint8_t *pSrc = reinterpret_cast<const uint8_t *>(pVertices);
+  uint8_t *pPlanes = reinterpret_cast<uint8_t *>(pScratch);
+  uint32_t previous[kMaxVertexWords] = {};
+  for (uint32_t v = 0; v < count; ++v) {
+    for (uint32_t w = 0; w < wordCount; ++w) {
+      uint32_t word = Read32(pSrc + (size_t)v * stride + w * 4);
+      uint32_t delta = ZigZag(word - previous[w]);
+      previous[w] = word;
+      for (uint32_t b = 0; b < 4; ++b) {
+        pPlanes[(size_t)(w * 4 + b) * count + v] = (uint8_t)(delta >> (8 * b));
+      }
+    }
+  }
+  return LzCompress(pPlanes, size, reinterpret_cast<uint8_t *>(pDst));
+}
+
+bool DecodeVertexBlock(const void *pSrc, size_t srcSize, uint32_t count,
+                       uint32_t stride, void *pScratch, void *pVertices) {
+  uint32_t wordCount = stride / 4;
+  if (stride % 4 != 0 || wordCount > kMaxVertexWords) {
+    return false;
+  }
+  const uint8_t *pPlanes = reinterpret_cast<const uint8_t *>(pScratch);
+  if (!LzDecompress(reinterpret_cast<const uint8_t *>(pSrc), srcSize,
+                    reinterpret_cast<uint8_t *>(pScratch),
+                    (size_t)count * stride)) {
+    return false;
+  }
+  uint8_t *pDst = reinterpret_cast<uint8_t *>(pVertices);
+  uint32_t previous[kMaxVertexWords] = {};
+  for (uint32_t v = 0; v < count; ++v) {
+    for (uint32_t w = 0; w < wordCount; ++w) {
+      const uint8_t *pPlane = pPlanes + (size_t)w * 4 * count + v;
+      uint32_t delta = pPlane[0] | ((uint32_t)pPlane[count] << 8) |
+                       ((uint32_t)pPlane[2 * count] << 16) |
+                       ((uint32_t)pPlane[3 * count] << 24);
+      previous[w] += UnZigZag(delta);
+      Write32(pDst + (size_t)v * stride + w * 4, previous[w]);
+    }
+  }
+  return true;
+}
+
+/// Index codes start with a byte per triangle: its low two bits give the
+/// edge of the previous triangle it shares, or 3 for none, and the next
+/// bits flag which of the indices that follow are the next new vertex.
+/// Other indices are varints of their zigzagged difference to the last one.
+static const uint8_t kNoSharedEdge = 3;
+
+struct IndexCodeState {
+  uint32_t mNext;
+  uint32_t mLast;
+};
+
+static inline uint8_t *WriteIndex(uint8_t *pOut, IndexCodeState &state,
+                                  uint32_t index, uint8_t &code,
+                                  uint32_t flag) {
+  if (index == state.mNext) {
+    code |= (uint8_t)flag;
+  } else {
+    for (uint32_t value = ZigZag(index - state.mLast);; value >>= 7) {
+      if (value < 0x80) {
+        *pOut++ = (uint8_t)value;
+        break;
+      }
+      *pOut++ = (uint8_t)(value | 0x80);
+    }
+  }
+  state.mNext = index >= state.mNext ? index + 1 : state.mNext;
+  state.mLast = index;
+  return pOut;
+}
+
+static inline bool ReadIndex(const uint8_t *pCodes, size_t codeSize,
+                             size_t &in, IndexCodeState &state, uint8_t code,
+                             uint32_t flag, uint32_t &index) {
+  if (code & flag) {
+    index = state.mNext;
+  } else {
+    uint32_t value = 0;
+    for (uint32_t shift = 0;; shift += 7) {
+      if (in >= codeSize || shift > 28) {
+        return false;
+      }
+      uint8_t byte = pCodes[in++];
+      value |= (uint32_t)(byte & 0x7f) << shift;
+      if (byte < 0x80) {
+        break;
+      }
+    }
+    index = state.mLast + UnZigZag(value);
+  }
+  state.mNext = index >= state.mNext ? index + 1 : state.mNext;
+  state.mLast = index;
+  return true;
+}
+
+size_t EncodeIndexBlock(const uint32_t *pIndices, uint32_t count,
+                        void *pScratch, void *pDst, size_t dstCapacity,
+                        uint32_t *pBaseIndex, uint32_t *pCodeSize) {
+  uint32_t triangleCount = count / 3;
+  uint32_t base = ~0u;
+  for (uint32_t i = 0; i < count; ++i) {
+    base = pIndices[i] < base ? pIndices[i] : base;
+  }
+  base = count > 0 ? base : 0;
+  uint8_t *pCodes = reinterpret_cast<uint8_t *>(pScratch);
+  uint8_t *pOut = pCodes + triangleCount;
+  IndexCodeState state = {0, 0};
+  uint32_t previous[3] = {};
+  for (uint32_t t = 0; t < triangleCount; ++t) {
+    uint32_t triangle[3] = {pIndices[t * 3] - base, pIndices[t * 3 + 1] - base,
+                            pIndices[t * 3 + 2] - base};
+    uint8_t code = kNoSharedEdge;
+    // A neighbor with the same winding walks the shared edge backwards.
+    for (uint32_t e = 0; t > 0 && e < 3 && code == kNoSharedEdge; ++e) {
+      for (uint32_t r = 0; r < 3; ++r) {
+        if (triangle[r] == previous[(e + 1) % 3] &&
+            triangle[(r + 1) % 3] == previous[e]) {
+          uint32_t rotated[3] = {triangle[r], triangle[(r + 1) % 3],
+                                 triangle[(r + 2) % 3]};
+          memcpy(triangle, rotated, sizeof(rotated));
+          code = (uint8_t)e;
+          break;
+        }
+      }
+    }
+    if (code == kNoSharedEdge) {
+      for (uint32_t k = 0; k < 3; ++k) {
+        pOut = WriteIndex(pOut, state, triangle[k], code, 4u << k);
+      }
+    } else {
+      pOut = WriteIndex(pOut, state, triangle[2], code, 4u);
+    }
+    pCodes[t] = code;
+    memcpy(previous, triangle, sizeof(previous));
+  }
+
+  size_t codeSize = (size_t)(pOut - pCodes);
+  if (dstCapacity < GetGeometryEncodedBound(codeSize)) {
+    return 0;
+  }
+  *pBaseIndex = base;
+  *pCodeSize = (uint32_t)codeSize;
+  return LzCompress(pCodes, codeSize, reinterpret_cast<uint8_t *>(pDst));
+}
+
+bool DecodeIndexBlock(const void *pSrc, size_t srcSize, uint32_t count,
+                      uint32_t baseIndex, uint32_t codeSize,
+                      uint32_t vertexCount, void *pScratch,
+                      uint32_t *pIndices) {
+  uint32_t triangleCount = count / 3;
+  const uint8_t *pCodes = reinterpret_cast<const uint8_t *>(pScratch);
+  if (codeSize < triangleCount || baseIndex > vertexCount ||
+      !LzDecompress(reinterpret_cast<const uint8_t *>(pSrc), srcSize,
+                    reinterpret_cast<uint8_t *>(pScratch), codeSize)) {
+    return false;
+  }
+  size_t in = triangleCount;
+  IndexCodeState state = {0, 0};
+  uint32_t previous[3] = {};
+  for (uint32_t t = 0; t < triangleCount; ++t) {
+    uint8_t code = pCodes[t];
+    uint32_t edge = code & 3u;
+    uint32_t triangle[3];
+    if (edge == kNoSharedEdge) {
+      for (uint32_t k = 0; k < 3; ++k) {
+        if (!ReadIndex(pCodes, codeSize, in, state, code, 4u << k,
+                       triangle[k])) {
+          return false;
+        }
+      }
+    } else {
+      triangle[0] = previous[(edge + 1) % 3];
+      triangle[1] = previous[edge];
+      if (t == 0 || !ReadIndex(pCodes, codeSize, in, state, code, 4u,
+                               triangle[2])) {
+        return false;
+      }
+    }
+    for (uint32_t k = 0; k < 3; ++k) {
+      if (triangle[k] >= vertexCount - baseIndex) {
+        return false;
+      }
+      pIndices[t * 3 + k] = baseIndex + triangle[k];
+    }
+    memcpy(previous, triangle, sizeof(previous));
+  }
+  return in == codeSize;
+}
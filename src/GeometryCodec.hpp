@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Compresses vertex and index buffers in independent blocks, so that blocks
+/// can be decoded in parallel and straight into their place in a buffer.
+/// Each block goes through two stages:
+///
+/// - A codec that turns the buffer's structure into runs of zero bytes.
+///   Vertices are split into 32-bit words, each stored as the zigzagged
+///   difference to the same word of the previous vertex, with the bytes of
+///   all words regrouped into planes. Triangles that share an edge with the
+///   previous one are stored as that edge and their third index, and new
+///   vertices, expected in order of first use, take no bytes at all.
+/// - A byte-oriented LZ77 stage in the style of LZ4, which collapses those
+///   runs and is fast to decode.
+///
+/// Decoding only writes the destination sequentially and never reads it
+/// back, so it can target write-combined upload memory. Neither direction
+/// allocates: the caller provides the scratch memory.
+
+/// Large enough for the LZ stage to find matches within a block, small
+/// enough to spread a model's blocks over every core.
+static const uint32_t kGeometryBlockVertexCount = 4096;
+static const uint32_t kGeometryBlockIndexCount = 3 * 8192;
+
+/// Upper bound of the size of a block encoding \c size bytes of input.
+size_t GetGeometryEncodedBound(size_t size);
+/// Upper bound of the first stage's output for \c indexCount indices.
+size_t GetIndexCodeBound(uint32_t indexCount);
+
+/// \c stride must be a multiple of 4, up to 256. \c pScratch holds \c count
+/// times \c stride bytes. Returns the encoded size, or 0 if \c dstCapacity
+/// is too small.
+size_t EncodeVertexBlock(const void *pVertices, uint32_t count,
+                         uint32_t stride, void *pScratch, void *pDst,
+                         size_t dstCapacity);
+/// Returns false if the block is corrupted.
+bool DecodeVertexBlock(const void *pSrc, size_t srcSize, uint32_t count,
+                       uint32_t stride, void *pScratch, void *pVertices);
+
+/// \c count must be a multiple of 3. Indices are stored relative to the
+/// block's smallest one, which \c pBaseIndex receives. Triangles may come
+/// back rotated, keeping their winding. \c pScratch holds
+/// \c GetIndexCodeBound bytes.
+size_t EncodeIndexBlock(const uint32_t *pIndices, uint32_t count,
+                        void *pScratch, void *pDst, size_t dstCapacity,
+                        uint32_t *pBaseIndex, uint32_t *pCodeSize);
+/// Returns false if the block is corrupted or refers to vertices past
+/// \c vertexCount.
+bool DecodeIndexBlock(const void *pSrc, size_t srcSize, uint32_t count,
+                      uint32_t baseIndex, uint32_t codeSize,
+                      uint32_t vertexCount, void *pScratch,
+                      uint32_t *pIndices);
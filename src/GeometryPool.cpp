@@ -0,0 +1,417 @@
+#include "GeometryPool.hpp"
+
+#include "Resources/ResourceLoader/Interfaces/IResourceLoader.h"
+#include "Utilities/Interfaces/ILog.h"
+#include "Utilities/ThirdParty/OpenSource/Nothings/stb_ds.h"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+/// Below this share of a buffer left stranded outside its largest free
+/// region, compaction isn't worth the copies.
+static const uint32_t kMinFragmentationShift = 6;
+
+/// Shaders also read both buffers as words, see SceneRenderSystem's
+/// visibility buffer.
+static const ResourceState kBufferStates[2] = {
+    RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | RESOURCE_STATE_SHADER_RESOURCE,
+    RESOURCE_STATE_INDEX_BUFFER | RESOURCE_STATE_SHADER_RESOURCE};
+
+bool GeometryPool::Init(const GeometryPoolDesc &desc) {
+  initMutex(&mMutex);
+  mVertexStride = desc.mVertexStride;
+  uint32_t vertexCapacity =
+      (uint32_t)min(desc.mVertexBytes / desc.mVertexStride, (uint64_t)~0u);
+  uint32_t indexCapacity =
+      (uint32_t)min(desc.mIndexBytes / sizeof(uint32_t), (uint64_t)~0u);
+  // Retired ranges stay allocated until released, so the allocators hold up
+  // to twice as many ranges as there are allocations.
+  uint32_t maxRangeCount = desc.mMaxAllocationCount * 2;
+  if (!mVertexAllocator.Init(vertexCapacity, maxRangeCount) ||
+      !mIndexAllocator.Init(indexCapacity, maxRangeCount)) {
+    LOGF(eERROR, "Failed to allocate the geometry pool's allocators");
+    mVertexAllocator.Destroy();
+    exitMutex(&mMutex);
+    return false;
+  }
+  MemoryTrack(kMemoryCategoryGeometryPool, kMemoryKindCpu,
+              mVertexAllocator.GetSizeBytes() +
+                  mIndexAllocator.GetSizeBytes());
+
+  // Entry 0 is never handed out, see kNoAllocation.
+  mAllocationCapacity = desc.mMaxAllocationCount + 1;
+  pAllocations = reinterpret_cast<Allocation *>(MemoryCalloc(
+      kMemoryCategoryGeometryPool, mAllocationCapacity, sizeof(Allocation)));
+  pFreeAllocations = reinterpret_cast<uint32_t *>(MemoryAlloc(
+      kMemoryCategoryGeometryPool, mAllocationCapacity * sizeof(uint32_t)));
+  for (uint32_t i = 0; i < 2; ++i) {
+    pMovableHeaps[i] = reinterpret_cast<uint32_t *>(MemoryAlloc(
+        kMemoryCategoryGeometryPool, mAllocationCapacity * sizeof(uint32_t)));
+  }
+  // Popped from the back, so allocations are numbered in order.
+  for (uint32_t i = 1; i < mAllocationCapacity; ++i) {
+    pFreeAllocations[mFreeAllocationCount++] = mAllocationCapacity - i;
+  }
+
+  BufferLoadDesc vbDesc = {};
+  vbDesc.mDesc.mDescriptors =
+      DESCRIPTOR_TYPE_VERTEX_BUFFER | DESCRIPTOR_TYPE_BUFFER;
+  vbDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+  vbDesc.mDesc.mStartState = kBufferStates[0];
+  vbDesc.mDesc.pName = "GeometryPoolVertices";
+  vbDesc.mDesc.mSize =
+      max((uint64_t)vertexCapacity * mVertexStride, (uint64_t)1);
+  vbDesc.mDesc.mElementCount =
+      (uint32_t)(vbDesc.mDesc.mSize / sizeof(uint32_t));
+  vbDesc.mDesc.mStructStride = sizeof(uint32_t);
+  vbDesc.ppBuffer = &pVertexBuffer;
+  addResource(&vbDesc, NULL);
+  BufferLoadDesc ibDesc = {};
+  ibDesc.mDesc.mDescriptors =
+      DESCRIPTOR_TYPE_INDEX_BUFFER | DESCRIPTOR_TYPE_BUFFER;
+  ibDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+  ibDesc.mDesc.mStartState = kBufferStates[1];
+  ibDesc.mDesc.pName = "GeometryPoolIndices";
+  ibDesc.mDesc.mSize =
+      max((uint64_t)indexCapacity * sizeof(uint32_t), (uint64_t)1);
+  ibDesc.mDesc.mElementCount =
+      (uint32_t)(ibDesc.mDesc.mSize / sizeof(uint32_t));
+  ibDesc.mDesc.mStructStride = sizeof(uint32_t);
+  ibDesc.ppBuffer = &pIndexBuffer;
+  addResource(&ibDesc, NULL);
+  BufferLoadDesc mbDesc = {};
+  mbDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+  mbDesc.mDesc.mStartState = mMoveBufferState;
+  mbDesc.mDesc.pName = "GeometryPoolMoves";
+  mbDesc.mDesc.mSize = kMaxMoveBytes * 2;
+  mbDesc.ppBuffer = &pMoveBuffer;
+  addResource(&mbDesc, NULL);
+  Buffer *pBuffers[] = {pVertexBuffer, pIndexBuffer, pMoveBuffer};
+  for (uint32_t i = 0; i < TF_ARRAY_COUNT(pBuffers); ++i) {
+    MemoryTrack(kMemoryCategoryGeometryPool, kMemoryKindGpu,
+                pBuffers[i]->mSize);
+  }
+
+  const double kMB = 1024.0 * 1024.0;
+  LOGF(eINFO,
+       "Geometry pool: %.1f MB of vertices, %.1f MB of indices, up to %u "
+       "allocations",
+       pVertexBuffer->mSize / kMB, pIndexBuffer->mSize / kMB,
+       desc.mMaxAllocationCount);
+  return true;
+}
+
+void GeometryPool::Exit() {
+  arrfree(pRetiredRanges);
+  Buffer *pBuffers[] = {pVertexBuffer, pIndexBuffer, pMoveBuffer};
+  for (uint32_t i = 0; i < TF_ARRAY_COUNT(pBuffers); ++i) {
+    MemoryUntrack(kMemoryCategoryGeometryPool, kMemoryKindGpu,
+                  pBuffers[i]->mSize);
+    removeResource(pBuffers[i]);
+  }
+  MemoryUntrack(kMemoryCategoryGeometryPool, kMemoryKindCpu,
+                mVertexAllocator.GetSizeBytes() +
+                    mIndexAllocator.GetSizeBytes());
+  mVertexAllocator.Destroy();
+  mIndexAllocator.Destroy();
+  MemoryFree(pAllocations);
+  MemoryFree(pFreeAllocations);
+  MemoryFree(pMovableHeaps[0]);
+  MemoryFree(pMovableHeaps[1]);
+  exitMutex(&mMutex);
+  *this = GeometryPool();
+}
+
+uint32_t GeometryPool::Allocate(uint32_t vertexCount, uint32_t indexCount) {
+  acquireMutex(&mMutex);
+  uint32_t allocation = kNoAllocation;
+  OffsetAllocation vertices = {OffsetAllocator::kInvalidOffset, 0};
+  OffsetAllocation indices = {OffsetAllocator::kInvalidOffset, 0};
+  if (mFreeAllocationCount > 0) {
+    vertices = mVertexAllocator.Allocate(max(vertexCount, 1u));
+  }
+  if (vertices.mOffset != OffsetAllocator::kInvalidOffset) {
+    indices = mIndexAllocator.Allocate(max(indexCount, 1u));
+    if (indices.mOffset == OffsetAllocator::kInvalidOffset) {
+      mVertexAllocator.Free(vertices);
+    }
+  }
+  if (indices.mOffset != OffsetAllocator::kInvalidOffset) {
+    allocation = pFreeAllocations[--mFreeAllocationCount];
+    pAllocations[allocation] = {vertices,
+                                indices,
+                                vertices.mOffset,
+                                indices.mOffset,
+                                true,
+                                false,
+                                {kNotMovable, kNotMovable}};
+  }
+  releaseMutex(&mMutex);
+  return allocation;
+}
+
+void GeometryPool::Free(uint32_t allocation, uint64_t submission) {
+  if (allocation == kNoAllocation) {
+    return;
+  }
+  acquireMutex(&mMutex);
+  RemoveMovable(0, allocation);
+  RemoveMovable(1, allocation);
+  Allocation &freed = pAllocations[allocation];
+  RetiredRange vertices = {freed.mVertices, false, submission};
+  RetiredRange indices = {freed.mIndices, true, submission};
+  arrpush(pRetiredRanges, vertices);
+  arrpush(pRetiredRanges, indices);
+  freed = {};
+  pFreeAllocations[mFreeAllocationCount++] = allocation;
+  releaseMutex(&mMutex);
+}
+
+void GeometryPool::SetMovable(uint32_t allocation) {
+  if (allocation == kNoAllocation) {
+    return;
+  }
+  acquireMutex(&mMutex);
+  Allocation &movable = pAllocations[allocation];
+  if (!movable.mMovable) {
+    movable.mMovable = true;
+    // Sizes don't change, so larger allocations never become candidates.
+    if (mVertexAllocator.GetAllocationSize(movable.mVertices) *
+            (uint64_t)mVertexStride <=
+        kMaxMoveBytes) {
+      PushMovable(0, allocation);
+    }
+    if (mIndexAllocator.GetAllocationSize(movable.mIndices) *
+            sizeof(uint32_t) <=
+        kMaxMoveBytes) {
+      PushMovable(1, allocation);
+    }
+  }
+  releaseMutex(&mMutex);
+}
+
+void GeometryPool::SetHeapSlot(uint32_t buffer, uint32_t slot,
+                               uint32_t allocation) {
+  pMovableHeaps[buffer][slot] = allocation;
+  pAllocations[allocation].mHeapSlots[buffer] = slot;
+}
+
+void GeometryPool::SiftUp(uint32_t buffer, uint32_t slot) {
+  uint32_t *pHeap = pMovableHeaps[buffer];
+  uint32_t allocation = pHeap[slot];
+  uint32_t offset = GetOffset(allocation, buffer);
+  while (slot > 0) {
+    uint32_t parent = (slot - 1) / 2;
+    if (GetOffset(pHeap[parent], buffer) >= offset) {
+      break;
+    }
+    SetHeapSlot(buffer, slot, pHeap[parent]);
+    slot = parent;
+  }
+  SetHeapSlot(buffer, slot, allocation);
+}
+
+void GeometryPool::SiftDown(uint32_t buffer, uint32_t slot) {
+  uint32_t *pHeap = pMovableHeaps[buffer];
+  uint32_t count = mMovableCounts[buffer];
+  uint32_t allocation = pHeap[slot];
+  uint32_t offset = GetOffset(allocation, buffer);
+  for (;;) {
+    uint32_t child = slot * 2 + 1;
+    if (child >= count) {
+      break;
+    }
+    if (child + 1 < count && GetOffset(pHeap[child + 1], buffer) >
+                                 GetOffset(pHeap[child], buffer)) {
+      ++child;
+    }
+    if (GetOffset(pHeap[child], buffer) <= offset) {
+      break;
+    }
+    SetHeapSlot(buffer, slot, pHeap[child]);
+    slot = child;
+  }
+  SetHeapSlot(buffer, slot, allocation);
+}
+
+void GeometryPool::PushMovable(uint32_t buffer, uint32_t allocation) {
+  uint32_t slot = mMovableCounts[buffer]++;
+  SetHeapSlot(buffer, slot, allocation);
+  SiftUp(buffer, slot);
+}
+
+void GeometryPool::RemoveMovable(uint32_t buffer, uint32_t allocation) {
+  uint32_t slot = pAllocations[allocation].mHeapSlots[buffer];
+  if (slot == kNotMovable) {
+    return;
+  }
+  pAllocations[allocation].mHeapSlots[buffer] = kNotMovable;
+  uint32_t last = --mMovableCounts[buffer];
+  if (slot == last) {
+    return;
+  }
+  // The last entry takes the removed one's place, then moves whichever way
+  // its offset requires.
+  uint32_t moved = pMovableHeaps[buffer][last];
+  SetHeapSlot(buffer, slot, moved);
+  SiftUp(buffer, slot);
+  SiftDown(buffer, pAllocations[moved].mHeapSlots[buffer]);
+}
+
+uint64_t GeometryPool::GetAllocationBytes(uint32_t allocation) const {
+  if (allocation == kNoAllocation) {
+    return 0;
+  }
+  const Allocation &live = pAllocations[allocation];
+  return (uint64_t)mVertexAllocator.GetAllocationSize(live.mVertices) *
+             mVertexStride +
+         (uint64_t)mIndexAllocator.GetAllocationSize(live.mIndices) *
+             sizeof(uint32_t);
+}
+
+void GeometryPool::Update(uint64_t completedSubmission) {
+  acquireMutex(&mMutex);
+  for (ptrdiff_t i = arrlen(pRetiredRanges) - 1; i >= 0; --i) {
+    const RetiredRange &retired = pRetiredRanges[i];
+    if (retired.mSubmission > completedSubmission) {
+      continue;
+    }
+    if (retired.mIndices) {
+      mIndexAllocator.Free(retired.mRange);
+    } else {
+      mVertexAllocator.Free(retired.mRange);
+    }
+    mCompactionBlocked[retired.mIndices ? 1 : 0] = false;
+    arrdelswap(pRetiredRanges, i);
+  }
+  releaseMutex(&mMutex);
+}
+
+bool GeometryPool::PlanMove(bool indices, uint64_t submission, Move &move) {
+  OffsetAllocator &allocator = indices ? mIndexAllocator : mVertexAllocator;
+  uint32_t buffer = indices ? 1 : 0;
+  uint32_t stranded = allocator.GetFreeSize() - allocator.GetLargestFreeSize();
+  if (mCompactionBlocked[buffer] ||
+      stranded <= allocator.GetSize() >> kMinFragmentationShift) {
+    return false;
+  }
+  uint64_t elementBytes = indices ? sizeof(uint32_t) : mVertexStride;
+  if (mMovableCounts[buffer] == 0) {
+    mCompactionBlocked[buffer] = true;
+    return false;
+  }
+
+  uint32_t highest = pMovableHeaps[buffer][0];
+  Allocation &moved = pAllocations[highest];
+  OffsetAllocation &range = indices ? moved.mIndices : moved.mVertices;
+  uint32_t size = allocator.GetAllocationSize(range);
+  OffsetAllocation target = allocator.Allocate(size);
+  if (target.mOffset == OffsetAllocator::kInvalidOffset ||
+      target.mOffset > range.mOffset) {
+    if (target.mOffset != OffsetAllocator::kInvalidOffset) {
+      allocator.Free(target);
+    }
+    mCompactionBlocked[buffer] = true;
+    return false;
+  }
+  move.mSrcOffset = range.mOffset * elementBytes;
+  move.mDstOffset = target.mOffset * elementBytes;
+  move.mSize = size * elementBytes;
+  // Frames in flight, and this frame's copy, still read the previous range.
+  RetiredRange retired = {range, indices, submission};
+  arrpush(pRetiredRanges, retired);
+  range = target;
+  if (indices) {
+    moved.mFirstIndex = target.mOffset;
+  } else {
+    moved.mFirstVertex = target.mOffset;
+  }
+  SiftDown(buffer, 0);
+  mMovedBytes += move.mSize;
+  mMoveCount++;
+  return true;
+}
+
+void GeometryPool::Compact(Cmd *pCmd, uint64_t submission) {
+  Move moves[2];
+  bool planned[2];
+  acquireMutex(&mMutex);
+  planned[0] = PlanMove(false, submission, moves[0]);
+  planned[1] = PlanMove(true, submission, moves[1]);
+  releaseMutex(&mMutex);
+  if (!planned[0] && !planned[1]) {
+    return;
+  }
+
+  // Through the move buffer: out of the pool, then back in.
+  Buffer *pBuffers[2] = {pVertexBuffer, pIndexBuffer};
+  BufferBarrier barriers[3];
+  uint32_t barrierCount = 0;
+  for (uint32_t i = 0; i < 2; ++i) {
+    if (planned[i]) {
+      barriers[barrierCount++] = {pBuffers[i], kBufferStates[i],
+                                  RESOURCE_STATE_COPY_SOURCE};
+    }
+  }
+  if (mMoveBufferState != RESOURCE_STATE_COPY_DEST) {
+    barriers[barrierCount++] = {pMoveBuffer, mMoveBufferState,
+                                RESOURCE_STATE_COPY_DEST};
+  }
+  cmdResourceBarrier(pCmd, barrierCount, barriers, 0, NULL, 0, NULL);
+  for (uint32_t i = 0; i < 2; ++i) {
+    if (planned[i]) {
+      cmdUpdateBuffer(pCmd, pMoveBuffer, i * kMaxMoveBytes, pBuffers[i],
+                      moves[i].mSrcOffset, moves[i].mSize);
+    }
+  }
+
+  barrierCount = 0;
+  for (uint32_t i = 0; i < 2; ++i) {
+    if (planned[i]) {
+      barriers[barrierCount++] = {pBuffers[i], RESOURCE_STATE_COPY_SOURCE,
+                                  RESOURCE_STATE_COPY_DEST};
+    }
+  }
+  barriers[barrierCount++] = {pMoveBuffer, RESOURCE_STATE_COPY_DEST,
+                              RESOURCE_STATE_COPY_SOURCE};
+  mMoveBufferState = RESOURCE_STATE_COPY_SOURCE;
+  cmdResourceBarrier(pCmd, barrierCount, barriers, 0, NULL, 0, NULL);
+  for (uint32_t i = 0; i < 2; ++i) {
+    if (planned[i]) {
+      cmdUpdateBuffer(pCmd, pBuffers[i], moves[i].mDstOffset, pMoveBuffer,
+                      i * kMaxMoveBytes, moves[i].mSize);
+    }
+  }
+
+  barrierCount = 0;
+  for (uint32_t i = 0; i < 2; ++i) {
+    if (planned[i]) {
+      barriers[barrierCount++] = {pBuffers[i], RESOURCE_STATE_COPY_DEST,
+                                  kBufferStates[i]};
+    }
+  }
+  cmdResourceBarrier(pCmd, barrierCount, barriers, 0, NULL, 0, NULL);
+}
+
+GeometryPoolStats GeometryPool::GetStats() const {
+  acquireMutex(&mMutex);
+  GeometryPoolStats stats = {};
+  stats.mAllocationCount = mAllocationCapacity - 1 - mFreeAllocationCount;
+  stats.mUsedVertexBytes =
+      (uint64_t)(mVertexAllocator.GetSize() - mVertexAllocator.GetFreeSize()) *
+      mVertexStride;
+  stats.mUsedIndexBytes =
+      (uint64_t)(mIndexAllocator.GetSize() - mIndexAllocator.GetFreeSize()) *
+      sizeof(uint32_t);
+  stats.mFragmentedVertexBytes =
+      (uint64_t)(mVertexAllocator.GetFreeSize() -
+                 mVertexAllocator.GetLargestFreeSize()) *
+      mVertexStride;
+  stats.mFragmentedIndexBytes =
+      (uint64_t)(mIndexAllocator.GetFreeSize() -
+                 mIndexAllocator.GetLargestFreeSize()) *
+      sizeof(uint32_t);
+  stats.mMovedBytes = mMovedBytes;
+  stats.mMoveCount = mMoveCount;
+  releaseMutex(&mMutex);
+  return stats;
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include "Graphics/Interfaces/IGraphics.h"
+#include "Utilities/Interfaces/IThread.h"
+
+#include "MemoryAccounting.hpp"
+#include "OffsetAllocator.hpp"
+
+struct GeometryPoolDesc {
+  uint32_t mVertexStride;
+  uint64_t mVertexBytes;
+  uint64_t mIndexBytes;
+  uint32_t mMaxAllocationCount;
+};
+
+struct GeometryPoolStats {
+  uint32_t mAllocationCount;
+  uint64_t mUsedVertexBytes;
+  uint64_t mUsedIndexBytes;
+  /// Free bytes outside of each buffer's largest free region.
+  uint64_t mFragmentedVertexBytes;
+  uint64_t mFragmentedIndexBytes;
+  uint64_t mMovedBytes;
+  uint32_t mMoveCount;
+};
+
+/// \c GeometryPool holds the vertices and 32-bit indices of every scene in
+/// one vertex and one index buffer, so that they're bound once and drawn
+/// with base vertex and index offsets. Each allocation is a range of both
+/// buffers, handed out by an \c OffsetAllocator.
+///
+/// Freed ranges are only reused once every frame that may draw them has
+/// completed. \c Compact moves the allocations that end up highest in a
+/// fragmented buffer into lower free regions, one small allocation per
+/// buffer and frame, with GPU copies recorded ahead of the frame's draws.
+/// Offsets are therefore only stable within a frame; they must be read
+/// through \c GetFirstVertex and \c GetFirstIndex while recording it.
+class GeometryPool {
+public:
+  /// Allocation 0 stands for geometry held in dedicated buffers, whose
+  /// offsets are zero, so that zeroed submeshes refer to no allocation.
+  static const uint32_t kNoAllocation = 0;
+  /// Larger allocations are never moved.
+  static const uint64_t kMaxMoveBytes = 4 * 1024 * 1024;
+
+  bool Init(const GeometryPoolDesc &desc);
+  /// The GPU must be idle.
+  void Exit();
+
+  /// Returns \c kNoAllocation if either buffer is out of space. New
+  /// allocations can't be moved until \c SetMovable. Thread-safe, like
+  /// \c Free.
+  uint32_t Allocate(uint32_t vertexCount, uint32_t indexCount);
+  /// Releases the allocation's ranges once \c submission has completed.
+  /// \c kNoAllocation is ignored.
+  void Free(uint32_t allocation, uint64_t submission);
+  /// Lets \c Compact move the allocation. Must be called from the main
+  /// thread, after every write to the allocation was issued: updates issued
+  /// before a frame is recorded are flushed ahead of its copies.
+  void SetMovable(uint32_t allocation);
+
+  inline uint32_t GetFirstVertex(uint32_t allocation) const {
+    return pAllocations[allocation].mFirstVertex;
+  }
+  inline uint32_t GetFirstIndex(uint32_t allocation) const {
+    return pAllocations[allocation].mFirstIndex;
+  }
+  uint64_t GetAllocationBytes(uint32_t allocation) const;
+
+  inline uint32_t GetVertexStride() const { return mVertexStride; }
+  inline Buffer *const *GetVertexBuffers() const { return &pVertexBuffer; }
+  inline Buffer *GetIndexBuffer() const { return pIndexBuffer; }
+
+  /// Releases the ranges whose submission has completed. Main thread only,
+  /// like \c Compact.
+  void Update(uint64_t completedSubmission);
+  /// Records the moves of this frame, if the buffers are fragmented. Must be
+  /// called before anything drawn from the pool is recorded into \c pCmd,
+  /// and outside of any render pass. \c submission is the frame's.
+  void Compact(Cmd *pCmd, uint64_t submission);
+
+  GeometryPoolStats GetStats() const;
+
+private:
+  struct Allocation {
+    OffsetAllocation mVertices;
+    OffsetAllocation mIndices;
+    /// Mirror the ranges' offsets for the draw loops.
+    uint32_t mFirstVertex;
+    uint32_t mFirstIndex;
+    bool mLive;
+    bool mMovable;
+    /// Positions in \c pMovableHeaps, or \c kNotMovable.
+    uint32_t mHeapSlots[2];
+  };
+  /// A range of the vertex or the index buffer, free once \c mSubmission has
+  /// completed.
+  struct RetiredRange {
+    OffsetAllocation mRange;
+    bool mIndices;
+    uint64_t mSubmission;
+  };
+  /// In bytes.
+  struct Move {
+    uint64_t mSrcOffset;
+    uint64_t mDstOffset;
+    uint64_t mSize;
+  };
+
+  static const uint32_t kNotMovable = ~0u;
+
+  /// Moves the highest movable allocation of a buffer into a lower region,
+  /// if it's fragmented, retiring the allocation's previous range.
+  bool PlanMove(bool indices, uint64_t submission, Move &move);
+
+  inline uint32_t GetOffset(uint32_t allocation, uint32_t buffer) const {
+    return buffer ? pAllocations[allocation].mIndices.mOffset
+                  : pAllocations[allocation].mVertices.mOffset;
+  }
+  void PushMovable(uint32_t buffer, uint32_t allocation);
+  void RemoveMovable(uint32_t buffer, uint32_t allocation);
+  void SiftUp(uint32_t buffer, uint32_t slot);
+  void SiftDown(uint32_t buffer, uint32_t slot);
+  void SetHeapSlot(uint32_t buffer, uint32_t slot, uint32_t allocation);
+
+  mutable Mutex mMutex;
+  uint32_t mVertexStride = 0;
+  Buffer *pVertexBuffer = NULL;
+  Buffer *pIndexBuffer = NULL;
+  /// Moves go through it, as a buffer can't be both a copy's source and
+  /// destination. The vertex move uses its first half, the index move the
+  /// other.
+  Buffer *pMoveBuffer = NULL;
+  ResourceState mMoveBufferState = RESOURCE_STATE_COPY_DEST;
+
+  OffsetAllocator mVertexAllocator;
+  OffsetAllocator mIndexAllocator;
+  Allocation *pAllocations = NULL;
+  uint32_t mAllocationCapacity = 0;
+  uint32_t *pFreeAllocations = NULL;
+  uint32_t mFreeAllocationCount = 0;
+  /// Per buffer, the movable allocations small enough to move, in a max-heap
+  /// on their offset in that buffer, so that the highest is found at once.
+  uint32_t *pMovableHeaps[2] = {};
+  uint32_t mMovableCounts[2] = {};
+  // stb_ds array.
+  RetiredRange *pRetiredRanges = NULL;
+  /// Set once a buffer's highest movable allocation found no lower region,
+  /// and cleared whenever ranges are released.
+  bool mCompactionBlocked[2] = {};
+
+  uint64_t mMovedBytes = 0;
+  uint32_t mMoveCount = 0;
+};
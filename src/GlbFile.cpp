@@ -0,0 +1,757 @@
+#include "GlbFile.hpp"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "Utilities/Interfaces/ILog.h"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+static const uint32_t kGlbMagic = 0x46546C67;
+static const uint32_t kGlbVersion = 2;
+static const uint32_t kGlbJsonChunk = 0x4E4F534A;
+static const uint32_t kGlbBinChunk = 0x004E4942;
+static const uint32_t kGlbHeaderSize = 12;
+static const uint32_t kGlbChunkHeaderSize = 8;
+static const uint32_t kGlbTriangles = 4;
+static const uint32_t kJsonMaxDepth = 64;
+
+enum JsonType : uint8_t { kJsonObject, kJsonArray, kJsonString, kJsonValue };
+
+/// Values follow their parent, objects alternating keys and values. String
+/// tokens span the characters between their quotes.
+struct JsonToken {
+  JsonType mType;
+  uint32_t mStart;
+  uint32_t mEnd;
+  /// Members or elements.
+  uint32_t mSize;
+  /// First token after the value's children.
+  uint32_t mNext;
+};
+
+struct JsonParser {
+  const char *pJson;
+  uint32_t mPosition;
+  JsonToken *pTokens;
+  uint32_t mTokenCount;
+  uint32_t mTokenCapacity;
+};
+
+static uint32_t PushToken(JsonParser &parser, JsonType type) {
+  if (parser.mTokenCount == parser.mTokenCapacity) {
+    parser.mTokenCapacity = max(parser.mTokenCapacity * 2, 256u);
+    parser.pTokens = reinterpret_cast<JsonToken *>(tf_realloc(
+        parser.pTokens, parser.mTokenCapacity * sizeof(JsonToken)));
+  }
+  uint32_t token = parser.mTokenCount++;
+  parser.pTokens[token] = {type, parser.mPosition, parser.mPosition, 0, 0};
+  return token;
+}
+
+static void SkipWhitespace(JsonParser &parser) {
+  for (;;) {
+    char c = parser.pJson[parser.mPosition];
+    if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+      return;
+    }
+    parser.mPosition++;
+  }
+}
+
+/// Escapes are skipped, not decoded: the keys and values read never hold
+/// any.
+static bool ParseString(JsonParser &parser) {
+  if (parser.pJson[parser.mPosition] != '"') {
+    return false;
+  }
+  parser.mPosition++;
+  uint32_t token = PushToken(parser, kJsonString);
+  for (;;) {
+    char c = parser.pJson[parser.mPosition];
+    if (c == '\0') {
+      return false;
+    }
+    if (c == '"') {
+      break;
+    }
+    parser.mPosition += c == '\\' && parser.pJson[parser.mPosition + 1] ? 2 : 1;
+  }
+  parser.pTokens[token].mEnd = parser.mPosition++;
+  parser.pTokens[token].mNext = parser.mTokenCount;
+  return true;
+}
+
+static bool ParseValue(JsonParser &parser, uint32_t depth) {
+  SkipWhitespace(parser);
+  char c = parser.pJson[parser.mPosition];
+  if (c == '"') {
+    return ParseString(parser);
+  }
+  if (c != '{' && c != '[') {
+    uint32_t token = PushToken(parser, kJsonValue);
+    while (c != '\0' && c != ',' && c != ']' && c != '}' && c != ' ' &&
+           c != '\t' && c != '\n' && c != '\r') {
+      c = parser.pJson[++parser.mPosition];
+    }
+    parser.pTokens[token].mEnd = parser.mPosition;
+    parser.pTokens[token].mNext = parser.mTokenCount;
+    return parser.pTokens[token].mEnd > parser.pTokens[token].mStart;
+  }
+  if (depth == kJsonMaxDepth) {
+    return false;
+  }
+  bool object = c == '{';
+  char close = object ? '}' : ']';
+  uint32_t token = PushToken(parser, object ? kJsonObject : kJsonArray);
+  parser.mPosition++;
+  SkipWhitespace(parser);
+  uint32_t size = 0;
+  if (parser.pJson[parser.mPosition] == close) {
+    parser.mPosition++;
+  } else {
+    for (;;) {
+      if (object) {
+        SkipWhitespace(parser);
+        if (!ParseString(parser)) {
+          return false;
+        }
+        SkipWhitespace(parser);
+        if (parser.pJson[parser.mPosition++] != ':') {
+          return false;
+        }
+      }
+      if (!ParseValue(parser, depth + 1)) {
+        return false;
+      }
+      size++;
+      SkipWhitespace(parser);
+      c = parser.pJson[parser.mPosition++];
+      if (c == close) {
+        break;
+      }
+      if (c != ',') {
+        return false;
+      }
+    }
+  }
+  parser.pTokens[token].mEnd = parser.mPosition;
+  parser.pTokens[token].mSize = size;
+  parser.pTokens[token].mNext = parser.mTokenCount;
+  return true;
+}
+
+/// Read-only view of a parsed document. Token indices are signed so that -1
+/// can stand for missing members.
+struct JsonDocument {
+  const char *pJson;
+  const JsonToken *pTokens;
+};
+
+static bool JsonEquals(const JsonDocument &doc, int32_t token,
+                       const char *pString) {
+  if (token < 0) {
+    return false;
+  }
+  const JsonToken &t = doc.pTokens[token];
+  size_t length = strlen(pString);
+  return t.mEnd - t.mStart == length &&
+         memcmp(doc.pJson + t.mStart, pString, length) == 0;
+}
+
+static int32_t FindMember(const JsonDocument &doc, int32_t object,
+                          const char *pKey) {
+  if (object < 0 || doc.pTokens[object].mType != kJsonObject) {
+    return -1;
+  }
+  uint32_t key = (uint32_t)object + 1;
+  for (uint32_t i = 0; i < doc.pTokens[object].mSize; ++i) {
+    if (JsonEquals(doc, (int32_t)key, pKey)) {
+      return (int32_t)key + 1;
+    }
+    key = doc.pTokens[key + 1].mNext;
+  }
+  return -1;
+}
+
+/// Number of elements of an array, zero for anything else.
+static uint32_t GetArraySize(const JsonDocument &doc, int32_t array) {
+  return array >= 0 && doc.pTokens[array].mType == kJsonArray
+             ? doc.pTokens[array].mSize
+             : 0;
+}
+
+static int32_t GetFirstElement(int32_t array) { return array + 1; }
+static int32_t GetNextElement(const JsonDocument &doc, int32_t element) {
+  return (int32_t)doc.pTokens[element].mNext;
+}
+
+static double GetNumber(const JsonDocument &doc, int32_t token,
+                        double fallback) {
+  if (token < 0 || doc.pTokens[token].mType != kJsonValue) {
+    return fallback;
+  }
+  // The JSON is terminated, and numbers end before any delimiter.
+  return strtod(doc.pJson + doc.pTokens[token].mStart, NULL);
+}
+
+static double GetMemberNumber(const JsonDocument &doc, int32_t object,
+                              const char *pKey, double fallback) {
+  return GetNumber(doc, FindMember(doc, object, pKey), fallback);
+}
+
+/// Indices and counts: -1 if missing or out of the \c int32_t range.
+static int32_t GetMemberIndex(const JsonDocument &doc, int32_t object,
+                              const char *pKey) {
+  double value = GetMemberNumber(doc, object, pKey, -1.0);
+  return value >= 0.0 && value <= 2147483647.0 ? (int32_t)value : -1;
+}
+
+static bool GetMemberBool(const JsonDocument &doc, int32_t object,
+                          const char *pKey) {
+  return JsonEquals(doc, FindMember(doc, object, pKey), "true");
+}
+
+/// Leaves \c pDst untouched if the member isn't an array of \c count.
+static void GetMemberFloats(const JsonDocument &doc, int32_t object,
+                            const char *pKey, uint32_t count, float *pDst) {
+  int32_t array = FindMember(doc, object, pKey);
+  if (GetArraySize(doc, array) != count) {
+    return;
+  }
+  int32_t element = GetFirstElement(array);
+  for (uint32_t i = 0; i < count; ++i) {
+    pDst[i] = (float)GetNumber(doc, element, pDst[i]);
+    element = GetNextElement(doc, element);
+  }
+}
+
+static uint32_t GetComponentSize(uint32_t componentType) {
+  switch (componentType) {
+  case kGlbByte:
+  case kGlbUnsignedByte:
+    return 1;
+  case kGlbShort:
+  case kGlbUnsignedShort:
+    return 2;
+  case kGlbUnsignedInt:
+  case kGlbFloat:
+    return 4;
+  default:
+    return 0;
+  }
+}
+
+static inline uint32_t Read32(const uint8_t *p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+/// Image index of a texture reference such as \c normalTexture, -1 if
+/// missing.
+static int32_t GetTextureImage(const JsonDocument &doc, int32_t info,
+                               const int32_t *pTextureImages,
+                               uint32_t textureCount) {
+  int32_t texture = GetMemberIndex(doc, info, "index");
+  return texture >= 0 && (uint32_t)texture < textureCount
+             ? pTextureImages[texture]
+             : -1;
+}
+
+bool GlbFile::Parse(const uint8_t *pData, size_t size) {
+  Destroy();
+  if (size < kGlbHeaderSize + kGlbChunkHeaderSize ||
+      Read32(pData) != kGlbMagic || Read32(pData + 4) != kGlbVersion) {
+    LOGF(eERROR, "Not a binary glTF 2.0 file");
+    return false;
+  }
+  uint64_t fileLength = min((uint64_t)Read32(pData + 8), (uint64_t)size);
+  uint64_t jsonLength = Read32(pData + kGlbHeaderSize);
+  uint64_t jsonOffset = kGlbHeaderSize + kGlbChunkHeaderSize;
+  if (Read32(pData + kGlbHeaderSize + 4) != kGlbJsonChunk ||
+      jsonOffset + jsonLength > fileLength) {
+    LOGF(eERROR, "Invalid JSON chunk");
+    return false;
+  }
+  const uint8_t *pBin = NULL;
+  uint64_t binLength = 0;
+  uint64_t binOffset = jsonOffset + ((jsonLength + 3) & ~3ull);
+  if (binOffset + kGlbChunkHeaderSize <= fileLength &&
+      Read32(pData + binOffset + 4) == kGlbBinChunk) {
+    pBin = pData + binOffset + kGlbChunkHeaderSize;
+    binLength = min((uint64_t)Read32(pData + binOffset),
+                    fileLength - binOffset - kGlbChunkHeaderSize);
+  }
+
+  pJson = reinterpret_cast<char *>(tf_malloc(jsonLength + 1));
+  memcpy(pJson, pData + jsonOffset, jsonLength);
+  pJson[jsonLength] = '\0';
+  JsonParser parser = {pJson, 0, NULL, 0, 0};
+  bool parsed = ParseValue(parser, 0);
+  SkipWhitespace(parser);
+  if (!parsed || parser.pTokens[0].mType != kJsonObject ||
+      pJson[parser.mPosition] != '\0') {
+    LOGF(eERROR, "Invalid JSON near byte %u", parser.mPosition);
+    tf_free(parser.pTokens);
+    Destroy();
+    return false;
+  }
+  JsonDocument doc = {pJson, parser.pTokens};
+  const int32_t root = 0;
+
+  int32_t required = FindMember(doc, root, "extensionsRequired");
+  int32_t extension = GetFirstElement(required);
+  for (uint32_t i = 0; i < GetArraySize(doc, required); ++i) {
+    if (!JsonEquals(doc, extension, "KHR_mesh_quantization") &&
+        !JsonEquals(doc, extension, "EXT_meshopt_compression")) {
+      const JsonToken &t = doc.pTokens[extension];
+      LOGF(eWARNING, "Unsupported required extension %.*s",
+           (int)(t.mEnd - t.mStart), pJson + t.mStart);
+    }
+    extension = GetNextElement(doc, extension);
+  }
+
+  // Only the binary chunk is loaded: it's the first buffer, if it has no
+  // URI. Fallback buffers of compressed views have no data either.
+  int32_t buffers = FindMember(doc, root, "buffers");
+  uint32_t bufferCount = GetArraySize(doc, buffers);
+  int32_t firstBuffer = GetFirstElement(buffers);
+  bool binBuffer = bufferCount > 0 && pBin &&
+                   FindMember(doc, firstBuffer, "uri") < 0 &&
+                   GetMemberNumber(doc, firstBuffer, "byteLength", 0.0) <=
+                       (double)binLength;
+
+  bool valid = true;
+  int32_t views = FindMember(doc, root, "bufferViews");
+  mBufferViewCount = GetArraySize(doc, views);
+  pBufferViews = reinterpret_cast<GlbBufferView *>(
+      tf_calloc(max(mBufferViewCount, 1u), sizeof(GlbBufferView)));
+  int32_t view = GetFirstElement(views);
+  for (uint32_t i = 0; i < mBufferViewCount && valid; ++i) {
+    GlbBufferView &v = pBufferViews[i];
+    int32_t buffer = GetMemberIndex(doc, view, "buffer");
+    double offset = GetMemberNumber(doc, view, "byteOffset", 0.0);
+    double length = GetMemberNumber(doc, view, "byteLength", 0.0);
+    v.mLength = (uint64_t)length;
+    v.mStride = (uint32_t)GetMemberIndex(doc, view, "byteStride");
+    v.mStride = v.mStride == ~0u ? 0 : v.mStride;
+    if (buffer == 0 && binBuffer) {
+      valid = offset >= 0.0 && offset + length <= (double)binLength;
+      v.pData = pBin + (uint64_t)offset;
+    }
+
+    int32_t meshopt = FindMember(
+        doc, FindMember(doc, view, "extensions"), "EXT_meshopt_compression");
+    if (meshopt >= 0 && valid) {
+      int32_t mode = FindMember(doc, meshopt, "mode");
+      int32_t filter = FindMember(doc, meshopt, "filter");
+      v.mMeshoptMode =
+          JsonEquals(doc, mode, "ATTRIBUTES")  ? GlbMeshoptMode::Attributes
+          : JsonEquals(doc, mode, "TRIANGLES") ? GlbMeshoptMode::Triangles
+          : JsonEquals(doc, mode, "INDICES")   ? GlbMeshoptMode::Indices
+                                               : GlbMeshoptMode::None;
+      v.mMeshoptFilter =
+          JsonEquals(doc, filter, "OCTAHEDRAL") ? GlbMeshoptFilter::Octahedral
+          : JsonEquals(doc, filter, "QUATERNION")
+              ? GlbMeshoptFilter::Quaternion
+          : JsonEquals(doc, filter, "EXPONENTIAL")
+              ? GlbMeshoptFilter::Exponential
+              : GlbMeshoptFilter::None;
+      int32_t source = GetMemberIndex(doc, meshopt, "buffer");
+      double sourceOffset = GetMemberNumber(doc, meshopt, "byteOffset", 0.0);
+      double sourceLength = GetMemberNumber(doc, meshopt, "byteLength", 0.0);
+      v.mMeshoptCount = (uint32_t)GetMemberIndex(doc, meshopt, "count");
+      v.mMeshoptStride = (uint32_t)GetMemberIndex(doc, meshopt, "byteStride");
+      valid = v.mMeshoptMode != GlbMeshoptMode::None && source == 0 &&
+              binBuffer && v.mMeshoptCount != ~0u &&
+              v.mMeshoptStride != ~0u && sourceOffset >= 0.0 &&
+              sourceOffset + sourceLength <= (double)binLength &&
+              (double)v.mMeshoptCount * v.mMeshoptStride <= length;
+      v.pMeshoptData = pBin + (uint64_t)sourceOffset;
+      v.mMeshoptLength = (uint64_t)sourceLength;
+      v.pData = NULL;
+    }
+    if (!valid) {
+      LOGF(eERROR, "Buffer view %u is out of its buffer's bounds", i);
+    }
+    view = GetNextElement(doc, view);
+  }
+
+  int32_t accessors = FindMember(doc, root, "accessors");
+  mAccessorCount = GetArraySize(doc, accessors);
+  pAccessors = reinterpret_cast<GlbAccessor *>(
+      tf_calloc(max(mAccessorCount, 1u), sizeof(GlbAccessor)));
+  int32_t accessor = GetFirstElement(accessors);
+  for (uint32_t i = 0; i < mAccessorCount && valid; ++i) {
+    GlbAccessor &a = pAccessors[i];
+    a.mBufferView = GetMemberIndex(doc, accessor, "bufferView");
+    a.mOffset = (uint64_t)GetMemberNumber(doc, accessor, "byteOffset", 0.0);
+    a.mComponentType =
+        (uint32_t)GetMemberNumber(doc, accessor, "componentType", 0.0);
+    int32_t type = FindMember(doc, accessor, "type");
+    a.mComponentCount = JsonEquals(doc, type, "SCALAR") ? 1
+                        : JsonEquals(doc, type, "VEC2") ? 2
+                        : JsonEquals(doc, type, "VEC3") ? 3
+                        : JsonEquals(doc, type, "VEC4") ? 4
+                                                        : 0;
+    a.mCount = (uint32_t)max(GetMemberIndex(doc, accessor, "count"), 0);
+    a.mNormalized = GetMemberBool(doc, accessor, "normalized");
+    a.mSparse = FindMember(doc, accessor, "sparse") >= 0;
+    valid = a.mBufferView < (int32_t)mBufferViewCount;
+    if (!valid) {
+      LOGF(eERROR, "Accessor %u refers to a missing buffer view", i);
+    }
+    accessor = GetNextElement(doc, accessor);
+  }
+
+  int32_t meshes = FindMember(doc, root, "meshes");
+  mMeshCount = GetArraySize(doc, meshes);
+  pMeshes = reinterpret_cast<GlbMesh *>(
+      tf_calloc(max(mMeshCount, 1u), sizeof(GlbMesh)));
+  int32_t mesh = GetFirstElement(meshes);
+  for (uint32_t i = 0; i < mMeshCount; ++i) {
+    mPrimitiveCount +=
+        GetArraySize(doc, FindMember(doc, mesh, "primitives"));
+    mesh = GetNextElement(doc, mesh);
+  }
+  pPrimitives = reinterpret_cast<GlbPrimitive *>(
+      tf_calloc(max(mPrimitiveCount, 1u), sizeof(GlbPrimitive)));
+  uint32_t primitiveCount = 0;
+  mesh = GetFirstElement(meshes);
+  for (uint32_t i = 0; i < mMeshCount; ++i) {
+    int32_t primitives = FindMember(doc, mesh, "primitives");
+    pMeshes[i].mFirstPrimitive = primitiveCount;
+    pMeshes[i].mPrimitiveCount = GetArraySize(doc, primitives);
+    int32_t primitive = GetFirstElement(primitives);
+    for (uint32_t j = 0; j < pMeshes[i].mPrimitiveCount; ++j) {
+      GlbPrimitive &p = pPrimitives[primitiveCount++];
+      int32_t attributes = FindMember(doc, primitive, "attributes");
+      p.mPosition = GetMemberIndex(doc, attributes, "POSITION");
+      p.mNormal = GetMemberIndex(doc, attributes, "NORMAL");
+      p.mTexCoord = GetMemberIndex(doc, attributes, "TEXCOORD_0");
+      p.mIndices = GetMemberIndex(doc, primitive, "indices");
+      p.mMaterial = GetMemberIndex(doc, primitive, "material");
+      p.mMode = (uint32_t)GetMemberNumber(doc, primitive, "mode",
+                                          (double)kGlbTriangles);
+      p.mMorphed = FindMember(doc, primitive, "targets") >= 0;
+      int32_t *pReferences[] = {&p.mPosition, &p.mNormal, &p.mTexCoord,
+                                &p.mIndices};
+      for (int32_t *pReference : pReferences) {
+        if (*pReference >= (int32_t)mAccessorCount) {
+          LOGF(eWARNING, "Mesh %u refers to a missing accessor", i);
+          *pReference = -1;
+        }
+      }
+      primitive = GetNextElement(doc, primitive);
+    }
+    mesh = GetNextElement(doc, mesh);
+  }
+
+  int32_t images = FindMember(doc, root, "images");
+  mImageCount = GetArraySize(doc, images);
+  pImages = reinterpret_cast<GlbImage *>(
+      tf_calloc(max(mImageCount, 1u), sizeof(GlbImage)));
+  int32_t image = GetFirstElement(images);
+  for (uint32_t i = 0; i < mImageCount; ++i) {
+    int32_t uri = FindMember(doc, image, "uri");
+    if (uri >= 0 && doc.pTokens[uri].mType == kJsonString) {
+      pImages[i].pUri = pJson + doc.pTokens[uri].mStart;
+      pImages[i].mUriLength = doc.pTokens[uri].mEnd - doc.pTokens[uri].mStart;
+    }
+    image = GetNextElement(doc, image);
+  }
+
+  int32_t textures = FindMember(doc, root, "textures");
+  uint32_t textureCount = GetArraySize(doc, textures);
+  int32_t *pTextureImages = reinterpret_cast<int32_t *>(
+      tf_malloc(max(textureCount, 1u) * sizeof(int32_t)));
+  int32_t texture = GetFirstElement(textures);
+  for (uint32_t i = 0; i < textureCount; ++i) {
+    int32_t source = GetMemberIndex(doc, texture, "source");
+    pTextureImages[i] = source < (int32_t)mImageCount ? source : -1;
+    texture = GetNextElement(doc, texture);
+  }
+
+  int32_t materials = FindMember(doc, root, "materials");
+  mMaterialCount = GetArraySize(doc, materials);
+  pMaterials = reinterpret_cast<GlbMaterial *>(
+      tf_calloc(max(mMaterialCount, 1u), sizeof(GlbMaterial)));
+  int32_t material = GetFirstElement(materials);
+  for (uint32_t i = 0; i < mMaterialCount; ++i) {
+    GlbMaterial &m = pMaterials[i];
+    int32_t pbr = FindMember(doc, material, "pbrMetallicRoughness");
+    m.mBaseColor[0] = m.mBaseColor[1] = m.mBaseColor[2] = 1.0f;
+    m.mBaseColor[3] = 1.0f;
+    GetMemberFloats(doc, pbr, "baseColorFactor", 4, m.mBaseColor);
+    m.mMetallic = (float)GetMemberNumber(doc, pbr, "metallicFactor", 1.0);
+    m.mRoughness = (float)GetMemberNumber(doc, pbr, "roughnessFactor", 1.0);
+    m.mBaseColorImage =
+        GetTextureImage(doc, FindMember(doc, pbr, "baseColorTexture"),
+                        pTextureImages, textureCount);
+    m.mNormalImage =
+        GetTextureImage(doc, FindMember(doc, material, "normalTexture"),
+                        pTextureImages, textureCount);
+    m.mMetallicRoughnessImage = GetTextureImage(
+        doc, FindMember(doc, pbr, "metallicRoughnessTexture"),
+        pTextureImages, textureCount);
+    material = GetNextElement(doc, material);
+  }
+  tf_free(pTextureImages);
+
+  int32_t nodes = FindMember(doc, root, "nodes");
+  mNodeCount = GetArraySize(doc, nodes);
+  pNodes = reinterpret_cast<GlbNode *>(
+      tf_calloc(max(mNodeCount, 1u), sizeof(GlbNode)));
+  for (uint32_t i = 0; i < mNodeCount; ++i) {
+    pNodes[i].mParent = -1;
+  }
+  int32_t node = GetFirstElement(nodes);
+  for (uint32_t i = 0; i < mNodeCount && valid; ++i) {
+    GlbNode &n = pNodes[i];
+    n.mMesh = GetMemberIndex(doc, node, "mesh");
+    n.mMesh = n.mMesh < (int32_t)mMeshCount ? n.mMesh : -1;
+    n.mSkinned = FindMember(doc, node, "skin") >= 0;
+    n.mHasMatrix = GetArraySize(doc, FindMember(doc, node, "matrix")) == 16;
+    for (uint32_t j = 0; j < 16; ++j) {
+      n.mMatrix[j] = j % 5 == 0 ? 1.0f : 0.0f;
+    }
+    GetMemberFloats(doc, node, "matrix", 16, n.mMatrix);
+    n.mRotation[3] = 1.0f;
+    n.mScale[0] = n.mScale[1] = n.mScale[2] = 1.0f;
+    GetMemberFloats(doc, node, "translation", 3, n.mTranslation);
+    GetMemberFloats(doc, node, "rotation", 4, n.mRotation);
+    GetMemberFloats(doc, node, "scale", 3, n.mScale);
+
+    int32_t children = FindMember(doc, node, "children");
+    int32_t child = GetFirstElement(children);
+    for (uint32_t j = 0; j < GetArraySize(doc, children) && valid; ++j) {
+      double index = GetNumber(doc, child, -1.0);
+      valid = index >= 0.0 && index < (double)mNodeCount &&
+              pNodes[(uint32_t)index].mParent < 0 && (uint32_t)index != i;
+      if (valid) {
+        pNodes[(uint32_t)index].mParent = (int32_t)i;
+      } else {
+        LOGF(eERROR, "Node %u has an invalid child", i);
+      }
+      child = GetNextElement(doc, child);
+    }
+    node = GetNextElement(doc, node);
+  }
+
+  // Nodes belong to the default scene through their root, which the walk up
+  // finds within mNodeCount steps unless the hierarchy has a cycle.
+  int32_t scenes = FindMember(doc, root, "scenes");
+  int32_t sceneIndex = GetMemberIndex(doc, root, "scene");
+  sceneIndex = sceneIndex >= 0 ? sceneIndex : 0;
+  if ((uint32_t)sceneIndex < GetArraySize(doc, scenes)) {
+    int32_t scene = GetFirstElement(scenes);
+    for (int32_t i = 0; i < sceneIndex; ++i) {
+      scene = GetNextElement(doc, scene);
+    }
+    int32_t roots = FindMember(doc, scene, "nodes");
+    int32_t sceneRoot = GetFirstElement(roots);
+    for (uint32_t i = 0; i < GetArraySize(doc, roots); ++i) {
+      double index = GetNumber(doc, sceneRoot, -1.0);
+      if (index >= 0.0 && index < (double)mNodeCount &&
+          pNodes[(uint32_t)index].mParent < 0) {
+        pNodes[(uint32_t)index].mInScene = true;
+      }
+      sceneRoot = GetNextElement(doc, sceneRoot);
+    }
+    for (uint32_t i = 0; i < mNodeCount; ++i) {
+      uint32_t ancestor = i;
+      for (uint32_t step = 0;
+           step < mNodeCount && pNodes[ancestor].mParent >= 0; ++step) {
+        ancestor = (uint32_t)pNodes[ancestor].mParent;
+      }
+      pNodes[i].mInScene = pNodes[ancestor].mInScene &&
+                           pNodes[ancestor].mParent < 0;
+    }
+  } else {
+    for (uint32_t i = 0; i < mNodeCount; ++i) {
+      pNodes[i].mInScene = true;
+    }
+  }
+
+  tf_free(parser.pTokens);
+  if (!valid) {
+    Destroy();
+    return false;
+  }
+  return true;
+}
+
+void GlbFile::Destroy() {
+  tf_free(pJson);
+  tf_free(pBufferViews);
+  tf_free(pAccessors);
+  tf_free(pMeshes);
+  tf_free(pPrimitives);
+  tf_free(pNodes);
+  tf_free(pMaterials);
+  tf_free(pImages);
+  *this = GlbFile();
+}
+
+void GlbFile::SetBufferViewData(uint32_t view, const uint8_t *pData,
+                                uint64_t length, uint32_t stride) {
+  pBufferViews[view].pData = pData;
+  pBufferViews[view].mLength = length;
+  pBufferViews[view].mStride = stride;
+}
+
+const uint8_t *GlbFile::GetAccessorData(const GlbAccessor &accessor,
+                                        uint32_t elementSize,
+                                        uint32_t &stride) const {
+  const GlbBufferView &view = pBufferViews[accessor.mBufferView];
+  stride = view.mStride ? view.mStride : elementSize;
+  uint64_t end = accessor.mOffset +
+                 (uint64_t)(accessor.mCount - 1) * stride + elementSize;
+  if (!view.pData || end > view.mLength) {
+    return NULL;
+  }
+  return view.pData + accessor.mOffset;
+}
+
+/// One loop per source type, so that the compiler can unroll the component
+/// loop. Elements may be unaligned in the view.
+template <typename T>
+static void ConvertFloats(const uint8_t *pSrc, uint32_t stride,
+                          uint32_t count, uint32_t srcComponents,
+                          uint32_t dstComponents, float scale, float minimum,
+                          float *pDst) {
+  uint32_t copied = min(srcComponents, dstComponents);
+  for (uint32_t i = 0; i < count; ++i) {
+    const uint8_t *pElement = pSrc + (size_t)i * stride;
+    float *pOut = pDst + (size_t)i * dstComponents;
+    for (uint32_t c = 0; c < copied; ++c) {
+      T value;
+      memcpy(&value, pElement + c * sizeof(T), sizeof(T));
+      float converted = (float)value * scale;
+      pOut[c] = converted < minimum ? minimum : converted;
+    }
+    for (uint32_t c = copied; c < dstComponents; ++c) {
+      pOut[c] = 0.0f;
+    }
+  }
+}
+
+bool GlbFile::ReadFloats(uint32_t accessor, uint32_t componentCount,
+                         float *pDst) const {
+  if (accessor >= mAccessorCount) {
+    return false;
+  }
+  const GlbAccessor &a = pAccessors[accessor];
+  uint32_t componentSize = GetComponentSize(a.mComponentType);
+  if (a.mSparse || a.mComponentCount == 0 || componentSize == 0) {
+    LOGF(eERROR, "Accessor %u has an unsupported layout", accessor);
+    return false;
+  }
+  if (a.mCount == 0) {
+    return true;
+  }
+  if (a.mBufferView < 0) {
+    memset(pDst, 0, (size_t)a.mCount * componentCount * sizeof(float));
+    return true;
+  }
+  uint32_t stride = 0;
+  const uint8_t *pSrc =
+      GetAccessorData(a, componentSize * a.mComponentCount, stride);
+  if (!pSrc) {
+    LOGF(eERROR, "Accessor %u is out of its buffer view's bounds", accessor);
+    return false;
+  }
+  if (a.mComponentType == kGlbFloat && a.mComponentCount == componentCount &&
+      stride == componentCount * sizeof(float)) {
+    memcpy(pDst, pSrc, (size_t)a.mCount * stride);
+    return true;
+  }
+
+  // Signed normalized values have one more negative than positive value,
+  // which maps below -1.
+  float minimum = a.mNormalized ? -1.0f : -3.402823466e+38f;
+  bool n = a.mNormalized;
+  uint32_t count = a.mCount;
+  uint32_t components = a.mComponentCount;
+  switch (a.mComponentType) {
+  case kGlbByte:
+    ConvertFloats<int8_t>(pSrc, stride, count, components, componentCount,
+                          n ? 1.0f / 127.0f : 1.0f, minimum, pDst);
+    break;
+  case kGlbUnsignedByte:
+    ConvertFloats<uint8_t>(pSrc, stride, count, components, componentCount,
+                           n ? 1.0f / 255.0f : 1.0f, minimum, pDst);
+    break;
+  case kGlbShort:
+    ConvertFloats<int16_t>(pSrc, stride, count, components, componentCount,
+                           n ? 1.0f / 32767.0f : 1.0f, minimum, pDst);
+    break;
+  case kGlbUnsignedShort:
+    ConvertFloats<uint16_t>(pSrc, stride, count, components, componentCount,
+                            n ? 1.0f / 65535.0f : 1.0f, minimum, pDst);
+    break;
+  case kGlbUnsignedInt:
+    ConvertFloats<uint32_t>(pSrc, stride, count, components, componentCount,
+                            n ? 1.0f / 4294967295.0f : 1.0f, minimum, pDst);
+    break;
+  default:
+    ConvertFloats<float>(pSrc, stride, count, components, componentCount,
+                         1.0f, minimum, pDst);
+    break;
+  }
+  return true;
+}
+
+template <typename T>
+static bool WidenIndices(const uint8_t *pSrc, uint32_t stride, uint32_t count,
+                         uint32_t baseVertex, uint32_t vertexCount,
+                         uint32_t *pDst) {
+  uint32_t invalid = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    T index;
+    memcpy(&index, pSrc + (size_t)i * stride, sizeof(T));
+    invalid |= (uint32_t)(index >= vertexCount);
+    pDst[i] = (uint32_t)index + baseVertex;
+  }
+  return invalid == 0;
+}
+
+bool GlbFile::ReadIndices(uint32_t accessor, uint32_t baseVertex,
+                          uint32_t vertexCount, uint32_t *pDst) const {
+  if (accessor >= mAccessorCount) {
+    return false;
+  }
+  const GlbAccessor &a = pAccessors[accessor];
+  uint32_t componentSize = GetComponentSize(a.mComponentType);
+  if (a.mSparse || a.mComponentCount != 1 || a.mBufferView < 0 ||
+      a.mComponentType == kGlbByte || a.mComponentType == kGlbShort ||
+      a.mComponentType == kGlbFloat) {
+    LOGF(eERROR, "Accessor %u doesn't hold indices", accessor);
+    return false;
+  }
+  if (a.mCount == 0) {
+    return true;
+  }
+  uint32_t stride = 0;
+  const uint8_t *pSrc = GetAccessorData(a, componentSize, stride);
+  if (!pSrc) {
+    LOGF(eERROR, "Accessor %u is out of its buffer view's bounds", accessor);
+    return false;
+  }
+  bool valid;
+  if (a.mComponentType == kGlbUnsignedByte) {
+    valid = WidenIndices<uint8_t>(pSrc, stride, a.mCount, baseVertex,
+                                  vertexCount, pDst);
+  } else if (a.mComponentType == kGlbUnsignedShort) {
+    valid = WidenIndices<uint16_t>(pSrc, stride, a.mCount, baseVertex,
+                                   vertexCount, pDst);
+  } else {
+    valid = WidenIndices<uint32_t>(pSrc, stride, a.mCount, baseVertex,
+                                   vertexCount, pDst);
+  }
+  if (!valid) {
+    LOGF(eERROR, "Accessor %u holds out of range indices", accessor);
+  }
+  return valid;
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Reads the meshes, nodes and materials of a binary glTF 2.0 file. Only the
+/// JSON is parsed: buffer views point into the file's binary chunk, so that
+/// accessors are read in place.
+///
+/// Quantized attributes (KHR_mesh_quantization) are converted by
+/// \c ReadFloats. Views compressed with EXT_meshopt_compression are left to
+/// the caller, see \c GlbBufferView::mMeshoptMode, as their decoder isn't
+/// part of the headless sources.
+
+enum GlbComponentType : uint32_t {
+  kGlbByte = 5120,
+  kGlbUnsignedByte = 5121,
+  kGlbShort = 5122,
+  kGlbUnsignedShort = 5123,
+  kGlbUnsignedInt = 5125,
+  kGlbFloat = 5126,
+};
+
+enum class GlbMeshoptMode : uint32_t { None, Attributes, Triangles, Indices };
+enum class GlbMeshoptFilter : uint32_t {
+  None,
+  Octahedral,
+  Quaternion,
+  Exponential,
+};
+
+struct GlbBufferView {
+  /// \c NULL if the view's buffer holds no data, such as the fallback
+  /// buffer of a compressed view, or an external file.
+  const uint8_t *pData;
+  uint64_t mLength;
+  /// Zero if elements are tightly packed.
+  uint32_t mStride;
+  /// Compressed views are only readable once the caller decoded
+  /// \c mMeshoptCount elements of \c mMeshoptStride bytes and handed them to
+  /// \c GlbFile::SetBufferViewData.
+  GlbMeshoptMode mMeshoptMode;
+  GlbMeshoptFilter mMeshoptFilter;
+  const uint8_t *pMeshoptData;
+  uint64_t mMeshoptLength;
+  uint32_t mMeshoptCount;
+  uint32_t mMeshoptStride;
+};
+
+struct GlbAccessor {
+  /// -1 for accessors without data, whose elements are all zero.
+  int32_t mBufferView;
+  uint64_t mOffset;
+  uint32_t mComponentType;
+  /// 1 to 4; matrices aren't supported and have none.
+  uint32_t mComponentCount;
+  uint32_t mCount;
+  bool mNormalized;
+  /// Sparse accessors aren't supported.
+  bool mSparse;
+};
+
+/// Attributes and indices are accessor indices, -1 if missing.
+struct GlbPrimitive {
+  int32_t mPosition;
+  int32_t mNormal;
+  int32_t mTexCoord;
+  int32_t mIndices;
+  int32_t mMaterial;
+  /// 4 for triangle lists, the only mode drawn.
+  uint32_t mMode;
+  bool mMorphed;
+};
+
+struct GlbMesh {
+  uint32_t mFirstPrimitive;
+  uint32_t mPrimitiveCount;
+};
+
+struct GlbNode {
+  /// -1 for roots.
+  int32_t mParent;
+  int32_t mMesh;
+  bool mSkinned;
+  /// Set if the node is part of the file's default scene, or of any scene if
+  /// it has none.
+  bool mInScene;
+  /// Column-major, set instead of the TRS below if \c mHasMatrix.
+  bool mHasMatrix;
+  float mMatrix[16];
+  float mTranslation[3];
+  /// x, y, z, w.
+  float mRotation[4];
+  float mScale[3];
+};
+
+struct GlbMaterial {
+  float mBaseColor[4];
+  float mMetallic;
+  float mRoughness;
+  /// Image indices, -1 if missing.
+  int32_t mBaseColorImage;
+  int32_t mNormalImage;
+  int32_t mMetallicRoughnessImage;
+};
+
+struct GlbImage {
+  /// Points into the JSON, not terminated; \c NULL for images stored in a
+  /// buffer view.
+  const char *pUri;
+  uint32_t mUriLength;
+};
+
+class GlbFile {
+public:
+  /// \c pData must outlive the object, as buffer views point into it.
+  /// Returns false if it isn't a valid binary glTF 2.0 file.
+  bool Parse(const uint8_t *pData, size_t size);
+  void Destroy();
+
+  inline uint32_t GetBufferViewCount() const { return mBufferViewCount; }
+  inline const GlbBufferView &GetBufferView(uint32_t i) const {
+    return pBufferViews[i];
+  }
+  /// Makes a compressed view readable, see \c GlbBufferView::mMeshoptMode.
+  /// \c pData must outlive the object.
+  void SetBufferViewData(uint32_t view, const uint8_t *pData, uint64_t length,
+                         uint32_t stride);
+
+  inline uint32_t GetAccessorCount() const { return mAccessorCount; }
+  inline const GlbAccessor &GetAccessor(uint32_t i) const {
+    return pAccessors[i];
+  }
+  inline uint32_t GetMeshCount() const { return mMeshCount; }
+  inline const GlbMesh &GetMesh(uint32_t i) const { return pMeshes[i]; }
+  inline uint32_t GetPrimitiveCount() const { return mPrimitiveCount; }
+  inline const GlbPrimitive &GetPrimitive(uint32_t i) const {
+    return pPrimitives[i];
+  }
+  inline uint32_t GetNodeCount() const { return mNodeCount; }
+  inline const GlbNode &GetNode(uint32_t i) const { return pNodes[i]; }
+  inline uint32_t GetMaterialCount() const { return mMaterialCount; }
+  inline const GlbMaterial &GetMaterial(uint32_t i) const {
+    return pMaterials[i];
+  }
+  inline uint32_t GetImageCount() const { return mImageCount; }
+  inline const GlbImage &GetImage(uint32_t i) const { return pImages[i]; }
+
+  /// Converts the accessor's elements into \c componentCount floats each,
+  /// tightly packed, applying normalization. Missing components are zero.
+  /// Returns false if the accessor isn't readable or overruns its view.
+  bool ReadFloats(uint32_t accessor, uint32_t componentCount,
+                  float *pDst) const;
+  /// Widens the accessor's indices to 32 bits and adds \c baseVertex.
+  /// Returns false if the accessor isn't readable, or if an index isn't
+  /// below \c vertexCount.
+  bool ReadIndices(uint32_t accessor, uint32_t baseVertex,
+                   uint32_t vertexCount, uint32_t *pDst) const;
+
+private:
+  /// The accessor's first element and the bytes between elements, or
+  /// \c NULL if it isn't readable.
+  const uint8_t *GetAccessorData(const GlbAccessor &accessor,
+                                 uint32_t elementSize,
+                                 uint32_t &stride) const;
+
+  /// Terminated copy of the JSON chunk, so that numbers can be parsed in
+  /// place. Image URIs point into it.
+  char *pJson = NULL;
+
+  GlbBufferView *pBufferViews = NULL;
+  uint32_t mBufferViewCount = 0;
+  GlbAccessor *pAccessors = NULL;
+  uint32_t mAccessorCount = 0;
+  GlbMesh *pMeshes = NULL;
+  uint32_t mMeshCount = 0;
+  GlbPrimitive *pPrimitives = NULL;
+  uint32_t mPrimitiveCount = 0;
+  GlbNode *pNodes = NULL;
+  uint32_t mNodeCount = 0;
+  GlbMaterial *pMaterials = NULL;
+  uint32_t mMaterialCount = 0;
+  GlbImage *pImages = NULL;
+  uint32_t mImageCount = 0;
+};
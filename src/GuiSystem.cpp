@@ -5,7 +5,19 @@ void GuiSystem::Init() {
   font.pFontPath = "TitilliumText/TitilliumText-Bold.otf";
   fntDefineFonts(&font, 1, &gFontID);
 }
-void GuiSystem::Exit() {}
+void GuiSystem::Exit() {
+  bdestroy(&mTextureStatsText);
+  bdestroy(&mDrawListStatsText);
+  bdestroy(&mDeletionQueueStatsText);
+  bdestroy(&mGeometryPoolStatsText);
+  bdestroy(&mLightingStatsText);
+  bdestroy(&mBlendShapeStatsText);
+  bdestroy(&mSceneStatusText);
+  bdestroy(&mReimportStatusText);
+  bdestroy(&mRenderStatsText);
+  bdestroy(&mMemoryStatsText);
+  bdestroy(&mLoadingText);
+}
 
 void GuiSystem::Load(GuiModelView modelView, int32_t appWidth,
                      int32_t appHeight, ReloadDesc *pReloadDesc) {
@@ -54,9 +66,38 @@ void GuiSystem::Load(GuiModelView modelView, int32_t appWidth,
                          &cameraOrbitSpeedWidget, WIDGET_TYPE_SLIDER_FLOAT);
 
     UIComponentDesc sceneGuiDesc{};
-    sceneGuiDesc.mStartPosition = vec2(appWidth * 0.01f, appHeight * 0.87f);
+    sceneGuiDesc.mStartPosition = vec2(appWidth * 0.01f, appHeight * 0.80f);
     uiAddComponent("Scene", &sceneGuiDesc, &pSceneOptionsWindow);
 
+    TextboxWidget modelFileWidget;
+    modelFileWidget.pText = modelView.pModelFileName;
+    uiAddComponentWidget(pSceneOptionsWindow, "Model", &modelFileWidget,
+                         WIDGET_TYPE_TEXTBOX);
+
+    ButtonWidget loadModelWidget;
+    UIWidget *pLoadModelButton =
+        uiAddComponentWidget(pSceneOptionsWindow, "Load Model",
+                             &loadModelWidget, WIDGET_TYPE_BUTTON);
+    uiSetWidgetOnEditedCallback(pLoadModelButton, modelView.pLoadModelUserData,
+                                modelView.pLoadModel);
+
+    DynamicTextWidget sceneStatusWidget;
+    sceneStatusWidget.pText = &mSceneStatusText;
+    sceneStatusWidget.pColor = &color;
+    uiAddComponentWidget(pSceneOptionsWindow, "Model Status",
+                         &sceneStatusWidget, WIDGET_TYPE_DYNAMIC_TEXT);
+
+    CheckboxWidget watchModelWidget;
+    watchModelWidget.pData = modelView.pWatchModel;
+    uiAddComponentWidget(pSceneOptionsWindow, "Watch Model", &watchModelWidget,
+                         WIDGET_TYPE_CHECKBOX);
+
+    DynamicTextWidget reimportStatusWidget;
+    reimportStatusWidget.pText = &mReimportStatusText;
+    reimportStatusWidget.pColor = &color;
+    uiAddComponentWidget(pSceneOptionsWindow, "Reimport Status",
+                         &reimportStatusWidget, WIDGET_TYPE_DYNAMIC_TEXT);
+
     SliderFloatWidget sceneScaleWidget;
     sceneScaleWidget.mMin = 0.0f;
     sceneScaleWidget.mMax = 100.0f;
@@ -64,10 +105,206 @@ void GuiSystem::Load(GuiModelView modelView, int32_t appWidth,
     sceneScaleWidget.pData = modelView.pSceneScale;
     uiAddComponentWidget(pSceneOptionsWindow, "Scale", &sceneScaleWidget,
                          WIDGET_TYPE_SLIDER_FLOAT);
+
+    SliderFloatWidget textureBudgetWidget;
+    textureBudgetWidget.mMin = 16.0f;
+    textureBudgetWidget.mMax = 4096.0f;
+    textureBudgetWidget.mStep = 16.0f;
+    textureBudgetWidget.pData = modelView.pTextureBudgetMB;
+    uiAddComponentWidget(pSceneOptionsWindow, "Texture Budget (MB)",
+                         &textureBudgetWidget, WIDGET_TYPE_SLIDER_FLOAT);
+
+    CheckboxWidget playAnimationWidget;
+    playAnimationWidget.pData = modelView.pPlayAnimation;
+    uiAddComponentWidget(pSceneOptionsWindow, "Play Animation",
+                         &playAnimationWidget, WIDGET_TYPE_CHECKBOX);
+
+    SliderFloatWidget animationSpeedWidget;
+    animationSpeedWidget.mMin = 0.0f;
+    animationSpeedWidget.mMax = 4.0f;
+    animationSpeedWidget.mStep = 0.05f;
+    animationSpeedWidget.pData = modelView.pAnimationSpeed;
+    uiAddComponentWidget(pSceneOptionsWindow, "Animation Speed",
+                         &animationSpeedWidget, WIDGET_TYPE_SLIDER_FLOAT);
+
+    CheckboxWidget animateBlendShapesWidget;
+    animateBlendShapesWidget.pData = modelView.pAnimateBlendShapes;
+    uiAddComponentWidget(pSceneOptionsWindow, "Animate Blend Shapes",
+                         &animateBlendShapesWidget, WIDGET_TYPE_CHECKBOX);
+
+    DynamicTextWidget blendShapeStatsWidget;
+    blendShapeStatsWidget.pText = &mBlendShapeStatsText;
+    blendShapeStatsWidget.pColor = &color;
+    uiAddComponentWidget(pSceneOptionsWindow, "Blend Shapes",
+                         &blendShapeStatsWidget, WIDGET_TYPE_DYNAMIC_TEXT);
+
+    DynamicTextWidget textureStatsWidget;
+    textureStatsWidget.pText = &mTextureStatsText;
+    textureStatsWidget.pColor = &color;
+    uiAddComponentWidget(pSceneOptionsWindow, "Texture Residency",
+                         &textureStatsWidget, WIDGET_TYPE_DYNAMIC_TEXT);
+
+    DynamicTextWidget drawListStatsWidget;
+    drawListStatsWidget.pText = &mDrawListStatsText;
+    drawListStatsWidget.pColor = &color;
+    uiAddComponentWidget(pSceneOptionsWindow, "Draw List",
+                         &drawListStatsWidget, WIDGET_TYPE_DYNAMIC_TEXT);
+
+    DynamicTextWidget deletionQueueStatsWidget;
+    deletionQueueStatsWidget.pText = &mDeletionQueueStatsText;
+    deletionQueueStatsWidget.pColor = &color;
+    uiAddComponentWidget(pSceneOptionsWindow, "Deletion Queue",
+                         &deletionQueueStatsWidget, WIDGET_TYPE_DYNAMIC_TEXT);
+
+    DynamicTextWidget geometryPoolStatsWidget;
+    geometryPoolStatsWidget.pText = &mGeometryPoolStatsText;
+    geometryPoolStatsWidget.pColor = &color;
+    uiAddComponentWidget(pSceneOptionsWindow, "Geometry Pool",
+                         &geometryPoolStatsWidget, WIDGET_TYPE_DYNAMIC_TEXT);
+
+    DynamicTextWidget memoryStatsWidget;
+    memoryStatsWidget.pText = &mMemoryStatsText;
+    memoryStatsWidget.pColor = &color;
+    uiAddComponentWidget(pSceneOptionsWindow, "Memory", &memoryStatsWidget,
+                         WIDGET_TYPE_DYNAMIC_TEXT);
+
+    UIComponentDesc renderingGuiDesc{};
+    renderingGuiDesc.mStartPosition =
+        vec2(appWidth * 0.75f, appHeight * 0.01f);
+    uiAddComponent("Rendering", &renderingGuiDesc, &pRenderingOptionsWindow);
+
+    CheckboxWidget dynamicResolutionWidget;
+    dynamicResolutionWidget.pData = modelView.pDynamicResolution;
+    uiAddComponentWidget(pRenderingOptionsWindow, "Dynamic Resolution",
+                         &dynamicResolutionWidget, WIDGET_TYPE_CHECKBOX);
+
+    // Follows the controller while dynamic resolution is on, and overrides
+    // the scale while it is off.
+    SliderFloatWidget resolutionScaleWidget;
+    resolutionScaleWidget.mMin = 0.25f;
+    resolutionScaleWidget.mMax = 1.0f;
+    resolutionScaleWidget.mStep = 0.01f;
+    resolutionScaleWidget.pData = modelView.pResolutionScale;
+    uiAddComponentWidget(pRenderingOptionsWindow, "Resolution Scale",
+                         &resolutionScaleWidget, WIDGET_TYPE_SLIDER_FLOAT);
+
+    SliderFloatWidget targetFrameTimeWidget;
+    targetFrameTimeWidget.mMin = 4.0f;
+    targetFrameTimeWidget.mMax = 50.0f;
+    targetFrameTimeWidget.mStep = 0.1f;
+    targetFrameTimeWidget.pData = modelView.pTargetFrameMs;
+    uiAddComponentWidget(pRenderingOptionsWindow, "Target GPU Time (ms)",
+                         &targetFrameTimeWidget, WIDGET_TYPE_SLIDER_FLOAT);
+
+    SliderFloatWidget minResolutionScaleWidget;
+    minResolutionScaleWidget.mMin = 0.25f;
+    minResolutionScaleWidget.mMax = 1.0f;
+    minResolutionScaleWidget.mStep = 0.01f;
+    minResolutionScaleWidget.pData = modelView.pMinResolutionScale;
+    uiAddComponentWidget(pRenderingOptionsWindow, "Min Scale",
+                         &minResolutionScaleWidget, WIDGET_TYPE_SLIDER_FLOAT);
+
+    SliderFloatWidget maxResolutionScaleWidget;
+    maxResolutionScaleWidget.mMin = 0.25f;
+    maxResolutionScaleWidget.mMax = 1.0f;
+    maxResolutionScaleWidget.mStep = 0.01f;
+    maxResolutionScaleWidget.pData = modelView.pMaxResolutionScale;
+    uiAddComponentWidget(pRenderingOptionsWindow, "Max Scale",
+                         &maxResolutionScaleWidget, WIDGET_TYPE_SLIDER_FLOAT);
+
+    SliderUintWidget lightCountWidget;
+    lightCountWidget.mMin = 1;
+    lightCountWidget.mMax = ClusteredLighting::kMaxLightCount;
+    lightCountWidget.mStep = 1;
+    lightCountWidget.pData = modelView.pLightCount;
+    uiAddComponentWidget(pRenderingOptionsWindow, "Light Count",
+                         &lightCountWidget, WIDGET_TYPE_SLIDER_UINT);
+
+    SliderFloatWidget lightRadiusWidget;
+    lightRadiusWidget.mMin = 0.005f;
+    lightRadiusWidget.mMax = 0.5f;
+    lightRadiusWidget.mStep = 0.005f;
+    lightRadiusWidget.pData = modelView.pLightRadius;
+    uiAddComponentWidget(pRenderingOptionsWindow, "Light Radius",
+                         &lightRadiusWidget, WIDGET_TYPE_SLIDER_FLOAT);
+
+    SliderFloatWidget lightIntensityWidget;
+    lightIntensityWidget.mMin = 0.0f;
+    lightIntensityWidget.mMax = 10.0f;
+    lightIntensityWidget.mStep = 0.1f;
+    lightIntensityWidget.pData = modelView.pLightIntensity;
+    uiAddComponentWidget(pRenderingOptionsWindow, "Light Intensity",
+                         &lightIntensityWidget, WIDGET_TYPE_SLIDER_FLOAT);
+
+    CheckboxWidget animateLightsWidget;
+    animateLightsWidget.pData = modelView.pAnimateLights;
+    uiAddComponentWidget(pRenderingOptionsWindow, "Animate Lights",
+                         &animateLightsWidget, WIDGET_TYPE_CHECKBOX);
+
+    CheckboxWidget clusterHeatmapWidget;
+    clusterHeatmapWidget.pData = modelView.pClusterHeatmap;
+    uiAddComponentWidget(pRenderingOptionsWindow, "Lights Per Cluster",
+                         &clusterHeatmapWidget, WIDGET_TYPE_CHECKBOX);
+
+    CheckboxWidget pbrShadingWidget;
+    pbrShadingWidget.pData = modelView.pPbrShading;
+    uiAddComponentWidget(pRenderingOptionsWindow, "PBR Shading",
+                         &pbrShadingWidget, WIDGET_TYPE_CHECKBOX);
+
+    CheckboxWidget visibilityBufferWidget;
+    visibilityBufferWidget.pData = modelView.pVisibilityBuffer;
+    uiAddComponentWidget(pRenderingOptionsWindow, "Visibility Buffer",
+                         &visibilityBufferWidget, WIDGET_TYPE_CHECKBOX);
+
+    CheckboxWidget ambientOcclusionWidget;
+    ambientOcclusionWidget.pData = modelView.pAmbientOcclusion;
+    uiAddComponentWidget(pRenderingOptionsWindow, "Ambient Occlusion",
+                         &ambientOcclusionWidget, WIDGET_TYPE_CHECKBOX);
+
+    static const char *kAmbientOcclusionQualityNames[] = {
+        "Low (quarter resolution)", "Medium (half resolution)",
+        "High (half resolution)"};
+    DropdownWidget ambientOcclusionQualityWidget;
+    ambientOcclusionQualityWidget.pData = modelView.pAmbientOcclusionQuality;
+    ambientOcclusionQualityWidget.pNames = kAmbientOcclusionQualityNames;
+    ambientOcclusionQualityWidget.mCount = kAmbientOcclusionQualityCount;
+    uiAddComponentWidget(pRenderingOptionsWindow, "AO Quality",
+                         &ambientOcclusionQualityWidget, WIDGET_TYPE_DROPDOWN);
+
+    SliderFloatWidget ambientOcclusionRadiusWidget;
+    ambientOcclusionRadiusWidget.mMin = 0.001f;
+    ambientOcclusionRadiusWidget.mMax = 0.1f;
+    ambientOcclusionRadiusWidget.mStep = 0.001f;
+    ambientOcclusionRadiusWidget.pData = modelView.pAmbientOcclusionRadius;
+    uiAddComponentWidget(pRenderingOptionsWindow, "AO Radius",
+                         &ambientOcclusionRadiusWidget,
+                         WIDGET_TYPE_SLIDER_FLOAT);
+
+    SliderFloatWidget ambientOcclusionIntensityWidget;
+    ambientOcclusionIntensityWidget.mMin = 0.0f;
+    ambientOcclusionIntensityWidget.mMax = 4.0f;
+    ambientOcclusionIntensityWidget.mStep = 0.05f;
+    ambientOcclusionIntensityWidget.pData =
+        modelView.pAmbientOcclusionIntensity;
+    uiAddComponentWidget(pRenderingOptionsWindow, "AO Intensity",
+                         &ambientOcclusionIntensityWidget,
+                         WIDGET_TYPE_SLIDER_FLOAT);
+
+    CheckboxWidget streamRenderStatsWidget;
+    streamRenderStatsWidget.pData = modelView.pStreamRenderStats;
+    uiAddComponentWidget(pRenderingOptionsWindow, "Stream Render Stats",
+                         &streamRenderStatsWidget, WIDGET_TYPE_CHECKBOX);
+
+    DynamicTextWidget lightingStatsWidget;
+    lightingStatsWidget.pText = &mLightingStatsText;
+    lightingStatsWidget.pColor = &color;
+    uiAddComponentWidget(pRenderingOptionsWindow, "Light Binning",
+                         &lightingStatsWidget, WIDGET_TYPE_DYNAMIC_TEXT);
   }
 }
 void GuiSystem::Unload(ReloadDesc *pReloadDesc) {
   if (pReloadDesc->mType & (RELOAD_TYPE_RESIZE | RELOAD_TYPE_RENDERTARGET)) {
+    uiRemoveComponent(pRenderingOptionsWindow);
     uiRemoveComponent(pSceneOptionsWindow);
     uiRemoveComponent(pControlsWindow);
   }
@@ -86,8 +323,144 @@ void GuiSystem::Draw(RenderContext::Frame frame, ProfileToken gpuProfileToken) {
   gFrameTimeDraw.mFontSize = 18.0f;
   gFrameTimeDraw.mFontID = gFontID;
   float2 txtSizePx = cmdDrawCpuProfile(cmd, float2(8.f, 15.f), &gFrameTimeDraw);
-  cmdDrawGpuProfile(cmd, float2(8.f, txtSizePx.y + 75.f), gpuProfileToken,
-                    &gFrameTimeDraw);
+  float2 gpuTxtSizePx =
+      cmdDrawGpuProfile(cmd, float2(8.f, txtSizePx.y + 75.f), gpuProfileToken,
+                        &gFrameTimeDraw);
+
+  mRenderStatsDraw.pText = (const char *)mRenderStatsText.data;
+  mRenderStatsDraw.mFontColor = 0xffffffff;
+  mRenderStatsDraw.mFontSize = 16.0f;
+  mRenderStatsDraw.mFontID = gFontID;
+  cmdDrawTextWithFont(
+      cmd, float2(8.f, txtSizePx.y + gpuTxtSizePx.y + 90.f), &mRenderStatsDraw);
+
+  if (mLoadingText.slen > 0) {
+    mLoadingDraw.pText = (const char *)mLoadingText.data;
+    mLoadingDraw.mFontColor = 0xffffffff;
+    mLoadingDraw.mFontSize = 32.0f;
+    mLoadingDraw.mFontID = gFontID;
+    float2 loadingSizePx =
+        fntMeasureFontText(mLoadingDraw.pText, &mLoadingDraw);
+    cmdDrawTextWithFont(
+        cmd,
+        float2((frame.pImage->mWidth - loadingSizePx.x) * 0.5f,
+               frame.pImage->mHeight * 0.75f),
+        &mLoadingDraw);
+  }
 
   cmdDrawUserInterface(cmd);
-}
\ No newline at end of file
+}
+
+void GuiSystem::SetTextureStats(uint64_t residentBytes,
+                                uint64_t requestedBytes) {
+  bassignformat(&mTextureStatsText, "Textures: %.1f MB resident, %.1f MB requested",
+                residentBytes / (1024.0 * 1024.0),
+                requestedBytes / (1024.0 * 1024.0));
+}
+
+void GuiSystem::SetDrawListStats(const DrawListStats &stats) {
+  bassignformat(&mDrawListStatsText,
+                "Draws: %u, state changes: %u pipeline, %u set, %u material, "
+                "sort: %.3f ms",
+                stats.mDrawCount, stats.mPipelineChanges,
+                stats.mDescriptorSetChanges, stats.mMaterialChanges,
+                stats.mSortMs);
+}
+void GuiSystem::SetDeletionQueueStats(const DeletionQueueStats &stats) {
+  bassignformat(&mDeletionQueueStatsText,
+                "Deferred deletions: %u pending (%.1f KB), %llu released",
+                stats.mPendingCount, stats.mPendingBytes / 1024.0,
+                (unsigned long long)stats.mReleasedCount);
+}
+void GuiSystem::SetGeometryPoolStats(const GeometryPoolStats &stats) {
+  const double kMB = 1024.0 * 1024.0;
+  bassignformat(&mGeometryPoolStatsText,
+                "Geometry pool: %u allocations, %.1f MB vertices, %.1f MB "
+                "indices\nFragmented: %.1f MB vertices, %.1f MB indices, "
+                "moved: %.1f MB in %u moves",
+                stats.mAllocationCount, stats.mUsedVertexBytes / kMB,
+                stats.mUsedIndexBytes / kMB,
+                stats.mFragmentedVertexBytes / kMB,
+                stats.mFragmentedIndexBytes / kMB, stats.mMovedBytes / kMB,
+                stats.mMoveCount);
+}
+void GuiSystem::SetLightingStats(const ClusterStats &stats) {
+  bassignformat(&mLightingStatsText,
+                "Lights: %u, indices: %u, max per cluster: %u, dropped: %u, "
+                "binning: %.3f ms",
+                stats.mLightCount, stats.mIndexCount,
+                stats.mMaxLightsPerCluster, stats.mDroppedCount,
+                stats.mBinningMs);
+}
+void GuiSystem::SetBlendShapeStats(const BlendShapeStats &stats) {
+  bassignformat(&mBlendShapeStatsText,
+                "Targets: %u, active: %u, deltas applied: %u, memory: %.1f KB "
+                "(%.1f KB dense)",
+                stats.mTargetCount, stats.mActiveTargetCount,
+                stats.mAppliedDeltaCount, stats.mSparseBytes / 1024.0,
+                stats.mDenseBytes / 1024.0);
+}
+void GuiSystem::SetSceneStatus(const char *pStatus, const char *pFileName) {
+  bassignformat(&mSceneStatusText, "%s %s", pStatus, pFileName);
+}
+void GuiSystem::SetLoadingIndicator(const char *pFileName, float seconds) {
+  if (pFileName == NULL) {
+    bassigncstr(&mLoadingText, "");
+    return;
+  }
+  // The dots cycle, so that a long load still shows signs of life.
+  static const char *const kDots[] = {".", "..", "..."};
+  bassignformat(&mLoadingText, "Loading %s%s %.1f s", pFileName,
+                kDots[(uint32_t)(seconds * 2.0f) % 3], seconds);
+}
+void GuiSystem::SetReimportStatus(float latencyMs,
+                                  const ScenePatchStats *pPatchStats) {
+  if (pPatchStats == NULL) {
+    bassignformat(&mReimportStatusText,
+                  "Reimported in %.1f ms: layout changed, reloaded", latencyMs);
+    return;
+  }
+  bassignformat(&mReimportStatusText,
+                "Reimported in %.1f ms: %u of %u meshes patched (%.1f KB)",
+                latencyMs, pPatchStats->mPatchedMeshCount,
+                pPatchStats->mMeshCount, pPatchStats->mPatchedBytes / 1024.0);
+}
+void GuiSystem::SetRenderStats(const RenderStatsFrame &stats) {
+  const double kMB = 1024.0 * 1024.0;
+  const uint64_t *pCounters = stats.mCounters;
+  const uint64_t *pResident = stats.mResidentBytes;
+  bassignformat(
+      &mRenderStatsText,
+      "Draws: %llu, triangles: %llu, vertices: %llu, culled: %llu\n"
+      "Binds: %llu pipeline, %llu descriptor set, %llu material changes\n"
+      "Draw list sort: %.3f ms\n"
+      "Uploaded: %.1f KB, fence wait: %.3f ms\n"
+      "GPU memory: %.1f MB geometry, %.1f MB textures, %.1f MB targets, "
+      "%.1f MB pending deletion",
+      (unsigned long long)pCounters[kRenderCounterDrawCalls],
+      (unsigned long long)pCounters[kRenderCounterTriangles],
+      (unsigned long long)pCounters[kRenderCounterVertices],
+      (unsigned long long)pCounters[kRenderCounterCulledObjects],
+      (unsigned long long)pCounters[kRenderCounterPipelineBinds],
+      (unsigned long long)pCounters[kRenderCounterDescriptorBinds],
+      (unsigned long long)pCounters[kRenderCounterMaterialChanges],
+      pCounters[kRenderCounterDrawListSortUSec] / 1000.0,
+      pCounters[kRenderCounterUploadedBytes] / 1024.0,
+      pCounters[kRenderCounterFenceWaitUSec] / 1000.0,
+      pResident[kGpuMemoryGeometry] / kMB, pResident[kGpuMemoryTextures] / kMB,
+      pResident[kGpuMemoryRenderTargets] / kMB,
+      pResident[kGpuMemoryPendingDeletion] / kMB);
+}
+void GuiSystem::UpdateMemoryStats() {
+  const double kMB = 1024.0 * 1024.0;
+  bassigncstr(&mMemoryStatsText,
+              "CPU live / peak MB, GPU live / peak MB (allocations)");
+  for (uint32_t i = 0; i < kMemoryCategoryCount; ++i) {
+    MemoryCounters cpu = GetMemoryCounters((MemoryCategory)i, kMemoryKindCpu);
+    MemoryCounters gpu = GetMemoryCounters((MemoryCategory)i, kMemoryKindGpu);
+    bformata(&mMemoryStatsText, "\n%s: %.2f / %.2f, %.2f / %.2f (%llu)",
+             GetMemoryCategoryName((MemoryCategory)i), cpu.mLiveBytes / kMB,
+             cpu.mPeakBytes / kMB, gpu.mLiveBytes / kMB, gpu.mPeakBytes / kMB,
+             (unsigned long long)(cpu.mLiveCount + gpu.mLiveCount));
+  }
+}
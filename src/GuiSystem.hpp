@@ -9,6 +9,8 @@
 
 #include "OrbitCameraController.hpp"
 #include "RenderContext.hpp"
+#include "RenderStats.hpp"
+#include "AmbientOcclusionSystem.hpp"
 #include "Scene.hpp"
 #include "SceneRenderSystem.hpp"
 #include "SkyBox.hpp"
@@ -19,6 +21,32 @@ struct GuiModelView {
   float *pCameraBraking;
   float *pCameraZoomSpeed;
   float *pCameraOrbitSpeed;
+  float *pTextureBudgetMB;
+  bool *pDynamicResolution;
+  float *pResolutionScale;
+  float *pTargetFrameMs;
+  float *pMinResolutionScale;
+  float *pMaxResolutionScale;
+  uint32_t *pLightCount;
+  float *pLightRadius;
+  float *pLightIntensity;
+  bool *pAnimateLights;
+  bool *pClusterHeatmap;
+  bool *pPbrShading;
+  bool *pVisibilityBuffer;
+  bool *pAmbientOcclusion;
+  uint32_t *pAmbientOcclusionQuality;
+  float *pAmbientOcclusionRadius;
+  float *pAmbientOcclusionIntensity;
+  bool *pPlayAnimation;
+  float *pAnimationSpeed;
+  bool *pAnimateBlendShapes;
+  bstring *pModelFileName;
+  bool *pWatchModel;
+  bool *pStreamRenderStats;
+  /// Called with \c pLoadModelUserData by the "Load Model" button.
+  void (*pLoadModel)(void *pUserData);
+  void *pLoadModelUserData;
 };
 
 class GuiSystem {
@@ -32,9 +60,27 @@ public:
 
   void Draw(RenderContext::Frame frame, ProfileToken gpuProfileToken);
 
+  void SetTextureStats(uint64_t residentBytes, uint64_t requestedBytes);
+  void SetDrawListStats(const DrawListStats &stats);
+  void SetDeletionQueueStats(const DeletionQueueStats &stats);
+  void SetGeometryPoolStats(const GeometryPoolStats &stats);
+  void SetLightingStats(const ClusterStats &stats);
+  void SetBlendShapeStats(const BlendShapeStats &stats);
+  void SetSceneStatus(const char *pStatus, const char *pFileName);
+  /// Drawn large over the scene while a model loads. \c NULL hides it.
+  void SetLoadingIndicator(const char *pFileName, float seconds);
+  /// \c pPatchStats is \c NULL if the whole model had to be reloaded.
+  void SetReimportStatus(float latencyMs, const ScenePatchStats *pPatchStats);
+  /// Shown under the profiler's timings.
+  void SetRenderStats(const RenderStatsFrame &stats);
+  /// Reads the counters of every memory category.
+  void UpdateMemoryStats();
+
 private:
   uint32_t gFontID = 0;
   FontDrawDesc gFrameTimeDraw;
+  FontDrawDesc mRenderStatsDraw;
+  FontDrawDesc mLoadingDraw;
 
   const char *const kControlsTextCharArray = "Manual:\n"
                                              "W: Zoom in\n"
@@ -46,6 +92,19 @@ private:
                                              "Mouse drag: Orbit around\n";
   bstring gControlsText = bfromarr(kControlsTextCharArray);
 
+  bstring mTextureStatsText = bempty();
+  bstring mDrawListStatsText = bempty();
+  bstring mDeletionQueueStatsText = bempty();
+  bstring mGeometryPoolStatsText = bempty();
+  bstring mLightingStatsText = bempty();
+  bstring mBlendShapeStatsText = bempty();
+  bstring mSceneStatusText = bempty();
+  bstring mReimportStatusText = bempty();
+  bstring mRenderStatsText = bempty();
+  bstring mMemoryStatsText = bempty();
+  bstring mLoadingText = bempty();
+
   UIComponent *pControlsWindow = NULL;
   UIComponent *pSceneOptionsWindow = NULL;
+  UIComponent *pRenderingOptionsWindow = NULL;
 };
\ No newline at end of file
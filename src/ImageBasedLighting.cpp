@@ -0,0 +1,605 @@
+#include "ImageBasedLighting.hpp"
+
+#include <math.h>
+#include <string.h>
+
+#include "Utilities/Interfaces/ILog.h"
+
+#include "Trace.hpp"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+static const uint32_t kIblFileMagic = 0x434c4249; // "IBLC"
+static const uint32_t kIblFileVersion = 1;
+
+/// The sky is resampled to the specular map's size, then halved down to 1x1
+/// to be sampled at the lod matching each GGX sample's footprint.
+static const uint32_t kSourceSize = ImageBasedLighting::kSpecularSize;
+static const uint32_t kSourceMipCount = 9;
+/// Spherical harmonics are projected from this mip of the sky, as the ninth
+/// coefficient can't hold more detail anyway.
+static const uint32_t kShSourceMip = 3;
+static const uint32_t kSpecularSampleCount = 64;
+static const uint32_t kBrdfLutSampleCount = 256;
+/// Face rows per batch.
+static const uint32_t kMinBatchSize = 8;
+
+static const float kPi = 3.14159265f;
+
+struct IblFileHeader {
+  uint32_t mMagic;
+  uint32_t mVersion;
+  uint32_t mSpecularSize;
+  uint32_t mSpecularMipCount;
+  uint32_t mBrdfLutSize;
+};
+
+/// A GGX sample around +z, shared by every texel of a mip.
+struct IblSample {
+  float mDirection[3];
+  float mNdotL;
+  float mLod;
+};
+
+/// Linear RGB, three floats per texel, every face of a mip in a row.
+struct IblSourceCube {
+  float *pMips[kSourceMipCount];
+};
+
+static void RunRanges(TaskSystem *pTaskSystem, uint32_t count,
+                      TaskSystem::RangeFunc pFunc, void *pUserData) {
+  if (pTaskSystem && count >= 2 * kMinBatchSize) {
+    pTaskSystem->ParallelFor(count, kMinBatchSize, pFunc, pUserData);
+  } else {
+    pFunc(pUserData, 0, count);
+  }
+}
+
+static inline uint32_t GetMipSize(uint32_t size, uint32_t mip) {
+  return size >> mip;
+}
+
+static size_t GetSpecularOffset(uint32_t mip) {
+  size_t offset = 0;
+  for (uint32_t i = 0; i < mip; ++i) {
+    uint32_t size = GetMipSize(ImageBasedLighting::kSpecularSize, i);
+    offset += (size_t)ImageBasedLighting::kFaceCount * size * size * 4;
+  }
+  return offset;
+}
+
+static inline float SrgbToLinear(float value) {
+  return value <= 0.04045f ? value / 12.92f
+                           : powf((value + 0.055f) / 1.055f, 2.4f);
+}
+
+static inline uint8_t LinearToSrgb8(float value) {
+  value = fminf(fmaxf(value, 0.0f), 1.0f);
+  float srgb = value <= 0.0031308f ? value * 12.92f
+                                   : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+  return (uint8_t)(srgb * 255.0f + 0.5f);
+}
+
+static inline void Normalize3(float v[3]) {
+  float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+  v[0] /= length;
+  v[1] /= length;
+  v[2] /= length;
+}
+
+/// Direction through \c (u, v) of \c face, with \c u and \c v in [-1, 1].
+static void GetFaceDirection(uint32_t face, float u, float v, float dir[3]) {
+  switch (face) {
+  case 0:
+    dir[0] = 1.0f, dir[1] = -v, dir[2] = -u;
+    break;
+  case 1:
+    dir[0] = -1.0f, dir[1] = -v, dir[2] = u;
+    break;
+  case 2:
+    dir[0] = u, dir[1] = 1.0f, dir[2] = v;
+    break;
+  case 3:
+    dir[0] = u, dir[1] = -1.0f, dir[2] = -v;
+    break;
+  case 4:
+    dir[0] = u, dir[1] = -v, dir[2] = 1.0f;
+    break;
+  default:
+    dir[0] = -u, dir[1] = -v, dir[2] = -1.0f;
+    break;
+  }
+  Normalize3(dir);
+}
+
+/// Inverse of \c GetFaceDirection, with \c u and \c v in [0, 1].
+static uint32_t GetDirectionFace(const float dir[3], float &u, float &v) {
+  float ax = fabsf(dir[0]), ay = fabsf(dir[1]), az = fabsf(dir[2]);
+  uint32_t face;
+  float sc, tc, ma;
+  if (ax >= ay && ax >= az) {
+    face = dir[0] > 0.0f ? 0 : 1;
+    sc = dir[0] > 0.0f ? -dir[2] : dir[2];
+    tc = -dir[1];
+    ma = ax;
+  } else if (ay >= az) {
+    face = dir[1] > 0.0f ? 2 : 3;
+    sc = dir[0];
+    tc = dir[1] > 0.0f ? dir[2] : -dir[2];
+    ma = ay;
+  } else {
+    face = dir[2] > 0.0f ? 4 : 5;
+    sc = dir[2] > 0.0f ? dir[0] : -dir[0];
+    tc = -dir[1];
+    ma = az;
+  }
+  u = 0.5f * (sc / ma + 1.0f);
+  v = 0.5f * (tc / ma + 1.0f);
+  return face;
+}
+
+/// Bilinear, clamped to the face's edges. \c pTexels holds \c channels
+/// floats per texel.
+static void SampleBilinear(const float *pTexels, uint32_t width,
+                           uint32_t height, uint32_t channels, float u,
+                           float v, float *pOut) {
+  float x = fmaxf(u * (float)width - 0.5f, 0.0f);
+  float y = fmaxf(v * (float)height - 0.5f, 0.0f);
+  uint32_t x0 = min((uint32_t)x, width - 1);
+  uint32_t y0 = min((uint32_t)y, height - 1);
+  uint32_t x1 = min(x0 + 1, width - 1);
+  uint32_t y1 = min(y0 + 1, height - 1);
+  float fx = fminf(x - (float)x0, 1.0f);
+  float fy = fminf(y - (float)y0, 1.0f);
+  const float *p00 = pTexels + ((size_t)y0 * width + x0) * channels;
+  const float *p01 = pTexels + ((size_t)y0 * width + x1) * channels;
+  const float *p10 = pTexels + ((size_t)y1 * width + x0) * channels;
+  const float *p11 = pTexels + ((size_t)y1 * width + x1) * channels;
+  for (uint32_t c = 0; c < channels; ++c) {
+    float top = p00[c] + (p01[c] - p00[c]) * fx;
+    float bottom = p10[c] + (p11[c] - p10[c]) * fx;
+    pOut[c] = top + (bottom - top) * fy;
+  }
+}
+
+/// Trilinear, without filtering across faces.
+static void SampleCube(const IblSourceCube &cube, const float dir[3],
+                       float lod, float color[3]) {
+  float u, v;
+  uint32_t face = GetDirectionFace(dir, u, v);
+  lod = fminf(fmaxf(lod, 0.0f), (float)(kSourceMipCount - 1));
+  uint32_t mip0 = (uint32_t)lod;
+  uint32_t mip1 = min(mip0 + 1, kSourceMipCount - 1);
+  float t = lod - (float)mip0;
+  float c0[3], c1[3];
+  uint32_t size0 = GetMipSize(kSourceSize, mip0);
+  uint32_t size1 = GetMipSize(kSourceSize, mip1);
+  SampleBilinear(cube.pMips[mip0] + (size_t)face * size0 * size0 * 3, size0,
+                 size0, 3, u, v, c0);
+  SampleBilinear(cube.pMips[mip1] + (size_t)face * size1 * size1 * 3, size1,
+                 size1, 3, u, v, c1);
+  for (uint32_t c = 0; c < 3; ++c) {
+    color[c] = c0[c] + (c1[c] - c0[c]) * t;
+  }
+}
+
+/// 2x2 box filter. Odd sizes drop their last row or column.
+static void Downsample(const float *pSrc, uint32_t srcWidth,
+                       uint32_t srcHeight, uint32_t channels, float *pDst) {
+  uint32_t dstWidth = max(srcWidth / 2, 1u);
+  uint32_t dstHeight = max(srcHeight / 2, 1u);
+  for (uint32_t y = 0; y < dstHeight; ++y) {
+    uint32_t y0 = min(2 * y, srcHeight - 1);
+    uint32_t y1 = min(2 * y + 1, srcHeight - 1);
+    for (uint32_t x = 0; x < dstWidth; ++x) {
+      uint32_t x0 = min(2 * x, srcWidth - 1);
+      uint32_t x1 = min(2 * x + 1, srcWidth - 1);
+      for (uint32_t c = 0; c < channels; ++c) {
+        pDst[((size_t)y * dstWidth + x) * channels + c] =
+            0.25f * (pSrc[((size_t)y0 * srcWidth + x0) * channels + c] +
+                     pSrc[((size_t)y0 * srcWidth + x1) * channels + c] +
+                     pSrc[((size_t)y1 * srcWidth + x0) * channels + c] +
+                     pSrc[((size_t)y1 * srcWidth + x1) * channels + c]);
+      }
+    }
+  }
+}
+
+struct SourceFaceJob {
+  const IblSourceFace *pFaces;
+  const float *pSrgbToLinear;
+  float *pLevel0;
+};
+
+/// Converts each face to linear, halves it until it's at most twice the
+/// source size, so that resampling doesn't skip texels, then resamples it.
+static void ResampleSourceFaces(void *pUserData, uint32_t begin,
+                                uint32_t end) {
+  TRACE_SCOPE("Resample Sky Faces");
+  SourceFaceJob &job = *reinterpret_cast<SourceFaceJob *>(pUserData);
+  for (uint32_t face = begin; face < end; ++face) {
+    const IblSourceFace &source = job.pFaces[face];
+    uint32_t width = source.mWidth;
+    uint32_t height = source.mHeight;
+    float *pLevel = reinterpret_cast<float *>(
+        tf_malloc((size_t)width * height * 3 * sizeof(float)));
+    for (size_t i = 0; i < (size_t)width * height; ++i) {
+      for (uint32_t c = 0; c < 3; ++c) {
+        pLevel[i * 3 + c] = job.pSrgbToLinear[source.pPixels[i * 4 + c]];
+      }
+    }
+    while (width > 2 * kSourceSize || height > 2 * kSourceSize) {
+      uint32_t halfWidth = max(width / 2, 1u);
+      uint32_t halfHeight = max(height / 2, 1u);
+      float *pHalf = reinterpret_cast<float *>(
+          tf_malloc((size_t)halfWidth * halfHeight * 3 * sizeof(float)));
+      Downsample(pLevel, width, height, 3, pHalf);
+      tf_free(pLevel);
+      pLevel = pHalf;
+      width = halfWidth;
+      height = halfHeight;
+    }
+    float *pDst = job.pLevel0 + (size_t)face * kSourceSize * kSourceSize * 3;
+    for (uint32_t y = 0; y < kSourceSize; ++y) {
+      for (uint32_t x = 0; x < kSourceSize; ++x) {
+        SampleBilinear(pLevel, width, height, 3,
+                       ((float)x + 0.5f) / (float)kSourceSize,
+                       ((float)y + 0.5f) / (float)kSourceSize,
+                       pDst + ((size_t)y * kSourceSize + x) * 3);
+      }
+    }
+    tf_free(pLevel);
+  }
+}
+
+static inline float GetAreaElement(float x, float y) {
+  return atan2f(x * y, sqrtf(x * x + y * y + 1.0f));
+}
+
+/// Solid angle of texel \c (x, y) of a face of \c size texels.
+static float GetTexelSolidAngle(uint32_t size, uint32_t x, uint32_t y) {
+  float scale = 2.0f / (float)size;
+  float x0 = (float)x * scale - 1.0f, x1 = x0 + scale;
+  float y0 = (float)y * scale - 1.0f, y1 = y0 + scale;
+  return GetAreaElement(x0, y0) - GetAreaElement(x0, y1) -
+         GetAreaElement(x1, y0) + GetAreaElement(x1, y1);
+}
+
+static void EvaluateSh(const float dir[3], float basis[9]) {
+  float x = dir[0], y = dir[1], z = dir[2];
+  basis[0] = 0.282095f;
+  basis[1] = 0.488603f * y;
+  basis[2] = 0.488603f * z;
+  basis[3] = 0.488603f * x;
+  basis[4] = 1.092548f * x * y;
+  basis[5] = 1.092548f * y * z;
+  basis[6] = 0.315392f * (3.0f * z * z - 1.0f);
+  basis[7] = 1.092548f * x * z;
+  basis[8] = 0.546274f * (x * x - y * y);
+}
+
+/// Runs serially, in a fixed order, as it only reads a small mip.
+static void ProjectIrradianceSh(const IblSourceCube &cube,
+                                float coefficients[9][4]) {
+  TRACE_SCOPE("Project Irradiance");
+  double sums[9][3] = {};
+  double totalWeight = 0.0;
+  uint32_t size = GetMipSize(kSourceSize, kShSourceMip);
+  const float *pTexels = cube.pMips[kShSourceMip];
+  for (uint32_t face = 0; face < ImageBasedLighting::kFaceCount; ++face) {
+    for (uint32_t y = 0; y < size; ++y) {
+      for (uint32_t x = 0; x < size; ++x) {
+        float dir[3];
+        GetFaceDirection(face, ((float)x + 0.5f) / (float)size * 2.0f - 1.0f,
+                         ((float)y + 0.5f) / (float)size * 2.0f - 1.0f, dir);
+        float weight = GetTexelSolidAngle(size, x, y);
+        float basis[9];
+        EvaluateSh(dir, basis);
+        const float *pColor =
+            pTexels + (((size_t)face * size + y) * size + x) * 3;
+        for (uint32_t i = 0; i < 9; ++i) {
+          for (uint32_t c = 0; c < 3; ++c) {
+            sums[i][c] += (double)(pColor[c] * basis[i] * weight);
+          }
+        }
+        totalWeight += weight;
+      }
+    }
+  }
+  // The cosine lobe's bands are pi, 2pi/3 and pi/4, divided by pi for
+  // Lambert. Texel solid angles are renormalized to exactly 4pi.
+  const float kBandScales[9] = {1.0f,        2.0f / 3.0f, 2.0f / 3.0f,
+                                2.0f / 3.0f, 0.25f,       0.25f,
+                                0.25f,       0.25f,       0.25f};
+  double normalization = 4.0 * (double)kPi / totalWeight;
+  for (uint32_t i = 0; i < 9; ++i) {
+    for (uint32_t c = 0; c < 3; ++c) {
+      coefficients[i][c] =
+          (float)(sums[i][c] * normalization) * kBandScales[i];
+    }
+    coefficients[i][3] = 0.0f;
+  }
+}
+
+static inline float RadicalInverse(uint32_t bits) {
+  bits = (bits << 16u) | (bits >> 16u);
+  bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+  bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+  bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+  bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+  return (float)bits * 2.3283064365386963e-10f;
+}
+
+/// Half vector of the \c i-th Hammersley point, around +z.
+static void SampleGgx(uint32_t i, uint32_t count, float alpha, float h[3]) {
+  float phi = 2.0f * kPi * ((float)i / (float)count);
+  float xi = RadicalInverse(i);
+  float cosTheta =
+      sqrtf((1.0f - xi) / (1.0f + (alpha * alpha - 1.0f) * xi));
+  float sinTheta = sqrtf(fmaxf(1.0f - cosTheta * cosTheta, 0.0f));
+  h[0] = sinTheta * cosf(phi);
+  h[1] = sinTheta * sinf(phi);
+  h[2] = cosTheta;
+}
+
+/// With N = V = R, every texel of a mip takes the same samples in its own
+/// frame. Each is read from the sky mip whose texels cover about the solid
+/// angle it stands for, which removes most of the noise of few samples.
+static uint32_t BuildSpecularSamples(uint32_t mip, IblSample *pSamples) {
+  float roughness =
+      (float)mip / (float)(ImageBasedLighting::kSpecularMipCount - 1);
+  float alpha = roughness * roughness;
+  float alpha2 = alpha * alpha;
+  float texelSolidAngle =
+      4.0f * kPi / (6.0f * (float)kSourceSize * (float)kSourceSize);
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < kSpecularSampleCount; ++i) {
+    float h[3];
+    SampleGgx(i, kSpecularSampleCount, alpha, h);
+    float nDotH = h[2];
+    float nDotL = 2.0f * nDotH * nDotH - 1.0f;
+    if (nDotL <= 0.0f) {
+      continue;
+    }
+    float denominator = nDotH * nDotH * (alpha2 - 1.0f) + 1.0f;
+    float distribution = alpha2 / (kPi * denominator * denominator);
+    // pdf(L) = D(H) * N.H / (4 * V.H), and V.H = N.H here.
+    float pdf = distribution * 0.25f;
+    float sampleSolidAngle = 1.0f / ((float)kSpecularSampleCount * pdf);
+    IblSample &sample = pSamples[count++];
+    sample.mDirection[0] = 2.0f * nDotH * h[0];
+    sample.mDirection[1] = 2.0f * nDotH * h[1];
+    sample.mDirection[2] = nDotL;
+    sample.mNdotL = nDotL;
+    sample.mLod = fmaxf(
+        0.5f * log2f(sampleSolidAngle / texelSolidAngle) + 1.0f, 0.0f);
+  }
+  return count;
+}
+
+struct SpecularJob {
+  const IblSourceCube *pCube;
+  const IblSample *pSamples;
+  uint32_t mSampleCount;
+  uint32_t mSize;
+  uint8_t *pDst;
+};
+
+/// One face row per item.
+static void PrefilterSpecularRows(void *pUserData, uint32_t begin,
+                                  uint32_t end) {
+  TRACE_SCOPE("Prefilter Specular");
+  SpecularJob &job = *reinterpret_cast<SpecularJob *>(pUserData);
+  uint32_t size = job.mSize;
+  for (uint32_t row = begin; row < end; ++row) {
+    uint32_t face = row / size;
+    uint32_t y = row % size;
+    for (uint32_t x = 0; x < size; ++x) {
+      float n[3];
+      GetFaceDirection(face, ((float)x + 0.5f) / (float)size * 2.0f - 1.0f,
+                       ((float)y + 0.5f) / (float)size * 2.0f - 1.0f, n);
+      float up[3] = {0.0f, 0.0f, 1.0f};
+      if (fabsf(n[2]) > 0.999f) {
+        up[0] = 1.0f, up[2] = 0.0f;
+      }
+      float t[3] = {up[1] * n[2] - up[2] * n[1], up[2] * n[0] - up[0] * n[2],
+                    up[0] * n[1] - up[1] * n[0]};
+      Normalize3(t);
+      float b[3] = {n[1] * t[2] - n[2] * t[1], n[2] * t[0] - n[0] * t[2],
+                    n[0] * t[1] - n[1] * t[0]};
+      float sum[3] = {};
+      float weight = 0.0f;
+      for (uint32_t i = 0; i < job.mSampleCount; ++i) {
+        const IblSample &sample = job.pSamples[i];
+        float l[3];
+        for (uint32_t c = 0; c < 3; ++c) {
+          l[c] = t[c] * sample.mDirection[0] + b[c] * sample.mDirection[1] +
+                 n[c] * sample.mDirection[2];
+        }
+        float color[3];
+        SampleCube(*job.pCube, l, sample.mLod, color);
+        for (uint32_t c = 0; c < 3; ++c) {
+          sum[c] += color[c] * sample.mNdotL;
+        }
+        weight += sample.mNdotL;
+      }
+      uint8_t *pTexel = job.pDst + ((size_t)row * size + x) * 4;
+      for (uint32_t c = 0; c < 3; ++c) {
+        pTexel[c] = LinearToSrgb8(sum[c] / weight);
+      }
+      pTexel[3] = 255;
+    }
+  }
+}
+
+/// Schlick-GGX, with k = alpha / 2 as for image-based lighting.
+static inline float GetGeometrySmith(float nDotV, float nDotL, float alpha) {
+  float k = alpha * 0.5f;
+  return (nDotV / (nDotV * (1.0f - k) + k)) *
+         (nDotL / (nDotL * (1.0f - k) + k));
+}
+
+/// One row, of a single roughness, per item.
+static void IntegrateBrdfRows(void *pUserData, uint32_t begin, uint32_t end) {
+  TRACE_SCOPE("Integrate BRDF");
+  uint16_t *pLut = reinterpret_cast<uint16_t *>(pUserData);
+  const uint32_t size = ImageBasedLighting::kBrdfLutSize;
+  for (uint32_t y = begin; y < end; ++y) {
+    float roughness = ((float)y + 0.5f) / (float)size;
+    float alpha = roughness * roughness;
+    for (uint32_t x = 0; x < size; ++x) {
+      float nDotV = ((float)x + 0.5f) / (float)size;
+      float v[3] = {sqrtf(1.0f - nDotV * nDotV), 0.0f, nDotV};
+      float scale = 0.0f, bias = 0.0f;
+      for (uint32_t i = 0; i < kBrdfLutSampleCount; ++i) {
+        float h[3];
+        SampleGgx(i, kBrdfLutSampleCount, alpha, h);
+        float vDotH = v[0] * h[0] + v[1] * h[1] + v[2] * h[2];
+        float nDotL = 2.0f * vDotH * h[2] - v[2];
+        if (nDotL <= 0.0f || vDotH <= 0.0f) {
+          continue;
+        }
+        float visibility = GetGeometrySmith(nDotV, nDotL, alpha) * vDotH /
+                           (h[2] * nDotV);
+        float fresnel = powf(1.0f - vDotH, 5.0f);
+        scale += (1.0f - fresnel) * visibility;
+        bias += fresnel * visibility;
+      }
+      uint16_t *pTexel = pLut + ((size_t)y * size + x) * 2;
+      pTexel[0] = (uint16_t)(fminf(scale / kBrdfLutSampleCount, 1.0f) *
+                                 65535.0f +
+                             0.5f);
+      pTexel[1] = (uint16_t)(fminf(bias / kBrdfLutSampleCount, 1.0f) *
+                                 65535.0f +
+                             0.5f);
+    }
+  }
+}
+
+void ImageBasedLighting::Allocate() {
+  Destroy();
+  pSpecular = reinterpret_cast<uint8_t *>(
+      tf_malloc(GetSpecularOffset(kSpecularMipCount)));
+  pBrdfLut = reinterpret_cast<uint16_t *>(
+      tf_malloc((size_t)kBrdfLutSize * kBrdfLutSize * 2 * sizeof(uint16_t)));
+}
+
+void ImageBasedLighting::Bake(const IblSourceFace faces[kFaceCount],
+                              TaskSystem *pTaskSystem) {
+  TRACE_SCOPE("Bake Image-Based Lighting");
+  Allocate();
+
+  float srgbToLinear[256];
+  for (uint32_t i = 0; i < 256; ++i) {
+    srgbToLinear[i] = SrgbToLinear((float)i / 255.0f);
+  }
+  IblSourceCube cube = {};
+  for (uint32_t mip = 0; mip < kSourceMipCount; ++mip) {
+    uint32_t size = GetMipSize(kSourceSize, mip);
+    cube.pMips[mip] = reinterpret_cast<float *>(
+        tf_malloc((size_t)kFaceCount * size * size * 3 * sizeof(float)));
+  }
+  SourceFaceJob faceJob = {faces, srgbToLinear, cube.pMips[0]};
+  if (pTaskSystem) {
+    pTaskSystem->ParallelFor(kFaceCount, 1, ResampleSourceFaces, &faceJob);
+  } else {
+    ResampleSourceFaces(&faceJob, 0, kFaceCount);
+  }
+  for (uint32_t mip = 1; mip < kSourceMipCount; ++mip) {
+    uint32_t size = GetMipSize(kSourceSize, mip);
+    for (uint32_t face = 0; face < kFaceCount; ++face) {
+      Downsample(cube.pMips[mip - 1] + (size_t)face * size * size * 4 * 3,
+                 size * 2, size * 2, 3,
+                 cube.pMips[mip] + (size_t)face * size * size * 3);
+    }
+  }
+
+  ProjectIrradianceSh(cube, mIrradianceSh);
+
+  // A mirror reflects the sky as is.
+  const float *pLevel0 = cube.pMips[0];
+  for (size_t i = 0; i < (size_t)kFaceCount * kSourceSize * kSourceSize;
+       ++i) {
+    for (uint32_t c = 0; c < 3; ++c) {
+      pSpecular[i * 4 + c] = LinearToSrgb8(pLevel0[i * 3 + c]);
+    }
+    pSpecular[i * 4 + 3] = 255;
+  }
+  IblSample samples[kSpecularSampleCount];
+  for (uint32_t mip = 1; mip < kSpecularMipCount; ++mip) {
+    SpecularJob job = {&cube, samples, BuildSpecularSamples(mip, samples),
+                       GetMipSize(kSpecularSize, mip),
+                       pSpecular + GetSpecularOffset(mip)};
+    RunRanges(pTaskSystem, kFaceCount * job.mSize, PrefilterSpecularRows,
+              &job);
+  }
+
+  RunRanges(pTaskSystem, kBrdfLutSize, IntegrateBrdfRows, pBrdfLut);
+
+  for (uint32_t mip = 0; mip < kSourceMipCount; ++mip) {
+    tf_free(cube.pMips[mip]);
+  }
+}
+
+bool ImageBasedLighting::Write(ResourceDirectory directory,
+                               const char *pFileName) const {
+  FileStream file = {};
+  if (!fsOpenStreamFromPath(directory, pFileName, FileMode::FM_WRITE,
+                            &file)) {
+    LOGF(eERROR, "Failed to open %s for writing", pFileName);
+    return false;
+  }
+  IblFileHeader header = {kIblFileMagic, kIblFileVersion, kSpecularSize,
+                          kSpecularMipCount, kBrdfLutSize};
+  fsWriteToStream(&file, &header, sizeof(header));
+  fsWriteToStream(&file, mIrradianceSh, sizeof(mIrradianceSh));
+  fsWriteToStream(&file, pSpecular, GetSpecularOffset(kSpecularMipCount));
+  fsWriteToStream(&file, pBrdfLut,
+                  (size_t)kBrdfLutSize * kBrdfLutSize * 2 * sizeof(uint16_t));
+  fsCloseStream(&file);
+  return true;
+}
+
+bool ImageBasedLighting::Read(ResourceDirectory directory,
+                              const char *pFileName) {
+  FileStream file = {};
+  if (!fsOpenStreamFromPath(directory, pFileName, FileMode::FM_READ, &file)) {
+    return false;
+  }
+  IblFileHeader header = {};
+  size_t specularBytes = GetSpecularOffset(kSpecularMipCount);
+  size_t lutBytes = (size_t)kBrdfLutSize * kBrdfLutSize * 2 * sizeof(uint16_t);
+  bool valid =
+      fsReadFromStream(&file, &header, sizeof(header)) == sizeof(header) &&
+      header.mMagic == kIblFileMagic && header.mVersion == kIblFileVersion &&
+      header.mSpecularSize == kSpecularSize &&
+      header.mSpecularMipCount == kSpecularMipCount &&
+      header.mBrdfLutSize == kBrdfLutSize;
+  if (valid) {
+    Allocate();
+    valid = fsReadFromStream(&file, mIrradianceSh, sizeof(mIrradianceSh)) ==
+                sizeof(mIrradianceSh) &&
+            fsReadFromStream(&file, pSpecular, specularBytes) ==
+                specularBytes &&
+            fsReadFromStream(&file, pBrdfLut, lutBytes) == lutBytes;
+  }
+  fsCloseStream(&file);
+  if (!valid) {
+    LOGF(eWARNING, "%s isn't a valid image-based lighting cache", pFileName);
+    Destroy();
+  }
+  return valid;
+}
+
+void ImageBasedLighting::Destroy() {
+  tf_free(pSpecular);
+  tf_free(pBrdfLut);
+  pSpecular = NULL;
+  pBrdfLut = NULL;
+}
+
+const uint8_t *ImageBasedLighting::GetSpecularFace(uint32_t mip,
+                                                   uint32_t face) const {
+  uint32_t size = GetMipSize(kSpecularSize, mip);
+  return pSpecular + GetSpecularOffset(mip) + (size_t)face * size * size * 4;
+}
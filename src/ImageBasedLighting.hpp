@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Utilities/Interfaces/IFileSystem.h"
+
+#include "TaskSystem.hpp"
+
+/// One face of a sky box, as RGBA8 sRGB texels from the top left row.
+struct IblSourceFace {
+  const uint8_t *pPixels;
+  uint32_t mWidth;
+  uint32_t mHeight;
+};
+
+/// Image-based lighting derived from a sky box, baked on the CPU so that it
+/// neither needs nor waits on a GPU:
+///
+/// - Diffuse irradiance, as nine spherical harmonics coefficients already
+///   convolved with the cosine lobe and divided by pi, so that their sum is
+///   the light a white Lambert surface reflects.
+/// - A specular cube map whose mips are the sky convolved with the GGX lobe
+///   of growing roughness, importance sampled from the sky's own mips.
+/// - The split-sum BRDF table, a scale and a bias of F0 indexed by
+///   N.V and roughness.
+///
+/// Faces follow the sky box's order, +x, -x, +y, -y, +z, -z, and are laid
+/// out like D3D and Vulkan cube maps, which the sky box shader matches. The
+/// specular map is baked in parallel over its texels and the table over its
+/// rows; every texel is computed independently, so results don't depend on
+/// the thread count.
+class ImageBasedLighting {
+public:
+  static const uint32_t kFaceCount = 6;
+  static const uint32_t kSpecularSize = 256;
+  /// Down to 4x4, at a roughness of 1.
+  static const uint32_t kSpecularMipCount = 7;
+  static const uint32_t kBrdfLutSize = 128;
+
+  /// Runs on the calling thread when \c pTaskSystem is \c NULL.
+  void Bake(const IblSourceFace faces[kFaceCount], TaskSystem *pTaskSystem);
+  /// Writes the maps to \c pFileName in \c directory.
+  bool Write(ResourceDirectory directory, const char *pFileName) const;
+  /// Returns false if the file is missing or from another version.
+  bool Read(ResourceDirectory directory, const char *pFileName);
+  void Destroy();
+
+  /// Nine linear RGB coefficients, padded to four floats, in the order
+  /// l=0, then l=1 for m=-1..1, then l=2 for m=-2..2.
+  inline const float *GetIrradianceSh() const { return &mIrradianceSh[0][0]; }
+  /// RGBA8 sRGB texels of one face of one mip.
+  const uint8_t *GetSpecularFace(uint32_t mip, uint32_t face) const;
+  /// Two 16-bit UNORM values per texel, N.V along x and roughness along y.
+  inline const uint16_t *GetBrdfLut() const { return pBrdfLut; }
+
+private:
+  float mIrradianceSh[9][4] = {};
+  /// Every face of mip 0, then of mip 1 and so on.
+  uint8_t *pSpecular = NULL;
+  uint16_t *pBrdfLut = NULL;
+
+  void Allocate();
+};
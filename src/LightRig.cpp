@@ -0,0 +1,89 @@
+#include "LightRig.hpp"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+/// xorshift, so that the swarm doesn't change between runs.
+static uint32_t NextRandom(uint32_t &state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+static float NextUnit(uint32_t &state) {
+  return (float)(NextRandom(state) & 0xffffff) / (float)0xffffff;
+}
+
+void LightRig::Destroy() {
+  tf_free(pLights);
+  tf_free(pOrbits);
+  pLights = NULL;
+  pOrbits = NULL;
+  mLightCount = 0;
+  mCapacity = 0;
+}
+
+void LightRig::Generate(uint32_t count, float radius, float intensity,
+                        const vec3 &boundsMin, const vec3 &boundsMax) {
+  count = clamp(count, 1u, ClusteredLighting::kMaxLightCount);
+  if (count > mCapacity) {
+    pLights =
+        reinterpret_cast<Light *>(tf_realloc(pLights, count * sizeof(Light)));
+    pOrbits = reinterpret_cast<float4 *>(
+        tf_realloc(pOrbits, count * sizeof(float4)));
+    mCapacity = count;
+  }
+  mLightCount = count;
+
+  vec3 extent = boundsMax - boundsMin;
+  float size = max(length(extent), 1e-3f);
+  mOrbitRadius = size * 0.02f;
+
+  // The key light replaces the single point light the viewer used to have.
+  pLights[0] = {};
+  pLights[0].mPosition = float3(0.0f, 0.0f, 0.0f);
+  pLights[0].mRadius = size * 1000.0f;
+  pLights[0].mColor = float3(0.9f, 0.9f, 0.7f); // Pale Yellow
+  pLights[0].mType = LightType::Point;
+  pOrbits[0] = float4(0.0f, 0.0f, 0.0f, 0.0f);
+
+  uint32_t random = 0x9e3779b9u;
+  for (uint32_t i = 1; i < count; ++i) {
+    vec3 position = boundsMin + vec3(extent.getX() * NextUnit(random),
+                                     extent.getY() * NextUnit(random),
+                                     extent.getZ() * NextUnit(random));
+    // Saturated hues read better than random RGB.
+    float hue = NextUnit(random) * 6.0f;
+    float red = clamp(fabsf(hue - 3.0f) - 1.0f, 0.0f, 1.0f);
+    float green = clamp(2.0f - fabsf(hue - 2.0f), 0.0f, 1.0f);
+    float blue = clamp(2.0f - fabsf(hue - 4.0f), 0.0f, 1.0f);
+
+    Light &light = pLights[i];
+    light = {};
+    light.mPosition = v3ToF3(position);
+    light.mRadius = size * radius * (0.5f + NextUnit(random));
+    light.mColor =
+        float3(red * intensity, green * intensity, blue * intensity);
+    // Every fourth light is a spot shining down.
+    if (i % 4 == 0) {
+      light.mType = LightType::Spot;
+      light.mDirection = float3(0.0f, -1.0f, 0.0f);
+      light.mSpotCosOuter = cosf(PI / 4.0f);
+      light.mSpotCosInner = cosf(PI / 6.0f);
+    } else {
+      light.mType = LightType::Point;
+    }
+    pOrbits[i] = float4(position.getX(), position.getY(), position.getZ(),
+                        NextUnit(random) * 2.0f * PI);
+  }
+}
+
+void LightRig::Animate(float time) {
+  for (uint32_t i = 1; i < mLightCount; ++i) {
+    const float4 &orbit = pOrbits[i];
+    float angle = time + orbit.w;
+    pLights[i].mPosition =
+        float3(orbit.x + cosf(angle) * mOrbitRadius, orbit.y,
+               orbit.z + sinf(angle) * mOrbitRadius);
+  }
+}
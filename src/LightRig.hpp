@@ -0,0 +1,27 @@
+#pragma once
+
+#include "ClusteredLighting.hpp"
+
+/// The viewer's lights: a key light at the origin, plus a swarm of point and
+/// spot lights scattered through the scene bounds, drifting on small circles.
+class LightRig {
+public:
+  void Destroy();
+
+  /// \c radius is relative to the size of the bounds. The swarm is placed
+  /// deterministically, so the same arguments give the same lights.
+  void Generate(uint32_t count, float radius, float intensity,
+                const vec3 &boundsMin, const vec3 &boundsMax);
+  void Animate(float time);
+
+  inline const Light *GetLights() const { return pLights; }
+  inline uint32_t GetLightCount() const { return mLightCount; }
+
+private:
+  Light *pLights = NULL;
+  /// Center of each light's path, and its phase in \c w.
+  float4 *pOrbits = NULL;
+  uint32_t mLightCount = 0;
+  uint32_t mCapacity = 0;
+  float mOrbitRadius = 0.0f;
+};
@@ -0,0 +1,118 @@
+#include "MemoryAccounting.hpp"
+
+#include "Utilities/Interfaces/ILog.h"
+#include "Utilities/Threading/Atomics.h"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+struct MemoryHeader {
+  uint64_t mSize;
+  uint32_t mCategory;
+  uint32_t mPadding;
+};
+// Keeps the blocks as aligned as tf_malloc's.
+static_assert(sizeof(MemoryHeader) == 16, "MemoryHeader must be 16 bytes");
+
+/// One cache line per category, so that subsystems allocating on different
+/// threads don't contend on the same line.
+struct alignas(64) MemoryCategoryCounters {
+  tfrg_atomic64_t mLiveBytes[kMemoryKindCount];
+  tfrg_atomic64_t mPeakBytes[kMemoryKindCount];
+  tfrg_atomic64_t mLiveCount[kMemoryKindCount];
+  tfrg_atomic64_t mTotalCount[kMemoryKindCount];
+};
+
+static MemoryCategoryCounters gMemoryCounters[kMemoryCategoryCount] = {};
+
+void MemoryTrack(MemoryCategory category, MemoryKind kind, uint64_t bytes) {
+  MemoryCategoryCounters &counters = gMemoryCounters[category];
+  uint64_t live =
+      tfrg_atomic64_add_relaxed(&counters.mLiveBytes[kind], bytes) + bytes;
+  tfrg_atomic64_add_relaxed(&counters.mLiveCount[kind], 1);
+  tfrg_atomic64_add_relaxed(&counters.mTotalCount[kind], 1);
+  uint64_t peak = tfrg_atomic64_load_relaxed(&counters.mPeakBytes[kind]);
+  while (live > peak) {
+    uint64_t previous =
+        tfrg_atomic64_cas_relaxed(&counters.mPeakBytes[kind], peak, live);
+    if (previous == peak) {
+      break;
+    }
+    peak = previous;
+  }
+}
+
+void MemoryUntrack(MemoryCategory category, MemoryKind kind, uint64_t bytes) {
+  MemoryCategoryCounters &counters = gMemoryCounters[category];
+  tfrg_atomic64_add_relaxed(&counters.mLiveBytes[kind], -(int64_t)bytes);
+  tfrg_atomic64_add_relaxed(&counters.mLiveCount[kind], -1);
+}
+
+void *MemoryAlloc(MemoryCategory category, size_t size) {
+  MemoryHeader *pHeader = reinterpret_cast<MemoryHeader *>(
+      tf_malloc(sizeof(MemoryHeader) + size));
+  pHeader->mSize = size;
+  pHeader->mCategory = category;
+  MemoryTrack(category, kMemoryKindCpu, size);
+  return pHeader + 1;
+}
+
+void *MemoryCalloc(MemoryCategory category, size_t count, size_t size) {
+  MemoryHeader *pHeader = reinterpret_cast<MemoryHeader *>(
+      tf_calloc(1, sizeof(MemoryHeader) + count * size));
+  pHeader->mSize = count * size;
+  pHeader->mCategory = category;
+  MemoryTrack(category, kMemoryKindCpu, count * size);
+  return pHeader + 1;
+}
+
+void MemoryFree(void *pMemory) {
+  if (pMemory == NULL) {
+    return;
+  }
+  MemoryHeader *pHeader = reinterpret_cast<MemoryHeader *>(pMemory) - 1;
+  ASSERT(pHeader->mCategory < kMemoryCategoryCount);
+  MemoryUntrack((MemoryCategory)pHeader->mCategory, kMemoryKindCpu,
+                pHeader->mSize);
+  tf_free(pHeader);
+}
+
+MemoryCounters GetMemoryCounters(MemoryCategory category, MemoryKind kind) {
+  MemoryCategoryCounters &counters = gMemoryCounters[category];
+  return {tfrg_atomic64_load_relaxed(&counters.mLiveBytes[kind]),
+          tfrg_atomic64_load_relaxed(&counters.mPeakBytes[kind]),
+          tfrg_atomic64_load_relaxed(&counters.mLiveCount[kind]),
+          tfrg_atomic64_load_relaxed(&counters.mTotalCount[kind])};
+}
+
+const char *GetMemoryCategoryName(MemoryCategory category) {
+  static const char *kNames[kMemoryCategoryCount] = {
+      "Scene",         "SkyBox",          "SceneRenderSystem",
+      "RenderContext", "TextureStreamer", "ChunkStreamer",
+      "GeometryPool",
+  };
+  return kNames[category];
+}
+
+void LogMemoryReport(bool checkLeaks) {
+  const double kMB = 1024.0 * 1024.0;
+  LOGF(eINFO,
+       "Memory by subsystem (live / peak MB, live / total allocations):");
+  for (uint32_t i = 0; i < kMemoryCategoryCount; ++i) {
+    MemoryCounters cpu = GetMemoryCounters((MemoryCategory)i, kMemoryKindCpu);
+    MemoryCounters gpu = GetMemoryCounters((MemoryCategory)i, kMemoryKindGpu);
+    LOGF(eINFO,
+         "  %-18s CPU %8.2f / %8.2f (%llu / %llu), "
+         "GPU %8.2f / %8.2f (%llu / %llu)",
+         GetMemoryCategoryName((MemoryCategory)i), cpu.mLiveBytes / kMB,
+         cpu.mPeakBytes / kMB, (unsigned long long)cpu.mLiveCount,
+         (unsigned long long)cpu.mTotalCount, gpu.mLiveBytes / kMB,
+         gpu.mPeakBytes / kMB, (unsigned long long)gpu.mLiveCount,
+         (unsigned long long)gpu.mTotalCount);
+    if (checkLeaks && (cpu.mLiveCount > 0 || gpu.mLiveCount > 0)) {
+      LOGF(eERROR, "%s leaked %llu CPU bytes and %llu GPU bytes",
+           GetMemoryCategoryName((MemoryCategory)i),
+           (unsigned long long)cpu.mLiveBytes,
+           (unsigned long long)gpu.mLiveBytes);
+    }
+  }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Subsystems whose CPU allocations and GPU resources are accounted for.
+enum MemoryCategory : uint32_t {
+  kMemoryCategoryScene,
+  kMemoryCategorySkyBox,
+  kMemoryCategorySceneRenderSystem,
+  kMemoryCategoryRenderContext,
+  kMemoryCategoryTextureStreamer,
+  kMemoryCategoryChunkStreamer,
+  kMemoryCategoryGeometryPool,
+  kMemoryCategoryCount,
+};
+
+enum MemoryKind : uint32_t {
+  kMemoryKindCpu,
+  kMemoryKindGpu,
+  kMemoryKindCount,
+};
+
+struct MemoryCounters {
+  uint64_t mLiveBytes;
+  uint64_t mPeakBytes;
+  uint64_t mLiveCount;
+  /// Every allocation made so far, including freed ones.
+  uint64_t mTotalCount;
+};
+
+/// Wrap \c tf_malloc, \c tf_calloc and \c tf_free, keeping the size and
+/// category in a header in front of each block, so that a block can be freed
+/// from anywhere. Every counter update is a relaxed atomic, cheap enough to
+/// stay on in release builds.
+void *MemoryAlloc(MemoryCategory category, size_t size);
+void *MemoryCalloc(MemoryCategory category, size_t count, size_t size);
+/// Only for blocks returned by the functions above. \c NULL is ignored.
+void MemoryFree(void *pMemory);
+
+/// Accounts for memory allocated by other means, such as GPU resources or
+/// the internals of helper types. Each \c MemoryTrack must be matched by a
+/// \c MemoryUntrack of the same size.
+void MemoryTrack(MemoryCategory category, MemoryKind kind, uint64_t bytes);
+void MemoryUntrack(MemoryCategory category, MemoryKind kind, uint64_t bytes);
+
+MemoryCounters GetMemoryCounters(MemoryCategory category, MemoryKind kind);
+const char *GetMemoryCategoryName(MemoryCategory category);
+
+/// Logs every category's counters. If \c checkLeaks is set, categories that
+/// still hold memory are reported as errors.
+void LogMemoryReport(bool checkLeaks);
@@ -0,0 +1,226 @@
+#include "OffsetAllocator.hpp"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "Utilities/Interfaces/IMemory.h"
+
+static const uint32_t kMantissaBits = 3;
+static const uint32_t kMantissaValue = 1u << kMantissaBits;
+static const uint32_t kMantissaMask = kMantissaValue - 1;
+
+/// Both take a non-zero argument.
+static inline uint32_t FindLowestSetBit(uint32_t bits) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, bits);
+  return (uint32_t)index;
+#else
+  return (uint32_t)__builtin_ctz(bits);
+#endif
+}
+static inline uint32_t FindHighestSetBit(uint32_t bits) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanReverse(&index, bits);
+  return (uint32_t)index;
+#else
+  return 31 - (uint32_t)__builtin_clz(bits);
+#endif
+}
+
+/// Bin of the regions of \c size: an exponent in the high bits and the 3
+/// bits below the leading one as mantissa, sizes below 8 being their own
+/// bin.
+static uint32_t GetBinRoundingDown(uint32_t size) {
+  if (size < kMantissaValue) {
+    return size;
+  }
+  uint32_t mantissaShift = FindHighestSetBit(size) - kMantissaBits;
+  return ((mantissaShift + 1) << kMantissaBits) |
+         ((size >> mantissaShift) & kMantissaMask);
+}
+
+/// Smallest bin whose regions all fit \c size. Rounding the mantissa up may
+/// carry into the exponent, hence the addition.
+static uint32_t GetBinRoundingUp(uint32_t size) {
+  if (size < kMantissaValue) {
+    return size;
+  }
+  uint32_t mantissaShift = FindHighestSetBit(size) - kMantissaBits;
+  uint32_t mantissa = (size >> mantissaShift) & kMantissaMask;
+  if (size & ((1u << mantissaShift) - 1)) {
+    mantissa++;
+  }
+  return ((mantissaShift + 1) << kMantissaBits) + mantissa;
+}
+
+bool OffsetAllocator::Init(uint32_t size, uint32_t maxAllocationCount) {
+  Destroy();
+  // Free regions never outnumber allocations by more than one.
+  mNodeCapacity = maxAllocationCount * 2 + 1;
+  pNodes = reinterpret_cast<Node *>(tf_malloc(mNodeCapacity * sizeof(Node)));
+  pUnusedNodes = reinterpret_cast<uint32_t *>(
+      tf_malloc(mNodeCapacity * sizeof(uint32_t)));
+  if (!pNodes || !pUnusedNodes) {
+    Destroy();
+    return false;
+  }
+  // Popped from the back, so nodes are used in order.
+  for (uint32_t i = 0; i < mNodeCapacity; ++i) {
+    pUnusedNodes[i] = mNodeCapacity - 1 - i;
+  }
+  mUnusedNodeCount = mNodeCapacity;
+  for (uint32_t i = 0; i < kBinCount; ++i) {
+    mBinHeads[i] = kNoNode;
+  }
+  mSize = size;
+  mMaxAllocationCount = maxAllocationCount;
+  if (size > 0) {
+    InsertFreeNode(0, size);
+  }
+  return true;
+}
+
+void OffsetAllocator::Destroy() {
+  tf_free(pNodes);
+  tf_free(pUnusedNodes);
+  *this = OffsetAllocator();
+}
+
+uint32_t OffsetAllocator::InsertFreeNode(uint32_t offset, uint32_t size) {
+  uint32_t bin = GetBinRoundingDown(size);
+  uint32_t topBin = bin >> kMantissaBits;
+  uint32_t leafBin = bin & kMantissaMask;
+  mUsedTopBins |= 1u << topBin;
+  mUsedLeafBins[topBin] |= (uint8_t)(1u << leafBin);
+
+  uint32_t node = pUnusedNodes[--mUnusedNodeCount];
+  uint32_t head = mBinHeads[bin];
+  pNodes[node] = {offset, size, kNoNode, head, kNoNode, kNoNode, false};
+  if (head != kNoNode) {
+    pNodes[head].mBinPrevious = node;
+  }
+  mBinHeads[bin] = node;
+  mFreeSize += size;
+  return node;
+}
+
+void OffsetAllocator::RemoveFreeNode(uint32_t node) {
+  const Node &removed = pNodes[node];
+  if (removed.mBinPrevious != kNoNode) {
+    pNodes[removed.mBinPrevious].mBinNext = removed.mBinNext;
+  } else {
+    uint32_t bin = GetBinRoundingDown(removed.mSize);
+    mBinHeads[bin] = removed.mBinNext;
+    if (removed.mBinNext == kNoNode) {
+      uint32_t topBin = bin >> kMantissaBits;
+      mUsedLeafBins[topBin] &= (uint8_t)~(1u << (bin & kMantissaMask));
+      if (mUsedLeafBins[topBin] == 0) {
+        mUsedTopBins &= ~(1u << topBin);
+      }
+    }
+  }
+  if (removed.mBinNext != kNoNode) {
+    pNodes[removed.mBinNext].mBinPrevious = removed.mBinPrevious;
+  }
+  mFreeSize -= removed.mSize;
+}
+
+OffsetAllocation OffsetAllocator::Allocate(uint32_t size) {
+  OffsetAllocation allocation = {kInvalidOffset, kNoNode};
+  if (mAllocationCount == mMaxAllocationCount || size > mFreeSize) {
+    return allocation;
+  }
+  uint32_t minBin = GetBinRoundingUp(size);
+  uint32_t topBin = minBin >> kMantissaBits;
+  uint32_t bin = kNoNode;
+  if (topBin < kTopBinCount && (mUsedTopBins & (1u << topBin))) {
+    uint32_t leafBins =
+        mUsedLeafBins[topBin] & (0xffu << (minBin & kMantissaMask)) & 0xffu;
+    if (leafBins) {
+      bin = (topBin << kMantissaBits) | FindLowestSetBit(leafBins);
+    }
+  }
+  if (bin == kNoNode) {
+    uint32_t topBins =
+        topBin + 1 < kTopBinCount ? mUsedTopBins & (~0u << (topBin + 1)) : 0;
+    if (topBins == 0) {
+      return allocation;
+    }
+    topBin = FindLowestSetBit(topBins);
+    bin = (topBin << kMantissaBits) |
+          FindLowestSetBit(mUsedLeafBins[topBin]);
+  }
+
+  uint32_t node = mBinHeads[bin];
+  RemoveFreeNode(node);
+  Node &used = pNodes[node];
+  uint32_t remainder = used.mSize - size;
+  used.mSize = size;
+  used.mUsed = true;
+  if (remainder > 0) {
+    uint32_t rest = InsertFreeNode(used.mOffset + size, remainder);
+    // InsertFreeNode doesn't move pNodes, so `used` is still valid.
+    pNodes[rest].mNeighbourPrevious = node;
+    pNodes[rest].mNeighbourNext = used.mNeighbourNext;
+    if (used.mNeighbourNext != kNoNode) {
+      pNodes[used.mNeighbourNext].mNeighbourPrevious = rest;
+    }
+    used.mNeighbourNext = rest;
+  }
+  mAllocationCount++;
+  allocation.mOffset = used.mOffset;
+  allocation.mNode = node;
+  return allocation;
+}
+
+void OffsetAllocator::Free(OffsetAllocation allocation) {
+  uint32_t node = allocation.mNode;
+  Node &freed = pNodes[node];
+  uint32_t offset = freed.mOffset;
+  uint32_t size = freed.mSize;
+  uint32_t previous = freed.mNeighbourPrevious;
+  uint32_t next = freed.mNeighbourNext;
+  if (previous != kNoNode && !pNodes[previous].mUsed) {
+    offset = pNodes[previous].mOffset;
+    size += pNodes[previous].mSize;
+    RemoveFreeNode(previous);
+    pUnusedNodes[mUnusedNodeCount++] = previous;
+    previous = pNodes[previous].mNeighbourPrevious;
+  }
+  if (next != kNoNode && !pNodes[next].mUsed) {
+    size += pNodes[next].mSize;
+    RemoveFreeNode(next);
+    pUnusedNodes[mUnusedNodeCount++] = next;
+    next = pNodes[next].mNeighbourNext;
+  }
+  pUnusedNodes[mUnusedNodeCount++] = node;
+
+  uint32_t merged = InsertFreeNode(offset, size);
+  pNodes[merged].mNeighbourPrevious = previous;
+  pNodes[merged].mNeighbourNext = next;
+  if (previous != kNoNode) {
+    pNodes[previous].mNeighbourNext = merged;
+  }
+  if (next != kNoNode) {
+    pNodes[next].mNeighbourPrevious = merged;
+  }
+  mAllocationCount--;
+}
+
+uint32_t OffsetAllocator::GetLargestFreeSize() const {
+  if (mUsedTopBins == 0) {
+    return 0;
+  }
+  uint32_t topBin = FindHighestSetBit(mUsedTopBins);
+  uint32_t bin = (topBin << kMantissaBits) |
+                 FindHighestSetBit(mUsedLeafBins[topBin]);
+  uint32_t largest = 0;
+  for (uint32_t node = mBinHeads[bin]; node != kNoNode;
+       node = pNodes[node].mBinNext) {
+    largest = pNodes[node].mSize > largest ? pNodes[node].mSize : largest;
+  }
+  return largest;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// A range handed out by \c OffsetAllocator. \c mNode identifies it when
+/// it's freed.
+struct OffsetAllocation {
+  uint32_t mOffset;
+  uint32_t mNode;
+};
+
+/// Hands out ranges of a linear space, such as a buffer's elements, in
+/// constant time, two-level segregated fit style. Free regions are kept in
+/// 256 bins whose sizes grow like a float with a 3-bit mantissa; two levels
+/// of bit masks find the smallest non-empty bin that fits a request, and a
+/// freed range merges with its free neighbours right away.
+///
+/// Requests are rounded up to the next bin, so any region of that bin fits
+/// them: lookups never walk a list, at the cost of up to 1/8 of the space
+/// being unusable to a request that an exact search would have satisfied.
+class OffsetAllocator {
+public:
+  static const uint32_t kInvalidOffset = ~0u;
+
+  /// \c size is in arbitrary units. Returns false if out of memory.
+  bool Init(uint32_t size, uint32_t maxAllocationCount);
+  void Destroy();
+
+  /// \c size must be non-zero. \c mOffset is \c kInvalidOffset if no free
+  /// region fits \c size, or if \c maxAllocationCount ranges are already
+  /// allocated.
+  OffsetAllocation Allocate(uint32_t size);
+  void Free(OffsetAllocation allocation);
+
+  inline uint32_t GetSize() const { return mSize; }
+  inline uint32_t GetFreeSize() const { return mFreeSize; }
+  inline uint32_t GetAllocationCount() const { return mAllocationCount; }
+  /// Size of a live allocation.
+  inline uint32_t GetAllocationSize(OffsetAllocation allocation) const {
+    return pNodes[allocation.mNode].mSize;
+  }
+  /// Walks the largest non-empty bin, which rarely holds more than a few
+  /// regions.
+  uint32_t GetLargestFreeSize() const;
+  /// Bytes held for bookkeeping.
+  inline uint64_t GetSizeBytes() const {
+    return (uint64_t)mNodeCapacity * (sizeof(Node) + sizeof(uint32_t));
+  }
+
+private:
+  static const uint32_t kTopBinCount = 32;
+  static const uint32_t kLeafBinCount = 8;
+  static const uint32_t kBinCount = kTopBinCount * kLeafBinCount;
+  static const uint32_t kNoNode = ~0u;
+
+  struct Node {
+    uint32_t mOffset;
+    uint32_t mSize;
+    /// Other free regions of the same bin.
+    uint32_t mBinPrevious;
+    uint32_t mBinNext;
+    /// Adjacent regions, free or not, by offset.
+    uint32_t mNeighbourPrevious;
+    uint32_t mNeighbourNext;
+    bool mUsed;
+  };
+
+  uint32_t InsertFreeNode(uint32_t offset, uint32_t size);
+  void RemoveFreeNode(uint32_t node);
+
+  uint32_t mSize = 0;
+  uint32_t mFreeSize = 0;
+  uint32_t mAllocationCount = 0;
+  uint32_t mMaxAllocationCount = 0;
+
+  Node *pNodes = NULL;
+  uint32_t mNodeCapacity = 0;
+  /// Stack of unused entries of \c pNodes.
+  uint32_t *pUnusedNodes = NULL;
+  uint32_t mUnusedNodeCount = 0;
+
+  /// Bit \c i is set if any bin of top-level bin \c i holds a region.
+  uint32_t mUsedTopBins = 0;
+  uint8_t mUsedLeafBins[kTopBinCount] = {};
+  /// First free region of each bin.
+  uint32_t mBinHeads[kBinCount] = {};
+};
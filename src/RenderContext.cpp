@@ -4,7 +4,14 @@
 #include "Application/Interfaces/IScreenshot.h"
 #include "Application/Interfaces/IUI.h"
 
-bool RenderContext::Init(const char *appName) {
+#include "Utilities/Interfaces/ITime.h"
+#include "Utilities/ThirdParty/OpenSource/Nothings/stb_ds.h"
+
+#include "RenderStats.hpp"
+#include "Trace.hpp"
+
+bool RenderContext::Init(const char *appName,
+                         const GeometryPoolDesc &geometryPoolDesc) {
   RendererDesc settings;
   memset(&settings, 0, sizeof(settings));
   initGPUConfiguration(settings.pExtendedSettings);
@@ -32,6 +39,27 @@ bool RenderContext::Init(const char *appName) {
 
   initResourceLoaderInterface(pRenderer);
 
+  if (!mGeometryPool.Init(geometryPoolDesc)) {
+    return false;
+  }
+
+  QueryPoolDesc queryPoolDesc = {};
+  queryPoolDesc.mType = QUERY_TYPE_TIMESTAMP;
+  queryPoolDesc.mQueryCount = kMaxGpuScopeCount * 2;
+  BufferLoadDesc readbackDesc = {};
+  readbackDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_TO_CPU;
+  readbackDesc.mDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
+  readbackDesc.mDesc.mStartState = RESOURCE_STATE_COPY_DEST;
+  readbackDesc.mDesc.mSize = kMaxGpuScopeCount * 2 * sizeof(uint64_t);
+  readbackDesc.mDesc.pName = "GpuScopeReadbackBuffer";
+  for (uint32_t i = 0; i < kDataBufferCount; ++i) {
+    addQueryPool(pRenderer, &queryPoolDesc, &mGpuScopes[i].pQueryPool);
+    readbackDesc.ppBuffer = &mGpuScopes[i].pReadbackBuffer;
+    addResource(&readbackDesc, NULL);
+    TrackResource(kMemoryCategoryRenderContext, mGpuScopes[i].pReadbackBuffer);
+  }
+  getTimestampFrequency(pGraphicsQueue, &mTimestampFrequency);
+
   FontSystemDesc fontRenderDesc = {};
   fontRenderDesc.pRenderer = pRenderer;
   if (!initFontSystem(&fontRenderDesc))
@@ -52,6 +80,16 @@ bool RenderContext::Init(const char *appName) {
 }
 
 void RenderContext::Exit() {
+  WaitIdle();
+  arrfree(pDeferredDeletions);
+  mGeometryPool.Exit();
+  for (uint32_t i = 0; i < kDataBufferCount; ++i) {
+    removeQueryPool(pRenderer, mGpuScopes[i].pQueryPool);
+    MemoryUntrack(kMemoryCategoryRenderContext, kMemoryKindGpu,
+                  mGpuScopes[i].pReadbackBuffer->mSize);
+    removeResource(mGpuScopes[i].pReadbackBuffer);
+  }
+
   exitScreenshotInterface();
 
   exitUserInterface();
@@ -104,15 +142,72 @@ bool RenderContext::Load(WindowHandle hWindow, uint32_t width, uint32_t height,
     depthRT.mDepth = 1;
     depthRT.mFormat = TinyImageFormat_D32_SFLOAT;
     depthRT.mStartState = RESOURCE_STATE_DEPTH_WRITE;
+    // Ambient occlusion samples it, so it can't live on tile memory.
+    depthRT.mDescriptors = DESCRIPTOR_TYPE_TEXTURE;
     depthRT.mWidth = width;
     depthRT.mHeight = height;
     depthRT.mSampleCount = SAMPLE_COUNT_1;
     depthRT.mSampleQuality = 0;
-    depthRT.mFlags =
-        TEXTURE_CREATION_FLAG_ON_TILE | TEXTURE_CREATION_FLAG_VR_MULTIVIEW;
+    depthRT.mFlags = TEXTURE_CREATION_FLAG_VR_MULTIVIEW;
     addRenderTarget(pRenderer, &depthRT, &pDepthBuffer);
     if (pDepthBuffer == NULL)
       return false;
+
+    // Add scene color buffer
+    RenderTargetDesc sceneColorRT = {};
+    sceneColorRT.mArraySize = 1;
+    sceneColorRT.mClearValue = {{0.0f, 0.0f, 0.0f, 0.0f}};
+    sceneColorRT.mDepth = 1;
+    sceneColorRT.mFormat = pSwapChain->ppRenderTargets[0]->mFormat;
+    sceneColorRT.mStartState = RESOURCE_STATE_SHADER_RESOURCE;
+    sceneColorRT.mDescriptors = DESCRIPTOR_TYPE_TEXTURE;
+    sceneColorRT.mWidth = width;
+    sceneColorRT.mHeight = height;
+    sceneColorRT.mSampleCount = SAMPLE_COUNT_1;
+    sceneColorRT.mSampleQuality = 0;
+    sceneColorRT.pName = "SceneColor";
+    addRenderTarget(pRenderer, &sceneColorRT, &pSceneColor);
+    if (pSceneColor == NULL)
+      return false;
+
+    // Add ambient occlusion buffer
+    RenderTargetDesc ambientOcclusionRT = {};
+    ambientOcclusionRT.mArraySize = 1;
+    ambientOcclusionRT.mClearValue = {{1.0f, 1.0f, 1.0f, 1.0f}};
+    ambientOcclusionRT.mDepth = 1;
+    ambientOcclusionRT.mFormat = TinyImageFormat_R8_UNORM;
+    ambientOcclusionRT.mStartState = RESOURCE_STATE_SHADER_RESOURCE;
+    ambientOcclusionRT.mDescriptors = DESCRIPTOR_TYPE_TEXTURE;
+    ambientOcclusionRT.mWidth = (width + 1) / 2;
+    ambientOcclusionRT.mHeight = (height + 1) / 2;
+    ambientOcclusionRT.mSampleCount = SAMPLE_COUNT_1;
+    ambientOcclusionRT.mSampleQuality = 0;
+    ambientOcclusionRT.pName = "AmbientOcclusion";
+    addRenderTarget(pRenderer, &ambientOcclusionRT, &pAmbientOcclusion);
+    if (pAmbientOcclusion == NULL)
+      return false;
+
+    // Add visibility buffer
+    RenderTargetDesc visibilityRT = {};
+    visibilityRT.mArraySize = 1;
+    // Cleared to ~0u, the ID of no triangle.
+    visibilityRT.mClearValue = {{1.0f, 1.0f, 1.0f, 1.0f}};
+    visibilityRT.mDepth = 1;
+    // IDs are packed as four unorm bytes, which round-trip exactly.
+    visibilityRT.mFormat = TinyImageFormat_R8G8B8A8_UNORM;
+    visibilityRT.mStartState = RESOURCE_STATE_SHADER_RESOURCE;
+    visibilityRT.mDescriptors = DESCRIPTOR_TYPE_TEXTURE;
+    visibilityRT.mWidth = width;
+    visibilityRT.mHeight = height;
+    visibilityRT.mSampleCount = SAMPLE_COUNT_1;
+    visibilityRT.mSampleQuality = 0;
+    visibilityRT.pName = "VisibilityBuffer";
+    addRenderTarget(pRenderer, &visibilityRT, &pVisibilityBuffer);
+    if (pVisibilityBuffer == NULL)
+      return false;
+
+    MemoryTrack(kMemoryCategoryRenderContext, kMemoryKindGpu,
+                GetRenderTargetBytes());
   }
 
   UserInterfaceLoadDesc uiLoad = {};
@@ -138,13 +233,24 @@ void RenderContext::Unload(ReloadDesc *pReloadDesc) {
   unloadUserInterface(pReloadDesc->mType);
 
   if (pReloadDesc->mType & (RELOAD_TYPE_RESIZE | RELOAD_TYPE_RENDERTARGET)) {
+    MemoryUntrack(kMemoryCategoryRenderContext, kMemoryKindGpu,
+                  GetRenderTargetBytes());
     removeSwapChain(pRenderer, pSwapChain);
     removeRenderTarget(pRenderer, pDepthBuffer);
+    removeRenderTarget(pRenderer, pSceneColor);
+    removeRenderTarget(pRenderer, pAmbientOcclusion);
+    removeRenderTarget(pRenderer, pVisibilityBuffer);
     unloadProfilerUI();
   }
 }
 
-void RenderContext::WaitIdle() { waitQueueIdle(pGraphicsQueue); }
+void RenderContext::WaitIdle() {
+  TRACE_SCOPE("Wait Queue Idle");
+  waitQueueIdle(pGraphicsQueue);
+  mCompletedSubmission = mSubmissionCount;
+  ReleaseDeferredDeletions();
+  mGeometryPool.Update(mCompletedSubmission);
+}
 
 void RenderContext::ToggleVSync() { ::toggleVSync(pRenderer, &pSwapChain); }
 
@@ -152,10 +258,103 @@ bool RenderContext::IsVSyncEnabled() const {
   return (bool)pSwapChain->mEnableVsync;
 }
 
+void RenderContext::SetRenderScale(float scale) {
+  mRenderScale = clamp(scale, 0.1f, 1.0f);
+}
+
 ProfileToken RenderContext::CreateGpuProfiler(const char *pProfilerName) {
   return initGpuProfiler(pRenderer, pGraphicsQueue, pProfilerName);
 }
 
+void RenderContext::BeginGpuFrameProfile(Cmd *pCmd, ProfileToken token) {
+  cmdBeginGpuFrameProfile(pCmd, token);
+  cmdResetQuery(pCmd, mGpuScopes[mFrameIndex].pQueryPool, 0,
+                kMaxGpuScopeCount * 2);
+}
+
+void RenderContext::EndGpuFrameProfile(Cmd *pCmd, ProfileToken token) {
+  GpuScopes &scopes = mGpuScopes[mFrameIndex];
+  ASSERT(scopes.mDepth == 0);
+  if (scopes.mCount > 0) {
+    cmdResolveQuery(pCmd, scopes.pQueryPool, scopes.pReadbackBuffer, 0,
+                    scopes.mCount * 2);
+    scopes.mResolvedCount = scopes.mCount;
+  }
+  cmdEndGpuFrameProfile(pCmd, token);
+}
+
+void RenderContext::BeginGpuScope(Cmd *pCmd, ProfileToken token,
+                                  const char *pName) {
+  cmdBeginGpuTimestampQuery(pCmd, token, pName);
+  GpuScopes &scopes = mGpuScopes[mFrameIndex];
+  if (scopes.mDepth >= kMaxGpuScopeDepth) {
+    ++scopes.mDepth;
+    return;
+  }
+  uint32_t index = ~0u;
+  if (scopes.mCount < kMaxGpuScopeCount) {
+    index = scopes.mCount++;
+    scopes.pNames[index] = pName;
+    QueryDesc query = {index * 2};
+    cmdBeginQuery(pCmd, scopes.pQueryPool, &query);
+  }
+  scopes.mStack[scopes.mDepth++] = index;
+}
+
+void RenderContext::EndGpuScope(Cmd *pCmd, ProfileToken token) {
+  GpuScopes &scopes = mGpuScopes[mFrameIndex];
+  ASSERT(scopes.mDepth > 0);
+  uint32_t depth = --scopes.mDepth;
+  if (depth < kMaxGpuScopeDepth && scopes.mStack[depth] != ~0u) {
+    QueryDesc query = {scopes.mStack[depth] * 2 + 1};
+    cmdEndQuery(pCmd, scopes.pQueryPool, &query);
+  }
+  cmdEndGpuTimestampQuery(pCmd, token);
+}
+
+void RenderContext::CollectGpuScopes(GpuScopes &scopes) {
+  uint32_t count = scopes.mResolvedCount;
+  scopes.mCount = 0;
+  scopes.mResolvedCount = 0;
+  scopes.mDepth = 0;
+  if (count == 0 || mTimestampFrequency <= 0.0) {
+    return;
+  }
+  const uint64_t *pTicks = reinterpret_cast<const uint64_t *>(
+      scopes.pReadbackBuffer->pCpuMappedAddress);
+  double usecPerTick = 1e6 / mTimestampFrequency;
+  int64_t gpuBeginUSec = (int64_t)(pTicks[0] * usecPerTick);
+  int64_t gpuEndUSec = gpuBeginUSec;
+  for (uint32_t i = 0; i < count; ++i) {
+    int64_t endUSec = (int64_t)(pTicks[i * 2 + 1] * usecPerTick);
+    gpuEndUSec = endUSec > gpuEndUSec ? endUSec : gpuEndUSec;
+  }
+
+  // The GPU clock is mapped onto the CPU's by an offset. The frame can't
+  // have started before it was submitted, nor ended after now, so the
+  // previous offset is clamped between those bounds; it converges on frames
+  // submitted to an idle GPU.
+  int64_t minOffset = scopes.mSubmitUSec - gpuBeginUSec;
+  int64_t maxOffset = getUSec(true) - gpuEndUSec;
+  if (!mGpuClockCalibrated) {
+    mGpuClockOffsetUSec = minOffset;
+    mGpuClockCalibrated = true;
+  }
+  mGpuClockOffsetUSec =
+      mGpuClockOffsetUSec > maxOffset ? maxOffset : mGpuClockOffsetUSec;
+  mGpuClockOffsetUSec =
+      mGpuClockOffsetUSec < minOffset ? minOffset : mGpuClockOffsetUSec;
+
+  for (uint32_t i = 0; i < count; ++i) {
+    int64_t beginUSec = (int64_t)(pTicks[i * 2] * usecPerTick);
+    int64_t endUSec = (int64_t)(pTicks[i * 2 + 1] * usecPerTick);
+    TraceAddGpuEvent(scopes.pNames[i], beginUSec + mGpuClockOffsetUSec,
+                     endUSec + mGpuClockOffsetUSec);
+    mGpuScopeTimings[i] = {scopes.pNames[i], (endUSec - beginUSec) / 1000.0f};
+  }
+  mGpuScopeTimingCount = count;
+}
+
 Sampler *RenderContext::CreateSampler(SamplerDesc *pDesc) {
   Sampler *pSampler;
   addSampler(pRenderer, pDesc, &pSampler);
@@ -206,10 +405,143 @@ void RenderContext::DestroyPipeline(Pipeline *pPipeline) {
   removePipeline(pRenderer, pPipeline);
 }
 
+void RenderContext::CompactGeometry(Cmd *pCmd) {
+  // The frame being recorded is the next submission.
+  mGeometryPool.Compact(pCmd, mSubmissionCount + 1);
+}
+
+static uint64_t GetGeometryBytes(const Geometry *pGeometry) {
+  uint64_t bytes = pGeometry->pIndexBuffer->mSize;
+  for (uint32_t i = 0; i < pGeometry->mVertexBufferCount; ++i) {
+    bytes += pGeometry->pVertexBuffers[i]->mSize;
+  }
+  return bytes;
+}
+
+static uint64_t GetTextureBytes(const Texture *pTexture) {
+  TinyImageFormat format = (TinyImageFormat)pTexture->mFormat;
+  uint64_t blockBytes = TinyImageFormat_BitSizeOfBlock(format) / 8;
+  uint32_t blockWidth = TinyImageFormat_WidthOfBlock(format);
+  uint32_t blockHeight = TinyImageFormat_HeightOfBlock(format);
+  uint64_t bytes = 0;
+  for (uint32_t mip = 0; mip < pTexture->mMipLevels; ++mip) {
+    uint32_t width = max((uint32_t)pTexture->mWidth >> mip, 1u);
+    uint32_t height = max((uint32_t)pTexture->mHeight >> mip, 1u);
+    uint32_t depth = max((uint32_t)pTexture->mDepth >> mip, 1u);
+    bytes += (uint64_t)((width + blockWidth - 1) / blockWidth) *
+             ((height + blockHeight - 1) / blockHeight) * depth * blockBytes;
+  }
+  return bytes * (pTexture->mArraySizeMinusOne + 1);
+}
+
+uint64_t RenderContext::GetRenderTargetBytes() const {
+  uint64_t bytes = GetTextureBytes(pDepthBuffer->pTexture) +
+                   GetTextureBytes(pSceneColor->pTexture) +
+                   GetTextureBytes(pAmbientOcclusion->pTexture) +
+                   GetTextureBytes(pVisibilityBuffer->pTexture);
+  for (uint32_t i = 0; i < pSwapChain->mImageCount; ++i) {
+    bytes += GetTextureBytes(pSwapChain->ppRenderTargets[i]->pTexture);
+  }
+  return bytes;
+}
+
+void RenderContext::TrackResource(MemoryCategory category, Buffer *pBuffer) {
+  MemoryTrack(category, kMemoryKindGpu, pBuffer->mSize);
+}
+void RenderContext::TrackResource(MemoryCategory category,
+                                  Texture *pTexture) {
+  MemoryTrack(category, kMemoryKindGpu, GetTextureBytes(pTexture));
+}
+void RenderContext::TrackResource(MemoryCategory category,
+                                  Geometry *pGeometry) {
+  MemoryTrack(category, kMemoryKindGpu, GetGeometryBytes(pGeometry));
+}
+
+void RenderContext::DeferDestroy(Buffer *pBuffer, MemoryCategory category) {
+  if (pBuffer) {
+    DeferDestroy(DeferredKind::Buffer, pBuffer, category, pBuffer->mSize);
+  }
+}
+void RenderContext::DeferDestroy(Texture *pTexture, MemoryCategory category) {
+  if (pTexture) {
+    DeferDestroy(DeferredKind::Texture, pTexture, category,
+                 GetTextureBytes(pTexture));
+  }
+}
+void RenderContext::DeferDestroy(Geometry *pGeometry,
+                                 MemoryCategory category) {
+  if (pGeometry) {
+    DeferDestroy(DeferredKind::Geometry, pGeometry, category,
+                 GetGeometryBytes(pGeometry));
+  }
+}
+void RenderContext::DeferDestroy(Pipeline *pPipeline) {
+  DeferDestroy(DeferredKind::Pipeline, pPipeline, kMemoryCategoryRenderContext,
+               0);
+}
+void RenderContext::DeferDestroy(DescriptorSet *pDescriptorSet) {
+  DeferDestroy(DeferredKind::DescriptorSet, pDescriptorSet,
+               kMemoryCategoryRenderContext, 0);
+}
+
+void RenderContext::DeferDestroy(DeferredKind kind, void *pResource,
+                                 MemoryCategory category, uint64_t bytes) {
+  if (pResource == NULL) {
+    return;
+  }
+  // The frame being recorded, if any, is the next submission.
+  DeferredDeletion deletion = {kind, category, pResource,
+                               mSubmissionCount + 1, bytes};
+  arrpush(pDeferredDeletions, deletion);
+  mPendingDeletionBytes += bytes;
+}
+
+DeletionQueueStats RenderContext::GetDeletionQueueStats() const {
+  return {(uint32_t)arrlen(pDeferredDeletions), mPendingDeletionBytes,
+          mReleasedDeletionCount};
+}
+
+void RenderContext::ReleaseDeferredDeletions() {
+  for (ptrdiff_t i = arrlen(pDeferredDeletions) - 1; i >= 0; --i) {
+    const DeferredDeletion &deletion = pDeferredDeletions[i];
+    if (deletion.mSubmission > mCompletedSubmission) {
+      continue;
+    }
+    switch (deletion.mKind) {
+    case DeferredKind::Buffer:
+      removeResource(reinterpret_cast<Buffer *>(deletion.pResource));
+      MemoryUntrack(deletion.mCategory, kMemoryKindGpu, deletion.mBytes);
+      break;
+    case DeferredKind::Texture:
+      removeResource(reinterpret_cast<Texture *>(deletion.pResource));
+      MemoryUntrack(deletion.mCategory, kMemoryKindGpu, deletion.mBytes);
+      break;
+    case DeferredKind::Geometry:
+      removeResource(reinterpret_cast<Geometry *>(deletion.pResource));
+      MemoryUntrack(deletion.mCategory, kMemoryKindGpu, deletion.mBytes);
+      break;
+    case DeferredKind::Pipeline:
+      removePipeline(pRenderer,
+                     reinterpret_cast<Pipeline *>(deletion.pResource));
+      break;
+    case DeferredKind::DescriptorSet:
+      removeDescriptorSet(
+          pRenderer, reinterpret_cast<DescriptorSet *>(deletion.pResource));
+      break;
+    }
+    mPendingDeletionBytes -= deletion.mBytes;
+    ++mReleasedDeletionCount;
+    arrdelswap(pDeferredDeletions, i);
+  }
+}
+
 RenderContext::Frame RenderContext::BeginFrame() {
   uint32_t imageIndex;
-  acquireNextImage(pRenderer, pSwapChain, pImageAcquiredSemaphore, NULL,
-                   &imageIndex);
+  {
+    TRACE_SCOPE("Acquire Image");
+    acquireNextImage(pRenderer, pSwapChain, pImageAcquiredSemaphore, NULL,
+                     &imageIndex);
+  }
 
   RenderTarget *pRenderTarget = pSwapChain->ppRenderTargets[imageIndex];
   GpuCmdRingElement elem = getNextGpuCmdRingElement(&mGraphicsCmdRing, true, 1);
@@ -217,17 +549,44 @@ RenderContext::Frame RenderContext::BeginFrame() {
   // Stall if CPU is running `kDataBufferCount` frames ahead of GPU
   FenceStatus fenceStatus;
   getFenceStatus(pRenderer, elem.pFence, &fenceStatus);
-  if (fenceStatus == FENCE_STATUS_INCOMPLETE)
+  if (fenceStatus == FENCE_STATUS_INCOMPLETE) {
+    TRACE_SCOPE("Wait For Frame Fence");
+    int64_t waitStartUSec = getUSec(true);
     waitForFences(pRenderer, 1, &elem.pFence);
+    RenderStatsAdd(kRenderCounterFenceWaitUSec,
+                   (uint64_t)(getUSec(true) - waitStartUSec));
+  }
+  CollectGpuScopes(mGpuScopes[mFrameIndex]);
 
   // Reset cmd pool for this frame
   resetCmdPool(pRenderer, elem.pCmdPool);
 
-  return RenderContext::Frame{mFrameIndex, imageIndex, pRenderTarget,
-                              pDepthBuffer, elem};
+  // Submissions complete in order, so the newest one whose fence has
+  // signaled covers every older one.
+  for (uint32_t i = 0; i < kDataBufferCount; ++i) {
+    if (mFrameSubmission[i] <= mCompletedSubmission) {
+      continue;
+    }
+    getFenceStatus(pRenderer, pFrameFences[i], &fenceStatus);
+    if (fenceStatus == FENCE_STATUS_COMPLETE) {
+      mCompletedSubmission = mFrameSubmission[i];
+    }
+  }
+  ReleaseDeferredDeletions();
+  mGeometryPool.Update(mCompletedSubmission);
+
+  uint32_t sceneWidth =
+      max((uint32_t)(pSceneColor->mWidth * mRenderScale + 0.5f), 1u);
+  uint32_t sceneHeight =
+      max((uint32_t)(pSceneColor->mHeight * mRenderScale + 0.5f), 1u);
+  return RenderContext::Frame{mFrameIndex,       imageIndex,  pRenderTarget,
+                              pDepthBuffer,      elem,        pSceneColor,
+                              sceneWidth,        sceneHeight, pAmbientOcclusion,
+                              pVisibilityBuffer};
 }
 
 void RenderContext::EndFrame(RenderContext::Frame &&frame) {
+  TRACE_SCOPE("Submit And Present");
   FlushResourceUpdateDesc flushUpdateDesc = {};
   flushUpdateDesc.mNodeIndex = 0;
   flushResourceUpdates(&flushUpdateDesc);
@@ -242,7 +601,10 @@ void RenderContext::EndFrame(RenderContext::Frame &&frame) {
   submitDesc.ppSignalSemaphores = &frame.mCmdRingElement.pSemaphore;
   submitDesc.ppWaitSemaphores = waitSemaphores;
   submitDesc.pSignalFence = frame.mCmdRingElement.pFence;
+  mGpuScopes[frame.index].mSubmitUSec = getUSec(true);
   queueSubmit(pGraphicsQueue, &submitDesc);
+  mFrameSubmission[frame.index] = ++mSubmissionCount;
+  pFrameFences[frame.index] = frame.mCmdRingElement.pFence;
 
   QueuePresentDesc presentDesc = {};
   presentDesc.mIndex = (uint8_t)frame.imageIndex;
@@ -5,11 +5,20 @@
 #include "Resources/ResourceLoader/Interfaces/IResourceLoader.h"
 #include "Utilities/RingBuffer.h"
 
+#include "GeometryPool.hpp"
+#include "MemoryAccounting.hpp"
+
+struct DeletionQueueStats {
+  uint32_t mPendingCount;
+  uint64_t mPendingBytes;
+  uint64_t mReleasedCount;
+};
+
 class RenderContext {
 public:
   const static uint32_t kDataBufferCount = 2;
 
-  bool Init(const char *appName);
+  bool Init(const char *appName, const GeometryPoolDesc &geometryPoolDesc);
   void Exit();
 
   bool Load(WindowHandle hWindow, uint32_t width, uint32_t height,
@@ -29,11 +38,53 @@ public:
   inline TinyImageFormat GetDepthFormat() const {
     return pDepthBuffer->mFormat;
   }
+  inline TinyImageFormat GetSceneColorFormat() const {
+    return pSceneColor->mFormat;
+  }
+  inline RenderTarget *GetSceneColor() const { return pSceneColor; }
+  inline RenderTarget *GetDepthBuffer() const { return pDepthBuffer; }
+  /// Half the size of the scene targets.
+  inline RenderTarget *GetAmbientOcclusion() const {
+    return pAmbientOcclusion;
+  }
+  /// Draw and triangle IDs, written in place of shading by
+  /// \c SceneRenderSystem's visibility buffer mode.
+  inline RenderTarget *GetVisibilityBuffer() const {
+    return pVisibilityBuffer;
+  }
 
+  /// The scene is rendered into the top-left \c scale fraction of the
+  /// offscreen scene targets, which keep the swapchain's size so that scale
+  /// changes never reallocate anything.
+  void SetRenderScale(float scale);
+  inline float GetRenderScale() const { return mRenderScale; }
+
+  /// Also releases every deferred deletion.
   void WaitIdle();
   void ToggleVSync();
 
   ProfileToken CreateGpuProfiler(const char *pProfilerName);
+  /// Wrap \c cmdBeginGpuFrameProfile and \c cmdEndGpuFrameProfile, and
+  /// reset and resolve the queries of the scopes below. Must be called
+  /// outside of any render pass.
+  void BeginGpuFrameProfile(Cmd *pCmd, ProfileToken token);
+  void EndGpuFrameProfile(Cmd *pCmd, ProfileToken token);
+  /// Wrap \c cmdBeginGpuTimestampQuery and \c cmdEndGpuTimestampQuery, also
+  /// timing the scope with the render context's own queries so that it can be
+  /// placed on the CPU trace's timeline, see Trace.hpp.
+  void BeginGpuScope(Cmd *pCmd, ProfileToken token, const char *pName);
+  void EndGpuScope(Cmd *pCmd, ProfileToken token);
+
+  struct GpuScopeTiming {
+    const char *pName;
+    float mMs;
+  };
+  /// Scopes of the latest frame whose timestamps were read back, in the
+  /// order they began.
+  inline const GpuScopeTiming *GetGpuScopeTimings(uint32_t &count) const {
+    count = mGpuScopeTimingCount;
+    return mGpuScopeTimings;
+  }
 
   Sampler *CreateSampler(SamplerDesc *pDesc);
   void DestroySampler(Sampler *pSampler);
@@ -52,12 +103,53 @@ public:
   Pipeline *CreatePipeline(PipelineDesc *pDesc);
   void DestroyPipeline(Pipeline *pPipeline);
 
+  /// Account for a created resource's GPU memory under \c category, which
+  /// \c DeferDestroy untracks once the resource is released.
+  void TrackResource(MemoryCategory category, Buffer *pBuffer);
+  void TrackResource(MemoryCategory category, Texture *pTexture);
+  void TrackResource(MemoryCategory category, Geometry *pGeometry);
+
+  /// Queue resources for destruction once every frame that may reference
+  /// them, up to the one being recorded, has completed on the GPU. Unlike
+  /// \c WaitIdle, this never stalls the CPU. Sized resources must have been
+  /// passed to \c TrackResource with the same category.
+  void DeferDestroy(Buffer *pBuffer, MemoryCategory category);
+  void DeferDestroy(Texture *pTexture, MemoryCategory category);
+  void DeferDestroy(Geometry *pGeometry, MemoryCategory category);
+  void DeferDestroy(Pipeline *pPipeline);
+  void DeferDestroy(DescriptorSet *pDescriptorSet);
+  DeletionQueueStats GetDeletionQueueStats() const;
+
+  /// Submissions are numbered from 1, in order. Anything the frames up to
+  /// \c GetLastSubmission referenced can be reused once
+  /// \c GetCompletedSubmission reaches it.
+  inline uint64_t GetLastSubmission() const { return mSubmissionCount; }
+  inline uint64_t GetCompletedSubmission() const {
+    return mCompletedSubmission;
+  }
+
+  inline GeometryPool &GetGeometryPool() { return mGeometryPool; }
+  inline const GeometryPool &GetGeometryPool() const { return mGeometryPool; }
+  /// Records this frame's geometry pool compaction, see
+  /// \c GeometryPool::Compact.
+  void CompactGeometry(Cmd *pCmd);
+
+  /// Swapchain images and the offscreen targets.
+  uint64_t GetRenderTargetBytes() const;
+
   struct Frame {
     uint32_t index;
     uint32_t imageIndex;
     RenderTarget *pImage;
     RenderTarget *pDepthBuffer;
     GpuCmdRingElement mCmdRingElement;
+    /// Offscreen target the scene is drawn into, at \c mSceneWidth by
+    /// \c mSceneHeight, before being upscaled into \c pImage.
+    RenderTarget *pSceneColor;
+    uint32_t mSceneWidth;
+    uint32_t mSceneHeight;
+    RenderTarget *pAmbientOcclusion;
+    RenderTarget *pVisibilityBuffer;
   };
 
   Frame BeginFrame();
@@ -71,7 +163,69 @@ private:
 
   SwapChain *pSwapChain = NULL;
   RenderTarget *pDepthBuffer = NULL;
+  RenderTarget *pSceneColor = NULL;
+  RenderTarget *pAmbientOcclusion = NULL;
+  RenderTarget *pVisibilityBuffer = NULL;
   Semaphore *pImageAcquiredSemaphore = NULL;
 
+  float mRenderScale = 1.0f;
+
+  GeometryPool mGeometryPool;
+
   uint8_t mFrameIndex = 0;
+
+  enum class DeferredKind : uint8_t {
+    Buffer,
+    Texture,
+    Geometry,
+    Pipeline,
+    DescriptorSet,
+  };
+  struct DeferredDeletion {
+    DeferredKind mKind;
+    MemoryCategory mCategory;
+    void *pResource;
+    /// Submission that must complete before the resource is released.
+    uint64_t mSubmission;
+    uint64_t mBytes;
+  };
+  DeferredDeletion *pDeferredDeletions = NULL;
+  uint64_t mPendingDeletionBytes = 0;
+  uint64_t mReleasedDeletionCount = 0;
+
+  /// Submissions are numbered from 1, in order.
+  uint64_t mSubmissionCount = 0;
+  uint64_t mCompletedSubmission = 0;
+  uint64_t mFrameSubmission[kDataBufferCount] = {};
+  Fence *pFrameFences[kDataBufferCount] = {};
+
+  void DeferDestroy(DeferredKind kind, void *pResource,
+                    MemoryCategory category, uint64_t bytes);
+  void ReleaseDeferredDeletions();
+
+  static const uint32_t kMaxGpuScopeCount = 64;
+  static const uint32_t kMaxGpuScopeDepth = 8;
+  /// Scopes recorded into one frame slot. Each one owns a begin and an end
+  /// timestamp query.
+  struct GpuScopes {
+    QueryPool *pQueryPool;
+    Buffer *pReadbackBuffer;
+    const char *pNames[kMaxGpuScopeCount];
+    uint32_t mCount;
+    /// Scopes whose queries were resolved, and can be read once the frame's
+    /// fence signals.
+    uint32_t mResolvedCount;
+    /// Indices of the open scopes, ~0u for those past \c kMaxGpuScopeCount.
+    uint32_t mStack[kMaxGpuScopeDepth];
+    uint32_t mDepth;
+    int64_t mSubmitUSec;
+  };
+  GpuScopes mGpuScopes[kDataBufferCount] = {};
+  double mTimestampFrequency = 0.0;
+  int64_t mGpuClockOffsetUSec = 0;
+  bool mGpuClockCalibrated = false;
+  GpuScopeTiming mGpuScopeTimings[kMaxGpuScopeCount] = {};
+  uint32_t mGpuScopeTimingCount = 0;
+
+  void CollectGpuScopes(GpuScopes &scopes);
 };
\ No newline at end of file
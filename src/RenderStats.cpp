@@ -0,0 +1,139 @@
+#include "RenderStats.hpp"
+
+#include <string.h>
+
+#include "Utilities/Interfaces/ILog.h"
+#include "Utilities/Threading/Atomics.h"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+struct RenderStatsSlot {
+  /// Only grow, and are only written by the owning thread, so a relaxed load
+  /// and store replace a locked add.
+  tfrg_atomic64_t mTotals[kRenderCounterCount];
+  /// Totals at the previous collection, only touched by the collecting
+  /// thread.
+  uint64_t mCollected[kRenderCounterCount];
+};
+
+static RenderStatsSlot *gRenderStatsSlots[kRenderStatsMaxThreadCount] = {};
+static tfrg_atomic32_t gRenderStatsSlotCount = 0;
+static thread_local RenderStatsSlot *tRenderStatsSlot = NULL;
+
+static RenderStatsSlot *GetThreadSlot() {
+  if (tRenderStatsSlot) {
+    return tRenderStatsSlot;
+  }
+  uint32_t index = tfrg_atomic32_add_relaxed(&gRenderStatsSlotCount, 1);
+  if (index >= kRenderStatsMaxThreadCount) {
+    return NULL;
+  }
+  RenderStatsSlot *pSlot = reinterpret_cast<RenderStatsSlot *>(
+      tf_calloc(1, sizeof(RenderStatsSlot)));
+  tfrg_atomicptr_store_release((tfrg_atomicptr_t *)&gRenderStatsSlots[index],
+                               (tfrg_atomicptr_t)pSlot);
+  tRenderStatsSlot = pSlot;
+  return pSlot;
+}
+
+void RenderStatsAdd(RenderCounter counter, uint64_t value) {
+  RenderStatsSlot *pSlot = GetThreadSlot();
+  if (pSlot == NULL) {
+    return;
+  }
+  tfrg_atomic64_t *pTotal = &pSlot->mTotals[counter];
+  tfrg_atomic64_store_relaxed(pTotal,
+                              tfrg_atomic64_load_relaxed(pTotal) + value);
+}
+
+void RenderStatsCollect(RenderStatsFrame &frame) {
+  memset(frame.mCounters, 0, sizeof(frame.mCounters));
+  uint32_t slotCount = min(tfrg_atomic32_load_acquire(&gRenderStatsSlotCount),
+                           kRenderStatsMaxThreadCount);
+  for (uint32_t i = 0; i < slotCount; ++i) {
+    RenderStatsSlot *pSlot =
+        (RenderStatsSlot *)tfrg_atomicptr_load_acquire(
+            (tfrg_atomicptr_t *)&gRenderStatsSlots[i]);
+    // NULL while registered but not published yet.
+    if (pSlot == NULL) {
+      continue;
+    }
+    for (uint32_t counter = 0; counter < kRenderCounterCount; ++counter) {
+      uint64_t total = tfrg_atomic64_load_relaxed(&pSlot->mTotals[counter]);
+      frame.mCounters[counter] += total - pSlot->mCollected[counter];
+      pSlot->mCollected[counter] = total;
+    }
+  }
+}
+
+void RenderStatsExit() {
+  uint32_t slotCount = min(tfrg_atomic32_load_acquire(&gRenderStatsSlotCount),
+                           kRenderStatsMaxThreadCount);
+  for (uint32_t i = 0; i < slotCount; ++i) {
+    tf_free(gRenderStatsSlots[i]);
+    gRenderStatsSlots[i] = NULL;
+  }
+  tRenderStatsSlot = NULL;
+  tfrg_atomic32_store_relaxed(&gRenderStatsSlotCount, 0);
+}
+
+const char *GetRenderCounterName(RenderCounter counter) {
+  static const char *kNames[kRenderCounterCount] = {
+      "drawCalls",       "triangles",     "vertices",
+      "culledObjects",    "uploadedBytes",    "pipelineBinds",
+      "descriptorBinds",  "materialChanges",  "drawListSortUSec",
+      "fenceWaitUSec",
+  };
+  return kNames[counter];
+}
+
+const char *GetGpuMemoryCategoryName(GpuMemoryCategory category) {
+  static const char *kNames[kGpuMemoryCategoryCount] = {
+      "geometry",
+      "textures",
+      "renderTargets",
+      "pendingDeletion",
+  };
+  return kNames[category];
+}
+
+bool RenderStatsStream::Open(const char *pFileName) {
+  Close();
+  if (!fsOpenStreamFromPath(RD_LOG, pFileName, FM_WRITE, &mFile)) {
+    LOGF(eERROR, "Failed to open render stats stream %s", pFileName);
+    return false;
+  }
+  mOpen = true;
+  LOGF(eINFO, "Streaming render stats to %s", pFileName);
+  return true;
+}
+
+void RenderStatsStream::Close() {
+  if (mOpen) {
+    fsCloseStream(&mFile);
+    mOpen = false;
+  }
+}
+
+void RenderStatsStream::Write(const RenderStatsFrame &frame) {
+  if (!mOpen) {
+    return;
+  }
+  fsPrintToStream(&mFile, "{\"frame\":%llu,\"cpuMs\":%.3f,\"gpuMs\":%.3f",
+                  (unsigned long long)frame.mFrame, frame.mCpuMs,
+                  frame.mGpuMs);
+  for (uint32_t i = 0; i < kRenderCounterCount; ++i) {
+    fsPrintToStream(&mFile, ",\"%s\":%llu",
+                    GetRenderCounterName((RenderCounter)i),
+                    (unsigned long long)frame.mCounters[i]);
+  }
+  fsPrintToStream(&mFile, ",\"residentBytes\":{");
+  for (uint32_t i = 0; i < kGpuMemoryCategoryCount; ++i) {
+    fsPrintToStream(&mFile, "%s\"%s\":%llu", i == 0 ? "" : ",",
+                    GetGpuMemoryCategoryName((GpuMemoryCategory)i),
+                    (unsigned long long)frame.mResidentBytes[i]);
+  }
+  fsPrintToStream(&mFile, "}}\n");
+  // Readers tail the stream, so each line is flushed as a whole.
+  fsFlushStream(&mFile);
+}
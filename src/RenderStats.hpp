@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Utilities/Interfaces/IFileSystem.h"
+
+/// Counters summed over a frame. Each thread adds to its own accumulators,
+/// which only it writes, so counting is a thread-local add; they're merged
+/// once per frame by \c RenderStatsCollect.
+enum RenderCounter : uint32_t {
+  kRenderCounterDrawCalls,
+  kRenderCounterTriangles,
+  kRenderCounterVertices,
+  kRenderCounterCulledObjects,
+  kRenderCounterUploadedBytes,
+  kRenderCounterPipelineBinds,
+  kRenderCounterDescriptorBinds,
+  /// Transitions between materials in the sorted draw list, and the time
+  /// its sort took.
+  kRenderCounterMaterialChanges,
+  kRenderCounterDrawListSortUSec,
+  kRenderCounterFenceWaitUSec,
+  kRenderCounterCount,
+};
+
+/// GPU memory held at the end of a frame, filled in by its owners.
+enum GpuMemoryCategory : uint32_t {
+  kGpuMemoryGeometry,
+  kGpuMemoryTextures,
+  kGpuMemoryRenderTargets,
+  kGpuMemoryPendingDeletion,
+  kGpuMemoryCategoryCount,
+};
+
+static const uint32_t kRenderStatsMaxThreadCount = 64;
+
+struct RenderStatsFrame {
+  uint64_t mFrame;
+  float mCpuMs;
+  float mGpuMs;
+  uint64_t mCounters[kRenderCounterCount];
+  uint64_t mResidentBytes[kGpuMemoryCategoryCount];
+};
+
+void RenderStatsAdd(RenderCounter counter, uint64_t value);
+
+/// Moves everything counted since the previous call into \c frame's
+/// counters. Must always be called from the same thread.
+void RenderStatsCollect(RenderStatsFrame &frame);
+
+/// Releases the accumulators. No thread may count afterwards.
+void RenderStatsExit();
+
+const char *GetRenderCounterName(RenderCounter counter);
+const char *GetGpuMemoryCategoryName(GpuMemoryCategory category);
+
+/// Appends one JSON object per frame to a file in \c RD_LOG, which can also
+/// be a named pipe read by a local dashboard.
+class RenderStatsStream {
+public:
+  bool Open(const char *pFileName);
+  void Close();
+  inline bool IsOpen() const { return mOpen; }
+
+  void Write(const RenderStatsFrame &frame);
+
+private:
+  FileStream mFile = {};
+  bool mOpen = false;
+};
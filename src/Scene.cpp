@@ -1,10 +1,22 @@
 #include "Scene.hpp"
 
+#include <ctype.h>
+
+#include "Utilities/Interfaces/ITime.h"
 #include "Utilities/Math/ShaderUtilities.h"
 
+#include "Tools/ThirdParty/OpenSource/meshoptimizer/src/meshoptimizer.h"
 #include "ofbx.h"
 
+#include "FbxInflate.hpp"
+#include "GeometryCodec.hpp"
+#include "GlbFile.hpp"
+#include "RenderStats.hpp"
 #include "SceneRenderSystem.hpp"
+#include "TangentSpace.hpp"
+#include "Trace.hpp"
+
+#include "Utilities/ThirdParty/OpenSource/Nothings/stb_ds.h"
 
 struct SceneVertex {
   float3 mPosition;
@@ -12,144 +24,2818 @@ struct SceneVertex {
   uint32_t mUv;
 };
 
-void Scene::LoadMeshResource(RenderContext &renderContext,
-                             const char *pResourceFileName) {
-  GeometryLoadDesc sceneGDesc = {};
-  sceneGDesc.ppGeometry = &pGeometry;
-  sceneGDesc.ppGeometryData = &pGeometryData;
-  sceneGDesc.pFileName = pResourceFileName;
-  sceneGDesc.pVertexLayout = &kSceneVertexLayout;
-  addResource(&sceneGDesc, NULL);
-  mKind = SceneKind::Preprocessed;
-}
-void Scene::LoadRawFBX(RenderContext &renderContext,
-                       const char *pResourceFileName) {
+const uint32_t Scene::kVertexStride = sizeof(SceneVertex);
+
+/// Meshes without normals are smoothed across edges sharper than this, in
+/// radians, so that hard edges stay hard.
+static const float kNormalSmoothingAngle = PI / 3.0f;
+
+/// A dielectric of medium roughness, also used for the metallic and
+/// roughness of FBX materials, whose Phong parameters don't map to them.
+static const float kDefaultMetallic = 0.0f;
+static const float kDefaultRoughness = 0.5f;
+
+static SceneMaterial GetDefaultMaterial() {
+  return {float4(1.0f), kDefaultMetallic, kDefaultRoughness,
+          TextureStreamer::kInvalidHandle, TextureStreamer::kInvalidHandle};
+}
+
+/// FBX files store texture paths as authored on the artist's machine, so only
+/// the file name is kept and looked up in \c RD_TEXTURES.
+static bool GetFBXTextureName(const ofbx::Material *pMaterial,
+                              ofbx::Texture::TextureType type,
+                              char (&fileName)[FS_MAX_PATH]) {
+  const ofbx::Texture *pTexture = pMaterial->getTexture(type);
+  if (pTexture == nullptr) {
+    return false;
+  }
+  char path[FS_MAX_PATH] = {};
+  pTexture->getRelativeFileName().toString(path);
+  if (path[0] == '\0') {
+    pTexture->getFileName().toString(path);
+  }
+  const char *pFileName = path;
+  for (const char *c = path; *c != '\0'; ++c) {
+    if (*c == '/' || *c == '\\') {
+      pFileName = c + 1;
+    }
+  }
+  if (*pFileName == '\0') {
+    return false;
+  }
+  strncpy(fileName, pFileName, FS_MAX_PATH - 1);
+  fileName[FS_MAX_PATH - 1] = '\0';
+  return true;
+}
+
+/// 64-bit FNV-1a, chained through \c hash.
+static uint64_t HashBytes(const void *pData, size_t size,
+                          uint64_t hash = 0xcbf29ce484222325ull) {
+  const uint8_t *pBytes = reinterpret_cast<const uint8_t *>(pData);
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ pBytes[i]) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+/// OpenFBX matrices are column-major doubles.
+template <typename FbxMatrix> static mat4 ToMat4(const FbxMatrix &m) {
+  return mat4(
+      vec4((float)m.m[0], (float)m.m[1], (float)m.m[2], (float)m.m[3]),
+      vec4((float)m.m[4], (float)m.m[5], (float)m.m[6], (float)m.m[7]),
+      vec4((float)m.m[8], (float)m.m[9], (float)m.m[10], (float)m.m[11]),
+      vec4((float)m.m[12], (float)m.m[13], (float)m.m[14], (float)m.m[15]));
+}
+
+static JointPose DecomposePose(const mat4 &m) {
+  vec3 x = m.getCol0().getXYZ();
+  vec3 y = m.getCol1().getXYZ();
+  vec3 z = m.getCol2().getXYZ();
+  JointPose pose;
+  pose.mScale = vec3(length(x), length(y), length(z));
+  pose.mRotation = normalize(Quat(Matrix3(x / pose.mScale.getX(),
+                                          y / pose.mScale.getY(),
+                                          z / pose.mScale.getZ())));
+  pose.mTranslation = m.getTranslation();
+  return pose;
+}
+
+/// Adds \c pBone after its ancestors and returns its joint index, or -1 if
+/// the skeleton is full.
+static int32_t AddJoint(const ofbx::Object *pBone, const ofbx::Object *pRoot,
+                        const ofbx::Object **ppJoints, int32_t *pParents,
+                        uint32_t &jointCount) {
+  for (uint32_t i = 0; i < jointCount; ++i) {
+    if (ppJoints[i] == pBone) {
+      return (int32_t)i;
+    }
+  }
+  const ofbx::Object *pParent = pBone->getParent();
+  int32_t parent = -1;
+  if (pParent != nullptr && pParent != pRoot) {
+    parent = AddJoint(pParent, pRoot, ppJoints, pParents, jointCount);
+    if (parent < 0) {
+      return -1;
+    }
+  }
+  if (jointCount >= Skeleton::kMaxJointCount) {
+    return -1;
+  }
+  ppJoints[jointCount] = pBone;
+  pParents[jointCount] = parent;
+  return (int32_t)jointCount++;
+}
+
+/// Gathers the bones of every skin, with their ancestors, into one skeleton.
+static void ImportSkeleton(const ofbx::IScene &scene,
+                           const ofbx::Object **ppJoints, Skeleton &skeleton) {
+  int32_t parents[Skeleton::kMaxJointCount];
+  mat4 inverseBindPoses[Skeleton::kMaxJointCount];
+  uint32_t jointCount = 0;
+  bool truncated = false;
+  for (uint32_t meshIdx = 0; meshIdx < (uint32_t)scene.getMeshCount();
+       meshIdx++) {
+    const ofbx::Skin *pSkin = scene.getMesh(meshIdx)->getSkin();
+    if (pSkin == nullptr) {
+      continue;
+    }
+    for (int c = 0; c < pSkin->getClusterCount(); ++c) {
+      const ofbx::Cluster *pCluster = pSkin->getCluster(c);
+      if (pCluster->getLink() == nullptr) {
+        continue;
+      }
+      uint32_t previousCount = jointCount;
+      int32_t joint = AddJoint(pCluster->getLink(), scene.getRoot(), ppJoints,
+                               parents, jointCount);
+      for (uint32_t i = previousCount; i < jointCount; ++i) {
+        inverseBindPoses[i] = mat4::identity();
+      }
+      if (joint < 0) {
+        truncated = true;
+        continue;
+      }
+      inverseBindPoses[joint] =
+          inverse(ToMat4(pCluster->getTransformLinkMatrix())) *
+          ToMat4(pCluster->getTransformMatrix());
+    }
+  }
+  if (truncated) {
+    LOGF(eWARNING, "Skeleton has more than %u joints, the rest are ignored",
+         Skeleton::kMaxJointCount);
+  }
+
+  skeleton.mJointCount = jointCount;
+  if (jointCount == 0) {
+    return;
+  }
+  // Freed by Skeleton::Destroy, so accounted for by ComputeHelperBytes.
+  skeleton.pParents =
+      reinterpret_cast<int32_t *>(tf_calloc(jointCount, sizeof(int32_t)));
+  skeleton.pInverseBindPoses =
+      reinterpret_cast<mat4 *>(tf_calloc(jointCount, sizeof(mat4)));
+  memcpy(skeleton.pParents, parents, jointCount * sizeof(int32_t));
+  memcpy(skeleton.pInverseBindPoses, inverseBindPoses,
+         jointCount * sizeof(mat4));
+}
+
+/// Resamples every animation stack at the scene's frame rate.
+static uint32_t ImportClips(const ofbx::IScene &scene,
+                            const ofbx::Object *const *ppJoints,
+                            uint32_t jointCount, AnimationClip **ppClips) {
+  uint32_t stackCount = (uint32_t)scene.getAnimationStackCount();
+  if (jointCount == 0 || stackCount == 0) {
+    return 0;
+  }
+  float sampleRate = scene.getSceneFrameRate();
+  if (sampleRate <= 0.0f) {
+    sampleRate = 30.0f;
+  }
+
+  AnimationClip *pClips = reinterpret_cast<AnimationClip *>(
+      MemoryCalloc(kMemoryCategoryScene, stackCount, sizeof(AnimationClip)));
+  uint32_t clipCount = 0;
+  for (uint32_t stackIdx = 0; stackIdx < stackCount; ++stackIdx) {
+    const ofbx::AnimationStack *pStack = scene.getAnimationStack(stackIdx);
+    const ofbx::AnimationLayer *pLayer = pStack->getLayer(0);
+    const ofbx::TakeInfo *pTake = scene.getTakeInfo(pStack->name);
+    if (pLayer == nullptr || pTake == nullptr) {
+      LOGF(eWARNING, "Skipping animation stack %s without a take",
+           pStack->name);
+      continue;
+    }
+    double begin = pTake->local_time_from;
+    double duration = fmax(pTake->local_time_to - begin, 0.0);
+    // Ten minutes at most, in case of a corrupted take.
+    uint32_t frameCount =
+        min((uint32_t)ceil(duration * sampleRate) + 1, 600u * 60u);
+
+    JointPose *pPoses = reinterpret_cast<JointPose *>(
+        MemoryCalloc(kMemoryCategoryScene, (size_t)frameCount * jointCount,
+                     sizeof(JointPose)));
+    for (uint32_t joint = 0; joint < jointCount; ++joint) {
+      const ofbx::Object *pBone = ppJoints[joint];
+      auto *pTranslationNode = pLayer->getCurveNode(*pBone, "Lcl Translation");
+      auto *pRotationNode = pLayer->getCurveNode(*pBone, "Lcl Rotation");
+      auto *pScalingNode = pLayer->getCurveNode(*pBone, "Lcl Scaling");
+      for (uint32_t frame = 0; frame < frameCount; ++frame) {
+        double time = begin + frame / (double)sampleRate;
+        auto translation = pTranslationNode
+                               ? pTranslationNode->getNodeLocalTransform(time)
+                               : pBone->getLocalTranslation();
+        auto rotation = pRotationNode
+                            ? pRotationNode->getNodeLocalTransform(time)
+                            : pBone->getLocalRotation();
+        auto scaling = pScalingNode ? pScalingNode->getNodeLocalTransform(time)
+                                    : pBone->getLocalScaling();
+        pPoses[frame * jointCount + joint] = DecomposePose(
+            ToMat4(pBone->evalLocal(translation, rotation, scaling)));
+      }
+    }
+    pClips[clipCount].Build(pPoses, frameCount, jointCount, sampleRate);
+    LOGF(eINFO, "Imported clip %s: %u frames, %u joints, %.1f KB",
+         pStack->name, frameCount, jointCount,
+         pClips[clipCount].GetSizeBytes() / 1024.0);
+    ++clipCount;
+    MemoryFree(pPoses);
+  }
+  *ppClips = pClips;
+  return clipCount;
+}
+
+/// Keeps the four largest influences of a control point.
+static void AddInfluence(SceneSkinVertex &vertex, float *pWeights,
+                         uint32_t joint, float weight) {
+  uint32_t smallest = 0;
+  for (uint32_t i = 1; i < 4; ++i) {
+    if (pWeights[i] < pWeights[smallest]) {
+      smallest = i;
+    }
+  }
+  if (weight > pWeights[smallest]) {
+    pWeights[smallest] = weight;
+    vertex.mJoints[smallest] = (uint8_t)joint;
+  }
+}
+
+static SceneSkinVertex NormalizeInfluences(SceneSkinVertex vertex,
+                                           const float *pWeights) {
+  float sum = pWeights[0] + pWeights[1] + pWeights[2] + pWeights[3];
+  if (sum <= 0.0f) {
+    return {{0, 0, 0, 0}, {255, 0, 0, 0}};
+  }
+  uint32_t total = 0;
+  uint32_t largest = 0;
+  for (uint32_t i = 0; i < 4; ++i) {
+    vertex.mWeights[i] = (uint8_t)(pWeights[i] / sum * 255.0f + 0.5f);
+    total += vertex.mWeights[i];
+    if (pWeights[i] > pWeights[largest]) {
+      largest = i;
+    }
+  }
+  // Rounding may be off by a few units; the largest weight absorbs it.
+  vertex.mWeights[largest] =
+      (uint8_t)((int32_t)vertex.mWeights[largest] + 255 - (int32_t)total);
+  return vertex;
+}
+
+/// Adds the blend shape channels of \c pMesh, whose unrolled vertices start
+/// at \c vertexOffset, to \c blendShapes. FBX shapes hold offsets of the
+/// control points they move. Only the full-weight shape of each channel is
+/// kept; in-between shapes are ignored.
+static void ImportBlendShapes(const ofbx::Mesh *pMesh,
+                              uint32_t controlPointCount,
+                              const int32_t *pVertexControlPoints,
+                              uint32_t vertexOffset, uint32_t vertexCount,
+                              BlendShapeSet &blendShapes) {
+  const ofbx::BlendShape *pBlendShape = pMesh->getBlendShape();
+  if (pBlendShape == nullptr || vertexCount == 0) {
+    return;
+  }
+  auto controlPointPositions = reinterpret_cast<float3 *>(
+      MemoryAlloc(kMemoryCategoryScene, controlPointCount * sizeof(float3)));
+  auto controlPointNormals = reinterpret_cast<float3 *>(
+      MemoryAlloc(kMemoryCategoryScene, controlPointCount * sizeof(float3)));
+  auto positionDeltas = reinterpret_cast<float3 *>(
+      MemoryAlloc(kMemoryCategoryScene, vertexCount * sizeof(float3)));
+  auto normalDeltas = reinterpret_cast<float3 *>(
+      MemoryAlloc(kMemoryCategoryScene, vertexCount * sizeof(float3)));
+
+  for (int c = 0; c < pBlendShape->getBlendShapeChannelCount(); ++c) {
+    const ofbx::BlendShapeChannel *pChannel =
+        pBlendShape->getBlendShapeChannel(c);
+    if (pChannel->getShapeCount() == 0) {
+      continue;
+    }
+    const ofbx::Shape *pShape =
+        pChannel->getShape(pChannel->getShapeCount() - 1);
+    memset(controlPointPositions, 0, controlPointCount * sizeof(float3));
+    memset(controlPointNormals, 0, controlPointCount * sizeof(float3));
+    const int *pIndices = pShape->getIndices();
+    auto *pOffsets = pShape->getVertices();
+    auto *pNormalOffsets = pShape->getNormals();
+    for (int i = 0; i < pShape->getIndexCount(); ++i) {
+      if (pIndices[i] < 0 || (uint32_t)pIndices[i] >= controlPointCount) {
+        continue;
+      }
+      controlPointPositions[pIndices[i]] =
+          float3((float)pOffsets[i].x, (float)pOffsets[i].y,
+                 (float)pOffsets[i].z);
+      if (pNormalOffsets) {
+        controlPointNormals[pIndices[i]] = float3((float)pNormalOffsets[i].x,
+                                                  (float)pNormalOffsets[i].y,
+                                                  (float)pNormalOffsets[i].z);
+      }
+    }
+    for (uint32_t v = 0; v < vertexCount; ++v) {
+      positionDeltas[v] = controlPointPositions[pVertexControlPoints[v]];
+      normalDeltas[v] = controlPointNormals[pVertexControlPoints[v]];
+    }
+    if (!blendShapes.AddTarget(positionDeltas,
+                               pNormalOffsets ? normalDeltas : NULL,
+                               vertexOffset, vertexCount,
+                               (float)pChannel->getDeformPercent() / 100.0f)) {
+      LOGF(eWARNING, "More than %u blend shapes, the rest are ignored",
+           BlendShapeSet::kMaxTargetCount);
+      break;
+    }
+  }
+
+  MemoryFree(normalDeltas);
+  MemoryFree(positionDeltas);
+  MemoryFree(controlPointNormals);
+  MemoryFree(controlPointPositions);
+}
+
+/// Adds \c pObject after its ancestors, below the scene's root, and returns
+/// its node index. Nodes are found by a linear search, as scenes rarely have
+/// more than a few thousand of them.
+static int32_t AddNode(const ofbx::Object *pObject, const ofbx::Object *pRoot,
+                       const ofbx::Object ***pppNodes, int32_t **ppParents,
+                       JointPose **ppLocals) {
+  for (ptrdiff_t i = 0; i < arrlen(*pppNodes); ++i) {
+    if ((*pppNodes)[i] == pObject) {
+      return (int32_t)i;
+    }
+  }
+  const ofbx::Object *pParent = pObject->getParent();
+  int32_t parent = -1;
+  if (pParent != nullptr && pParent != pRoot) {
+    parent = AddNode(pParent, pRoot, pppNodes, ppParents, ppLocals);
+  }
+  arrpush(*pppNodes, pObject);
+  arrpush(*ppParents, parent);
+  mat4 local = ToMat4(pObject->evalLocal(pObject->getLocalTranslation(),
+                                         pObject->getLocalRotation(),
+                                         pObject->getLocalScaling()));
+  arrpush(*ppLocals, DecomposePose(local));
+  return (int32_t)arrlen(*pppNodes) - 1;
+}
+
+/// Moves a model-space box by \c transform, keeping it axis-aligned.
+static void TransformBounds(const mat4 &transform, vec3 &boundsMin,
+                            vec3 &boundsMax) {
+  vec3 center = (boundsMin + boundsMax) * 0.5f;
+  vec3 extent = (boundsMax - boundsMin) * 0.5f;
+  center = (transform * Point3(center)).getXYZ();
+  extent = absPerElem(transform.getCol0().getXYZ()) * extent.getX() +
+           absPerElem(transform.getCol1().getXYZ()) * extent.getY() +
+           absPerElem(transform.getCol2().getXYZ()) * extent.getZ();
+  boundsMin = center - extent;
+  boundsMax = center + extent;
+}
+
+/// Reads and parses an FBX file in \c RD_MESHES. The scene keeps pointing
+/// into \c *ppData, which is only freed once the scene is no longer used.
+/// \c pFileSize, unless it's \c NULL, receives the size of the file.
+/// Compressed arrays are inflated on \c pTaskSystem's threads before parsing,
+/// or on the calling thread alone if it's \c NULL.
+static ofbx::IScene *ParseFBX(const char *pFileName, ofbx::u8 **ppData,
+                              uint64_t *pFileSize, TaskSystem *pTaskSystem) {
   FileStream file = {};
-  if (!fsOpenStreamFromPath(RD_MESHES, pResourceFileName, FileMode::FM_READ,
-                            &file)) {
-    LOGF(eERROR, "Failed to open file %s", pResourceFileName);
-    ASSERT(false);
+  if (!fsOpenStreamFromPath(RD_MESHES, pFileName, FileMode::FM_READ, &file)) {
+    LOGF(eERROR, "Failed to open file %s", pFileName);
+    return nullptr;
   }
 
   size_t fileSize = fsGetStreamFileSize(&file);
-  ofbx::u8 *data = reinterpret_cast<ofbx::u8 *>(tf_calloc(1, fileSize));
+  ofbx::u8 *data = reinterpret_cast<ofbx::u8 *>(
+      MemoryCalloc(kMemoryCategoryScene, 1, fileSize));
   fsReadFromStream(&file, data, fileSize);
+  fsCloseStream(&file);
 
+  // OpenFBX would otherwise inflate arrays one by one as it parses them.
+  FbxInflateStats inflateStats = {};
+  uint64_t parseSize = fileSize;
+  uint8_t *pInflated =
+      InflateFbxArrays(data, fileSize, kMemoryCategoryScene, pTaskSystem,
+                       &parseSize, &inflateStats);
+  if (pInflated) {
+    MemoryFree(data);
+    data = pInflated;
+  }
+
+  // Skins, bones (usually limb nodes) and animations are kept for skeletal
+  // animation, and blend shapes for morph targets.
   ofbx::LoadFlags flags =
       //		ofbx::LoadFlags::IGNORE_MODELS |
-      ofbx::LoadFlags::IGNORE_BLEND_SHAPES | ofbx::LoadFlags::IGNORE_CAMERAS |
-      ofbx::LoadFlags::IGNORE_LIGHTS | ofbx::LoadFlags::IGNORE_TEXTURES |
-      ofbx::LoadFlags::IGNORE_SKIN | ofbx::LoadFlags::IGNORE_BONES |
-      ofbx::LoadFlags::IGNORE_PIVOTS | ofbx::LoadFlags::IGNORE_MATERIALS |
-      ofbx::LoadFlags::IGNORE_POSES | ofbx::LoadFlags::IGNORE_VIDEOS |
-      ofbx::LoadFlags::IGNORE_LIMBS |
       //		ofbx::LoadFlags::IGNORE_MESHES |
-      ofbx::LoadFlags::IGNORE_ANIMATIONS;
+      //		ofbx::LoadFlags::IGNORE_BLEND_SHAPES |
+      ofbx::LoadFlags::IGNORE_CAMERAS |
+      ofbx::LoadFlags::IGNORE_LIGHTS | ofbx::LoadFlags::IGNORE_PIVOTS |
+      ofbx::LoadFlags::IGNORE_POSES | ofbx::LoadFlags::IGNORE_VIDEOS;
 
   // There is a leak here. OpenFBX allocates a buffer with unique_ptr, but we
   // can't free it here because the "delete" keyword has been redifined. There
   // are two options (aside from ignoring this): 1) Modify OpenFBX to allow
   // custom allocators; 2) Prevent the redefining of the "delete" keyword for
   // this section only.
-  auto scene = ofbx::load(data, fileSize, (ofbx::u16)flags);
+  ofbx::IScene *scene;
+  int64_t parseStart = getUSec(false);
+  {
+    TRACE_SCOPE("Parse FBX");
+    scene = ofbx::load(data, (size_t)parseSize, (ofbx::u16)flags);
+  }
+  double parseMs = (double)(getUSec(false) - parseStart) / 1000.0;
+  if (pInflated) {
+    LOGF(eINFO,
+         "Inflated %u FBX arrays, %.1f MB into %.1f MB, in %.1f ms on %u "
+         "threads (%.1f ms scanning), then parsed in %.1f ms",
+         inflateStats.mArrayCount,
+         inflateStats.mCompressedBytes / (1024.0 * 1024.0),
+         inflateStats.mInflatedBytes / (1024.0 * 1024.0),
+         (double)(inflateStats.mScanUSec + inflateStats.mInflateUSec) / 1000.0,
+         pTaskSystem ? pTaskSystem->GetThreadCount() : 1,
+         (double)inflateStats.mScanUSec / 1000.0, parseMs);
+  } else {
+    LOGF(eINFO, "Parsed FBX in %.1f ms", parseMs);
+  }
   if (scene == nullptr) {
     LOGF(LogLevel::eERROR, "Failed to load FBX: %s", ofbx::getError());
-    ASSERT(false);
+    MemoryFree(data);
+    return nullptr;
   }
+  *ppData = data;
+  if (pFileSize) {
+    *pFileSize = fileSize;
+  }
+  return scene;
+}
+
+/// Returns the index of \c pFbxMaterial in \c pMaterials, adding it and
+/// queuing its textures if it's new. Materials are shared between meshes, so
+/// they are deduplicated by object; index 0 is the default material.
+static uint32_t AddFBXMaterial(const ofbx::Material *pFbxMaterial,
+                               const ofbx::Material **ppFbxMaterials,
+                               SceneMaterial *pMaterials,
+                               uint32_t &materialCount,
+                               SceneTextureRequest **ppTextureRequests) {
+  if (pFbxMaterial == nullptr) {
+    return 0u;
+  }
+  for (uint32_t i = 1; i < materialCount; ++i) {
+    if (ppFbxMaterials[i] == pFbxMaterial) {
+      return i;
+    }
+  }
+  uint32_t index = materialCount++;
+  ppFbxMaterials[index] = pFbxMaterial;
+  ofbx::Color diffuse = pFbxMaterial->getDiffuseColor();
+  pMaterials[index].mDiffuseColor =
+      float4(diffuse.r, diffuse.g, diffuse.b, 1.0f);
+  pMaterials[index].mMetallic = kDefaultMetallic;
+  pMaterials[index].mRoughness = kDefaultRoughness;
+  pMaterials[index].mDiffuseTexture = TextureStreamer::kInvalidHandle;
+  pMaterials[index].mNormalTexture = TextureStreamer::kInvalidHandle;
+  SceneTextureRequest request = {index, StreamedTextureKind::Diffuse};
+  if (GetFBXTextureName(pFbxMaterial, ofbx::Texture::DIFFUSE,
+                        request.mFileName)) {
+    arrpush(*ppTextureRequests, request);
+  }
+  request.mKind = StreamedTextureKind::Normal;
+  if (GetFBXTextureName(pFbxMaterial, ofbx::Texture::NORMAL,
+                        request.mFileName)) {
+    arrpush(*ppTextureRequests, request);
+  }
+  return index;
+}
+
+/// Normal maps need tangents, which FBX files rarely have right, so they're
+/// generated for every mesh with a normal mapped material.
+static bool HasFBXNormalMap(const ofbx::Mesh *pMesh) {
+  for (int i = 0; i < pMesh->getMaterialCount(); ++i) {
+    const ofbx::Material *pMaterial = pMesh->getMaterial(i);
+    if (pMaterial != nullptr &&
+        pMaterial->getTexture(ofbx::Texture::NORMAL) != nullptr) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/// Moves vertices from a mesh's space into model space. Normals follow the
+/// inverse transpose, so that they stay perpendicular under non-uniform
+/// scale.
+struct FBXVertexTransform {
+  mat4 mPosition;
+  Matrix3 mNormal;
+};
+
+/// Unrolled vertex \c index of an FBX geometry, moved by \c pTransform
+/// unless it's \c NULL.
+template <typename Positions, typename Normals, typename Uvs>
+static SceneVertex ReadFBXVertex(const Positions &positions,
+                                 const Normals &normals, const Uvs &uvs,
+                                 int32_t index,
+                                 const FBXVertexTransform *pTransform) {
+  auto rawPosition = positions.get(index);
+  // Meshes without normals have theirs generated once unrolled.
+  auto rawNormal = normals.values ? normals.get(index) : ofbx::Vec3{0, 0, 1};
+  auto rawUv = uvs.values ? uvs.get(index) : ofbx::Vec2{0, 0};
+  vec3 position((float)rawPosition.x, (float)rawPosition.y,
+                (float)rawPosition.z);
+  vec3 normal((float)rawNormal.x, (float)rawNormal.y, (float)rawNormal.z);
+  if (pTransform) {
+    position = (pTransform->mPosition * Point3(position)).getXYZ();
+    normal = normalize(pTransform->mNormal * normal);
+  }
+  // FBX UVs have their origin at the bottom left.
+  return {v3ToF3(position), packUnorm2x16(encodeDir(v3ToF3(normal))),
+          packFloat2ToHalf2({rawUv.x, 1.0f - rawUv.y})};
+}
+
+/// The normal and UV of unrolled vertex \c index, unpacked for
+/// \c TangentSpaceGenerator. UVs keep their origin at the bottom left.
+template <typename Normals, typename Uvs>
+static void ReadFBXTangentInputs(const Normals &normals, const Uvs &uvs,
+                                 int32_t index, float *pNormal, float *pUv) {
+  vec3 normal(0.0f);
+  if (normals.values) {
+    auto rawNormal = normals.get(index);
+    normal = vec3((float)rawNormal.x, (float)rawNormal.y, (float)rawNormal.z);
+    float normalLength = length(normal);
+    normal = normalLength > 0.0f ? normal / normalLength : vec3(0.0f);
+  }
+  auto rawUv = uvs.values ? uvs.get(index) : ofbx::Vec2{0, 0};
+  pNormal[0] = normal.getX();
+  pNormal[1] = normal.getY();
+  pNormal[2] = normal.getZ();
+  pUv[0] = (float)rawUv.x;
+  pUv[1] = (float)rawUv.y;
+}
+
+/// Octahedral, like the shader decodes. Zero vectors, of vertices no
+/// triangle uses, are packed as +Z.
+static uint32_t PackNormal(const float *pNormal) {
+  float3 normal(pNormal[0], pNormal[1], pNormal[2]);
+  if (normal.x == 0.0f && normal.y == 0.0f && normal.z == 0.0f) {
+    normal = float3(0.0f, 0.0f, 1.0f);
+  }
+  return packUnorm2x16(encodeDir(normal));
+}
+
+/// Octahedral, the lowest bit replaced by the bitangent's sign, set if
+/// negative. The shader reads the bit as part of the direction too, off by
+/// at most one step.
+static uint32_t PackTangent(const float *pTangent) {
+  return (PackNormal(pTangent) & ~1u) | (pTangent[3] < 0.0f ? 1u : 0u);
+}
+
+static tfrg_atomic32_t gNextSceneId = 1;
+
+void Scene::BuildIdentityTransforms() {
+  const int32_t parent = -1;
+  const JointPose identity = {Quat::identity(), vec3(0.0f), vec3(1.0f)};
+  mTransforms.Build(&parent, &identity, 1, NULL);
+  mTransforms.Update(NULL);
+}
+
+bool Scene::LoadRaw(RenderContext &renderContext,
+                    const char *pResourceFileName, TaskSystem *pTaskSystem) {
+  if (!ImportRaw(pResourceFileName, pTaskSystem)) {
+    return false;
+  }
+  UploadRaw(renderContext);
+  return true;
+}
 
+/// Case-insensitive.
+static bool HasExtension(const char *pFileName, const char *pExtension) {
+  size_t length = strlen(pFileName);
+  size_t extensionLength = strlen(pExtension);
+  if (length < extensionLength) {
+    return false;
+  }
+  const char *pSuffix = pFileName + length - extensionLength;
+  for (size_t i = 0; i < extensionLength; ++i) {
+    if (tolower((unsigned char)pSuffix[i]) != pExtension[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Scene::ImportRaw(const char *pResourceFileName,
+                      TaskSystem *pTaskSystem) {
+  int64_t start = getUSec(false);
+  bool imported = HasExtension(pResourceFileName, ".glb")
+                      ? ImportRawGLB(pResourceFileName, pTaskSystem)
+                      : ImportRawFBX(pResourceFileName, pTaskSystem);
+  if (imported) {
+    LOGF(eINFO, "Imported %s in %.1f ms: %.1f MB, %u indices",
+         pResourceFileName, (double)(getUSec(false) - start) / 1000.0,
+         mSourceBytes / (1024.0 * 1024.0), mIndexCount);
+  }
+  return imported;
+}
+
+bool Scene::ImportRawFBX(const char *pResourceFileName,
+                         TaskSystem *pTaskSystem) {
+  TRACE_SCOPE("Import FBX");
+  mId = tfrg_atomic32_add_relaxed(&gNextSceneId, 1);
+  ofbx::u8 *data = NULL;
+  ofbx::IScene *scene =
+      ParseFBX(pResourceFileName, &data, &mSourceBytes, pTaskSystem);
+  if (scene == nullptr) {
+    return false;
+  }
+
+  // Each mesh partition is drawn with the mesh material of the same index.
   uint32_t maxVertexCount = 0;
   uint32_t maxIndexPerPolygonCount = 0;
-  for (uint32_t geomIdx = 0; geomIdx < scene->getGeometryCount(); geomIdx++) {
-    auto geometry = scene->getGeometry(geomIdx);
-    auto &geomData = geometry->getGeometryData();
+  uint32_t maxSubMeshCount = 0;
+  uint32_t maxMeshVertexCount = 0;
+  bool generatesTangentSpace = false;
+  for (uint32_t meshIdx = 0; meshIdx < scene->getMeshCount(); meshIdx++) {
+    auto mesh = scene->getMesh(meshIdx);
+    auto &geomData = mesh->getGeometryData();
+    uint32_t meshVertexCount = 0;
     for (uint32_t partIdx = 0; partIdx < geomData.getPartitionCount();
          partIdx++) {
       auto partition = geomData.getPartition(partIdx);
-      maxVertexCount += partition.triangles_count * 3;
+      meshVertexCount += partition.triangles_count * 3;
       maxIndexPerPolygonCount =
           max(maxIndexPerPolygonCount,
               (uint32_t)partition.max_polygon_triangles * 3);
+      maxSubMeshCount++;
     }
+    maxVertexCount += meshVertexCount;
+    maxMeshVertexCount = max(maxMeshVertexCount, meshVertexCount);
+    generatesTangentSpace |=
+        geomData.getNormals().values == nullptr || HasFBXNormalMap(mesh);
   }
   uint32_t maxIndexCount = maxVertexCount;
   auto vertices = reinterpret_cast<SceneVertex *>(
-      tf_calloc(maxVertexCount, sizeof(SceneVertex)));
-  auto indices =
-      reinterpret_cast<int16_t *>(tf_calloc(maxIndexCount, sizeof(int16_t)));
+      MemoryCalloc(kMemoryCategoryScene, maxVertexCount, sizeof(SceneVertex)));
+  auto indices = reinterpret_cast<uint32_t *>(
+      MemoryCalloc(kMemoryCategoryScene, maxIndexCount, sizeof(uint32_t)));
+
+  auto fbxMaterials = reinterpret_cast<const ofbx::Material **>(
+      MemoryCalloc(kMemoryCategoryScene, maxSubMeshCount + 1,
+                   sizeof(ofbx::Material *)));
+  pMaterials = reinterpret_cast<SceneMaterial *>(
+      MemoryCalloc(kMemoryCategoryScene, maxSubMeshCount + 1,
+                   sizeof(SceneMaterial)));
+  pSubMeshes = reinterpret_cast<SceneSubMesh *>(
+      MemoryCalloc(kMemoryCategoryScene, maxSubMeshCount,
+                   sizeof(SceneSubMesh)));
+  mMaterialCount = 1;
+  pMaterials[0] = GetDefaultMaterial();
+  mSubMeshCount = 0;
+
+  auto joints = reinterpret_cast<const ofbx::Object **>(
+      MemoryCalloc(kMemoryCategoryScene, Skeleton::kMaxJointCount,
+                   sizeof(ofbx::Object *)));
+  ImportSkeleton(*scene, joints, mSkeleton);
+  mClipCount = ImportClips(*scene, joints, mSkeleton.mJointCount, &pClips);
+  SceneSkinVertex *skinVertices = NULL;
+  if (mSkeleton.mJointCount > 0) {
+    skinVertices = reinterpret_cast<SceneSkinVertex *>(
+        MemoryCalloc(kMemoryCategoryScene, maxVertexCount,
+                     sizeof(SceneSkinVertex)));
+  }
+  pMeshRanges = reinterpret_cast<SceneMeshRange *>(
+      MemoryCalloc(kMemoryCategoryScene, scene->getMeshCount() + 1,
+                   sizeof(SceneMeshRange)));
+  mMeshRangeCount = 0;
+  auto findJoint = [&](const ofbx::Object *pBone) {
+    for (uint32_t i = 0; i < mSkeleton.mJointCount; ++i) {
+      if (joints[i] == pBone) {
+        return (int32_t)i;
+      }
+    }
+    return -1;
+  };
 
   auto indexTmp = reinterpret_cast<int32_t *>(
-      tf_calloc(maxIndexPerPolygonCount, sizeof(int32_t)));
+      MemoryCalloc(kMemoryCategoryScene, maxIndexPerPolygonCount,
+                   sizeof(int32_t)));
+  // Control point of each unrolled vertex, which blend shapes refer to.
+  auto vertexControlPoints = reinterpret_cast<int32_t *>(
+      MemoryCalloc(kMemoryCategoryScene, maxVertexCount, sizeof(int32_t)));
+  // Normals, UVs and tangents of one mesh at a time, for meshes whose
+  // normals or tangents are generated.
+  float *meshNormals = NULL;
+  float *meshUvs = NULL;
+  float *meshTangents = NULL;
+  if (generatesTangentSpace) {
+    meshNormals = reinterpret_cast<float *>(MemoryAlloc(
+        kMemoryCategoryScene, (size_t)maxMeshVertexCount * 9 * sizeof(float)));
+    meshUvs = meshNormals + (size_t)maxMeshVertexCount * 3;
+    meshTangents = meshUvs + (size_t)maxMeshVertexCount * 2;
+  }
+  uint32_t *tangentVertices = NULL;
   mIndexCount = 0;
   auto write = [&](SceneVertex vertex) {
     vertices[mIndexCount] = vertex;
     indices[mIndexCount] = mIndexCount;
     mIndexCount++;
   };
+  // Vertices stay in their mesh's space, placed by the mesh's node.
+  const ofbx::Object **nodes = NULL;
+  int32_t *nodeParents = NULL;
+  JointPose *nodeLocals = NULL;
 
-  for (uint32_t geomIdx = 0; geomIdx < scene->getGeometryCount(); geomIdx++) {
-    auto geometry = scene->getGeometry(geomIdx);
-    auto &geomData = geometry->getGeometryData();
+  for (uint32_t meshIdx = 0; meshIdx < scene->getMeshCount(); meshIdx++) {
+    auto mesh = scene->getMesh(meshIdx);
+    auto &geomData = mesh->getGeometryData();
     auto positions = geomData.getPositions();
     auto normals = geomData.getNormals();
     auto uvs = geomData.getUVs();
+    uint32_t meshVertexOffset = mIndexCount;
+    uint32_t meshNode = (uint32_t)AddNode(mesh, scene->getRoot(), &nodes,
+                                          &nodeParents, &nodeLocals);
+    bool generateNormals = normals.values == nullptr;
+    bool generateTangents = HasFBXNormalMap(mesh);
+
+    // Influences are per control point, so they're gathered before the
+    // polygons are unrolled.
+    const ofbx::Skin *pSkin = skinVertices ? mesh->getSkin() : nullptr;
+    SceneSkinVertex *controlPointSkins = NULL;
+    float *controlPointWeights = NULL;
+    if (pSkin != nullptr) {
+      controlPointSkins = reinterpret_cast<SceneSkinVertex *>(
+          MemoryCalloc(kMemoryCategoryScene, positions.values_count,
+                       sizeof(SceneSkinVertex)));
+      controlPointWeights = reinterpret_cast<float *>(
+          MemoryCalloc(kMemoryCategoryScene, positions.values_count * 4,
+                       sizeof(float)));
+      for (int c = 0; c < pSkin->getClusterCount(); ++c) {
+        const ofbx::Cluster *pCluster = pSkin->getCluster(c);
+        int32_t joint = findJoint(pCluster->getLink());
+        if (joint < 0) {
+          continue;
+        }
+        const int *pIndices = pCluster->getIndices();
+        const double *pWeights = pCluster->getWeights();
+        for (int i = 0; i < pCluster->getIndicesCount(); ++i) {
+          int controlPoint = pIndices[i];
+          if (controlPoint < 0 || controlPoint >= positions.values_count) {
+            continue;
+          }
+          AddInfluence(controlPointSkins[controlPoint],
+                       &controlPointWeights[controlPoint * 4], joint,
+                       (float)pWeights[i]);
+        }
+      }
+      for (int i = 0; i < positions.values_count; ++i) {
+        controlPointSkins[i] = NormalizeInfluences(controlPointSkins[i],
+                                                   &controlPointWeights[i * 4]);
+      }
+    }
+
     for (uint32_t partIdx = 0; partIdx < geomData.getPartitionCount();
          partIdx++) {
       auto partition = geomData.getPartition(partIdx);
+      SceneSubMesh &subMesh = pSubMeshes[mSubMeshCount++];
+      subMesh.mIndexOffset = mIndexCount;
+      subMesh.mMaterialIndex =
+          partIdx < (uint32_t)mesh->getMaterialCount()
+              ? AddFBXMaterial(mesh->getMaterial(partIdx), fbxMaterials,
+                               pMaterials, mMaterialCount, &pTextureRequests)
+              : 0;
+      subMesh.mSkinned = pSkin != nullptr;
+      subMesh.mNode = meshNode;
+      vec3 boundsMin(FLT_MAX);
+      vec3 boundsMax(-FLT_MAX);
       for (size_t polyIdx = 0; polyIdx < partition.polygon_count; polyIdx++) {
         auto polygon = partition.polygons[polyIdx];
         uint32_t vertexCount = ofbx::triangulate(geomData, polygon, indexTmp);
         for (size_t vtxIdx = 0; vtxIdx < vertexCount; vtxIdx++) {
           int32_t geomVIdx = indexTmp[vtxIdx];
-          auto rawPosition = positions.get(geomVIdx);
-          auto rawNormal = normals.get(geomVIdx);
-          auto rawUv = uvs.get(geomVIdx);
-          float3 position = {(float)rawPosition.x, (float)rawPosition.y,
-                             (float)rawPosition.z};
-          uint32_t normal =
-              packUnorm2x16(encodeDir({rawNormal.x, rawNormal.y, rawNormal.z}));
-          uint32_t uv = packFloat2ToHalf2({rawUv.x, rawUv.y});
-          write({position, normal, uv});
+          SceneVertex vertex =
+              ReadFBXVertex(positions, normals, uvs, geomVIdx, NULL);
+          int controlPoint =
+              positions.indices ? positions.indices[geomVIdx] : geomVIdx;
+          vertexControlPoints[mIndexCount] = controlPoint;
+          if (pSkin != nullptr) {
+            skinVertices[mIndexCount] = controlPointSkins[controlPoint];
+          }
+          if (generateNormals || generateTangents) {
+            uint32_t meshVertex = mIndexCount - meshVertexOffset;
+            ReadFBXTangentInputs(normals, uvs, geomVIdx,
+                                 meshNormals + meshVertex * 3,
+                                 meshUvs + meshVertex * 2);
+          }
+          write(vertex);
+          boundsMin = minPerElem(boundsMin, f3Tov3(vertex.mPosition));
+          boundsMax = maxPerElem(boundsMax, f3Tov3(vertex.mPosition));
+        }
+      }
+      subMesh.mIndexCount = mIndexCount - subMesh.mIndexOffset;
+      subMesh.mBoundsMin = v3ToF3(boundsMin);
+      subMesh.mBoundsMax = v3ToF3(boundsMax);
+    }
+    MemoryFree(controlPointSkins);
+    MemoryFree(controlPointWeights);
+
+    uint32_t meshVertexCount = mIndexCount - meshVertexOffset;
+    if ((generateNormals || generateTangents) && meshVertexCount > 0) {
+      TRACE_SCOPE("Generate Tangent Space");
+      // Unrolled vertices of one control point are smoothed together.
+      TangentSpaceMesh tangentMesh = {};
+      tangentMesh.mIndexCount = meshVertexCount;
+      tangentMesh.mVertexCount = meshVertexCount;
+      tangentMesh.pPositions = &vertices[meshVertexOffset].mPosition;
+      tangentMesh.mPositionStride = sizeof(SceneVertex);
+      tangentMesh.pUvs = meshUvs;
+      tangentMesh.mUvStride = 2 * sizeof(float);
+      tangentMesh.pPositionIds = reinterpret_cast<const uint32_t *>(
+          vertexControlPoints + meshVertexOffset);
+      tangentMesh.mPositionIdCount = (uint32_t)positions.values_count;
+      TangentSpaceGenerator generator;
+      if (!generator.Init(tangentMesh, pTaskSystem)) {
+        LOGF(eWARNING, "Mesh %u has invalid control points, its normals and "
+                       "tangents aren't generated",
+             meshIdx);
+      } else {
+        if (generateNormals) {
+          generator.GenerateNormals(kNormalSmoothingAngle, meshNormals);
+          for (uint32_t i = 0; i < meshVertexCount; ++i) {
+            vertices[meshVertexOffset + i].mNormal =
+                PackNormal(meshNormals + i * 3);
+          }
+        }
+        if (generateTangents) {
+          if (tangentVertices == NULL) {
+            tangentVertices = reinterpret_cast<uint32_t *>(MemoryCalloc(
+                kMemoryCategoryScene, maxVertexCount, sizeof(uint32_t)));
+          }
+          generator.GenerateTangents(meshNormals, meshTangents);
+          for (uint32_t i = 0; i < meshVertexCount; ++i) {
+            tangentVertices[meshVertexOffset + i] =
+                PackTangent(meshTangents + i * 4);
+          }
+        }
+        generator.Destroy();
+      }
+    }
+
+    ImportBlendShapes(mesh, (uint32_t)positions.values_count,
+                      vertexControlPoints + meshVertexOffset, meshVertexOffset,
+                      mIndexCount - meshVertexOffset, mBlendShapes);
+
+    SceneMeshRange &range = pMeshRanges[mMeshRangeCount++];
+    range.mVertexOffset = meshVertexOffset;
+    range.mVertexCount = mIndexCount - meshVertexOffset;
+    range.mHash = HashBytes(vertices + meshVertexOffset,
+                            range.mVertexCount * sizeof(SceneVertex));
+    if (skinVertices) {
+      range.mHash =
+          HashBytes(skinVertices + meshVertexOffset,
+                    range.mVertexCount * sizeof(SceneSkinVertex), range.mHash);
+    }
+    if (tangentVertices) {
+      range.mHash =
+          HashBytes(tangentVertices + meshVertexOffset,
+                    range.mVertexCount * sizeof(uint32_t), range.mHash);
+    }
+  }
+  MemoryFree(meshNormals);
+  MemoryFree(vertexControlPoints);
+  MemoryFree(indexTmp);
+  MemoryFree(joints);
+
+  uint32_t nodeCount = (uint32_t)arrlen(nodes);
+  uint32_t *nodeIndices = reinterpret_cast<uint32_t *>(
+      MemoryCalloc(kMemoryCategoryScene, nodeCount + 1, sizeof(uint32_t)));
+  if (nodeCount > kMaxNodeCount ||
+      !mTransforms.Build(nodeParents, nodeLocals, nodeCount, nodeIndices)) {
+    LOGF(eWARNING, "Meshes are left unplaced, %u nodes out of at most %u",
+         nodeCount, kMaxNodeCount);
+    BuildIdentityTransforms();
+    for (uint32_t i = 0; i < mSubMeshCount; ++i) {
+      pSubMeshes[i].mNode = 0;
+    }
+  } else {
+    mTransforms.Update(NULL);
+    for (uint32_t i = 0; i < mSubMeshCount; ++i) {
+      pSubMeshes[i].mNode = nodeIndices[pSubMeshes[i].mNode];
+    }
+  }
+  MemoryFree(nodeIndices);
+  arrfree(nodes);
+  arrfree(nodeParents);
+  arrfree(nodeLocals);
+  MemoryFree(fbxMaterials);
+  MemoryFree(data);
+
+  mKind = SceneKind::Raw;
+  pVertices = vertices;
+  pIndices = indices;
+  pVertexBuffer = NULL;
+  pIndexBuffer = NULL;
+  mVertexCapacity = maxVertexCount;
+  pSkinVertices = skinVertices;
+  pTangentVertices = tangentVertices;
+  mLayoutHash = ComputeLayoutHash();
+  mHelperBytes = ComputeHelperBytes();
+  MemoryTrack(kMemoryCategoryScene, kMemoryKindCpu, mHelperBytes);
+  return true;
+}
+
+/// Decodes the buffer views compressed with EXT_meshopt_compression into
+/// allocations stored in \c ppDecoded, one per view, which \c glb then reads.
+static bool DecodeMeshoptViews(GlbFile &glb, void **ppDecoded) {
+  for (uint32_t i = 0; i < glb.GetBufferViewCount(); ++i) {
+    const GlbBufferView &view = glb.GetBufferView(i);
+    if (view.mMeshoptMode == GlbMeshoptMode::None) {
+      continue;
+    }
+    uint32_t count = view.mMeshoptCount;
+    uint32_t stride = view.mMeshoptStride;
+    size_t size = (size_t)count * stride;
+    bool indices = view.mMeshoptMode != GlbMeshoptMode::Attributes;
+    // The decoders assert on layouts the extension doesn't allow.
+    bool valid = indices ? (stride == 2 || stride == 4) &&
+                               (view.mMeshoptMode == GlbMeshoptMode::Indices ||
+                                count % 3 == 0)
+                         : stride > 0 && stride <= 256 && stride % 4 == 0;
+    switch (view.mMeshoptFilter) {
+    case GlbMeshoptFilter::None:
+      break;
+    case GlbMeshoptFilter::Octahedral:
+      valid &= !indices && (stride == 4 || stride == 8);
+      break;
+    case GlbMeshoptFilter::Quaternion:
+      valid &= !indices && stride == 8;
+      break;
+    case GlbMeshoptFilter::Exponential:
+      valid &= !indices;
+      break;
+    }
+    ppDecoded[i] = MemoryAlloc(kMemoryCategoryScene, max(size, (size_t)1));
+    int result = -1;
+    if (valid && view.mMeshoptMode == GlbMeshoptMode::Attributes) {
+      result = meshopt_decodeVertexBuffer(ppDecoded[i], count, stride,
+                                          view.pMeshoptData,
+                                          (size_t)view.mMeshoptLength);
+    } else if (valid && view.mMeshoptMode == GlbMeshoptMode::Triangles) {
+      result = meshopt_decodeIndexBuffer(ppDecoded[i], count, stride,
+                                         view.pMeshoptData,
+                                         (size_t)view.mMeshoptLength);
+    } else if (valid) {
+      result = meshopt_decodeIndexSequence(ppDecoded[i], count, stride,
+                                           view.pMeshoptData,
+                                           (size_t)view.mMeshoptLength);
+    }
+    if (result != 0) {
+      LOGF(eERROR, "Failed to decode buffer view %u", i);
+      return false;
+    }
+    switch (view.mMeshoptFilter) {
+    case GlbMeshoptFilter::None:
+      break;
+    case GlbMeshoptFilter::Octahedral:
+      meshopt_decodeFilterOct(ppDecoded[i], count, stride);
+      break;
+    case GlbMeshoptFilter::Quaternion:
+      meshopt_decodeFilterQuat(ppDecoded[i], count, stride);
+      break;
+    case GlbMeshoptFilter::Exponential:
+      meshopt_decodeFilterExp(ppDecoded[i], count, stride);
+      break;
+    }
+    glb.SetBufferViewData(i, reinterpret_cast<uint8_t *>(ppDecoded[i]), size,
+                          view.mStride);
+  }
+  return true;
+}
+
+/// Triangle lists with positions, the only primitives drawn.
+static bool IsDrawnPrimitive(const GlbFile &glb,
+                             const GlbPrimitive &primitive) {
+  return primitive.mMode == 4 && primitive.mPosition >= 0 &&
+         glb.GetAccessor(primitive.mPosition).mCount > 0;
+}
+
+/// Image URIs are relative to the file, so, as for FBX, only the file name
+/// is kept and looked up in \c RD_TEXTURES. Escaped characters are decoded.
+static bool GetGLBTextureName(const GlbFile &glb, int32_t image,
+                              char (&fileName)[FS_MAX_PATH]) {
+  if (image < 0) {
+    return false;
+  }
+  const GlbImage &glbImage = glb.GetImage(image);
+  if (glbImage.pUri == NULL ||
+      (glbImage.mUriLength >= 5 && strncmp(glbImage.pUri, "data:", 5) == 0)) {
+    LOGF(eWARNING, "Image %d is embedded, which isn't supported", image);
+    return false;
+  }
+  uint32_t start = 0;
+  for (uint32_t i = 0; i < glbImage.mUriLength; ++i) {
+    if (glbImage.pUri[i] == '/' || glbImage.pUri[i] == '\\') {
+      start = i + 1;
+    }
+  }
+  uint32_t length = 0;
+  for (uint32_t i = start;
+       i < glbImage.mUriLength && length < FS_MAX_PATH - 1; ++i) {
+    char c = glbImage.pUri[i];
+    if (c == '%' && i + 2 < glbImage.mUriLength &&
+        isxdigit((unsigned char)glbImage.pUri[i + 1]) &&
+        isxdigit((unsigned char)glbImage.pUri[i + 2])) {
+      char digits[3] = {glbImage.pUri[i + 1], glbImage.pUri[i + 2], '\0'};
+      c = (char)strtol(digits, NULL, 16);
+      i += 2;
+    }
+    fileName[length++] = c;
+  }
+  fileName[length] = '\0';
+  return length > 0;
+}
+
+/// Same as \c AddFBXMaterial, \c pMaterialMap holding the scene material of
+/// each glTF material, or 0 until it's added.
+static uint32_t AddGLBMaterial(const GlbFile &glb, int32_t glbMaterial,
+                               uint32_t *pMaterialMap,
+                               SceneMaterial *pMaterials,
+                               uint32_t &materialCount,
+                               SceneTextureRequest **ppTextureRequests) {
+  if (glbMaterial < 0 || (uint32_t)glbMaterial >= glb.GetMaterialCount()) {
+    return 0u;
+  }
+  if (pMaterialMap[glbMaterial] != 0) {
+    return pMaterialMap[glbMaterial];
+  }
+  uint32_t index = materialCount++;
+  pMaterialMap[glbMaterial] = index;
+  const GlbMaterial &material = glb.GetMaterial((uint32_t)glbMaterial);
+  // Alpha is left out, like FBX, as glTF materials default to opaque.
+  pMaterials[index].mDiffuseColor =
+      float4(material.mBaseColor[0], material.mBaseColor[1],
+             material.mBaseColor[2], 1.0f);
+  // Metallic/roughness textures aren't streamed, and the factors only scale
+  // them.
+  bool hasFactors = material.mMetallicRoughnessImage < 0;
+  pMaterials[index].mMetallic =
+      hasFactors ? material.mMetallic : kDefaultMetallic;
+  pMaterials[index].mRoughness =
+      hasFactors ? material.mRoughness : kDefaultRoughness;
+  pMaterials[index].mDiffuseTexture = TextureStreamer::kInvalidHandle;
+  pMaterials[index].mNormalTexture = TextureStreamer::kInvalidHandle;
+  SceneTextureRequest request = {index, StreamedTextureKind::Diffuse};
+  if (GetGLBTextureName(glb, material.mBaseColorImage, request.mFileName)) {
+    arrpush(*ppTextureRequests, request);
+  }
+  request.mKind = StreamedTextureKind::Normal;
+  if (GetGLBTextureName(glb, material.mNormalImage, request.mFileName)) {
+    arrpush(*ppTextureRequests, request);
+  }
+  return index;
+}
+
+static JointPose GetGLBLocalPose(const GlbNode &node) {
+  if (node.mHasMatrix) {
+    const float *m = node.mMatrix;
+    return DecomposePose(mat4(vec4(m[0], m[1], m[2], m[3]),
+                              vec4(m[4], m[5], m[6], m[7]),
+                              vec4(m[8], m[9], m[10], m[11]),
+                              vec4(m[12], m[13], m[14], m[15])));
+  }
+  JointPose pose;
+  pose.mRotation = normalize(Quat(node.mRotation[0], node.mRotation[1],
+                                  node.mRotation[2], node.mRotation[3]));
+  pose.mTranslation =
+      vec3(node.mTranslation[0], node.mTranslation[1], node.mTranslation[2]);
+  pose.mScale = vec3(node.mScale[0], node.mScale[1], node.mScale[2]);
+  return pose;
+}
+
+/// Where a glTF primitive's indices ended up.
+struct GLBPrimitiveRange {
+  uint32_t mIndexOffset;
+  uint32_t mIndexCount;
+  uint32_t mMaterialIndex;
+  float3 mBoundsMin;
+  float3 mBoundsMax;
+};
+
+bool Scene::ImportRawGLB(const char *pResourceFileName,
+                         TaskSystem *pTaskSystem) {
+  TRACE_SCOPE("Import GLB");
+  mId = tfrg_atomic32_add_relaxed(&gNextSceneId, 1);
+  FileStream file = {};
+  if (!fsOpenStreamFromPath(RD_MESHES, pResourceFileName, FileMode::FM_READ,
+                            &file)) {
+    LOGF(eERROR, "Failed to open file %s", pResourceFileName);
+    return false;
+  }
+  // Read once; accessors then point into it, rather than into copies of
+  // each buffer.
+  size_t fileSize = fsGetStreamFileSize(&file);
+  uint8_t *data = reinterpret_cast<uint8_t *>(
+      MemoryAlloc(kMemoryCategoryScene, max(fileSize, (size_t)1)));
+  size_t readSize = fsReadFromStream(&file, data, fileSize);
+  fsCloseStream(&file);
+
+  GlbFile glb;
+  void **decodedViews = NULL;
+  bool parsed;
+  {
+    TRACE_SCOPE("Parse GLB");
+    parsed = readSize == fileSize && glb.Parse(data, fileSize);
+    if (parsed) {
+      decodedViews = reinterpret_cast<void **>(
+          MemoryCalloc(kMemoryCategoryScene, glb.GetBufferViewCount() + 1,
+                       sizeof(void *)));
+      parsed = DecodeMeshoptViews(glb, decodedViews);
+    }
+  }
+  auto release = [&]() {
+    for (uint32_t i = 0; decodedViews && i < glb.GetBufferViewCount(); ++i) {
+      MemoryFree(decodedViews[i]);
+    }
+    MemoryFree(decodedViews);
+    glb.Destroy();
+    MemoryFree(data);
+  };
+  if (!parsed) {
+    LOGF(eERROR, "Failed to load GLB %s", pResourceFileName);
+    release();
+    return false;
+  }
+
+  // Meshes are imported once, however many nodes place them.
+  uint32_t glbMeshCount = glb.GetMeshCount();
+  bool *meshUsed = reinterpret_cast<bool *>(
+      MemoryCalloc(kMemoryCategoryScene, glbMeshCount + 1, sizeof(bool)));
+  uint32_t nodeCount = 0;
+  bool skinned = false;
+  for (uint32_t i = 0; i < glb.GetNodeCount(); ++i) {
+    const GlbNode &node = glb.GetNode(i);
+    if (node.mInScene) {
+      nodeCount++;
+      skinned |= node.mSkinned && node.mMesh >= 0;
+      if (node.mMesh >= 0) {
+        meshUsed[node.mMesh] = true;
+      }
+    }
+  }
+  if (skinned) {
+    LOGF(eWARNING, "Skins aren't supported, meshes are shown unskinned");
+  }
+  uint32_t vertexCount = 0;
+  uint32_t indexCount = 0;
+  uint32_t maxPrimitiveVertexCount = 0;
+  bool skippedPrimitives = false;
+  bool morphed = false;
+  for (uint32_t meshIdx = 0; meshIdx < glbMeshCount; meshIdx++) {
+    const GlbMesh &mesh = glb.GetMesh(meshIdx);
+    for (uint32_t p = 0; meshUsed[meshIdx] && p < mesh.mPrimitiveCount; p++) {
+      const GlbPrimitive &primitive =
+          glb.GetPrimitive(mesh.mFirstPrimitive + p);
+      if (!IsDrawnPrimitive(glb, primitive)) {
+        skippedPrimitives = true;
+        continue;
+      }
+      morphed |= primitive.mMorphed;
+      uint32_t count = glb.GetAccessor(primitive.mPosition).mCount;
+      vertexCount += count;
+      indexCount += primitive.mIndices >= 0
+                        ? glb.GetAccessor(primitive.mIndices).mCount
+                        : count;
+      maxPrimitiveVertexCount = max(maxPrimitiveVertexCount, count);
+    }
+  }
+  if (skippedPrimitives) {
+    LOGF(eWARNING, "Only triangle lists with positions are drawn");
+  }
+  if (morphed) {
+    LOGF(eWARNING, "Morph targets aren't supported, meshes are undeformed");
+  }
+
+  auto vertices = reinterpret_cast<SceneVertex *>(MemoryCalloc(
+      kMemoryCategoryScene, max(vertexCount, 1u), sizeof(SceneVertex)));
+  auto indices = reinterpret_cast<uint32_t *>(MemoryCalloc(
+      kMemoryCategoryScene, max(indexCount, 1u), sizeof(uint32_t)));
+  // Attributes of one primitive at a time, converted to floats.
+  auto positions = reinterpret_cast<float *>(
+      MemoryAlloc(kMemoryCategoryScene,
+                  (maxPrimitiveVertexCount + 1) * 12 * sizeof(float)));
+  float *normals = positions + (maxPrimitiveVertexCount + 1) * 3;
+  float *uvs = normals + (maxPrimitiveVertexCount + 1) * 3;
+  float *tangents = uvs + (maxPrimitiveVertexCount + 1) * 2;
+  uint32_t *tangentVertices = NULL;
+  auto primitiveRanges = reinterpret_cast<GLBPrimitiveRange *>(
+      MemoryCalloc(kMemoryCategoryScene, glb.GetPrimitiveCount() + 1,
+                   sizeof(GLBPrimitiveRange)));
+  auto materialMap = reinterpret_cast<uint32_t *>(
+      MemoryCalloc(kMemoryCategoryScene, glb.GetMaterialCount() + 1,
+                   sizeof(uint32_t)));
+  pMaterials = reinterpret_cast<SceneMaterial *>(
+      MemoryCalloc(kMemoryCategoryScene, glb.GetMaterialCount() + 1,
+                   sizeof(SceneMaterial)));
+  mMaterialCount = 1;
+  pMaterials[0] = GetDefaultMaterial();
+  pMeshRanges = reinterpret_cast<SceneMeshRange *>(MemoryCalloc(
+      kMemoryCategoryScene, glbMeshCount + 1, sizeof(SceneMeshRange)));
+  mMeshRangeCount = 0;
+
+  uint32_t vertexOffset = 0;
+  uint32_t indexOffset = 0;
+  bool valid = true;
+  for (uint32_t meshIdx = 0; meshIdx < glbMeshCount && valid; meshIdx++) {
+    if (!meshUsed[meshIdx]) {
+      continue;
+    }
+    const GlbMesh &mesh = glb.GetMesh(meshIdx);
+    uint32_t meshVertexOffset = vertexOffset;
+    for (uint32_t p = 0; p < mesh.mPrimitiveCount && valid; p++) {
+      const GlbPrimitive &primitive =
+          glb.GetPrimitive(mesh.mFirstPrimitive + p);
+      if (!IsDrawnPrimitive(glb, primitive)) {
+        continue;
+      }
+      uint32_t count = glb.GetAccessor(primitive.mPosition).mCount;
+      GLBPrimitiveRange &range = primitiveRanges[mesh.mFirstPrimitive + p];
+      range.mIndexOffset = indexOffset;
+      range.mIndexCount = primitive.mIndices >= 0
+                              ? glb.GetAccessor(primitive.mIndices).mCount
+                              : count;
+      range.mMaterialIndex =
+          AddGLBMaterial(glb, primitive.mMaterial, materialMap, pMaterials,
+                         mMaterialCount, &pTextureRequests);
+      valid = glb.ReadFloats(primitive.mPosition, 3, positions);
+      if (valid && primitive.mIndices >= 0) {
+        valid = glb.ReadIndices(primitive.mIndices, vertexOffset, count,
+                                indices + indexOffset);
+      } else {
+        for (uint32_t i = 0; i < count; ++i) {
+          indices[indexOffset + i] = vertexOffset + i;
         }
       }
+      if (!valid) {
+        break;
+      }
+      // Attributes that can't be read are filled in rather than failing the
+      // whole import.
+      if (primitive.mTexCoord < 0 ||
+          glb.GetAccessor(primitive.mTexCoord).mCount != count ||
+          !glb.ReadFloats(primitive.mTexCoord, 2, uvs)) {
+        memset(uvs, 0, (size_t)count * 2 * sizeof(float));
+      }
+      bool generateNormals =
+          primitive.mNormal < 0 ||
+          glb.GetAccessor(primitive.mNormal).mCount != count ||
+          !glb.ReadFloats(primitive.mNormal, 3, normals);
+      // Tangents are regenerated even if the file has them, so that every
+      // model follows the same convention.
+      bool generateTangents =
+          primitive.mMaterial >= 0 &&
+          (uint32_t)primitive.mMaterial < glb.GetMaterialCount() &&
+          glb.GetMaterial((uint32_t)primitive.mMaterial).mNormalImage >= 0;
+      TangentSpaceGenerator generator;
+      if (generateNormals || generateTangents) {
+        TRACE_SCOPE("Generate Tangent Space");
+        TangentSpaceMesh tangentMesh = {};
+        tangentMesh.pIndices = indices + indexOffset;
+        tangentMesh.mBaseVertex = vertexOffset;
+        tangentMesh.mIndexCount = range.mIndexCount;
+        tangentMesh.mVertexCount = count;
+        tangentMesh.pPositions = positions;
+        tangentMesh.mPositionStride = 3 * sizeof(float);
+        tangentMesh.pUvs = uvs;
+        tangentMesh.mUvStride = 2 * sizeof(float);
+        // Indices were checked against the primitive's vertices when read,
+        // so this only fails if the file is inconsistent in some other way.
+        if (!generator.Init(tangentMesh, pTaskSystem)) {
+          LOGF(eERROR, "Mesh %u has invalid indices, its tangent space can't "
+                       "be generated",
+               meshIdx);
+          valid = false;
+          break;
+        }
+        if (generateNormals) {
+          generator.GenerateNormals(kNormalSmoothingAngle, normals);
+        }
+      }
+      for (uint32_t i = 0; i < count; ++i) {
+        vec3 normal(normals[i * 3], normals[i * 3 + 1], normals[i * 3 + 2]);
+        float normalLength = length(normal);
+        normal = normalLength > 0.0f ? normal / normalLength
+                                     : vec3(0.0f, 1.0f, 0.0f);
+        normals[i * 3] = normal.getX();
+        normals[i * 3 + 1] = normal.getY();
+        normals[i * 3 + 2] = normal.getZ();
+      }
+      if (generateTangents) {
+        TRACE_SCOPE("Generate Tangent Space");
+        if (tangentVertices == NULL) {
+          tangentVertices = reinterpret_cast<uint32_t *>(MemoryCalloc(
+              kMemoryCategoryScene, max(vertexCount, 1u), sizeof(uint32_t)));
+        }
+        // Flipping V only flips the bitangent, so tangents are generated
+        // from the file's UVs and their sign turned to a bottom left origin,
+        // like FBX's.
+        generator.GenerateTangents(normals, tangents);
+        for (uint32_t i = 0; i < count; ++i) {
+          tangents[i * 4 + 3] = -tangents[i * 4 + 3];
+          tangentVertices[vertexOffset + i] = PackTangent(tangents + i * 4);
+        }
+      }
+      generator.Destroy();
+
+      vec3 boundsMin(FLT_MAX);
+      vec3 boundsMax(-FLT_MAX);
+      for (uint32_t i = 0; i < count; ++i) {
+        vec3 position(positions[i * 3], positions[i * 3 + 1],
+                      positions[i * 3 + 2]);
+        // glTF UVs have their origin at the top left, like the renderer's.
+        vertices[vertexOffset + i] = {
+            v3ToF3(position), PackNormal(normals + i * 3),
+            packFloat2ToHalf2({uvs[i * 2], uvs[i * 2 + 1]})};
+        boundsMin = minPerElem(boundsMin, position);
+        boundsMax = maxPerElem(boundsMax, position);
+      }
+      range.mBoundsMin = v3ToF3(boundsMin);
+      range.mBoundsMax = v3ToF3(boundsMax);
+      vertexOffset += count;
+      indexOffset += range.mIndexCount;
+    }
+
+    SceneMeshRange &range = pMeshRanges[mMeshRangeCount++];
+    range.mVertexOffset = meshVertexOffset;
+    range.mVertexCount = vertexOffset - meshVertexOffset;
+    range.mHash = HashBytes(vertices + meshVertexOffset,
+                            range.mVertexCount * sizeof(SceneVertex));
+    if (tangentVertices) {
+      range.mHash =
+          HashBytes(tangentVertices + meshVertexOffset,
+                    range.mVertexCount * sizeof(uint32_t), range.mHash);
+    }
+  }
+  MemoryFree(materialMap);
+  MemoryFree(positions);
+  MemoryFree(meshUsed);
+
+  // One submesh per primitive of each node, the nodes of the default scene
+  // renumbered in file order.
+  int32_t *nodeIndices = reinterpret_cast<int32_t *>(MemoryCalloc(
+      kMemoryCategoryScene, glb.GetNodeCount() + 1, sizeof(int32_t)));
+  int32_t *nodeParents = reinterpret_cast<int32_t *>(
+      MemoryCalloc(kMemoryCategoryScene, nodeCount + 1, sizeof(int32_t)));
+  JointPose *nodeLocals = reinterpret_cast<JointPose *>(
+      MemoryCalloc(kMemoryCategoryScene, nodeCount + 1, sizeof(JointPose)));
+  uint32_t subMeshCount = 0;
+  nodeCount = 0;
+  for (uint32_t i = 0; i < glb.GetNodeCount(); ++i) {
+    const GlbNode &node = glb.GetNode(i);
+    nodeIndices[i] = node.mInScene ? (int32_t)nodeCount++ : -1;
+    if (node.mInScene && node.mMesh >= 0) {
+      subMeshCount += glb.GetMesh(node.mMesh).mPrimitiveCount;
+    }
+  }
+  pSubMeshes = reinterpret_cast<SceneSubMesh *>(MemoryCalloc(
+      kMemoryCategoryScene, subMeshCount + 1, sizeof(SceneSubMesh)));
+  mSubMeshCount = 0;
+  for (uint32_t i = 0; i < glb.GetNodeCount() && valid; ++i) {
+    const GlbNode &node = glb.GetNode(i);
+    if (!node.mInScene) {
+      continue;
+    }
+    nodeParents[nodeIndices[i]] =
+        node.mParent >= 0 ? nodeIndices[node.mParent] : -1;
+    nodeLocals[nodeIndices[i]] = GetGLBLocalPose(node);
+    if (node.mMesh < 0) {
+      continue;
+    }
+    const GlbMesh &mesh = glb.GetMesh(node.mMesh);
+    for (uint32_t p = 0; p < mesh.mPrimitiveCount; ++p) {
+      if (!IsDrawnPrimitive(glb, glb.GetPrimitive(mesh.mFirstPrimitive + p))) {
+        continue;
+      }
+      const GLBPrimitiveRange &range =
+          primitiveRanges[mesh.mFirstPrimitive + p];
+      SceneSubMesh &subMesh = pSubMeshes[mSubMeshCount++];
+      subMesh.mIndexOffset = range.mIndexOffset;
+      subMesh.mIndexCount = range.mIndexCount;
+      subMesh.mMaterialIndex = range.mMaterialIndex;
+      subMesh.mBoundsMin = range.mBoundsMin;
+      subMesh.mBoundsMax = range.mBoundsMax;
+      subMesh.mNode = (uint32_t)nodeIndices[i];
     }
   }
-  tf_free(indexTmp);
+  MemoryFree(primitiveRanges);
+  MemoryFree(nodeIndices);
+
+  if (valid) {
+    uint32_t *hierarchyIndices = reinterpret_cast<uint32_t *>(
+        MemoryCalloc(kMemoryCategoryScene, nodeCount + 1, sizeof(uint32_t)));
+    if (nodeCount > kMaxNodeCount ||
+        !mTransforms.Build(nodeParents, nodeLocals, nodeCount,
+                           hierarchyIndices)) {
+      LOGF(eWARNING, "Meshes are left unplaced, %u nodes out of at most %u",
+           nodeCount, kMaxNodeCount);
+      BuildIdentityTransforms();
+      for (uint32_t i = 0; i < mSubMeshCount; ++i) {
+        pSubMeshes[i].mNode = 0;
+      }
+    } else {
+      mTransforms.Update(NULL);
+      for (uint32_t i = 0; i < mSubMeshCount; ++i) {
+        pSubMeshes[i].mNode = hierarchyIndices[pSubMeshes[i].mNode];
+      }
+    }
+    MemoryFree(hierarchyIndices);
+  }
+  MemoryFree(nodeParents);
+  MemoryFree(nodeLocals);
+  release();
+  if (!valid) {
+    LOGF(eERROR, "Failed to load GLB %s", pResourceFileName);
+    // Nothing is left for Destroy, as callers don't destroy failed imports.
+    MemoryFree(vertices);
+    MemoryFree(indices);
+    MemoryFree(tangentVertices);
+    MemoryFree(pMaterials);
+    MemoryFree(pMeshRanges);
+    MemoryFree(pSubMeshes);
+    arrfree(pTextureRequests);
+    pMaterials = NULL;
+    pMeshRanges = NULL;
+    pSubMeshes = NULL;
+    mMaterialCount = 0;
+    mMeshRangeCount = 0;
+    mSubMeshCount = 0;
+    return false;
+  }
+
+  mKind = SceneKind::Raw;
+  pVertices = vertices;
+  pIndices = indices;
+  pVertexBuffer = NULL;
+  pIndexBuffer = NULL;
+  mIndexCount = indexCount;
+  mVertexCapacity = vertexCount;
+  pTangentVertices = tangentVertices;
+  mSourceBytes = fileSize;
+  mLayoutHash = ComputeLayoutHash();
+  mHelperBytes = ComputeHelperBytes();
+  MemoryTrack(kMemoryCategoryScene, kMemoryKindCpu, mHelperBytes);
+  return true;
+}
+
+static void UpdateBufferRange(Buffer *pBuffer, uint64_t offset,
+                              const void *pData, uint64_t size) {
+  BufferUpdateDesc update = {};
+  update.pBuffer = pBuffer;
+  update.mDstOffset = offset;
+  update.mSize = size;
+  beginUpdateResource(&update);
+  memcpy(update.pMappedData, pData, size);
+  endUpdateResource(&update);
+}
 
+void Scene::UploadRaw(RenderContext &renderContext) {
+  TRACE_SCOPE("Upload Scene");
+  SceneVertex *vertices = reinterpret_cast<SceneVertex *>(pVertices);
+  uint32_t maxVertexCount = mVertexCapacity;
+  // FBX vertices are unrolled, one per index; glTF ones are shared.
+  uint32_t maxIndexCount = mIndexCount;
+  bool hasBlendShapes = mBlendShapes.GetDeltaCount() > 0;
+  // Blend shapes, skins and tangents add vertex streams parallel to the
+  // vertex buffer, which base vertex offsets would misalign.
+  if (!hasBlendShapes && pSkinVertices == NULL && pTangentVertices == NULL &&
+      mIndexCount > 0) {
+    GeometryPool &geometryPool = renderContext.GetGeometryPool();
+    mGeometryAllocation = geometryPool.Allocate(maxVertexCount, maxIndexCount);
+    if (mGeometryAllocation != GeometryPool::kNoAllocation) {
+      pGeometryPool = &geometryPool;
+      UpdateBufferRange(
+          geometryPool.GetVertexBuffers()[0],
+          (uint64_t)geometryPool.GetFirstVertex(mGeometryAllocation) *
+              sizeof(SceneVertex),
+          vertices, (uint64_t)maxVertexCount * sizeof(SceneVertex));
+      UpdateBufferRange(
+          geometryPool.GetIndexBuffer(),
+          (uint64_t)geometryPool.GetFirstIndex(mGeometryAllocation) *
+              sizeof(uint32_t),
+          pIndices, (uint64_t)maxIndexCount * sizeof(uint32_t));
+      for (uint32_t i = 0; i < mSubMeshCount; ++i) {
+        pSubMeshes[i].mGeometry = mGeometryAllocation;
+      }
+      RenderStatsAdd(kRenderCounterUploadedBytes, GetGpuBytes());
+      return;
+    }
+    LOGF(eWARNING, "The geometry pool is full, the scene gets its own buffers");
+  }
+  // Blend shapes and the visibility buffer's resolve read the vertices,
+  // indices and tangents as words, see blendshapes.comp and
+  // visibility_resolve.frag.
   BufferLoadDesc vbDesc = {};
-  vbDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_VERTEX_BUFFER;
+  vbDesc.mDesc.mDescriptors =
+      DESCRIPTOR_TYPE_VERTEX_BUFFER | DESCRIPTOR_TYPE_BUFFER;
   vbDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
   vbDesc.mDesc.pName = "VertexBuffer";
   vbDesc.mDesc.mSize = maxVertexCount * sizeof(SceneVertex);
+  vbDesc.mDesc.mElementCount =
+      maxVertexCount * sizeof(SceneVertex) / sizeof(uint32_t);
+  vbDesc.mDesc.mStructStride = sizeof(uint32_t);
   vbDesc.pData = vertices;
   vbDesc.ppBuffer = &pVertexBuffer;
-  addResource(&vbDesc, nullptr);
+  addResource(&vbDesc, &mUploadToken);
+
+  if (hasBlendShapes) {
+    vbDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_VERTEX_BUFFER |
+                                DESCRIPTOR_TYPE_BUFFER |
+                                DESCRIPTOR_TYPE_RW_BUFFER;
+    vbDesc.mDesc.mStartState = RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER |
+                               RESOURCE_STATE_SHADER_RESOURCE;
+    vbDesc.mDesc.pName = "MorphedVertexBuffer";
+    vbDesc.ppBuffer = &pMorphedVertexBuffer;
+    addResource(&vbDesc, &mUploadToken);
+
+    BufferLoadDesc dbDesc = {};
+    dbDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_BUFFER;
+    dbDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+    dbDesc.mDesc.pName = "BlendShapeDeltaBuffer";
+    dbDesc.mDesc.mElementCount = mBlendShapes.GetDeltaCount();
+    dbDesc.mDesc.mStructStride = sizeof(BlendShapeDelta);
+    dbDesc.mDesc.mSize =
+        mBlendShapes.GetDeltaCount() * sizeof(BlendShapeDelta);
+    dbDesc.pData = mBlendShapes.GetDeltas();
+    dbDesc.ppBuffer = &pBlendShapeDeltaBuffer;
+    addResource(&dbDesc, &mUploadToken);
+
+    BlendShapeStats stats = mBlendShapes.ComputeStats(NULL, 0);
+    LOGF(eINFO, "Imported %u blend shapes: %.1f KB sparse, %.1f KB dense",
+         stats.mTargetCount, stats.mSparseBytes / 1024.0,
+         stats.mDenseBytes / 1024.0);
+  }
 
   BufferLoadDesc ibDesc = {};
-  ibDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_INDEX_BUFFER;
+  ibDesc.mDesc.mDescriptors =
+      DESCRIPTOR_TYPE_INDEX_BUFFER | DESCRIPTOR_TYPE_BUFFER;
   ibDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
   ibDesc.mDesc.pName = "IndexBuffer";
-  ibDesc.mDesc.mSize = maxIndexCount * sizeof(uint16_t);
-  ibDesc.pData = indices;
+  ibDesc.mDesc.mSize = maxIndexCount * sizeof(uint32_t);
+  ibDesc.mDesc.mElementCount = maxIndexCount;
+  ibDesc.mDesc.mStructStride = sizeof(uint32_t);
+  ibDesc.pData = pIndices;
   ibDesc.ppBuffer = &pIndexBuffer;
-  addResource(&ibDesc, nullptr);
+  addResource(&ibDesc, &mUploadToken);
 
-  tf_free(data);
+  if (pSkinVertices) {
+    BufferLoadDesc sbDesc = {};
+    sbDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_VERTEX_BUFFER;
+    sbDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+    sbDesc.mDesc.pName = "SkinBuffer";
+    sbDesc.mDesc.mSize = maxVertexCount * sizeof(SceneSkinVertex);
+    sbDesc.pData = pSkinVertices;
+    sbDesc.ppBuffer = &pSkinBuffer;
+    addResource(&sbDesc, &mUploadToken);
+  }
 
-  mKind = SceneKind::Raw;
-  pVertices = vertices;
-  pIndices = indices;
+  if (pTangentVertices) {
+    BufferLoadDesc tbDesc = {};
+    tbDesc.mDesc.mDescriptors =
+        DESCRIPTOR_TYPE_VERTEX_BUFFER | DESCRIPTOR_TYPE_BUFFER;
+    tbDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+    tbDesc.mDesc.pName = "TangentBuffer";
+    tbDesc.mDesc.mSize = maxVertexCount * sizeof(uint32_t);
+    tbDesc.mDesc.mElementCount = maxVertexCount;
+    tbDesc.mDesc.mStructStride = sizeof(uint32_t);
+    tbDesc.pData = pTangentVertices;
+    tbDesc.ppBuffer = &pTangentBuffer;
+    addResource(&tbDesc, &mUploadToken);
+  }
+
+  Buffer *pBuffers[] = {pVertexBuffer, pIndexBuffer, pMorphedVertexBuffer,
+                        pBlendShapeDeltaBuffer, pSkinBuffer, pTangentBuffer};
+  for (uint32_t i = 0; i < TF_ARRAY_COUNT(pBuffers); ++i) {
+    if (pBuffers[i]) {
+      renderContext.TrackResource(kMemoryCategoryScene, pBuffers[i]);
+    }
+  }
+  RenderStatsAdd(kRenderCounterUploadedBytes, GetGpuBytes());
+}
+
+/// Small enough that a chunk's vertices can always be indexed with 16 bits.
+static const uint32_t kMaxChunkTriangleCount = 4096;
+/// Power of two, at least twice the vertices of a chunk.
+static const uint32_t kChunkVertexTableSize = 32768;
+
+/// A triangle of the unrolled vertices being split into chunks.
+struct ChunkTriangle {
+  float mCentroid[3];
+  uint32_t mFirstVertex;
+};
+
+struct ChunkWriter {
+  FileStream *pFile;
+  uint64_t mOffset;
+  // stb_ds array.
+  ChunkInfo *pChunks;
+  uint32_t mMaxVertexCount;
+  uint32_t mMaxIndexCount;
+  /// Scratch for the chunk being written: its vertices, indices and a hash
+  /// table of vertex index + 1, zero for empty entries.
+  SceneVertex *pVertices;
+  uint16_t *pIndices;
+  uint32_t *pVertexTable;
+};
+
+/// Partially sorts \c pTriangles along \c axis, so that the triangle at
+/// \c nth is where a full sort would put it, with none smaller after it.
+static void SelectTriangles(ChunkTriangle *pTriangles, int32_t count,
+                            int32_t nth, uint32_t axis) {
+  int32_t first = 0;
+  int32_t last = count - 1;
+  while (first < last) {
+    float pivot = pTriangles[(first + last) / 2].mCentroid[axis];
+    int32_t i = first;
+    int32_t j = last;
+    while (i <= j) {
+      while (pTriangles[i].mCentroid[axis] < pivot) {
+        ++i;
+      }
+      while (pTriangles[j].mCentroid[axis] > pivot) {
+        --j;
+      }
+      if (i <= j) {
+        ChunkTriangle tmp = pTriangles[i];
+        pTriangles[i++] = pTriangles[j];
+        pTriangles[j--] = tmp;
+      }
+    }
+    if (nth <= j) {
+      last = j;
+    } else if (nth >= i) {
+      first = i;
+    } else {
+      return;
+    }
+  }
 }
+
+/// Writes the triangles as one chunk, merging identical vertices.
+static void WriteChunk(ChunkWriter &writer, const ChunkTriangle *pTriangles,
+                       uint32_t count, const SceneVertex *pVertices,
+                       uint32_t materialIndex) {
+  memset(writer.pVertexTable, 0,
+         kChunkVertexTableSize * sizeof(*writer.pVertexTable));
+  uint32_t vertexCount = 0;
+  uint32_t indexCount = 0;
+  vec3 boundsMin(FLT_MAX);
+  vec3 boundsMax(-FLT_MAX);
+  for (uint32_t t = 0; t < count; ++t) {
+    for (uint32_t k = 0; k < 3; ++k) {
+      const SceneVertex &vertex = pVertices[pTriangles[t].mFirstVertex + k];
+      uint32_t entry = (uint32_t)HashBytes(&vertex, sizeof(vertex)) &
+                       (kChunkVertexTableSize - 1);
+      for (;;) {
+        uint32_t stored = writer.pVertexTable[entry];
+        if (stored == 0) {
+          writer.pVertexTable[entry] = vertexCount + 1;
+          writer.pVertices[vertexCount] = vertex;
+          writer.pIndices[indexCount++] = (uint16_t)vertexCount++;
+          break;
+        }
+        if (memcmp(&writer.pVertices[stored - 1], &vertex, sizeof(vertex)) ==
+            0) {
+          writer.pIndices[indexCount++] = (uint16_t)(stored - 1);
+          break;
+        }
+        entry = (entry + 1) & (kChunkVertexTableSize - 1);
+      }
+      boundsMin = minPerElem(boundsMin, f3Tov3(vertex.mPosition));
+      boundsMax = maxPerElem(boundsMax, f3Tov3(vertex.mPosition));
+    }
+  }
+
+  fsWriteToStream(writer.pFile, writer.pVertices,
+                  vertexCount * sizeof(SceneVertex));
+  fsWriteToStream(writer.pFile, writer.pIndices,
+                  indexCount * sizeof(uint16_t));
+  const uint16_t padding = 0;
+  uint64_t size = vertexCount * sizeof(SceneVertex) +
+                  indexCount * sizeof(uint16_t);
+  if (indexCount % 2 != 0) {
+    fsWriteToStream(writer.pFile, &padding, sizeof(padding));
+  }
+  ChunkInfo chunk = {writer.mOffset, vertexCount, indexCount, materialIndex,
+                     v3ToF3(boundsMin), v3ToF3(boundsMax)};
+  arrpush(writer.pChunks, chunk);
+  writer.mOffset += size + (indexCount % 2) * sizeof(padding);
+  writer.mMaxVertexCount = max(writer.mMaxVertexCount, vertexCount);
+  writer.mMaxIndexCount = max(writer.mMaxIndexCount, indexCount);
+}
+
+/// Splits the triangles at the median of their centroids along the longest
+/// axis until each half fits in a chunk, so that chunks are compact.
+static void WriteChunks(ChunkWriter &writer, ChunkTriangle *pTriangles,
+                        uint32_t count, const SceneVertex *pVertices,
+                        uint32_t materialIndex) {
+  if (count <= kMaxChunkTriangleCount) {
+    WriteChunk(writer, pTriangles, count, pVertices, materialIndex);
+    return;
+  }
+  float boundsMin[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+  float boundsMax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+  for (uint32_t t = 0; t < count; ++t) {
+    for (uint32_t axis = 0; axis < 3; ++axis) {
+      boundsMin[axis] = min(boundsMin[axis], pTriangles[t].mCentroid[axis]);
+      boundsMax[axis] = max(boundsMax[axis], pTriangles[t].mCentroid[axis]);
+    }
+  }
+  uint32_t longest = 0;
+  for (uint32_t axis = 1; axis < 3; ++axis) {
+    if (boundsMax[axis] - boundsMin[axis] >
+        boundsMax[longest] - boundsMin[longest]) {
+      longest = axis;
+    }
+  }
+  uint32_t half = count / 2;
+  SelectTriangles(pTriangles, (int32_t)count, (int32_t)half, longest);
+  WriteChunks(writer, pTriangles, half, pVertices, materialIndex);
+  WriteChunks(writer, pTriangles + half, count - half, pVertices,
+              materialIndex);
+}
+
+bool Scene::ConvertFBXToChunks(const char *pFilePath,
+                               const char *pChunkFilePath) {
+  TRACE_SCOPE("Convert FBX To Chunks");
+  ofbx::u8 *data = NULL;
+  ofbx::IScene *scene = ParseFBX(pFilePath, &data, NULL, NULL);
+  if (scene == nullptr) {
+    return false;
+  }
+  FileStream file = {};
+  if (!fsOpenStreamFromPath(RD_MESHES, pChunkFilePath, FileMode::FM_WRITE,
+                            &file)) {
+    LOGF(eERROR, "Failed to open chunk file %s", pChunkFilePath);
+    MemoryFree(data);
+    return false;
+  }
+
+  // Every mesh partition's material, so that each material's triangles can
+  // be gathered from all meshes at once.
+  uint32_t partitionCount = 0;
+  uint32_t maxIndexPerPolygonCount = 0;
+  for (uint32_t meshIdx = 0; meshIdx < scene->getMeshCount(); meshIdx++) {
+    auto &geomData = scene->getMesh(meshIdx)->getGeometryData();
+    for (uint32_t partIdx = 0; partIdx < geomData.getPartitionCount();
+         partIdx++) {
+      maxIndexPerPolygonCount =
+          max(maxIndexPerPolygonCount,
+              (uint32_t)geomData.getPartition(partIdx).max_polygon_triangles *
+                  3);
+      partitionCount++;
+    }
+  }
+  auto fbxMaterials = reinterpret_cast<const ofbx::Material **>(
+      MemoryCalloc(kMemoryCategoryScene, partitionCount + 1,
+                   sizeof(ofbx::Material *)));
+  auto materials = reinterpret_cast<SceneMaterial *>(MemoryCalloc(
+      kMemoryCategoryScene, partitionCount + 1, sizeof(SceneMaterial)));
+  auto partitionMaterials = reinterpret_cast<uint32_t *>(
+      MemoryCalloc(kMemoryCategoryScene, partitionCount + 1,
+                   sizeof(uint32_t)));
+  SceneTextureRequest *textureRequests = NULL;
+  uint32_t materialCount = 1;
+  materials[0] = GetDefaultMaterial();
+  uint32_t partition = 0;
+  for (uint32_t meshIdx = 0; meshIdx < scene->getMeshCount(); meshIdx++) {
+    auto mesh = scene->getMesh(meshIdx);
+    for (uint32_t partIdx = 0;
+         partIdx < mesh->getGeometryData().getPartitionCount(); partIdx++) {
+      partitionMaterials[partition++] =
+          partIdx < (uint32_t)mesh->getMaterialCount()
+              ? AddFBXMaterial(mesh->getMaterial(partIdx), fbxMaterials,
+                               materials, materialCount, &textureRequests)
+              : 0;
+    }
+  }
+
+  // Rewritten once the tables are known.
+  ChunkFileHeader header = {};
+  fsWriteToStream(&file, &header, sizeof(header));
+  ChunkWriter writer = {};
+  writer.pFile = &file;
+  writer.mOffset = sizeof(header);
+  writer.pVertices = reinterpret_cast<SceneVertex *>(
+      MemoryAlloc(kMemoryCategoryScene,
+                  kMaxChunkTriangleCount * 3 * sizeof(SceneVertex)));
+  writer.pIndices = reinterpret_cast<uint16_t *>(MemoryAlloc(
+      kMemoryCategoryScene, kMaxChunkTriangleCount * 3 * sizeof(uint16_t)));
+  writer.pVertexTable = reinterpret_cast<uint32_t *>(MemoryAlloc(
+      kMemoryCategoryScene, kChunkVertexTableSize * sizeof(uint32_t)));
+  auto indexTmp = reinterpret_cast<int32_t *>(
+      MemoryCalloc(kMemoryCategoryScene, maxIndexPerPolygonCount,
+                   sizeof(int32_t)));
+  // stb_ds arrays, holding one material's unrolled triangles at a time.
+  SceneVertex *vertices = NULL;
+  ChunkTriangle *triangles = NULL;
+
+  for (uint32_t material = 0; material < materialCount; ++material) {
+    arrsetlen(vertices, 0);
+    arrsetlen(triangles, 0);
+    partition = 0;
+    for (uint32_t meshIdx = 0; meshIdx < scene->getMeshCount(); meshIdx++) {
+      auto mesh = scene->getMesh(meshIdx);
+      auto &geomData = mesh->getGeometryData();
+      auto positions = geomData.getPositions();
+      auto normals = geomData.getNormals();
+      auto uvs = geomData.getUVs();
+      // Chunks mix meshes, so vertices are moved into model space.
+      FBXVertexTransform transform;
+      transform.mPosition = ToMat4(mesh->getGlobalTransform());
+      transform.mNormal =
+          transpose(inverse(transform.mPosition.getUpper3x3()));
+      for (uint32_t partIdx = 0; partIdx < geomData.getPartitionCount();
+           partIdx++) {
+        if (partitionMaterials[partition++] != material) {
+          continue;
+        }
+        auto fbxPartition = geomData.getPartition(partIdx);
+        for (size_t polyIdx = 0; polyIdx < fbxPartition.polygon_count;
+             polyIdx++) {
+          uint32_t vertexCount = ofbx::triangulate(
+              geomData, fbxPartition.polygons[polyIdx], indexTmp);
+          for (uint32_t vtxIdx = 0; vtxIdx + 3 <= vertexCount; vtxIdx += 3) {
+            uint32_t firstVertex = (uint32_t)arrlen(vertices);
+            vec3 centroid(0.0f);
+            for (uint32_t k = 0; k < 3; ++k) {
+              SceneVertex vertex = ReadFBXVertex(
+                  positions, normals, uvs, indexTmp[vtxIdx + k], &transform);
+              centroid += f3Tov3(vertex.mPosition) / 3.0f;
+              arrpush(vertices, vertex);
+            }
+            if (normals.values == nullptr) {
+              // Chunks gather one material's triangles at a time, so
+              // meshes without normals are shaded flat rather than smoothed.
+              SceneVertex *pTriangle = vertices + firstVertex;
+              vec3 p0 = f3Tov3(pTriangle[0].mPosition);
+              vec3 normal = cross(f3Tov3(pTriangle[1].mPosition) - p0,
+                                  f3Tov3(pTriangle[2].mPosition) - p0);
+              float normalLength = length(normal);
+              normal = normalLength > 0.0f ? normal / normalLength
+                                           : vec3(0.0f, 0.0f, 1.0f);
+              uint32_t packedNormal = packUnorm2x16(encodeDir(v3ToF3(normal)));
+              for (uint32_t k = 0; k < 3; ++k) {
+                pTriangle[k].mNormal = packedNormal;
+              }
+            }
+            ChunkTriangle triangle = {
+                {centroid.getX(), centroid.getY(), centroid.getZ()},
+                firstVertex};
+            arrpush(triangles, triangle);
+          }
+        }
+      }
+    }
+    if (arrlen(triangles) > 0) {
+      WriteChunks(writer, triangles, (uint32_t)arrlen(triangles), vertices,
+                  material);
+    }
+  }
+
+  header.mMagic = kChunkFileMagic;
+  header.mVersion = kChunkFileVersion;
+  header.mVertexStride = sizeof(SceneVertex);
+  header.mChunkCount = (uint32_t)arrlen(writer.pChunks);
+  header.mMaterialCount = materialCount;
+  header.mTextureRequestCount = (uint32_t)arrlen(textureRequests);
+  header.mMaxVertexCount = writer.mMaxVertexCount;
+  header.mMaxIndexCount = writer.mMaxIndexCount;
+  header.mTableOffset = writer.mOffset;
+  fsWriteToStream(&file, writer.pChunks,
+                  header.mChunkCount * sizeof(ChunkInfo));
+  for (uint32_t i = 0; i < materialCount; ++i) {
+    fsWriteToStream(&file, &materials[i].mDiffuseColor, sizeof(float4));
+    fsWriteToStream(&file, &materials[i].mMetallic, sizeof(float));
+    fsWriteToStream(&file, &materials[i].mRoughness, sizeof(float));
+  }
+  fsWriteToStream(&file, textureRequests,
+                  header.mTextureRequestCount * sizeof(SceneTextureRequest));
+  fsSeekStream(&file, SBO_START_OF_FILE, 0);
+  fsWriteToStream(&file, &header, sizeof(header));
+  fsCloseStream(&file);
+  LOGF(eINFO, "Converted %s into %u chunks, %.1f MB", pFilePath,
+       header.mChunkCount, header.mTableOffset / (1024.0 * 1024.0));
+
+  arrfree(vertices);
+  arrfree(triangles);
+  arrfree(writer.pChunks);
+  arrfree(textureRequests);
+  MemoryFree(indexTmp);
+  MemoryFree(writer.pVertexTable);
+  MemoryFree(writer.pIndices);
+  MemoryFree(writer.pVertices);
+  MemoryFree(partitionMaterials);
+  MemoryFree(materials);
+  MemoryFree(fbxMaterials);
+  MemoryFree(data);
+  return true;
+}
+
+bool Scene::LoadStreamed(RenderContext &renderContext, TaskSystem &taskSystem,
+                         const char *pChunkFilePath,
+                         const ChunkStreamerDesc &desc) {
+  mId = tfrg_atomic32_add_relaxed(&gNextSceneId, 1);
+  FileStream file = {};
+  if (!fsOpenStreamFromPath(RD_MESHES, pChunkFilePath, FileMode::FM_READ,
+                            &file)) {
+    LOGF(eERROR, "Failed to open chunk file %s", pChunkFilePath);
+    return false;
+  }
+  ChunkFileHeader header;
+  if (!ReadChunkFileHeader(file, pChunkFilePath, sizeof(SceneVertex),
+                           header)) {
+    fsCloseStream(&file);
+    return false;
+  }
+  // Materials and texture requests follow the table, and are allocated from
+  // their counts.
+  const uint64_t kMaterialBytes = sizeof(float4) + sizeof(float) * 2;
+  uint64_t fileSize = (uint64_t)fsGetStreamFileSize(&file);
+  uint64_t tableEnd =
+      header.mTableOffset + header.mChunkCount * (uint64_t)sizeof(ChunkInfo);
+  if (header.mMaterialCount > (fileSize - tableEnd) / kMaterialBytes ||
+      header.mTextureRequestCount >
+          (fileSize - tableEnd - header.mMaterialCount * kMaterialBytes) /
+              sizeof(SceneTextureRequest) ||
+      !fsSeekStream(&file, SBO_START_OF_FILE, (ssize_t)tableEnd)) {
+    LOGF(eERROR, "%s is truncated", pChunkFilePath);
+    fsCloseStream(&file);
+    return false;
+  }
+  mMaterialCount = max(header.mMaterialCount, 1u);
+  pMaterials = reinterpret_cast<SceneMaterial *>(MemoryCalloc(
+      kMemoryCategoryScene, mMaterialCount, sizeof(SceneMaterial)));
+  for (uint32_t i = 0; i < mMaterialCount; ++i) {
+    pMaterials[i] = GetDefaultMaterial();
+  }
+  bool read = true;
+  for (uint32_t i = 0; read && i < header.mMaterialCount; ++i) {
+    read = fsReadFromStream(&file, &pMaterials[i].mDiffuseColor,
+                            sizeof(float4)) == sizeof(float4) &&
+           fsReadFromStream(&file, &pMaterials[i].mMetallic,
+                            sizeof(float)) == sizeof(float) &&
+           fsReadFromStream(&file, &pMaterials[i].mRoughness,
+                            sizeof(float)) == sizeof(float);
+  }
+  size_t requestBytes =
+      header.mTextureRequestCount * sizeof(SceneTextureRequest);
+  arrsetlen(pTextureRequests, header.mTextureRequestCount);
+  read = read && (size_t)fsReadFromStream(&file, pTextureRequests,
+                                          requestBytes) == requestBytes;
+  fsCloseStream(&file);
+  if (!read) {
+    LOGF(eERROR, "%s is truncated", pChunkFilePath);
+    arrfree(pTextureRequests);
+    MemoryFree(pMaterials);
+    pMaterials = NULL;
+    mMaterialCount = 0;
+    return false;
+  }
+  for (ptrdiff_t i = 0; i < arrlen(pTextureRequests); ++i) {
+    SceneTextureRequest &request = pTextureRequests[i];
+    if (request.mMaterialIndex >= mMaterialCount ||
+        (request.mKind != StreamedTextureKind::Diffuse &&
+         request.mKind != StreamedTextureKind::Normal)) {
+      arrdelswap(pTextureRequests, i--);
+      continue;
+    }
+    request.mFileName[sizeof(request.mFileName) - 1] = '\0';
+  }
+
+  pChunkStreamer = tf_placement_new<ChunkStreamer>(
+      MemoryCalloc(kMemoryCategoryChunkStreamer, 1, sizeof(ChunkStreamer)));
+  mChunkVersion = 0;
+  mKind = SceneKind::Streamed;
+  if (!pChunkStreamer->Init(renderContext, taskSystem, pChunkFilePath,
+                            sizeof(SceneVertex), desc)) {
+    Destroy(renderContext);
+    return false;
+  }
+
+  // Submeshes stay empty until their chunk is resident.
+  mSubMeshCount = pChunkStreamer->GetChunkCount();
+  pSubMeshes = reinterpret_cast<SceneSubMesh *>(
+      MemoryCalloc(kMemoryCategoryScene, mSubMeshCount, sizeof(SceneSubMesh)));
+  for (uint32_t i = 0; i < mSubMeshCount; ++i) {
+    const ChunkInfo &chunk = pChunkStreamer->GetChunk(i);
+    pSubMeshes[i].mMaterialIndex =
+        chunk.mMaterialIndex < mMaterialCount ? chunk.mMaterialIndex : 0;
+    pSubMeshes[i].mBoundsMin = chunk.mBoundsMin;
+    pSubMeshes[i].mBoundsMax = chunk.mBoundsMax;
+  }
+  // Chunks are already in model space.
+  BuildIdentityTransforms();
+  mHelperBytes = ComputeHelperBytes();
+  MemoryTrack(kMemoryCategoryScene, kMemoryKindCpu, mHelperBytes);
+  return true;
+}
+
+void Scene::UpdateStreaming(RenderContext &renderContext,
+                            const vec3 &viewPosition) {
+  if (mKind != SceneKind::Streamed) {
+    return;
+  }
+  pChunkStreamer->Update(renderContext, viewPosition);
+  if (pChunkStreamer->GetVersion() == mChunkVersion) {
+    return;
+  }
+  mChunkVersion = pChunkStreamer->GetVersion();
+  for (uint32_t i = 0; i < mSubMeshCount; ++i) {
+    SceneSubMesh &subMesh = pSubMeshes[i];
+    if (!pChunkStreamer->IsResident(i)) {
+      subMesh.mIndexCount = 0;
+      continue;
+    }
+    subMesh.mIndexCount = pChunkStreamer->GetChunk(i).mIndexCount;
+    subMesh.mGeometry = pChunkStreamer->GetAllocation(i);
+  }
+}
+
+static const uint32_t kPackedFileMagic = 0x4f454750; // "PGEO"
+static const uint32_t kPackedFileVersion = 3;
+
+/// Packed files start with this header, followed by the encoded blocks. At
+/// \c mTableOffset come the vertex then the index blocks' \c PackedBlock,
+/// the submeshes, the material colors, the texture requests, and the nodes'
+/// parents and local transforms.
+struct PackedFileHeader {
+  uint32_t mMagic;
+  uint32_t mVersion;
+  uint32_t mVertexStride;
+  uint32_t mVertexCount;
+  uint32_t mIndexCount;
+  uint32_t mVertexBlockCount;
+  uint32_t mIndexBlockCount;
+  uint32_t mSubMeshCount;
+  uint32_t mMaterialCount;
+  uint32_t mTextureRequestCount;
+  uint32_t mNodeCount;
+  uint64_t mSourceBytes;
+  uint64_t mTableOffset;
+};
+
+/// A run of vertices or indices, encoded by \c GeometryCodec.
+struct PackedBlock {
+  uint64_t mOffset;
+  uint32_t mSize;
+  uint32_t mFirst;
+  uint32_t mCount;
+  /// Only used by index blocks, see \c EncodeIndexBlock.
+  uint32_t mBaseIndex;
+  uint32_t mCodeSize;
+};
+
+/// Large enough for the first stage of any block.
+static size_t GetPackedScratchSize() {
+  return max(kGeometryBlockVertexCount * sizeof(SceneVertex),
+             GetIndexCodeBound(kGeometryBlockIndexCount));
+}
+
+bool Scene::WritePacked(const char *pPackedFilePath) const {
+  TRACE_SCOPE("Write Packed Scene");
+  ASSERT(mKind == SceneKind::Raw);
+  if (mSkeleton.mJointCount > 0 || mBlendShapes.GetTargetCount() > 0 ||
+      pTangentVertices != NULL) {
+    LOGF(eWARNING,
+         "Scenes with skins, blend shapes or tangents can't be packed");
+    return false;
+  }
+  FileStream file = {};
+  if (!fsOpenStreamFromPath(RD_MESHES, pPackedFilePath, FileMode::FM_WRITE,
+                            &file)) {
+    LOGF(eERROR, "Failed to open packed file %s", pPackedFilePath);
+    return false;
+  }
+
+  // Raw scenes unroll every polygon. Merged vertices are numbered in order
+  // of first use, which the index codec expects.
+  const SceneVertex *rawVertices =
+      reinterpret_cast<const SceneVertex *>(pVertices);
+  const uint32_t *rawIndices = reinterpret_cast<const uint32_t *>(pIndices);
+  uint32_t tableSize = 1;
+  while (tableSize < mIndexCount * 2) {
+    tableSize *= 2;
+  }
+  auto vertexTable = reinterpret_cast<uint32_t *>(
+      MemoryCalloc(kMemoryCategoryScene, tableSize, sizeof(uint32_t)));
+  auto vertices = reinterpret_cast<SceneVertex *>(MemoryAlloc(
+      kMemoryCategoryScene, max(mIndexCount, 1u) * sizeof(SceneVertex)));
+  auto indices = reinterpret_cast<uint32_t *>(MemoryAlloc(
+      kMemoryCategoryScene, max(mIndexCount, 1u) * sizeof(uint32_t)));
+  uint32_t vertexCount = 0;
+  for (uint32_t i = 0; i < mIndexCount; ++i) {
+    const SceneVertex &vertex = rawVertices[rawIndices[i]];
+    uint32_t entry =
+        (uint32_t)HashBytes(&vertex, sizeof(vertex)) & (tableSize - 1);
+    for (;;) {
+      uint32_t stored = vertexTable[entry];
+      if (stored == 0) {
+        vertexTable[entry] = vertexCount + 1;
+        vertices[vertexCount] = vertex;
+        indices[i] = vertexCount++;
+        break;
+      }
+      if (memcmp(&vertices[stored - 1], &vertex, sizeof(vertex)) == 0) {
+        indices[i] = stored - 1;
+        break;
+      }
+      entry = (entry + 1) & (tableSize - 1);
+    }
+  }
+  MemoryFree(vertexTable);
+
+  // Rewritten once the tables are known.
+  PackedFileHeader header = {};
+  fsWriteToStream(&file, &header, sizeof(header));
+  uint64_t offset = sizeof(header);
+  size_t scratchSize = GetPackedScratchSize();
+  size_t encodedCapacity = GetGeometryEncodedBound(scratchSize);
+  void *scratch = MemoryAlloc(kMemoryCategoryScene, scratchSize);
+  void *encoded = MemoryAlloc(kMemoryCategoryScene, encodedCapacity);
+  // stb_ds array.
+  PackedBlock *blocks = NULL;
+  for (uint32_t first = 0; first < vertexCount;
+       first += kGeometryBlockVertexCount) {
+    PackedBlock block = {offset, 0, first,
+                         min(kGeometryBlockVertexCount, vertexCount - first)};
+    block.mSize = (uint32_t)EncodeVertexBlock(
+        vertices + first, block.mCount, sizeof(SceneVertex), scratch,
+        encoded, encodedCapacity);
+    fsWriteToStream(&file, encoded, block.mSize);
+    offset += block.mSize;
+    arrpush(blocks, block);
+  }
+  for (uint32_t first = 0; first < mIndexCount;
+       first += kGeometryBlockIndexCount) {
+    PackedBlock block = {offset, 0, first,
+                         min(kGeometryBlockIndexCount, mIndexCount - first)};
+    block.mSize = (uint32_t)EncodeIndexBlock(
+        indices + first, block.mCount, scratch, encoded, encodedCapacity,
+        &block.mBaseIndex, &block.mCodeSize);
+    fsWriteToStream(&file, encoded, block.mSize);
+    offset += block.mSize;
+    arrpush(blocks, block);
+  }
+
+  header.mMagic = kPackedFileMagic;
+  header.mVersion = kPackedFileVersion;
+  header.mVertexStride = sizeof(SceneVertex);
+  header.mVertexCount = vertexCount;
+  header.mIndexCount = mIndexCount;
+  header.mVertexBlockCount =
+      (vertexCount + kGeometryBlockVertexCount - 1) /
+      kGeometryBlockVertexCount;
+  header.mIndexBlockCount = (uint32_t)arrlen(blocks) - header.mVertexBlockCount;
+  header.mSubMeshCount = mSubMeshCount;
+  header.mMaterialCount = mMaterialCount;
+  header.mTextureRequestCount = (uint32_t)arrlen(pTextureRequests);
+  header.mNodeCount = mTransforms.GetNodeCount();
+  header.mSourceBytes = mSourceBytes;
+  header.mTableOffset = offset;
+  fsWriteToStream(&file, blocks, arrlen(blocks) * sizeof(PackedBlock));
+  fsWriteToStream(&file, pSubMeshes, mSubMeshCount * sizeof(SceneSubMesh));
+  for (uint32_t i = 0; i < mMaterialCount; ++i) {
+    fsWriteToStream(&file, &pMaterials[i].mDiffuseColor, sizeof(float4));
+    fsWriteToStream(&file, &pMaterials[i].mMetallic, sizeof(float));
+    fsWriteToStream(&file, &pMaterials[i].mRoughness, sizeof(float));
+  }
+  fsWriteToStream(&file, pTextureRequests,
+                  header.mTextureRequestCount * sizeof(SceneTextureRequest));
+  for (uint32_t i = 0; i < header.mNodeCount; ++i) {
+    int32_t parent = mTransforms.GetParent(i);
+    fsWriteToStream(&file, &parent, sizeof(parent));
+  }
+  for (uint32_t i = 0; i < header.mNodeCount; ++i) {
+    JointPose local = mTransforms.GetLocal(i);
+    fsWriteToStream(&file, &local, sizeof(local));
+  }
+  fsSeekStream(&file, SBO_START_OF_FILE, 0);
+  fsWriteToStream(&file, &header, sizeof(header));
+  fsCloseStream(&file);
+  LOGF(eINFO,
+       "Packed %s: %u vertices merged into %u, %.1f MB of buffers into "
+       "%.1f MB",
+       pPackedFilePath, mIndexCount, vertexCount,
+       ((uint64_t)vertexCount * sizeof(SceneVertex) +
+        (uint64_t)mIndexCount * sizeof(uint32_t)) /
+           (1024.0 * 1024.0),
+       offset / (1024.0 * 1024.0));
+
+  arrfree(blocks);
+  MemoryFree(encoded);
+  MemoryFree(scratch);
+  MemoryFree(indices);
+  MemoryFree(vertices);
+  return true;
+}
+
+struct PackedDecodeJob {
+  const PackedBlock *pBlocks;
+  uint32_t mVertexBlockCount;
+  /// The file's contents from the end of its header.
+  const uint8_t *pData;
+  uint32_t mVertexCount;
+  /// Upload staging memory of the vertex and index buffers.
+  SceneVertex *pVertices;
+  uint32_t *pIndices;
+  tfrg_atomic32_t mFailed;
+};
+
+static void DecodePackedBlocks(void *pUserData, uint32_t begin,
+                               uint32_t end) {
+  TRACE_SCOPE("Decode Packed Blocks");
+  PackedDecodeJob &job = *reinterpret_cast<PackedDecodeJob *>(pUserData);
+  void *scratch = MemoryAlloc(kMemoryCategoryScene, GetPackedScratchSize());
+  for (uint32_t i = begin; i < end; ++i) {
+    const PackedBlock &block = job.pBlocks[i];
+    const uint8_t *pSrc =
+        job.pData + (block.mOffset - sizeof(PackedFileHeader));
+    bool decoded =
+        i < job.mVertexBlockCount
+            ? DecodeVertexBlock(pSrc, block.mSize, block.mCount,
+                                sizeof(SceneVertex), scratch,
+                                job.pVertices + block.mFirst)
+            : DecodeIndexBlock(pSrc, block.mSize, block.mCount,
+                               block.mBaseIndex, block.mCodeSize,
+                               job.mVertexCount, scratch,
+                               job.pIndices + block.mFirst);
+    if (!decoded) {
+      tfrg_atomic32_store_relaxed(&job.mFailed, 1);
+    }
+  }
+  MemoryFree(scratch);
+}
+
+/// True if every block lies within the file's data and its buffer.
+static bool ValidatePackedBlocks(const PackedFileHeader &header,
+                                 const PackedBlock *pBlocks) {
+  uint32_t blockCount = header.mVertexBlockCount + header.mIndexBlockCount;
+  for (uint32_t i = 0; i < blockCount; ++i) {
+    const PackedBlock &block = pBlocks[i];
+    bool isVertexBlock = i < header.mVertexBlockCount;
+    uint32_t bufferCount =
+        isVertexBlock ? header.mVertexCount : header.mIndexCount;
+    uint32_t maxCount =
+        isVertexBlock ? kGeometryBlockVertexCount : kGeometryBlockIndexCount;
+    if (block.mOffset < sizeof(PackedFileHeader) ||
+        block.mOffset > header.mTableOffset ||
+        block.mSize > header.mTableOffset - block.mOffset ||
+        block.mCount > maxCount || block.mFirst > bufferCount ||
+        block.mCount > bufferCount - block.mFirst ||
+        (!isVertexBlock &&
+         (block.mCount % 3 != 0 ||
+          block.mCodeSize > GetIndexCodeBound(block.mCount)))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Scene::LoadPacked(RenderContext &renderContext, TaskSystem &taskSystem,
+                       const char *pPackedFilePath) {
+  TRACE_SCOPE("Load Packed Scene");
+  mId = tfrg_atomic32_add_relaxed(&gNextSceneId, 1);
+  FileStream file = {};
+  if (!fsOpenStreamFromPath(RD_MESHES, pPackedFilePath, FileMode::FM_READ,
+                            &file)) {
+    LOGF(eERROR, "Failed to open packed file %s", pPackedFilePath);
+    return false;
+  }
+  PackedFileHeader header = {};
+  if (fsReadFromStream(&file, &header, sizeof(header)) != sizeof(header) ||
+      header.mMagic != kPackedFileMagic ||
+      header.mVersion != kPackedFileVersion ||
+      header.mVertexStride != sizeof(SceneVertex) ||
+      header.mTableOffset < sizeof(header)) {
+    LOGF(eERROR, "%s isn't a packed file of this version", pPackedFilePath);
+    fsCloseStream(&file);
+    return false;
+  }
+  // Everything below is allocated from the header's counts, so they must fit
+  // in the file first. Vertices and indices only come from blocks.
+  const uint64_t kMaterialBytes = sizeof(float4) + sizeof(float) * 2;
+  uint64_t blockCount =
+      (uint64_t)header.mVertexBlockCount + header.mIndexBlockCount;
+  uint64_t tableBytes =
+      blockCount * sizeof(PackedBlock) +
+      (uint64_t)header.mSubMeshCount * sizeof(SceneSubMesh) +
+      header.mMaterialCount * kMaterialBytes +
+      (uint64_t)header.mTextureRequestCount * sizeof(SceneTextureRequest) +
+      (uint64_t)header.mNodeCount * (sizeof(int32_t) + sizeof(JointPose));
+  uint64_t fileSize = (uint64_t)fsGetStreamFileSize(&file);
+  if (header.mTableOffset > fileSize ||
+      tableBytes > fileSize - header.mTableOffset ||
+      header.mVertexCount >
+          (uint64_t)header.mVertexBlockCount * kGeometryBlockVertexCount ||
+      header.mIndexCount >
+          (uint64_t)header.mIndexBlockCount * kGeometryBlockIndexCount) {
+    LOGF(eERROR, "%s is truncated or corrupted", pPackedFilePath);
+    fsCloseStream(&file);
+    return false;
+  }
+  size_t dataSize = (size_t)(header.mTableOffset - sizeof(header));
+  size_t blockBytes = (size_t)blockCount * sizeof(PackedBlock);
+  auto blocks = reinterpret_cast<PackedBlock *>(
+      MemoryAlloc(kMemoryCategoryScene, max(blockBytes, sizeof(PackedBlock))));
+  auto data = reinterpret_cast<uint8_t *>(
+      MemoryAlloc(kMemoryCategoryScene, max(dataSize, (size_t)1)));
+  bool read =
+      (size_t)fsReadFromStream(&file, data, dataSize) == dataSize &&
+      (size_t)fsReadFromStream(&file, blocks, blockBytes) == blockBytes;
+
+  mSubMeshCount = header.mSubMeshCount;
+  size_t subMeshBytes = mSubMeshCount * sizeof(SceneSubMesh);
+  pSubMeshes = reinterpret_cast<SceneSubMesh *>(
+      MemoryCalloc(kMemoryCategoryScene, mSubMeshCount, sizeof(SceneSubMesh)));
+  read = read && (size_t)fsReadFromStream(&file, pSubMeshes, subMeshBytes) ==
+                     subMeshBytes;
+  mMaterialCount = max(header.mMaterialCount, 1u);
+  pMaterials = reinterpret_cast<SceneMaterial *>(MemoryCalloc(
+      kMemoryCategoryScene, mMaterialCount, sizeof(SceneMaterial)));
+  for (uint32_t i = 0; i < mMaterialCount; ++i) {
+    pMaterials[i] = GetDefaultMaterial();
+  }
+  for (uint32_t i = 0; read && i < header.mMaterialCount; ++i) {
+    read = fsReadFromStream(&file, &pMaterials[i].mDiffuseColor,
+                            sizeof(float4)) == sizeof(float4) &&
+           fsReadFromStream(&file, &pMaterials[i].mMetallic,
+                            sizeof(float)) == sizeof(float) &&
+           fsReadFromStream(&file, &pMaterials[i].mRoughness,
+                            sizeof(float)) == sizeof(float);
+  }
+  size_t requestBytes =
+      header.mTextureRequestCount * sizeof(SceneTextureRequest);
+  arrsetlen(pTextureRequests, header.mTextureRequestCount);
+  read = read && (size_t)fsReadFromStream(&file, pTextureRequests,
+                                          requestBytes) == requestBytes;
+  auto nodeParents = reinterpret_cast<int32_t *>(MemoryCalloc(
+      kMemoryCategoryScene, header.mNodeCount + 1, sizeof(int32_t)));
+  auto nodeLocals = reinterpret_cast<JointPose *>(MemoryCalloc(
+      kMemoryCategoryScene, header.mNodeCount + 1, sizeof(JointPose)));
+  size_t parentBytes = header.mNodeCount * sizeof(int32_t);
+  size_t localBytes = header.mNodeCount * sizeof(JointPose);
+  read = read &&
+         (size_t)fsReadFromStream(&file, nodeParents, parentBytes) ==
+             parentBytes &&
+         (size_t)fsReadFromStream(&file, nodeLocals, localBytes) == localBytes;
+  fsCloseStream(&file);
+  if (!read) {
+    LOGF(eERROR, "%s is truncated", pPackedFilePath);
+    MemoryFree(nodeLocals);
+    MemoryFree(nodeParents);
+    MemoryFree(data);
+    MemoryFree(blocks);
+    arrfree(pTextureRequests);
+    MemoryFree(pSubMeshes);
+    MemoryFree(pMaterials);
+    pSubMeshes = NULL;
+    pMaterials = NULL;
+    mSubMeshCount = 0;
+    mMaterialCount = 0;
+    return false;
+  }
+
+  // Packed nodes are already sorted by depth, so they keep their indices.
+  if (header.mNodeCount == 0 || header.mNodeCount > kMaxNodeCount ||
+      !mTransforms.Build(nodeParents, nodeLocals, header.mNodeCount, NULL)) {
+    BuildIdentityTransforms();
+  } else {
+    mTransforms.Update(NULL);
+  }
+  MemoryFree(nodeLocals);
+  MemoryFree(nodeParents);
+  for (uint32_t i = 0; i < mSubMeshCount; ++i) {
+    SceneSubMesh &subMesh = pSubMeshes[i];
+    subMesh.mMaterialIndex =
+        subMesh.mMaterialIndex < mMaterialCount ? subMesh.mMaterialIndex : 0;
+    subMesh.mNode =
+        subMesh.mNode < mTransforms.GetNodeCount() ? subMesh.mNode : 0;
+    subMesh.mSkinned = false;
+    subMesh.mGeometry = GeometryPool::kNoAllocation;
+    if (subMesh.mIndexOffset > header.mIndexCount ||
+        subMesh.mIndexCount > header.mIndexCount - subMesh.mIndexOffset) {
+      subMesh.mIndexCount = 0;
+    }
+  }
+  for (ptrdiff_t i = 0; i < arrlen(pTextureRequests); ++i) {
+    SceneTextureRequest &request = pTextureRequests[i];
+    if (request.mMaterialIndex >= mMaterialCount ||
+        (request.mKind != StreamedTextureKind::Diffuse &&
+         request.mKind != StreamedTextureKind::Normal)) {
+      arrdelswap(pTextureRequests, i--);
+      continue;
+    }
+    request.mFileName[sizeof(request.mFileName) - 1] = '\0';
+  }
+
+  mKind = SceneKind::Packed;
+  pVertices = NULL;
+  pIndices = NULL;
+  pVertexBuffer = NULL;
+  pIndexBuffer = NULL;
+  mIndexCount = header.mIndexCount;
+  mVertexCapacity = header.mVertexCount;
+  mSourceBytes = header.mSourceBytes;
+  mHelperBytes = ComputeHelperBytes();
+  MemoryTrack(kMemoryCategoryScene, kMemoryKindCpu, mHelperBytes);
+  if (!ValidatePackedBlocks(header, blocks)) {
+    LOGF(eERROR, "%s has corrupted blocks", pPackedFilePath);
+    MemoryFree(data);
+    MemoryFree(blocks);
+    Destroy(renderContext);
+    return false;
+  }
+
+  uint64_t vertexBytes =
+      max(header.mVertexCount, 1u) * (uint64_t)sizeof(SceneVertex);
+  uint64_t indexBytes =
+      max(header.mIndexCount, 1u) * (uint64_t)sizeof(uint32_t);
+  BufferUpdateDesc vertexUpdate = {};
+  BufferUpdateDesc indexUpdate = {};
+  GeometryPool &geometryPool = renderContext.GetGeometryPool();
+  mGeometryAllocation =
+      geometryPool.Allocate(header.mVertexCount, header.mIndexCount);
+  if (mGeometryAllocation != GeometryPool::kNoAllocation) {
+    pGeometryPool = &geometryPool;
+    vertexUpdate.pBuffer = geometryPool.GetVertexBuffers()[0];
+    vertexUpdate.mDstOffset =
+        (uint64_t)geometryPool.GetFirstVertex(mGeometryAllocation) *
+        sizeof(SceneVertex);
+    indexUpdate.pBuffer = geometryPool.GetIndexBuffer();
+    indexUpdate.mDstOffset =
+        (uint64_t)geometryPool.GetFirstIndex(mGeometryAllocation) *
+        sizeof(uint32_t);
+    for (uint32_t i = 0; i < mSubMeshCount; ++i) {
+      pSubMeshes[i].mGeometry = mGeometryAllocation;
+    }
+  } else {
+    LOGF(eWARNING, "The geometry pool is full, the scene gets its own buffers");
+    BufferLoadDesc vbDesc = {};
+    vbDesc.mDesc.mDescriptors =
+        DESCRIPTOR_TYPE_VERTEX_BUFFER | DESCRIPTOR_TYPE_BUFFER;
+    vbDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+    vbDesc.mDesc.pName = "VertexBuffer";
+    vbDesc.mDesc.mSize = vertexBytes;
+    vbDesc.mDesc.mElementCount = (uint32_t)(vertexBytes / sizeof(uint32_t));
+    vbDesc.mDesc.mStructStride = sizeof(uint32_t);
+    vbDesc.ppBuffer = &pVertexBuffer;
+    addResource(&vbDesc, &mUploadToken);
+    BufferLoadDesc ibDesc = {};
+    ibDesc.mDesc.mDescriptors =
+        DESCRIPTOR_TYPE_INDEX_BUFFER | DESCRIPTOR_TYPE_BUFFER;
+    ibDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+    ibDesc.mDesc.pName = "IndexBuffer";
+    ibDesc.mDesc.mSize = indexBytes;
+    ibDesc.mDesc.mElementCount = (uint32_t)(indexBytes / sizeof(uint32_t));
+    ibDesc.mDesc.mStructStride = sizeof(uint32_t);
+    ibDesc.ppBuffer = &pIndexBuffer;
+    addResource(&ibDesc, &mUploadToken);
+    renderContext.TrackResource(kMemoryCategoryScene, pVertexBuffer);
+    renderContext.TrackResource(kMemoryCategoryScene, pIndexBuffer);
+    vertexUpdate.pBuffer = pVertexBuffer;
+    indexUpdate.pBuffer = pIndexBuffer;
+  }
+
+  vertexUpdate.mSize = vertexBytes;
+  beginUpdateResource(&vertexUpdate);
+  indexUpdate.mSize = indexBytes;
+  beginUpdateResource(&indexUpdate);
+  PackedDecodeJob job = {};
+  job.pBlocks = blocks;
+  job.mVertexBlockCount = header.mVertexBlockCount;
+  job.pData = data;
+  job.mVertexCount = header.mVertexCount;
+  job.pVertices = reinterpret_cast<SceneVertex *>(vertexUpdate.pMappedData);
+  job.pIndices = reinterpret_cast<uint32_t *>(indexUpdate.pMappedData);
+  int64_t decodeStart = getUSec(false);
+  taskSystem.ParallelFor((uint32_t)blockCount, 1, DecodePackedBlocks, &job);
+  double decodeSeconds = (double)(getUSec(false) - decodeStart) / 1e6;
+  endUpdateResource(&vertexUpdate);
+  endUpdateResource(&indexUpdate);
+  MemoryFree(data);
+  MemoryFree(blocks);
+  if (tfrg_atomic32_load_relaxed(&job.mFailed)) {
+    LOGF(eERROR, "%s has corrupted blocks", pPackedFilePath);
+    Destroy(renderContext);
+    return false;
+  }
+
+  // Every write was issued from the main thread, so the geometry can move
+  // from now on.
+  geometryPool.SetMovable(mGeometryAllocation);
+  uint64_t rawBytes = vertexBytes + indexBytes;
+  LOGF(eINFO,
+       "Loaded %s: %.1f MB packed, %.2fx smaller than its buffers and %.2fx "
+       "than its FBX, decoded at %.2f GB/s on %u threads",
+       pPackedFilePath, dataSize / (1024.0 * 1024.0),
+       (double)rawBytes / max(dataSize, (size_t)1),
+       (double)mSourceBytes / max(dataSize, (size_t)1),
+       rawBytes / max(decodeSeconds, 1e-9) / 1e9, taskSystem.GetThreadCount());
+  RenderStatsAdd(kRenderCounterUploadedBytes, GetGpuBytes());
+  return true;
+}
+
+uint64_t Scene::ComputeLayoutHash() const {
+  uint64_t hash = HashBytes(&mIndexCount, sizeof(mIndexCount));
+  for (uint32_t i = 0; i < mMeshRangeCount; ++i) {
+    hash = HashBytes(&pMeshRanges[i].mVertexCount, sizeof(uint32_t), hash);
+  }
+  // Bounds are left out, as they follow the vertices.
+  for (uint32_t i = 0; i < mSubMeshCount; ++i) {
+    const SceneSubMesh &subMesh = pSubMeshes[i];
+    hash = HashBytes(&subMesh.mIndexOffset, sizeof(uint32_t), hash);
+    hash = HashBytes(&subMesh.mIndexCount, sizeof(uint32_t), hash);
+    hash = HashBytes(&subMesh.mMaterialIndex, sizeof(uint32_t), hash);
+    hash = HashBytes(&subMesh.mSkinned, sizeof(bool), hash);
+    hash = HashBytes(&subMesh.mNode, sizeof(uint32_t), hash);
+  }
+  // Local transforms are left out, as Patch takes them.
+  for (uint32_t i = 0; i < mTransforms.GetNodeCount(); ++i) {
+    int32_t parent = mTransforms.GetParent(i);
+    hash = HashBytes(&parent, sizeof(int32_t), hash);
+  }
+  for (uint32_t i = 0; i < mMaterialCount; ++i) {
+    hash = HashBytes(&pMaterials[i].mDiffuseColor, sizeof(float4), hash);
+    hash = HashBytes(&pMaterials[i].mMetallic, sizeof(float), hash);
+    hash = HashBytes(&pMaterials[i].mRoughness, sizeof(float), hash);
+  }
+  for (ptrdiff_t i = 0; i < arrlen(pTextureRequests); ++i) {
+    const SceneTextureRequest &request = pTextureRequests[i];
+    hash = HashBytes(&request.mMaterialIndex, sizeof(uint32_t), hash);
+    hash = HashBytes(&request.mKind, sizeof(request.mKind), hash);
+    hash = HashBytes(request.mFileName, strlen(request.mFileName), hash);
+  }
+  // Drawn with another pipeline, and patched into a buffer of its own.
+  bool hasTangents = pTangentVertices != NULL;
+  hash = HashBytes(&hasTangents, sizeof(bool), hash);
+  hash = HashBytes(&mSkeleton.mJointCount, sizeof(uint32_t), hash);
+  if (mSkeleton.mJointCount > 0) {
+    hash = HashBytes(mSkeleton.pParents,
+                     mSkeleton.mJointCount * sizeof(int32_t), hash);
+    hash = HashBytes(mSkeleton.pInverseBindPoses,
+                     mSkeleton.mJointCount * sizeof(mat4), hash);
+  }
+  for (uint32_t i = 0; i < mBlendShapes.GetTargetCount(); ++i) {
+    hash = HashBytes(&mBlendShapes.GetTarget(i), sizeof(BlendShapeTarget),
+                     hash);
+  }
+  return HashBytes(mBlendShapes.GetDeltas(),
+                   mBlendShapes.GetDeltaCount() * sizeof(BlendShapeDelta),
+                   hash);
+}
+
+ScenePatchStats Scene::Patch(Scene &imported) {
+  TRACE_SCOPE("Patch Scene");
+  ASSERT(CanPatch(imported));
+  ScenePatchStats stats = {mMeshRangeCount, 0, 0};
+  SceneVertex *vertices = reinterpret_cast<SceneVertex *>(pVertices);
+  Buffer *pTargetBuffer = pVertexBuffer;
+  uint64_t targetOffset = 0;
+  if (pGeometryPool) {
+    pTargetBuffer = pGeometryPool->GetVertexBuffers()[0];
+    targetOffset =
+        (uint64_t)pGeometryPool->GetFirstVertex(mGeometryAllocation) *
+        sizeof(SceneVertex);
+  }
+  const SceneVertex *importedVertices =
+      reinterpret_cast<const SceneVertex *>(imported.pVertices);
+  for (uint32_t i = 0; i < mMeshRangeCount; ++i) {
+    SceneMeshRange &range = pMeshRanges[i];
+    if (range.mHash == imported.pMeshRanges[i].mHash) {
+      continue;
+    }
+    range.mHash = imported.pMeshRanges[i].mHash;
+    const SceneVertex *pSource = importedVertices + range.mVertexOffset;
+    uint64_t offset = range.mVertexOffset * sizeof(SceneVertex);
+    uint64_t size = range.mVertexCount * sizeof(SceneVertex);
+    memcpy(vertices + range.mVertexOffset, pSource, size);
+    UpdateBufferRange(pTargetBuffer, targetOffset + offset, pSource, size);
+    // Vertices outside of the blend shapes' range are never reset from the
+    // base buffer, see BlendShapeSystem.
+    if (pMorphedVertexBuffer) {
+      UpdateBufferRange(pMorphedVertexBuffer, offset, pSource, size);
+      stats.mPatchedBytes += size;
+    }
+    if (pSkinBuffer && imported.pSkinVertices) {
+      uint64_t skinSize = range.mVertexCount * sizeof(SceneSkinVertex);
+      UpdateBufferRange(pSkinBuffer,
+                        range.mVertexOffset * sizeof(SceneSkinVertex),
+                        imported.pSkinVertices + range.mVertexOffset,
+                        skinSize);
+      stats.mPatchedBytes += skinSize;
+    }
+    if (pTangentBuffer && imported.pTangentVertices) {
+      uint64_t tangentSize = range.mVertexCount * sizeof(uint32_t);
+      UpdateBufferRange(pTangentBuffer,
+                        range.mVertexOffset * sizeof(uint32_t),
+                        imported.pTangentVertices + range.mVertexOffset,
+                        tangentSize);
+      stats.mPatchedBytes += tangentSize;
+    }
+    stats.mPatchedMeshCount++;
+    stats.mPatchedBytes += size;
+  }
+  RenderStatsAdd(kRenderCounterUploadedBytes, stats.mPatchedBytes);
+
+  memcpy(pSubMeshes, imported.pSubMeshes,
+         mSubMeshCount * sizeof(SceneSubMesh));
+  for (uint32_t i = 0; i < mSubMeshCount; ++i) {
+    pSubMeshes[i].mGeometry = mGeometryAllocation;
+  }
+  // Keyframes aren't part of the layout, so clips are simply exchanged,
+  // along with the bytes they account for.
+  uint64_t clipBytes = GetClipBytes();
+  uint64_t importedClipBytes = imported.GetClipBytes();
+  mHelperBytes = mHelperBytes - clipBytes + importedClipBytes;
+  imported.mHelperBytes =
+      imported.mHelperBytes - importedClipBytes + clipBytes;
+  AnimationClip *pImportedClips = imported.pClips;
+  uint32_t importedClipCount = imported.mClipCount;
+  imported.pClips = pClips;
+  imported.mClipCount = mClipCount;
+  pClips = pImportedClips;
+  mClipCount = importedClipCount;
+  // As is the hierarchy, whose size only depends on the layout.
+  TransformHierarchy transforms = mTransforms;
+  mTransforms = imported.mTransforms;
+  imported.mTransforms = transforms;
+  return stats;
+}
+
+uint64_t Scene::GetClipBytes() const {
+  uint64_t bytes = 0;
+  for (uint32_t i = 0; i < mClipCount; ++i) {
+    bytes += pClips[i].GetSizeBytes();
+  }
+  return bytes;
+}
+
+uint64_t Scene::ComputeHelperBytes() const {
+  return (uint64_t)mSkeleton.mJointCount * (sizeof(int32_t) + sizeof(mat4)) +
+         GetClipBytes() + mBlendShapes.GetSizeBytes() +
+         mTransforms.GetSizeBytes();
+}
+
+uint64_t Scene::GetGpuBytes() const {
+  if (mKind == SceneKind::Streamed) {
+    return pChunkStreamer->GetGpuBytes();
+  }
+  Buffer *pBuffers[] = {pVertexBuffer, pIndexBuffer, pMorphedVertexBuffer,
+                        pBlendShapeDeltaBuffer, pSkinBuffer, pTangentBuffer};
+  uint64_t bytes =
+      pGeometryPool ? pGeometryPool->GetAllocationBytes(mGeometryAllocation)
+                    : 0;
+  for (uint32_t i = 0; i < TF_ARRAY_COUNT(pBuffers); ++i) {
+    bytes += pBuffers[i] ? pBuffers[i]->mSize : 0;
+  }
+  return bytes;
+}
+
+void Scene::RequestTextures(TextureStreamer &textureStreamer) {
+  for (ptrdiff_t i = 0; i < arrlen(pTextureRequests); ++i) {
+    const SceneTextureRequest &request = pTextureRequests[i];
+    SceneMaterial &material = pMaterials[request.mMaterialIndex];
+    uint32_t handle =
+        textureStreamer.Request(request.mFileName, request.mKind);
+    if (request.mKind == StreamedTextureKind::Diffuse) {
+      material.mDiffuseTexture = handle;
+    } else {
+      material.mNormalTexture = handle;
+    }
+  }
+  arrfree(pTextureRequests);
+}
+
+void Scene::ReleaseTextures(RenderContext &renderContext,
+                            TextureStreamer &textureStreamer) {
+  for (uint32_t i = 0; i < mMaterialCount; ++i) {
+    SceneMaterial &material = pMaterials[i];
+    textureStreamer.Release(renderContext, material.mDiffuseTexture);
+    textureStreamer.Release(renderContext, material.mNormalTexture);
+    material.mDiffuseTexture = TextureStreamer::kInvalidHandle;
+    material.mNormalTexture = TextureStreamer::kInvalidHandle;
+  }
+}
+
+void Scene::AllowGeometryMoves() {
+  if (pGeometryPool) {
+    pGeometryPool->SetMovable(mGeometryAllocation);
+  }
+}
+
 void Scene::Destroy(RenderContext &renderContext) {
+  arrfree(pTextureRequests);
+  MemoryFree(pSubMeshes);
+  MemoryFree(pMaterials);
+  pSubMeshes = NULL;
+  pMaterials = NULL;
+  mSubMeshCount = 0;
+  mMaterialCount = 0;
+
+  renderContext.DeferDestroy(pSkinBuffer, kMemoryCategoryScene);
+  renderContext.DeferDestroy(pTangentBuffer, kMemoryCategoryScene);
+  pSkinBuffer = NULL;
+  pTangentBuffer = NULL;
+  if (mHelperBytes > 0) {
+    MemoryUntrack(kMemoryCategoryScene, kMemoryKindCpu, mHelperBytes);
+    mHelperBytes = 0;
+  }
+  for (uint32_t i = 0; i < mClipCount; ++i) {
+    pClips[i].Destroy();
+  }
+  MemoryFree(pClips);
+  pClips = NULL;
+  mClipCount = 0;
+  mSkeleton.Destroy();
+  mTransforms.Destroy();
+
+  renderContext.DeferDestroy(pMorphedVertexBuffer, kMemoryCategoryScene);
+  renderContext.DeferDestroy(pBlendShapeDeltaBuffer, kMemoryCategoryScene);
+  pMorphedVertexBuffer = NULL;
+  pBlendShapeDeltaBuffer = NULL;
+  mBlendShapes.Destroy();
+
+  MemoryFree(pMeshRanges);
+  MemoryFree(pSkinVertices);
+  MemoryFree(pTangentVertices);
+  pMeshRanges = NULL;
+  pSkinVertices = NULL;
+  pTangentVertices = NULL;
+  mMeshRangeCount = 0;
+
   switch (mKind) {
   case SceneKind::Raw:
-    removeResource(pVertexBuffer);
-    removeResource(pIndexBuffer);
-    tf_free(pVertices);
-    tf_free(pIndices);
+  case SceneKind::Packed:
+    // Imported scenes may never have been uploaded.
+    renderContext.DeferDestroy(pVertexBuffer, kMemoryCategoryScene);
+    renderContext.DeferDestroy(pIndexBuffer, kMemoryCategoryScene);
+    if (pGeometryPool) {
+      pGeometryPool->Free(mGeometryAllocation,
+                          renderContext.GetLastSubmission() + 1);
+    }
+    pVertexBuffer = NULL;
+    pIndexBuffer = NULL;
+    pGeometryPool = NULL;
+    mGeometryAllocation = GeometryPool::kNoAllocation;
+    MemoryFree(pVertices);
+    MemoryFree(pIndices);
     return;
-  case SceneKind::Preprocessed:
-    removeResource(pGeometry);
-    removeResource(pGeometryData);
+  case SceneKind::Streamed:
+    pChunkStreamer->Exit(renderContext);
+    pChunkStreamer->~ChunkStreamer();
+    MemoryFree(pChunkStreamer);
+    pChunkStreamer = NULL;
+    return;
+  }
+}
+
+void Scene::ReportTextureDemand(TextureStreamer &textureStreamer,
+                                const mat4 &modelView, float projScaleY,
+                                float viewportHeight) const {
+  // Uniform scale is assumed, as the viewer only scales the whole scene.
+  float scale = length(modelView.getCol0().getXYZ());
+  for (uint32_t i = 0; i < mSubMeshCount; ++i) {
+    const SceneSubMesh &subMesh = pSubMeshes[i];
+    const SceneMaterial &material = pMaterials[subMesh.mMaterialIndex];
+    if (material.mDiffuseTexture == TextureStreamer::kInvalidHandle &&
+        material.mNormalTexture == TextureStreamer::kInvalidHandle) {
+      continue;
+    }
+    vec3 boundsMin, boundsMax;
+    GetSubMeshBounds(i, boundsMin, boundsMax);
+    vec3 center = (boundsMin + boundsMax) * 0.5f;
+    float radius = length(boundsMax - boundsMin) * 0.5f * scale;
+    float viewDepth = (modelView * vec4(center, 1.0f)).getZ();
+    // Projected diameter of the bounding sphere; anything touching the near
+    // plane is treated as filling the screen.
+    float screenSize =
+        viewDepth > radius
+            ? (2.0f * radius * projScaleY / viewDepth) * 0.5f * viewportHeight
+            : viewportHeight;
+    textureStreamer.AddDemand(material.mDiffuseTexture, screenSize);
+    textureStreamer.AddDemand(material.mNormalTexture, screenSize);
+  }
+}
+
+void Scene::ComputeBounds(vec3 &boundsMin, vec3 &boundsMax) const {
+  if (mSubMeshCount == 0) {
+    boundsMin = boundsMax = vec3(0.0f);
     return;
   }
+  GetSubMeshBounds(0, boundsMin, boundsMax);
+  for (uint32_t i = 1; i < mSubMeshCount; ++i) {
+    vec3 subMeshMin, subMeshMax;
+    GetSubMeshBounds(i, subMeshMin, subMeshMax);
+    boundsMin = minPerElem(boundsMin, subMeshMin);
+    boundsMax = maxPerElem(boundsMax, subMeshMax);
+  }
+}
+
+void Scene::GetSubMeshBounds(uint32_t i, vec3 &boundsMin,
+                             vec3 &boundsMax) const {
+  const SceneSubMesh &subMesh = pSubMeshes[i];
+  boundsMin = f3Tov3(subMesh.mBoundsMin);
+  boundsMax = f3Tov3(subMesh.mBoundsMax);
+  if (!subMesh.mSkinned) {
+    TransformBounds(mTransforms.GetWorld(subMesh.mNode), boundsMin,
+                    boundsMax);
+  }
 }
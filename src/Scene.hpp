@@ -3,71 +3,318 @@
 #include "Graphics/Interfaces/IGraphics.h"
 #include "Resources/ResourceLoader/Interfaces/IResourceLoader.h"
 
+#include "Animation.hpp"
+#include "BlendShapes.hpp"
+#include "ChunkStreamer.hpp"
 #include "RenderContext.hpp"
+#include "TextureStreamer.hpp"
+#include "TransformHierarchy.hpp"
 
 enum class SceneKind {
   Raw,
-  Preprocessed,
+  Streamed,
+  Packed,
+};
+
+struct SceneMaterial {
+  float4 mDiffuseColor;
+  /// Only read by PBR shading.
+  float mMetallic;
+  float mRoughness;
+  /// \c TextureStreamer handles, or \c TextureStreamer::kInvalidHandle.
+  uint32_t mDiffuseTexture;
+  uint32_t mNormalTexture;
+};
+
+/// A contiguous range of the index buffer drawn with a single material.
+struct SceneSubMesh {
+  uint32_t mIndexOffset;
+  /// Zero while a streamed submesh isn't resident.
+  uint32_t mIndexCount;
+  /// Added to every index, so that submeshes can share 16-bit indices.
+  uint32_t mVertexOffset;
+  uint32_t mMaterialIndex;
+  float3 mBoundsMin;
+  float3 mBoundsMax;
+  /// Skinned submeshes also read the scene's skin buffer.
+  bool mSkinned;
+  /// Index in the scene's transform hierarchy. Skinned submeshes ignore it,
+  /// as skinning already places them in model space.
+  uint32_t mNode;
+  /// Geometry pool allocation the offsets above are relative to, or
+  /// \c GeometryPool::kNoAllocation if the scene has its own buffers.
+  uint32_t mGeometry;
+};
+
+/// Second vertex stream of skinned scenes, parallel to the first.
+struct SceneSkinVertex {
+  uint8_t mJoints[4];
+  /// Normalized, summing to 255.
+  uint8_t mWeights[4];
+};
+
+/// Vertices of one FBX or glTF mesh, with a hash of their contents so that a
+/// reimport can tell which meshes changed.
+struct SceneMeshRange {
+  uint32_t mVertexOffset;
+  uint32_t mVertexCount;
+  uint64_t mHash;
+};
+
+struct ScenePatchStats {
+  uint32_t mMeshCount;
+  uint32_t mPatchedMeshCount;
+  uint64_t mPatchedBytes;
+};
+
+/// A material texture found while loading, requested from the texture
+/// streamer once back on the main thread.
+struct SceneTextureRequest {
+  uint32_t mMaterialIndex;
+  StreamedTextureKind mKind;
+  char mFileName[FS_MAX_PATH];
 };
 
 struct Scene {
 public:
-  void LoadMeshResource(RenderContext &renderContext,
-                        const char *pResourceFileName);
+  /// Larger hierarchies are flattened into a single node.
+  static const uint32_t kMaxNodeCount = 16384;
+  /// Size of the vertices of every scene kind, and of the render context's
+  /// geometry pool.
+  static const uint32_t kVertexStride;
+
   /// Ideally, this would have been integrated inside The Forge's Resource
   /// Loader systems as to leverage its multithreading, but I'd like to keep
   /// Forge as vanilla as I can.
   /// For simplicity, this loads all meshes and models into a single unified
-  /// geometry.
-  void LoadRawFBX(RenderContext &renderContext, const char *pFilePath);
+  /// geometry, split into one submesh per mesh material.
+  /// Can run on any thread: textures are only requested by
+  /// \c RequestTextures, and GPU uploads complete asynchronously, see
+  /// \c IsUploaded. Returns false if the file can't be read or parsed.
+  /// Missing normals, and tangents of normal mapped meshes, are generated
+  /// with \c TangentSpaceGenerator, in parallel over triangle ranges on
+  /// \c pTaskSystem, or on the calling thread alone if it's \c NULL. Off the
+  /// main thread, pass \c TaskSystem::GetLoadTasks.
+  bool LoadRaw(RenderContext &renderContext, const char *pFilePath,
+               TaskSystem *pTaskSystem);
+  /// The two halves of \c LoadRaw. Importing only touches the CPU, so an
+  /// imported scene can be patched into another with \c Patch and destroyed
+  /// without ever being uploaded. Files ending in \c .glb go through
+  /// \c ImportRawGLB, others through \c ImportRawFBX.
+  bool ImportRaw(const char *pFilePath, TaskSystem *pTaskSystem);
+  void UploadRaw(RenderContext &renderContext);
+  bool ImportRawFBX(const char *pFilePath, TaskSystem *pTaskSystem);
+  /// Imports the default scene of a binary glTF file. Accessors are read in
+  /// place from the file's binary chunk, after decoding the views compressed
+  /// with EXT_meshopt_compression. Skins and morph targets are ignored.
+  bool ImportRawGLB(const char *pFilePath, TaskSystem *pTaskSystem);
+  /// Converts an FBX file into a chunk file, both relative to \c RD_MESHES,
+  /// for \c LoadStreamed. Meshes are placed by their nodes and split into
+  /// chunks of nearby triangles sharing a material. The FBX still has to fit
+  /// in memory while converting, but the chunks are written as they're made.
+  static bool ConvertFBXToChunks(const char *pFilePath,
+                                 const char *pChunkFilePath);
+  /// Loads the materials and chunk table of a chunk file. Chunks only become
+  /// resident, nearest first, through \c UpdateStreaming; each chunk is a
+  /// submesh whose index count stays zero until then.
+  bool LoadStreamed(RenderContext &renderContext, TaskSystem &taskSystem,
+                    const char *pChunkFilePath,
+                    const ChunkStreamerDesc &desc);
+  /// Does nothing unless the scene is streamed. \c viewPosition is in model
+  /// space.
+  void UpdateStreaming(RenderContext &renderContext,
+                       const vec3 &viewPosition);
+  /// Writes an imported raw scene into a packed file in \c RD_MESHES, for
+  /// \c LoadPacked. Identical vertices are merged, then vertices and indices
+  /// are compressed in independent blocks, see \c GeometryCodec. Must be
+  /// called before \c RequestTextures. Skins, blend shapes and tangents
+  /// aren't supported.
+  bool WritePacked(const char *pPackedFilePath) const;
+  /// Decodes a packed file's blocks in parallel, straight into the resource
+  /// loader's staging memory. Decoding uses \c ParallelFor, so this must be
+  /// called from the main thread.
+  bool LoadPacked(RenderContext &renderContext, TaskSystem &taskSystem,
+                  const char *pPackedFilePath);
+  /// Must be called from the main thread after loading.
+  void RequestTextures(TextureStreamer &textureStreamer);
+  /// Gives back the textures \c RequestTextures got, before \c Destroy.
+  /// Must be called from the main thread.
+  void ReleaseTextures(RenderContext &renderContext,
+                       TextureStreamer &textureStreamer);
+  /// Lets the geometry pool compact the scene's geometry, see
+  /// \c GeometryPool::SetMovable. Must be called from the main thread once
+  /// loading returned.
+  void AllowGeometryMoves();
+  inline bool IsUploaded() const { return isTokenCompleted(&mUploadToken); }
   void Destroy(RenderContext &renderContext);
 
+  /// True if \c imported only differs from this scene in the contents of its
+  /// meshes' vertices, which \c Patch can then update in place. Materials,
+  /// the skeleton and node hierarchies and blend shapes are part of the
+  /// layout.
+  inline bool CanPatch(const Scene &imported) const {
+    return mKind == SceneKind::Raw && imported.mKind == SceneKind::Raw &&
+           (pVertexBuffer != NULL ||
+            mGeometryAllocation != GeometryPool::kNoAllocation) &&
+           mLayoutHash == imported.mLayoutHash;
+  }
+  /// Re-uploads the meshes whose hash differs from \c imported into the
+  /// existing buffers, and takes its submesh bounds, animation clips and node
+  /// transforms. A frame in flight may briefly draw a partially updated mesh.
+  ScenePatchStats Patch(Scene &imported);
+
+  /// Unique to each load, so that caches keyed by scene don't mistake a scene
+  /// loaded at the address of a destroyed one for it.
+  inline uint32_t GetId() const { return mId; }
+
+  /// Reports how large each material's textures appear on screen, given the
+  /// scene's model-view matrix, the projection's vertical scale and the
+  /// viewport height in pixels.
+  void ReportTextureDemand(TextureStreamer &textureStreamer,
+                           const mat4 &modelView, float projScaleY,
+                           float viewportHeight) const;
+
+  /// Size of the scene's buffers, zero until it's uploaded.
+  uint64_t GetGpuBytes() const;
+
+  /// Union of the submesh bounds, in model space.
+  void ComputeBounds(vec3 &boundsMin, vec3 &boundsMax) const;
+  /// Bounds of a submesh in model space, as of the transforms' last update.
+  void GetSubMeshBounds(uint32_t i, vec3 &boundsMin, vec3 &boundsMax) const;
+
+  /// The FBX or glTF nodes holding meshes, and their ancestors. Moving nodes
+  /// at runtime only takes effect once the hierarchy is updated.
+  inline TransformHierarchy &GetTransforms() { return mTransforms; }
+  inline const TransformHierarchy &GetTransforms() const {
+    return mTransforms;
+  }
+
   inline uint32_t GetIndexCount() const {
     switch (mKind) {
-    case SceneKind::Preprocessed:
-      return pGeometry->mIndexCount;
     case SceneKind::Raw:
+    case SceneKind::Packed:
       return mIndexCount;
+    case SceneKind::Streamed:
+      return 0;
     }
   }
-  inline uint32_t GetVertexBufferCount() const {
-    switch (mKind) {
-    case SceneKind::Preprocessed:
-      return pGeometry->mVertexBufferCount;
-    case SceneKind::Raw:
-      return 1;
-    }
-  }
+  inline IndexType GetIndexType() const { return INDEX_TYPE_UINT32; }
+  inline uint32_t GetVertexBufferCount() const { return 1; }
   inline Buffer *const *GetVertexBuffers() const {
     switch (mKind) {
-    case SceneKind::Preprocessed:
-      return pGeometry->pVertexBuffers;
     case SceneKind::Raw:
-      return &pVertexBuffer;
+    case SceneKind::Packed:
+      if (pGeometryPool) {
+        return pGeometryPool->GetVertexBuffers();
+      }
+      return pMorphedVertexBuffer ? &pMorphedVertexBuffer : &pVertexBuffer;
+    case SceneKind::Streamed:
+      return pChunkStreamer->GetVertexBuffers();
     }
   }
   inline Buffer *GetIndexBuffer() const {
     switch (mKind) {
-    case SceneKind::Preprocessed:
-      return pGeometry->pIndexBuffer;
     case SceneKind::Raw:
-      return pIndexBuffer;
+    case SceneKind::Packed:
+      return pGeometryPool ? pGeometryPool->GetIndexBuffer() : pIndexBuffer;
+    case SceneKind::Streamed:
+      return pChunkStreamer->GetIndexBuffer();
     }
   }
+  /// \c NULL unless the scene has skinned meshes.
+  inline Buffer *GetSkinBuffer() const { return pSkinBuffer; }
+  /// \c NULL unless the scene has normal mapped meshes. Holds one
+  /// octahedral tangent per vertex, the bitangent's sign in the lowest bit,
+  /// zero for vertices of meshes without normal maps.
+  inline Buffer *GetTangentBuffer() const { return pTangentBuffer; }
+  inline const Skeleton &GetSkeleton() const { return mSkeleton; }
+  inline uint32_t GetClipCount() const { return mClipCount; }
+  inline const AnimationClip &GetClip(uint32_t i) const { return pClips[i]; }
+
+  inline const BlendShapeSet &GetBlendShapes() const { return mBlendShapes; }
+  /// The following are \c NULL unless the scene has blend shapes. The
+  /// morphed vertex buffer then replaces the first vertex buffer, and holds
+  /// the undeformed vertices until \c BlendShapeSystem writes it.
+  inline Buffer *GetBlendShapeDeltaBuffer() const {
+    return pBlendShapeDeltaBuffer;
+  }
+  inline Buffer *GetBaseVertexBuffer() const {
+    return pMorphedVertexBuffer ? pVertexBuffer : NULL;
+  }
+  inline Buffer *GetMorphedVertexBuffer() const { return pMorphedVertexBuffer; }
+
+  inline uint32_t GetSubMeshCount() const { return mSubMeshCount; }
+  inline const SceneSubMesh &GetSubMesh(uint32_t i) const {
+    return pSubMeshes[i];
+  }
+  inline uint32_t GetMaterialCount() const { return mMaterialCount; }
+  inline const SceneMaterial &GetMaterial(uint32_t i) const {
+    return pMaterials[i];
+  }
 
 private:
+  uint64_t ComputeLayoutHash() const;
+  uint64_t GetClipBytes() const;
+  /// Bytes held by the skeleton, clips, blend shapes and transforms, which
+  /// allocate through their own types rather than \c MemoryAlloc.
+  uint64_t ComputeHelperBytes() const;
+  void BuildIdentityTransforms();
+
+  uint32_t mId = 0;
+  SyncToken mUploadToken = {};
+  SceneTextureRequest *pTextureRequests = NULL;
+
   // std::variant doesn't exist on C++14 ¯\_(ツ)_/¯
-  SceneKind mKind;
+  SceneKind mKind = SceneKind::Raw;
   union {
-    struct {
-      Geometry *pGeometry;
-      GeometryData *pGeometryData;
-    };
+    // Raw and packed scenes, the latter without CPU copies. The buffers are
+    // NULL if the scene is in the geometry pool.
     struct {
       void *pVertices, *pIndices;
       Buffer *pVertexBuffer;
       Buffer *pIndexBuffer;
       uint32_t mIndexCount;
+      uint32_t mVertexCapacity;
+    };
+    struct {
+      ChunkStreamer *pChunkStreamer;
+      /// \c ChunkStreamer::GetVersion as of the last submesh refresh.
+      uint32_t mChunkVersion;
     };
   };
+
+  /// Set if a raw or packed scene is in the geometry pool. Streamed scenes'
+  /// chunks have an allocation each, see \c ChunkStreamer.
+  GeometryPool *pGeometryPool = NULL;
+  uint32_t mGeometryAllocation = GeometryPool::kNoAllocation;
+
+  SceneMeshRange *pMeshRanges = NULL;
+  uint32_t mMeshRangeCount = 0;
+  /// Hash of everything \c Patch can't update, see \c CanPatch.
+  uint64_t mLayoutHash = 0;
+  /// Tracked by \c ImportRaw, see \c ComputeHelperBytes.
+  uint64_t mHelperBytes = 0;
+  /// Size of the file the scene was imported or packed from.
+  uint64_t mSourceBytes = 0;
+
+  SceneSubMesh *pSubMeshes = NULL;
+  uint32_t mSubMeshCount = 0;
+  SceneMaterial *pMaterials = NULL;
+  uint32_t mMaterialCount = 0;
+
+  Buffer *pSkinBuffer = NULL;
+  /// Read asynchronously by the upload, so it's freed with the scene.
+  SceneSkinVertex *pSkinVertices = NULL;
+  Buffer *pTangentBuffer = NULL;
+  /// Same as \c pSkinVertices.
+  uint32_t *pTangentVertices = NULL;
+  Skeleton mSkeleton;
+  AnimationClip *pClips = NULL;
+  uint32_t mClipCount = 0;
+
+  BlendShapeSet mBlendShapes;
+  Buffer *pBlendShapeDeltaBuffer = NULL;
+  Buffer *pMorphedVertexBuffer = NULL;
+
+  TransformHierarchy mTransforms;
 };
@@ -1,5 +1,34 @@
 #include "SceneRenderSystem.hpp"
 
+#include "Utilities/Interfaces/ILog.h"
+#include "Utilities/Interfaces/ITime.h"
+
+#include "ImageBasedLighting.hpp"
+#include "RenderStats.hpp"
+#include "Trace.hpp"
+
+/// Indexed by a variant's vertex features.
+static const VertexLayout *const kSceneVertexLayouts[4] = {
+    &kSceneVertexLayout,
+    &kSkinnedSceneVertexLayout,
+    &kTangentSceneVertexLayout,
+    &kSkinnedTangentSceneVertexLayout,
+};
+
+/// The visibility pass only reads positions.
+static const VertexLayout kVisibilityVertexLayout = {
+    {
+        {sizeof(float3) + sizeof(uint32_t) + sizeof(float),
+         VERTEX_BINDING_RATE_VERTEX},
+    },
+    {
+        {SEMANTIC_POSITION, 0, "vPosition", TinyImageFormat_R32G32B32_SFLOAT, 0,
+         0, 0},
+    },
+    1,
+    1,
+};
+
 void SceneRenderSystem::Init(RenderContext &renderContext) {
   BufferLoadDesc ubDesc = {};
   ubDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_UNIFORM_BUFFER;
@@ -16,12 +45,119 @@ void SceneRenderSystem::Init(RenderContext &renderContext) {
     ubDesc.ppBuffer = &pSkyboxUniformBuffer[i];
     addResource(&ubDesc, NULL);
   }
+
+  BufferLoadDesc sbDesc = {};
+  sbDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_BUFFER;
+  sbDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_CPU_TO_GPU;
+  sbDesc.mDesc.mFlags = BUFFER_CREATION_FLAG_PERSISTENT_MAP_BIT;
+  sbDesc.mDesc.mFirstElement = 0;
+  sbDesc.pData = NULL;
+  for (uint32_t i = 0; i < RenderContext::kDataBufferCount; ++i) {
+    sbDesc.mDesc.pName = "LightBuffer";
+    sbDesc.mDesc.mElementCount = ClusteredLighting::kMaxLightCount;
+    sbDesc.mDesc.mStructStride = sizeof(GpuLight);
+    sbDesc.mDesc.mSize = ClusteredLighting::kMaxLightCount * sizeof(GpuLight);
+    sbDesc.ppBuffer = &pLightBuffer[i];
+    addResource(&sbDesc, NULL);
+    sbDesc.mDesc.pName = "ClusterRangeBuffer";
+    sbDesc.mDesc.mElementCount = ClusteredLighting::kClusterCount;
+    sbDesc.mDesc.mStructStride = sizeof(uint32_t);
+    sbDesc.mDesc.mSize = ClusteredLighting::kClusterCount * sizeof(uint32_t);
+    sbDesc.ppBuffer = &pClusterRangeBuffer[i];
+    addResource(&sbDesc, NULL);
+    sbDesc.mDesc.pName = "LightIndexBuffer";
+    sbDesc.mDesc.mElementCount = ClusteredLighting::kMaxLightIndexCount;
+    sbDesc.mDesc.mStructStride = sizeof(uint32_t);
+    sbDesc.mDesc.mSize =
+        ClusteredLighting::kMaxLightIndexCount * sizeof(uint32_t);
+    sbDesc.ppBuffer = &pLightIndexBuffer[i];
+    addResource(&sbDesc, NULL);
+    sbDesc.mDesc.pName = "SkinningBuffer";
+    sbDesc.mDesc.mElementCount = Skeleton::kMaxJointCount;
+    sbDesc.mDesc.mStructStride = sizeof(mat4);
+    sbDesc.mDesc.mSize = Skeleton::kMaxJointCount * sizeof(mat4);
+    sbDesc.ppBuffer = &pSkinningBuffer[i];
+    addResource(&sbDesc, NULL);
+    sbDesc.mDesc.pName = "NodeBuffer";
+    sbDesc.mDesc.mElementCount = Scene::kMaxNodeCount;
+    sbDesc.mDesc.mStructStride = sizeof(mat4);
+    sbDesc.mDesc.mSize = Scene::kMaxNodeCount * sizeof(mat4);
+    sbDesc.ppBuffer = &pNodeBuffer[i];
+    addResource(&sbDesc, NULL);
+    sbDesc.mDesc.pName = "MaterialBuffer";
+    sbDesc.mDesc.mElementCount = kMaxMaterialCount;
+    sbDesc.mDesc.mStructStride = sizeof(GpuMaterial);
+    sbDesc.mDesc.mSize = kMaxMaterialCount * sizeof(GpuMaterial);
+    sbDesc.ppBuffer = &pMaterialBuffer[i];
+    addResource(&sbDesc, NULL);
+    sbDesc.mDesc.pName = "VisibilityDrawBuffer";
+    sbDesc.mDesc.mElementCount = kMaxVisibilityDrawCount;
+    sbDesc.mDesc.mStructStride = sizeof(VisibilityDraw);
+    sbDesc.mDesc.mSize = kMaxVisibilityDrawCount * sizeof(VisibilityDraw);
+    sbDesc.ppBuffer = &pVisibilityDrawBuffer[i];
+    addResource(&sbDesc, NULL);
+  }
+  // A single zero tangent, like those of meshes without normal maps.
+  static const uint32_t kEmptyTangent = 0;
+  BufferLoadDesc tbDesc = {};
+  tbDesc.mDesc.mDescriptors = DESCRIPTOR_TYPE_BUFFER;
+  tbDesc.mDesc.mMemoryUsage = RESOURCE_MEMORY_USAGE_GPU_ONLY;
+  tbDesc.mDesc.pName = "EmptyTangentBuffer";
+  tbDesc.mDesc.mSize = sizeof(uint32_t);
+  tbDesc.mDesc.mElementCount = 1;
+  tbDesc.mDesc.mStructStride = sizeof(uint32_t);
+  tbDesc.pData = &kEmptyTangent;
+  tbDesc.ppBuffer = &pEmptyTangentBuffer;
+  addResource(&tbDesc, NULL);
+  renderContext.TrackResource(kMemoryCategorySceneRenderSystem,
+                              pEmptyTangentBuffer);
+  for (uint32_t i = 0; i < RenderContext::kDataBufferCount; ++i) {
+    Buffer *pBuffers[] = {pSceneUniformBuffer[i],  pSkyboxUniformBuffer[i],
+                          pLightBuffer[i],         pClusterRangeBuffer[i],
+                          pLightIndexBuffer[i],    pSkinningBuffer[i],
+                          pNodeBuffer[i],          pMaterialBuffer[i],
+                          pVisibilityDrawBuffer[i]};
+    for (uint32_t j = 0; j < TF_ARRAY_COUNT(pBuffers); ++j) {
+      renderContext.TrackResource(kMemoryCategorySceneRenderSystem,
+                                  pBuffers[j]);
+    }
+  }
+
+  SamplerDesc samplerDesc = {FILTER_LINEAR,
+                             FILTER_LINEAR,
+                             MIPMAP_MODE_LINEAR,
+                             ADDRESS_MODE_REPEAT,
+                             ADDRESS_MODE_REPEAT,
+                             ADDRESS_MODE_REPEAT};
+  samplerDesc.mMaxAnisotropy = 8.0f;
+  pMaterialSampler = renderContext.CreateSampler(&samplerDesc);
 }
 void SceneRenderSystem::Exit(RenderContext &renderContext) {
   for (uint32_t i = 0; i < RenderContext::kDataBufferCount; ++i) {
-    removeResource(pSceneUniformBuffer[i]);
-    removeResource(pSkyboxUniformBuffer[i]);
+    renderContext.DeferDestroy(pSceneUniformBuffer[i],
+                               kMemoryCategorySceneRenderSystem);
+    renderContext.DeferDestroy(pSkyboxUniformBuffer[i],
+                               kMemoryCategorySceneRenderSystem);
+    renderContext.DeferDestroy(pLightBuffer[i],
+                               kMemoryCategorySceneRenderSystem);
+    renderContext.DeferDestroy(pClusterRangeBuffer[i],
+                               kMemoryCategorySceneRenderSystem);
+    renderContext.DeferDestroy(pLightIndexBuffer[i],
+                               kMemoryCategorySceneRenderSystem);
+    renderContext.DeferDestroy(pSkinningBuffer[i],
+                               kMemoryCategorySceneRenderSystem);
+    renderContext.DeferDestroy(pNodeBuffer[i],
+                               kMemoryCategorySceneRenderSystem);
+    renderContext.DeferDestroy(pMaterialBuffer[i],
+                               kMemoryCategorySceneRenderSystem);
+    renderContext.DeferDestroy(pVisibilityDrawBuffer[i],
+                               kMemoryCategorySceneRenderSystem);
   }
+  renderContext.DeferDestroy(pEmptyTangentBuffer,
+                             kMemoryCategorySceneRenderSystem);
+  renderContext.DestroySampler(pMaterialSampler);
+  mDrawList.Destroy();
+  mForwardDrawList.Destroy();
 }
 
 void SceneRenderSystem::Load(RenderContext &renderContext, const SkyBox &skyBox,
@@ -52,32 +188,183 @@ void SceneRenderSystem::Unload(RenderContext &renderContext,
 
 void SceneRenderSystem::UpdateSceneViewProj(mat4 sceneMat, mat4 viewMat,
                                             CameraMatrix projMat) {
+  mSceneViewMat = viewMat * sceneMat;
   mSceneUniformData.mModelProjectView = projMat * viewMat * sceneMat;
-  mSceneUniformData.mLightPosition = vec4(0, 0, 0, 0);
-  mSceneUniformData.mLightColor = vec4(0.9f, 0.9f, 0.7f, 1.0f); // Pale Yellow
+  mSceneUniformData.mModelView = mSceneViewMat;
+  mSceneUniformData.mAmbientColor = vec4(0.1f, 0.1f, 0.1f, 1.0f);
+  // The sky box is in world space, and only directions are transformed.
+  mSceneUniformData.mViewToWorld = inverse(viewMat);
 
   viewMat.setTranslation(vec3(0));
   mSkyBoxUniformData = {};
   mSkyBoxUniformData.mProjectView = projMat * viewMat;
 }
 
-void SceneRenderSystem::Draw(RenderContext::Frame &frame, const Scene &scene,
-                             const SkyBox &skyBox,
+void SceneRenderSystem::UpdateLights(RenderContext::Frame &frame,
+                                     const ClusteredLighting &lighting,
+                                     bool showHeatmap) {
+  const ClusterStats &stats = lighting.GetStats();
+
+  BufferUpdateDesc lightUpdate = {pLightBuffer[frame.index]};
+  beginUpdateResource(&lightUpdate);
+  memcpy(lightUpdate.pMappedData, lighting.GetGpuLights(),
+         stats.mLightCount * sizeof(GpuLight));
+  endUpdateResource(&lightUpdate);
+
+  BufferUpdateDesc rangeUpdate = {pClusterRangeBuffer[frame.index]};
+  beginUpdateResource(&rangeUpdate);
+  memcpy(rangeUpdate.pMappedData, lighting.GetClusterRanges(),
+         ClusteredLighting::kClusterCount * sizeof(uint32_t));
+  endUpdateResource(&rangeUpdate);
+
+  BufferUpdateDesc indexUpdate = {pLightIndexBuffer[frame.index]};
+  beginUpdateResource(&indexUpdate);
+  memcpy(indexUpdate.pMappedData, lighting.GetLightIndices(),
+         stats.mIndexCount * sizeof(uint32_t));
+  endUpdateResource(&indexUpdate);
+  RenderStatsAdd(kRenderCounterUploadedBytes,
+                 stats.mLightCount * sizeof(GpuLight) +
+                     (ClusteredLighting::kClusterCount + stats.mIndexCount) *
+                         sizeof(uint32_t));
+
+  // Tiles span the scaled scene viewport, not the whole target.
+  mSceneUniformData.mClusterScale =
+      vec4((float)ClusteredLighting::kTileCountX / frame.mSceneWidth,
+           (float)ClusteredLighting::kTileCountY / frame.mSceneHeight,
+           lighting.GetSliceScale(), lighting.GetSliceBias());
+  mSceneUniformData.mClusterParams[0] = ClusteredLighting::kTileCountX;
+  mSceneUniformData.mClusterParams[1] = ClusteredLighting::kTileCountY;
+  mSceneUniformData.mClusterParams[2] = ClusteredLighting::kSliceCount;
+  mSceneUniformData.mClusterParams[3] = 0;
+  mShadingFeatures = (mShadingFeatures & ~kSceneShaderHeatmap) |
+                     (showHeatmap ? kSceneShaderHeatmap : 0);
+}
+
+void SceneRenderSystem::UpdateShading(const SkyBox &skyBox, bool pbr) {
+  mShadingFeatures = (mShadingFeatures & ~kSceneShaderPbr) |
+                     (pbr && skyBox.IsLightingReady() ? kSceneShaderPbr : 0);
+  mSceneUniformData.mShadingParams[0] = 0;
+  mSceneUniformData.mShadingParams[1] =
+      ImageBasedLighting::kSpecularMipCount - 1;
+  memcpy(mSceneUniformData.mIrradianceSh, skyBox.GetIrradianceSh(),
+         sizeof(mSceneUniformData.mIrradianceSh));
+}
+
+void SceneRenderSystem::UpdateSkinning(RenderContext::Frame &frame,
+                                       const mat4 *pMatrices, uint32_t count) {
+  BufferUpdateDesc skinningUpdate = {pSkinningBuffer[frame.index]};
+  beginUpdateResource(&skinningUpdate);
+  memcpy(skinningUpdate.pMappedData, pMatrices,
+         min(count, Skeleton::kMaxJointCount) * sizeof(mat4));
+  endUpdateResource(&skinningUpdate);
+  RenderStatsAdd(kRenderCounterUploadedBytes,
+                 min(count, Skeleton::kMaxJointCount) * sizeof(mat4));
+}
+
+void SceneRenderSystem::UpdateNodes(RenderContext::Frame &frame,
+                                    const Scene &scene) {
+  const TransformHierarchy &transforms = scene.GetTransforms();
+  if (mNodeSceneId[frame.index] == scene.GetId() &&
+      mNodeVersion[frame.index] == transforms.GetVersion()) {
+    return;
+  }
+  mNodeSceneId[frame.index] = scene.GetId();
+  mNodeVersion[frame.index] = transforms.GetVersion();
+  uint64_t size = (uint64_t)transforms.GetNodeCount() * sizeof(mat4);
+  BufferUpdateDesc nodeUpdate = {pNodeBuffer[frame.index]};
+  beginUpdateResource(&nodeUpdate);
+  memcpy(nodeUpdate.pMappedData, transforms.GetWorlds(), size);
+  endUpdateResource(&nodeUpdate);
+  RenderStatsAdd(kRenderCounterUploadedBytes, size);
+}
+
+void SceneRenderSystem::UpdateMaterials(
+    RenderContext &renderContext, RenderContext::Frame &frame,
+    const Scene &scene, const TextureStreamer &textureStreamer) {
+  // This frame's previous submission has completed by now, so its slice of
+  // the material descriptor set can be rewritten safely.
+  if (mMaterialSceneId[frame.index] == scene.GetId() &&
+      mMaterialGeneration[frame.index] == textureStreamer.GetGeneration()) {
+    return;
+  }
+  mMaterialSceneId[frame.index] = scene.GetId();
+  mMaterialGeneration[frame.index] = textureStreamer.GetGeneration();
+
+  uint32_t materialCount = min(scene.GetMaterialCount(), kMaxMaterialCount);
+  Texture *pDiffuseTextures[kMaxMaterialCount];
+  Texture *pNormalTextures[kMaxMaterialCount];
+  BufferUpdateDesc materialUpdate = {pMaterialBuffer[frame.index]};
+  beginUpdateResource(&materialUpdate);
+  GpuMaterial *pGpuMaterials =
+      reinterpret_cast<GpuMaterial *>(materialUpdate.pMappedData);
+  for (uint32_t i = 0; i < materialCount; ++i) {
+    const SceneMaterial &material = scene.GetMaterial(i);
+    pDiffuseTextures[i] = textureStreamer.GetTexture(
+        material.mDiffuseTexture, StreamedTextureKind::Diffuse);
+    pNormalTextures[i] = textureStreamer.GetTexture(
+        material.mNormalTexture, StreamedTextureKind::Normal);
+    DescriptorData params[2] = {};
+    params[0].pName = "DiffuseTexture";
+    params[0].ppTextures = &pDiffuseTextures[i];
+    params[1].pName = "NormalTexture";
+    params[1].ppTextures = &pNormalTextures[i];
+    renderContext.UpdateDescriptorSet(pDescriptorSetMaterials,
+                                      frame.index * kMaxMaterialCount + i, 2,
+                                      params);
+    pGpuMaterials[i] = {material.mDiffuseColor, material.mMetallic,
+                        material.mRoughness, {}};
+  }
+  endUpdateResource(&materialUpdate);
+  RenderStatsAdd(kRenderCounterUploadedBytes,
+                 materialCount * sizeof(GpuMaterial));
+  if (materialCount == 0) {
+    return;
+  }
+  // The resolve indexes every material at once.
+  DescriptorData arrayParams[2] = {};
+  arrayParams[0].pName = "DiffuseTextures";
+  arrayParams[0].ppTextures = pDiffuseTextures;
+  arrayParams[0].mCount = materialCount;
+  arrayParams[1].pName = "NormalTextures";
+  arrayParams[1].ppTextures = pNormalTextures;
+  arrayParams[1].mCount = materialCount;
+  renderContext.UpdateDescriptorSet(pDescriptorSetMaterialArrays, frame.index,
+                                    2, arrayParams);
+}
+
+void SceneRenderSystem::Draw(RenderContext &renderContext,
+                             RenderContext::Frame &frame, const Scene &scene,
+                             const SkyBox &skyBox, bool visibilityBuffer,
                              ProfileToken gpuProfileToken) {
   Cmd *cmd = frame.mCmdRingElement.pCmds[0];
 
   UpdateUniformBuffers(frame);
+  BuildDrawList(scene);
+  // The scene shown until the first model is loaded has no buffers at all.
+  visibilityBuffer = visibilityBuffer && mDrawList.GetCount() > 0;
+  if (visibilityBuffer) {
+    UpdateGeometryDescriptors(renderContext, frame, scene);
+  }
 
-  cmdBeginGpuTimestampQuery(cmd, gpuProfileToken, "Draw Skybox");
+  renderContext.BeginGpuScope(cmd, gpuProfileToken, "Draw Skybox");
   DrawSkyBox(frame, skyBox);
-  cmdEndGpuTimestampQuery(cmd, gpuProfileToken);
+  renderContext.EndGpuScope(cmd, gpuProfileToken);
 
-  cmdBeginGpuTimestampQuery(cmd, gpuProfileToken, "Draw Scene");
-  DrawScene(frame, scene);
-  cmdEndGpuTimestampQuery(cmd, gpuProfileToken);
+  if (visibilityBuffer) {
+    DrawVisibilityBuffer(renderContext, frame, scene,
+                         renderContext.GetGeometryPool(), gpuProfileToken);
+    return;
+  }
+  renderContext.BeginGpuScope(cmd, gpuProfileToken, "Draw Scene");
+  DrawScene(renderContext, frame, scene, renderContext.GetGeometryPool(),
+            mDrawList);
+  renderContext.EndGpuScope(cmd, gpuProfileToken);
 }
 
 void SceneRenderSystem::UpdateUniformBuffers(RenderContext::Frame &frame) {
+  mSceneUniformData.mViewportParams =
+      vec4((float)frame.mSceneWidth, (float)frame.mSceneHeight,
+           1.0f / frame.mSceneWidth, 1.0f / frame.mSceneHeight);
   BufferUpdateDesc viewProjCbv = {pSceneUniformBuffer[frame.index]};
   beginUpdateResource(&viewProjCbv);
   memcpy(viewProjCbv.pMappedData, &mSceneUniformData,
@@ -89,20 +376,290 @@ void SceneRenderSystem::UpdateUniformBuffers(RenderContext::Frame &frame) {
   memcpy(skyboxViewProjCbv.pMappedData, &mSkyBoxUniformData,
          sizeof(mSkyBoxUniformData));
   endUpdateResource(&skyboxViewProjCbv);
+  RenderStatsAdd(kRenderCounterUploadedBytes,
+                 sizeof(mSceneUniformData) + sizeof(mSkyBoxUniformData));
 }
 
-void SceneRenderSystem::DrawScene(RenderContext::Frame &frame,
-                                  const Scene &scene) {
+void SceneRenderSystem::BuildDrawList(const Scene &scene) {
+  PROFILER_SET_CPU_SCOPE("Cpu", "Build Draw List", 0xff80c0ff);
+  TRACE_SCOPE("Build Draw List");
+  mDrawList.Clear();
+  if (scene.GetMaterialCount() > kMaxMaterialCount &&
+      mTruncatedMaterialSceneId != scene.GetId()) {
+    mTruncatedMaterialSceneId = scene.GetId();
+    LOGF(eWARNING,
+         "Scene has %u materials, those past %u are drawn with the first one",
+         scene.GetMaterialCount(), kMaxMaterialCount);
+  }
+  for (uint32_t i = 0; i < scene.GetSubMeshCount(); ++i) {
+    const SceneSubMesh &subMesh = scene.GetSubMesh(i);
+    // Streamed submeshes whose chunk isn't resident.
+    if (subMesh.mIndexCount == 0) {
+      continue;
+    }
+    uint32_t materialIndex = subMesh.mMaterialIndex < kMaxMaterialCount
+                                 ? subMesh.mMaterialIndex
+                                 : 0;
+    vec3 boundsMin, boundsMax;
+    scene.GetSubMeshBounds(i, boundsMin, boundsMax);
+    vec3 center = (boundsMin + boundsMax) * 0.5f;
+    float viewDepth = (mSceneViewMat * vec4(center, 1.0f)).getZ();
+    // Draw keys hold the vertex features, as the shading features are the
+    // same for every draw.
+    uint32_t pipeline = 0;
+    if (subMesh.mSkinned && scene.GetSkinBuffer() != NULL) {
+      pipeline |= kSceneShaderSkinned;
+    }
+    if (scene.GetTangentBuffer() != NULL) {
+      pipeline |= kSceneShaderTangents;
+    }
+    // Each material owns its descriptor set, so both fields coincide for now.
+    mDrawList.Add(
+        DrawKey::Make(pipeline, materialIndex, materialIndex, viewDepth), i);
+  }
+  mDrawList.Sort();
+  mDrawListStats = mDrawList.ComputeStats();
+  RenderStatsAdd(kRenderCounterMaterialChanges,
+                 mDrawListStats.mMaterialChanges);
+  RenderStatsAdd(kRenderCounterDrawListSortUSec,
+                 (uint64_t)(mDrawListStats.mSortMs * 1000.0f));
+}
+
+void SceneRenderSystem::DrawScene(RenderContext &renderContext,
+                                  RenderContext::Frame &frame,
+                                  const Scene &scene,
+                                  const GeometryPool &geometryPool,
+                                  const DrawList &drawList) {
   Cmd *cmd = frame.mCmdRingElement.pCmds[0];
-  cmdSetViewport(cmd, 0.0f, 0.0f, (float)frame.pImage->mWidth,
-                 (float)frame.pImage->mHeight, 0.0f, 1.0f);
-  cmdBindPipeline(cmd, pScenePipeline);
+  if (drawList.GetCount() == 0) {
+    return;
+  }
+
+  cmdSetViewport(cmd, 0.0f, 0.0f, (float)frame.mSceneWidth,
+                 (float)frame.mSceneHeight, 0.0f, 1.0f);
+  cmdBindIndexBuffer(cmd, scene.GetIndexBuffer(), scene.GetIndexType(), 0);
+
+  // Counted locally and added once, so the loop stays free of stats calls.
+  uint32_t pipelineBinds = 0;
+  uint32_t descriptorBinds = 0;
+  uint64_t indexCount = 0;
+  uint64_t previousKey = ~0ull;
+  uint32_t previousNode = ~0u;
+  for (uint32_t i = 0; i < drawList.GetCount(); ++i) {
+    uint64_t key = drawList.GetKey(i);
+    const SceneSubMesh &subMesh = scene.GetSubMesh(drawList.GetPayload(i));
+    uint32_t pipeline = DrawKey::GetPipeline(key);
+    uint32_t descriptorSet = DrawKey::GetDescriptorSet(key);
+    uint32_t materialIndex = DrawKey::GetMaterial(key);
+    bool nodeChanged = subMesh.mNode != previousNode;
+    if (pipeline != DrawKey::GetPipeline(previousKey)) {
+      cmdBindPipeline(cmd, GetScenePipeline(renderContext,
+                                            pipeline | mShadingFeatures));
+      if (pipeline == 0) {
+        cmdBindVertexBuffer(cmd, scene.GetVertexBufferCount(),
+                            const_cast<Buffer **>(scene.GetVertexBuffers()),
+                            &kSceneVertexLayout.mBindings[0].mStride, nullptr);
+      } else {
+        // Skin and tangent buffers follow the vertices, in this order.
+        const VertexLayout &layout = *kSceneVertexLayouts[pipeline];
+        Buffer *vertexBuffers[3] = {scene.GetVertexBuffers()[0]};
+        uint32_t strides[3] = {layout.mBindings[0].mStride};
+        uint32_t bindingCount = 1;
+        if (pipeline & kSceneShaderSkinned) {
+          vertexBuffers[bindingCount] = scene.GetSkinBuffer();
+          strides[bindingCount] = layout.mBindings[bindingCount].mStride;
+          bindingCount++;
+        }
+        if (pipeline & kSceneShaderTangents) {
+          vertexBuffers[bindingCount] = scene.GetTangentBuffer();
+          strides[bindingCount] = layout.mBindings[bindingCount].mStride;
+          bindingCount++;
+        }
+        cmdBindVertexBuffer(cmd, bindingCount, vertexBuffers, strides,
+                            nullptr);
+      }
+      cmdBindDescriptorSet(cmd, frame.index * 2 + 1, pDescriptorSetUniforms);
+      pipelineBinds++;
+      descriptorBinds++;
+      // Other state is rebound after a pipeline change.
+      previousKey = ~0ull;
+    }
+    if (descriptorSet != DrawKey::GetDescriptorSet(previousKey)) {
+      cmdBindDescriptorSet(cmd, frame.index * kMaxMaterialCount + descriptorSet,
+                           pDescriptorSetMaterials);
+      descriptorBinds++;
+    }
+    if (materialIndex != DrawKey::GetMaterial(previousKey) || nodeChanged) {
+      const SceneMaterial &material = scene.GetMaterial(materialIndex);
+      MaterialRootConstant rootConstant = {material.mDiffuseColor,
+                                           subMesh.mNode, material.mMetallic,
+                                           material.mRoughness, 0};
+      cmdBindPushConstants(cmd, pRootSignature, mMaterialRootConstantIndex,
+                           &rootConstant);
+      previousNode = subMesh.mNode;
+    }
+    // Pool offsets are read here, as compaction may have moved them since
+    // the submeshes were set up.
+    cmdDrawIndexed(
+        cmd, subMesh.mIndexCount,
+        geometryPool.GetFirstIndex(subMesh.mGeometry) + subMesh.mIndexOffset,
+        geometryPool.GetFirstVertex(subMesh.mGeometry) + subMesh.mVertexOffset);
+    indexCount += subMesh.mIndexCount;
+    previousKey = key;
+  }
+  RenderStatsAdd(kRenderCounterDrawCalls, drawList.GetCount());
+  RenderStatsAdd(kRenderCounterTriangles, indexCount / 3);
+  RenderStatsAdd(kRenderCounterVertices, indexCount);
+  RenderStatsAdd(kRenderCounterPipelineBinds, pipelineBinds);
+  RenderStatsAdd(kRenderCounterDescriptorBinds, descriptorBinds);
+}
+
+void SceneRenderSystem::UpdateGeometryDescriptors(RenderContext &renderContext,
+                                                  RenderContext::Frame &frame,
+                                                  const Scene &scene) {
+  // This frame's previous submission has completed by now, and nothing
+  // bound the descriptors since.
+  if (mGeometrySceneId[frame.index] == scene.GetId()) {
+    return;
+  }
+  mGeometrySceneId[frame.index] = scene.GetId();
+  Buffer *pBuffers[3] = {scene.GetVertexBuffers()[0], scene.GetIndexBuffer(),
+                         scene.GetTangentBuffer() ? scene.GetTangentBuffer()
+                                                  : pEmptyTangentBuffer};
+  const char *const pNames[3] = {"SceneVertices", "SceneIndices",
+                                 "SceneTangents"};
+  DescriptorData params[3] = {};
+  uint32_t paramCount = 0;
+  for (uint32_t i = 0; i < 3; ++i) {
+    if (pBuffers[i] != NULL) {
+      params[paramCount].pName = pNames[i];
+      params[paramCount].ppBuffers = &pBuffers[i];
+      paramCount++;
+    }
+  }
+  renderContext.UpdateDescriptorSet(pDescriptorSetUniforms,
+                                    frame.index * 2 + 1, paramCount, params);
+}
+
+void SceneRenderSystem::DrawVisibilityBuffer(RenderContext &renderContext,
+                                             RenderContext::Frame &frame,
+                                             const Scene &scene,
+                                             const GeometryPool &geometryPool,
+                                             ProfileToken gpuProfileToken) {
+  Cmd *cmd = frame.mCmdRingElement.pCmds[0];
+
+  renderContext.BeginGpuScope(cmd, gpuProfileToken, "Visibility Pass");
+  cmdBindRenderTargets(cmd, NULL);
+  RenderTargetBarrier barrier = {frame.pVisibilityBuffer,
+                                 RESOURCE_STATE_SHADER_RESOURCE,
+                                 RESOURCE_STATE_RENDER_TARGET};
+  cmdResourceBarrier(cmd, 0, NULL, 0, NULL, 1, &barrier);
+  // The depth buffer was cleared with the scene color.
+  BindRenderTargetsDesc bindRenderTargets = {};
+  bindRenderTargets.mRenderTargetCount = 1;
+  bindRenderTargets.mRenderTargets[0] = {frame.pVisibilityBuffer,
+                                         LOAD_ACTION_CLEAR};
+  bindRenderTargets.mDepthStencil = {frame.pDepthBuffer, LOAD_ACTION_LOAD};
+  cmdBindRenderTargets(cmd, &bindRenderTargets);
+  cmdSetViewport(cmd, 0.0f, 0.0f, (float)frame.mSceneWidth,
+                 (float)frame.mSceneHeight, 0.0f, 1.0f);
+  cmdSetScissor(cmd, 0, 0, frame.mSceneWidth, frame.mSceneHeight);
+
+  cmdBindPipeline(cmd, pVisibilityPipeline);
+  cmdBindIndexBuffer(cmd, scene.GetIndexBuffer(), INDEX_TYPE_UINT32, 0);
+  cmdBindVertexBuffer(cmd, 1, const_cast<Buffer **>(scene.GetVertexBuffers()),
+                      &kVisibilityVertexLayout.mBindings[0].mStride, nullptr);
   cmdBindDescriptorSet(cmd, frame.index * 2 + 1, pDescriptorSetUniforms);
-  cmdBindVertexBuffer(cmd, scene.GetVertexBufferCount(),
-                      const_cast<Buffer **>(scene.GetVertexBuffers()),
-                      &kSceneVertexLayout.mBindings[0].mStride, nullptr);
-  cmdBindIndexBuffer(cmd, scene.GetIndexBuffer(), INDEX_TYPE_UINT16, 0);
-  cmdDrawIndexed(cmd, scene.GetIndexCount(), 0, 0);
+
+  // Written while recording, as pool offsets may have moved since the
+  // previous frame, see DrawScene. This frame's slot is no longer read.
+  BufferUpdateDesc drawUpdate = {pVisibilityDrawBuffer[frame.index]};
+  beginUpdateResource(&drawUpdate);
+  VisibilityDraw *pDraws =
+      reinterpret_cast<VisibilityDraw *>(drawUpdate.pMappedData);
+  mForwardDrawList.Clear();
+  uint32_t drawCount = 0;
+  uint64_t indexCount = 0;
+  for (uint32_t i = 0; i < mDrawList.GetCount(); ++i) {
+    uint64_t key = mDrawList.GetKey(i);
+    const SceneSubMesh &subMesh = scene.GetSubMesh(mDrawList.GetPayload(i));
+    uint32_t triangleCount = subMesh.mIndexCount / 3;
+    uint32_t chunkCount = (triangleCount + kMaxVisibilityTriangleCount - 1) /
+                          kMaxVisibilityTriangleCount;
+    if ((DrawKey::GetPipeline(key) & kSceneShaderSkinned) ||
+        drawCount + chunkCount > kMaxVisibilityDrawCount) {
+      mForwardDrawList.Add(key, mDrawList.GetPayload(i));
+      continue;
+    }
+    uint32_t firstIndex =
+        geometryPool.GetFirstIndex(subMesh.mGeometry) + subMesh.mIndexOffset;
+    uint32_t baseVertex =
+        geometryPool.GetFirstVertex(subMesh.mGeometry) + subMesh.mVertexOffset;
+    for (uint32_t chunk = 0; chunk < chunkCount; ++chunk) {
+      uint32_t chunkFirstIndex = chunk * kMaxVisibilityTriangleCount * 3;
+      uint32_t chunkIndexCount = min(subMesh.mIndexCount - chunkFirstIndex,
+                                     kMaxVisibilityTriangleCount * 3);
+      pDraws[drawCount] = {firstIndex + chunkFirstIndex, baseVertex,
+                           subMesh.mNode, DrawKey::GetMaterial(key)};
+      // Only the node and the draw index are read.
+      MaterialRootConstant rootConstant = {};
+      rootConstant.mNode = subMesh.mNode;
+      rootConstant.mDrawIndex = drawCount;
+      cmdBindPushConstants(cmd, pRootSignature, mMaterialRootConstantIndex,
+                           &rootConstant);
+      cmdDrawIndexed(cmd, chunkIndexCount, firstIndex + chunkFirstIndex,
+                     baseVertex);
+      drawCount++;
+    }
+    indexCount += subMesh.mIndexCount;
+  }
+  endUpdateResource(&drawUpdate);
+  RenderStatsAdd(kRenderCounterUploadedBytes,
+                 drawCount * sizeof(VisibilityDraw));
+  RenderStatsAdd(kRenderCounterDrawCalls, drawCount);
+  RenderStatsAdd(kRenderCounterTriangles, indexCount / 3);
+  RenderStatsAdd(kRenderCounterVertices, indexCount);
+  RenderStatsAdd(kRenderCounterPipelineBinds, 1);
+  RenderStatsAdd(kRenderCounterDescriptorBinds, 1);
+
+  cmdBindRenderTargets(cmd, NULL);
+  barrier = {frame.pVisibilityBuffer, RESOURCE_STATE_RENDER_TARGET,
+             RESOURCE_STATE_SHADER_RESOURCE};
+  cmdResourceBarrier(cmd, 0, NULL, 0, NULL, 1, &barrier);
+  renderContext.EndGpuScope(cmd, gpuProfileToken);
+
+  // Pixels no triangle covered are discarded, and keep the sky box.
+  renderContext.BeginGpuScope(cmd, gpuProfileToken, "Visibility Resolve");
+  bindRenderTargets = {};
+  bindRenderTargets.mRenderTargetCount = 1;
+  bindRenderTargets.mRenderTargets[0] = {frame.pSceneColor, LOAD_ACTION_LOAD};
+  cmdBindRenderTargets(cmd, &bindRenderTargets);
+  cmdSetViewport(cmd, 0.0f, 0.0f, (float)frame.mSceneWidth,
+                 (float)frame.mSceneHeight, 0.0f, 1.0f);
+  cmdSetScissor(cmd, 0, 0, frame.mSceneWidth, frame.mSceneHeight);
+  uint32_t variant =
+      mShadingFeatures |
+      (scene.GetTangentBuffer() != NULL ? kSceneShaderTangents : 0);
+  cmdBindPipeline(cmd, GetResolvePipeline(renderContext, variant));
+  cmdBindDescriptorSet(cmd, 0, pDescriptorSetTexture);
+  cmdBindDescriptorSet(cmd, frame.index * 2 + 1, pDescriptorSetUniforms);
+  cmdBindDescriptorSet(cmd, frame.index, pDescriptorSetMaterialArrays);
+  cmdDraw(cmd, 3, 0);
+  RenderStatsAdd(kRenderCounterDrawCalls, 1);
+  RenderStatsAdd(kRenderCounterTriangles, 1);
+  RenderStatsAdd(kRenderCounterVertices, 3);
+  RenderStatsAdd(kRenderCounterPipelineBinds, 1);
+  RenderStatsAdd(kRenderCounterDescriptorBinds, 3);
+  renderContext.EndGpuScope(cmd, gpuProfileToken);
+
+  if (mForwardDrawList.GetCount() == 0) {
+    return;
+  }
+  renderContext.BeginGpuScope(cmd, gpuProfileToken, "Draw Scene");
+  bindRenderTargets.mDepthStencil = {frame.pDepthBuffer, LOAD_ACTION_LOAD};
+  cmdBindRenderTargets(cmd, &bindRenderTargets);
+  DrawScene(renderContext, frame, scene, geometryPool, mForwardDrawList);
+  renderContext.EndGpuScope(cmd, gpuProfileToken);
 }
 
 void SceneRenderSystem::DrawSkyBox(RenderContext::Frame &frame,
@@ -110,14 +667,19 @@ void SceneRenderSystem::DrawSkyBox(RenderContext::Frame &frame,
   Cmd *cmd = frame.mCmdRingElement.pCmds[0];
   const uint32_t skyboxVbStride = sizeof(float) * 4;
 
-  cmdSetViewport(cmd, 0.0f, 0.0f, (float)frame.pImage->mWidth,
-                 (float)frame.pImage->mHeight, 1.0f, 1.0f);
+  cmdSetViewport(cmd, 0.0f, 0.0f, (float)frame.mSceneWidth,
+                 (float)frame.mSceneHeight, 1.0f, 1.0f);
   cmdBindPipeline(cmd, pSkyBoxDrawPipeline);
   cmdBindDescriptorSet(cmd, 0, pDescriptorSetTexture);
   cmdBindDescriptorSet(cmd, frame.index * 2 + 0, pDescriptorSetUniforms);
   cmdBindVertexBuffer(cmd, 1, const_cast<Buffer **>(&skyBox.GetVertexBuffer()),
                       &skyboxVbStride, NULL);
   cmdDraw(cmd, 36, 0);
+  RenderStatsAdd(kRenderCounterDrawCalls, 1);
+  RenderStatsAdd(kRenderCounterTriangles, 12);
+  RenderStatsAdd(kRenderCounterVertices, 36);
+  RenderStatsAdd(kRenderCounterPipelineBinds, 1);
+  RenderStatsAdd(kRenderCounterDescriptorBinds, 2);
 }
 
 void SceneRenderSystem::AddDescriptorSets(RenderContext &renderContext) {
@@ -126,51 +688,121 @@ void SceneRenderSystem::AddDescriptorSets(RenderContext &renderContext) {
   desc = {pRootSignature, DESCRIPTOR_UPDATE_FREQ_PER_FRAME,
           RenderContext::kDataBufferCount * 2};
   pDescriptorSetUniforms = renderContext.CreateDescriptorSet(&desc);
+  desc = {pRootSignature, DESCRIPTOR_UPDATE_FREQ_PER_BATCH,
+          RenderContext::kDataBufferCount * kMaxMaterialCount};
+  pDescriptorSetMaterials = renderContext.CreateDescriptorSet(&desc);
+  desc = {pRootSignature, DESCRIPTOR_UPDATE_FREQ_PER_DRAW,
+          RenderContext::kDataBufferCount};
+  pDescriptorSetMaterialArrays = renderContext.CreateDescriptorSet(&desc);
+  for (uint32_t i = 0; i < RenderContext::kDataBufferCount; ++i) {
+    mMaterialSceneId[i] = 0;
+    mGeometrySceneId[i] = 0;
+  }
 }
 
 void SceneRenderSystem::RemoveDescriptorSets(RenderContext &renderContext) {
-  renderContext.DestroyDescriptorSet(pDescriptorSetTexture);
-  renderContext.DestroyDescriptorSet(pDescriptorSetUniforms);
+  renderContext.DeferDestroy(pDescriptorSetTexture);
+  renderContext.DeferDestroy(pDescriptorSetUniforms);
+  renderContext.DeferDestroy(pDescriptorSetMaterials);
+  renderContext.DeferDestroy(pDescriptorSetMaterialArrays);
 }
 
 void SceneRenderSystem::AddRootSignatures(RenderContext &renderContext) {
-  Shader *shaders[2];
+  Shader *shaders[kSceneShaderVariantCount * 2 + 2];
   uint32_t shadersCount = 0;
-  shaders[shadersCount++] = pSceneShader;
+  for (uint32_t variant = 0; variant < kSceneShaderVariantCount; ++variant) {
+    shaders[shadersCount++] = pSceneShaders[variant];
+    if (pResolveShaders[variant] != NULL) {
+      shaders[shadersCount++] = pResolveShaders[variant];
+    }
+  }
   shaders[shadersCount++] = pSkyBoxDrawShader;
+  shaders[shadersCount++] = pVisibilityShader;
 
   RootSignatureDesc rootDesc = {};
   rootDesc.mShaderCount = shadersCount;
   rootDesc.ppShaders = shaders;
   pRootSignature = renderContext.CreateRootSignature(&rootDesc);
+  mMaterialRootConstantIndex =
+      getDescriptorIndexFromName(pRootSignature, "materialRootConstant");
 }
 
 void SceneRenderSystem::RemoveRootSignatures(RenderContext &renderContext) {
   renderContext.DestroyRootSignature(pRootSignature);
 }
 
+void SceneRenderSystem::GetSceneShaderFileNames(uint32_t variant,
+                                                char *pVertName,
+                                                char *pFragName, size_t size) {
+  bool tangents = (variant & kSceneShaderTangents) != 0;
+  snprintf(pVertName, size, "basic%s%s.vert",
+           (variant & kSceneShaderSkinned) ? "_skinned" : "",
+           tangents ? "_tangents" : "");
+  snprintf(pFragName, size, "basic%s%s%s.frag", tangents ? "_tangents" : "",
+           (variant & kSceneShaderPbr) ? "_pbr" : "",
+           (variant & kSceneShaderHeatmap) ? "_heatmap" : "");
+}
+
+void SceneRenderSystem::GetResolveShaderFileName(uint32_t variant,
+                                                 char *pFragName, size_t size) {
+  snprintf(pFragName, size, "visibility_resolve%s%s%s.frag",
+           (variant & kSceneShaderTangents) ? "_tangents" : "",
+           (variant & kSceneShaderPbr) ? "_pbr" : "",
+           (variant & kSceneShaderHeatmap) ? "_heatmap" : "");
+}
+
 void SceneRenderSystem::AddShaders(RenderContext &renderContext) {
   ShaderLoadDesc skyShader = {};
   skyShader.mVert.pFileName = "skybox.vert";
   skyShader.mFrag.pFileName = "skybox.frag";
+  pSkyBoxDrawShader = renderContext.LoadShader(&skyShader);
 
-  ShaderLoadDesc basicShader = {};
-  basicShader.mVert.pFileName = "basic.vert";
-  basicShader.mFrag.pFileName = "basic.frag";
+  for (uint32_t variant = 0; variant < kSceneShaderVariantCount; ++variant) {
+    char vertName[64];
+    char fragName[64];
+    GetSceneShaderFileNames(variant, vertName, fragName, sizeof(vertName));
+    ShaderLoadDesc sceneShader = {};
+    sceneShader.mVert.pFileName = vertName;
+    sceneShader.mFrag.pFileName = fragName;
+    pSceneShaders[variant] = renderContext.LoadShader(&sceneShader);
+  }
 
-  pSkyBoxDrawShader = renderContext.LoadShader(&skyShader);
-  pSceneShader = renderContext.LoadShader(&basicShader);
+  ShaderLoadDesc visibilityShader = {};
+  visibilityShader.mVert.pFileName = "visibility.vert";
+  visibilityShader.mFrag.pFileName = "visibility.frag";
+  pVisibilityShader = renderContext.LoadShader(&visibilityShader);
+
+  for (uint32_t variant = 0; variant < kSceneShaderVariantCount; ++variant) {
+    if (variant & kSceneShaderSkinned) {
+      continue;
+    }
+    char fragName[64];
+    GetResolveShaderFileName(variant, fragName, sizeof(fragName));
+    ShaderLoadDesc resolveShader = {};
+    resolveShader.mVert.pFileName = "visibility_resolve.vert";
+    resolveShader.mFrag.pFileName = fragName;
+    pResolveShaders[variant] = renderContext.LoadShader(&resolveShader);
+  }
 }
 
 void SceneRenderSystem::RemoveShaders(RenderContext &renderContext) {
-  renderContext.DestroyShader(pSceneShader);
+  for (uint32_t variant = 0; variant < kSceneShaderVariantCount; ++variant) {
+    renderContext.DestroyShader(pSceneShaders[variant]);
+    if (pResolveShaders[variant] != NULL) {
+      renderContext.DestroyShader(pResolveShaders[variant]);
+      pResolveShaders[variant] = NULL;
+    }
+  }
   renderContext.DestroyShader(pSkyBoxDrawShader);
+  renderContext.DestroyShader(pVisibilityShader);
 }
 
-void SceneRenderSystem::AddPipelines(RenderContext &renderContext) {
-  RasterizerStateDesc rasterizerStateDesc = {};
-  rasterizerStateDesc.mCullMode = CULL_MODE_NONE;
-
+Pipeline *SceneRenderSystem::GetScenePipeline(RenderContext &renderContext,
+                                              uint32_t variant) {
+  if (pScenePipelines[variant] != NULL) {
+    return pScenePipelines[variant];
+  }
+  int64_t start = getUSec(false);
   RasterizerStateDesc sceneRasterizerStateDesc = {};
   sceneRasterizerStateDesc.mCullMode = CULL_MODE_NONE;
 
@@ -179,24 +811,81 @@ void SceneRenderSystem::AddPipelines(RenderContext &renderContext) {
   depthStateDesc.mDepthWrite = true;
   depthStateDesc.mDepthFunc = CMP_GEQUAL;
 
-  TinyImageFormat swapChainFormat = renderContext.GetSwapChainFormat();
+  TinyImageFormat sceneColorFormat = renderContext.GetSceneColorFormat();
   PipelineDesc desc = {};
   desc.mType = PIPELINE_TYPE_GRAPHICS;
   GraphicsPipelineDesc &pipelineSettings = desc.mGraphicsDesc;
   pipelineSettings.mPrimitiveTopo = PRIMITIVE_TOPO_TRI_LIST;
   pipelineSettings.mRenderTargetCount = 1;
   pipelineSettings.pDepthState = &depthStateDesc;
-  pipelineSettings.pColorFormats = &swapChainFormat;
+  pipelineSettings.pColorFormats = &sceneColorFormat;
   pipelineSettings.mSampleCount = renderContext.GetSwapChainSampleCount();
   pipelineSettings.mSampleQuality = renderContext.GetSwapChainSampleQuality();
   pipelineSettings.mDepthStencilFormat = renderContext.GetDepthFormat();
   pipelineSettings.pRootSignature = pRootSignature;
-  pipelineSettings.pShaderProgram = pSceneShader;
-  pipelineSettings.pVertexLayout =
-      const_cast<VertexLayout *>(&kSceneVertexLayout);
+  pipelineSettings.pShaderProgram = pSceneShaders[variant];
+  pipelineSettings.pVertexLayout = const_cast<VertexLayout *>(
+      kSceneVertexLayouts[variant & kSceneShaderVertexFeatures]);
   pipelineSettings.pRasterizerState = &sceneRasterizerStateDesc;
   pipelineSettings.mVRFoveatedRendering = true;
-  pScenePipeline = renderContext.CreatePipeline(&desc);
+  pScenePipelines[variant] = renderContext.CreatePipeline(&desc);
+
+  char vertName[64];
+  char fragName[64];
+  GetSceneShaderFileNames(variant, vertName, fragName, sizeof(vertName));
+  LOGF(eINFO, "Created the scene pipeline for %s and %s in %.1f ms", vertName,
+       fragName, (double)(getUSec(false) - start) / 1000.0);
+  return pScenePipelines[variant];
+}
+
+Pipeline *SceneRenderSystem::GetResolvePipeline(RenderContext &renderContext,
+                                                uint32_t variant) {
+  if (pResolvePipelines[variant] != NULL) {
+    return pResolvePipelines[variant];
+  }
+  int64_t start = getUSec(false);
+  RasterizerStateDesc rasterizerStateDesc = {};
+  rasterizerStateDesc.mCullMode = CULL_MODE_NONE;
+
+  TinyImageFormat sceneColorFormat = renderContext.GetSceneColorFormat();
+  PipelineDesc desc = {};
+  desc.mType = PIPELINE_TYPE_GRAPHICS;
+  GraphicsPipelineDesc &pipelineSettings = desc.mGraphicsDesc;
+  pipelineSettings.mPrimitiveTopo = PRIMITIVE_TOPO_TRI_LIST;
+  pipelineSettings.mRenderTargetCount = 1;
+  pipelineSettings.pColorFormats = &sceneColorFormat;
+  pipelineSettings.mSampleCount = SAMPLE_COUNT_1;
+  pipelineSettings.mSampleQuality = 0;
+  pipelineSettings.mDepthStencilFormat = TinyImageFormat_UNDEFINED;
+  pipelineSettings.pRootSignature = pRootSignature;
+  pipelineSettings.pShaderProgram = pResolveShaders[variant];
+  pipelineSettings.pVertexLayout = NULL;
+  pipelineSettings.pRasterizerState = &rasterizerStateDesc;
+  pResolvePipelines[variant] = renderContext.CreatePipeline(&desc);
+
+  char fragName[64];
+  GetResolveShaderFileName(variant, fragName, sizeof(fragName));
+  LOGF(eINFO, "Created the resolve pipeline for %s in %.1f ms", fragName,
+       (double)(getUSec(false) - start) / 1000.0);
+  return pResolvePipelines[variant];
+}
+
+void SceneRenderSystem::AddPipelines(RenderContext &renderContext) {
+  RasterizerStateDesc rasterizerStateDesc = {};
+  rasterizerStateDesc.mCullMode = CULL_MODE_NONE;
+
+  TinyImageFormat sceneColorFormat = renderContext.GetSceneColorFormat();
+  PipelineDesc desc = {};
+  desc.mType = PIPELINE_TYPE_GRAPHICS;
+  GraphicsPipelineDesc &pipelineSettings = desc.mGraphicsDesc;
+  pipelineSettings.mPrimitiveTopo = PRIMITIVE_TOPO_TRI_LIST;
+  pipelineSettings.mRenderTargetCount = 1;
+  pipelineSettings.pColorFormats = &sceneColorFormat;
+  pipelineSettings.mSampleCount = renderContext.GetSwapChainSampleCount();
+  pipelineSettings.mSampleQuality = renderContext.GetSwapChainSampleQuality();
+  pipelineSettings.mDepthStencilFormat = renderContext.GetDepthFormat();
+  pipelineSettings.pRootSignature = pRootSignature;
+  pipelineSettings.mVRFoveatedRendering = true;
 
   // layout and pipeline for skybox draw
   VertexLayout vertexLayout = {};
@@ -212,18 +901,43 @@ void SceneRenderSystem::AddPipelines(RenderContext &renderContext) {
 
   pipelineSettings.pDepthState = NULL;
   pipelineSettings.pRasterizerState = &rasterizerStateDesc;
-  pipelineSettings.pShaderProgram = pSkyBoxDrawShader; //-V519
+  pipelineSettings.pShaderProgram = pSkyBoxDrawShader;
   pSkyBoxDrawPipeline = renderContext.CreatePipeline(&desc);
+
+  DepthStateDesc depthStateDesc = {};
+  depthStateDesc.mDepthTest = true;
+  depthStateDesc.mDepthWrite = true;
+  depthStateDesc.mDepthFunc = CMP_GEQUAL;
+  TinyImageFormat visibilityFormat =
+      renderContext.GetVisibilityBuffer()->mFormat;
+  pipelineSettings.pColorFormats = &visibilityFormat;
+  pipelineSettings.pDepthState = &depthStateDesc;
+  pipelineSettings.pVertexLayout =
+      const_cast<VertexLayout *>(&kVisibilityVertexLayout);
+  pipelineSettings.pShaderProgram = pVisibilityShader;
+  pVisibilityPipeline = renderContext.CreatePipeline(&desc);
+  // Scene and resolve pipelines are created when first drawn, see
+  // GetScenePipeline.
 }
 
 void SceneRenderSystem::RemovePipelines(RenderContext &renderContext) {
-  renderContext.DestroyPipeline(pSkyBoxDrawPipeline);
-  renderContext.DestroyPipeline(pScenePipeline);
+  renderContext.DeferDestroy(pSkyBoxDrawPipeline);
+  renderContext.DeferDestroy(pVisibilityPipeline);
+  for (uint32_t variant = 0; variant < kSceneShaderVariantCount; ++variant) {
+    if (pScenePipelines[variant] != NULL) {
+      renderContext.DeferDestroy(pScenePipelines[variant]);
+      pScenePipelines[variant] = NULL;
+    }
+    if (pResolvePipelines[variant] != NULL) {
+      renderContext.DeferDestroy(pResolvePipelines[variant]);
+      pResolvePipelines[variant] = NULL;
+    }
+  }
 }
 
 void SceneRenderSystem::PrepareDescriptorSets(RenderContext &renderContext,
                                               const SkyBox &skyBox) {
-  DescriptorData params[7] = {};
+  DescriptorData params[12] = {};
 
   params[0].pName = "RightText";
   params[1].pName = "LeftText";
@@ -237,7 +951,18 @@ void SceneRenderSystem::PrepareDescriptorSets(RenderContext &renderContext,
 
   params[6].pName = "uSampler0";
   params[6].ppSamplers = const_cast<Sampler **>(&skyBox.GetSampler());
-  renderContext.UpdateDescriptorSet(pDescriptorSetTexture, 0, 7, params);
+  params[7].pName = "uMaterialSampler";
+  params[7].ppSamplers = &pMaterialSampler;
+  params[8].pName = "SpecularMap";
+  params[8].ppTextures = const_cast<Texture **>(&skyBox.GetSpecularTexture());
+  params[9].pName = "BrdfLut";
+  params[9].ppTextures = const_cast<Texture **>(&skyBox.GetBrdfLutTexture());
+  params[10].pName = "uLightingSampler";
+  params[10].ppSamplers =
+      const_cast<Sampler **>(&skyBox.GetLightingSampler());
+  params[11].pName = "VisibilityBuffer";
+  params[11].ppTextures = &renderContext.GetVisibilityBuffer()->pTexture;
+  renderContext.UpdateDescriptorSet(pDescriptorSetTexture, 0, 12, params);
 
   for (uint32_t i = 0; i < RenderContext::kDataBufferCount; ++i) {
     DescriptorData uParams[1] = {};
@@ -246,9 +971,24 @@ void SceneRenderSystem::PrepareDescriptorSets(RenderContext &renderContext,
     renderContext.UpdateDescriptorSet(pDescriptorSetUniforms, i * 2 + 0, 1,
                                       uParams);
 
-    uParams[0].pName = "uniformBlock";
-    uParams[0].ppBuffers = &pSceneUniformBuffer[i];
-    renderContext.UpdateDescriptorSet(pDescriptorSetUniforms, i * 2 + 1, 1,
-                                      uParams);
+    DescriptorData sceneParams[8] = {};
+    sceneParams[0].pName = "uniformBlock";
+    sceneParams[0].ppBuffers = &pSceneUniformBuffer[i];
+    sceneParams[1].pName = "Lights";
+    sceneParams[1].ppBuffers = &pLightBuffer[i];
+    sceneParams[2].pName = "ClusterRanges";
+    sceneParams[2].ppBuffers = &pClusterRangeBuffer[i];
+    sceneParams[3].pName = "LightIndices";
+    sceneParams[3].ppBuffers = &pLightIndexBuffer[i];
+    sceneParams[4].pName = "SkinningMatrices";
+    sceneParams[4].ppBuffers = &pSkinningBuffer[i];
+    sceneParams[5].pName = "NodeMatrices";
+    sceneParams[5].ppBuffers = &pNodeBuffer[i];
+    sceneParams[6].pName = "Materials";
+    sceneParams[6].ppBuffers = &pMaterialBuffer[i];
+    sceneParams[7].pName = "VisibilityDraws";
+    sceneParams[7].ppBuffers = &pVisibilityDrawBuffer[i];
+    renderContext.UpdateDescriptorSet(pDescriptorSetUniforms, i * 2 + 1, 8,
+                                      sceneParams);
   }
 }
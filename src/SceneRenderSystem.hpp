@@ -8,9 +8,12 @@
 #include "Utilities/Math/MathTypes.h"
 #include "Utilities/RingBuffer.h"
 
+#include "ClusteredLighting.hpp"
+#include "DrawList.hpp"
 #include "RenderContext.hpp"
 #include "Scene.hpp"
 #include "SkyBox.hpp"
+#include "TextureStreamer.hpp"
 
 static const VertexLayout kSceneVertexLayout = {
     {
@@ -29,8 +32,80 @@ static const VertexLayout kSceneVertexLayout = {
     3,
 };
 
+/// \c kSceneVertexLayout, plus the scene's skin buffer in a second binding.
+static const VertexLayout kSkinnedSceneVertexLayout = {
+    {
+        {sizeof(float3) + sizeof(uint32_t) + sizeof(float),
+         VERTEX_BINDING_RATE_VERTEX},
+        {sizeof(SceneSkinVertex), VERTEX_BINDING_RATE_VERTEX},
+    },
+    {
+        {SEMANTIC_POSITION, 0, "vPosition", TinyImageFormat_R32G32B32_SFLOAT, 0,
+         0, 0},
+        {SEMANTIC_NORMAL, 0, "vNormal", TinyImageFormat_R32_UINT, 0, 1,
+         sizeof(float3)},
+        {SEMANTIC_TEXCOORD0, 0, "vUV", TinyImageFormat_R16G16_SFLOAT, 0, 2,
+         sizeof(float3) + sizeof(uint32_t)},
+        {SEMANTIC_JOINTS, 0, "vJoints", TinyImageFormat_R8G8B8A8_UINT, 1, 3, 0},
+        {SEMANTIC_WEIGHTS, 0, "vWeights", TinyImageFormat_R8G8B8A8_UNORM, 1, 4,
+         4 * sizeof(uint8_t)},
+    },
+    2,
+    5,
+};
+
+/// \c kSceneVertexLayout, plus the scene's tangent buffer in a second
+/// binding.
+static const VertexLayout kTangentSceneVertexLayout = {
+    {
+        {sizeof(float3) + sizeof(uint32_t) + sizeof(float),
+         VERTEX_BINDING_RATE_VERTEX},
+        {sizeof(uint32_t), VERTEX_BINDING_RATE_VERTEX},
+    },
+    {
+        {SEMANTIC_POSITION, 0, "vPosition", TinyImageFormat_R32G32B32_SFLOAT, 0,
+         0, 0},
+        {SEMANTIC_NORMAL, 0, "vNormal", TinyImageFormat_R32_UINT, 0, 1,
+         sizeof(float3)},
+        {SEMANTIC_TEXCOORD0, 0, "vUV", TinyImageFormat_R16G16_SFLOAT, 0, 2,
+         sizeof(float3) + sizeof(uint32_t)},
+        {SEMANTIC_TANGENT, 0, "vTangent", TinyImageFormat_R32_UINT, 1, 3, 0},
+    },
+    2,
+    4,
+};
+
+/// \c kSkinnedSceneVertexLayout, plus the scene's tangent buffer in a third
+/// binding.
+static const VertexLayout kSkinnedTangentSceneVertexLayout = {
+    {
+        {sizeof(float3) + sizeof(uint32_t) + sizeof(float),
+         VERTEX_BINDING_RATE_VERTEX},
+        {sizeof(SceneSkinVertex), VERTEX_BINDING_RATE_VERTEX},
+        {sizeof(uint32_t), VERTEX_BINDING_RATE_VERTEX},
+    },
+    {
+        {SEMANTIC_POSITION, 0, "vPosition", TinyImageFormat_R32G32B32_SFLOAT, 0,
+         0, 0},
+        {SEMANTIC_NORMAL, 0, "vNormal", TinyImageFormat_R32_UINT, 0, 1,
+         sizeof(float3)},
+        {SEMANTIC_TEXCOORD0, 0, "vUV", TinyImageFormat_R16G16_SFLOAT, 0, 2,
+         sizeof(float3) + sizeof(uint32_t)},
+        {SEMANTIC_JOINTS, 0, "vJoints", TinyImageFormat_R8G8B8A8_UINT, 1, 3, 0},
+        {SEMANTIC_WEIGHTS, 0, "vWeights", TinyImageFormat_R8G8B8A8_UNORM, 1, 4,
+         4 * sizeof(uint8_t)},
+        {SEMANTIC_TANGENT, 0, "vTangent", TinyImageFormat_R32_UINT, 2, 5, 0},
+    },
+    3,
+    6,
+};
+
 class SceneRenderSystem {
 public:
+  /// Materials past this count are drawn with the scene's first material,
+  /// which is logged once per scene.
+  static const uint32_t kMaxMaterialCount = 256;
+
   void Init(RenderContext &renderContext);
   void Exit(RenderContext &renderContext);
 
@@ -40,40 +115,200 @@ public:
 
   void UpdateSceneViewProj(mat4 sceneMat, mat4 viewMat, CameraMatrix projMat);
 
-  void Draw(RenderContext::Frame &frame, const Scene &scene,
-            const SkyBox &skyBox, ProfileToken gpuProfileToken);
+  /// Uploads this frame's binned lights. Must run before \c Draw.
+  void UpdateLights(RenderContext::Frame &frame,
+                    const ClusteredLighting &lighting, bool showHeatmap);
+
+  /// Selects Lambert shading, with a flat ambient term, or metallic/roughness
+  /// shading with \c skyBox's image-based lighting, falling back to Lambert
+  /// until the latter is uploaded. Must run before \c Draw.
+  void UpdateShading(const SkyBox &skyBox, bool pbr);
+
+  /// Uploads this frame's skinning matrices, at most
+  /// \c Skeleton::kMaxJointCount. Must run before \c Draw when the scene has
+  /// skinned meshes.
+  void UpdateSkinning(RenderContext::Frame &frame, const mat4 *pMatrices,
+                      uint32_t count);
+
+  /// Uploads the world matrices of the scene's nodes whenever they changed
+  /// since this frame's previous upload. Must run before \c Draw.
+  void UpdateNodes(RenderContext::Frame &frame, const Scene &scene);
+
+  /// Refreshes this frame's material descriptors whenever the texture
+  /// streamer swapped a texture. Must run before \c Draw.
+  void UpdateMaterials(RenderContext &renderContext,
+                       RenderContext::Frame &frame, const Scene &scene,
+                       const TextureStreamer &textureStreamer);
+
+  /// Shades the scene forward or, with \c visibilityBuffer, rasterizes only
+  /// draw and triangle IDs plus depth, then shades each pixel once in a
+  /// full-screen resolve, see \c DrawVisibilityBuffer. Scenes whose geometry
+  /// shaders can't read are always shaded forward.
+  void Draw(RenderContext &renderContext, RenderContext::Frame &frame,
+            const Scene &scene, const SkyBox &skyBox, bool visibilityBuffer,
+            ProfileToken gpuProfileToken);
+
+  inline const DrawListStats &GetDrawListStats() const {
+    return mDrawListStats;
+  }
 
 private:
   RootSignature *pRootSignature = NULL;
 
-  Shader *pSceneShader = NULL;
-  Pipeline *pScenePipeline = NULL;
+  /// Compile-time features of the scene shaders. Each combination is a
+  /// variant in ShaderList.fsl, named after its features in this order, so
+  /// that pixels only pay for the features in use. Vertex features follow
+  /// each draw's vertex format, shading features hold for a whole frame.
+  enum : uint32_t {
+    kSceneShaderSkinned = 1u << 0,
+    kSceneShaderTangents = 1u << 1,
+    kSceneShaderPbr = 1u << 2,
+    kSceneShaderHeatmap = 1u << 3,
+    kSceneShaderVertexFeatures = kSceneShaderSkinned | kSceneShaderTangents,
+    kSceneShaderVariantCount = 1u << 4,
+  };
+
+  /// Every variant is loaded up front, as the root signature is built from
+  /// all of them, but pipelines are only created once a variant is drawn.
+  Shader *pSceneShaders[kSceneShaderVariantCount] = {};
+  Pipeline *pScenePipelines[kSceneShaderVariantCount] = {};
+  uint32_t mShadingFeatures = 0;
 
   Shader *pSkyBoxDrawShader = NULL;
   Pipeline *pSkyBoxDrawPipeline = NULL;
 
+  /// Visibility buffer pixels pack a draw index above the index of a
+  /// triangle within it, see visibility.frag. Larger submeshes are split
+  /// into several draws. The last draw index is left for pixels no triangle
+  /// covered, and draws past it are shaded forward.
+  static const uint32_t kVisibilityTriangleBits = 20;
+  static const uint32_t kMaxVisibilityTriangleCount =
+      1u << kVisibilityTriangleBits;
+  static const uint32_t kMaxVisibilityDrawCount =
+      (1u << (32 - kVisibilityTriangleBits)) - 1;
+
+  Shader *pVisibilityShader = NULL;
+  Pipeline *pVisibilityPipeline = NULL;
+  /// Indexed by variant, like the scene shaders, but skinned variants are
+  /// left empty: skinned draws are always shaded forward, as only the vertex
+  /// shader knows their vertices. Pipelines are also created on first use.
+  Shader *pResolveShaders[kSceneShaderVariantCount] = {};
+  Pipeline *pResolvePipelines[kSceneShaderVariantCount] = {};
+
   DescriptorSet *pDescriptorSetTexture = {NULL};
   DescriptorSet *pDescriptorSetUniforms = {NULL};
+  DescriptorSet *pDescriptorSetMaterials = {NULL};
+  /// Every material's textures in one set per frame, for the resolve.
+  DescriptorSet *pDescriptorSetMaterialArrays = NULL;
+  uint32_t mMaterialRootConstantIndex = 0;
+
+  Sampler *pMaterialSampler = NULL;
+  // Texture streamer generation each frame's material descriptors were
+  // written with.
+  uint32_t mMaterialGeneration[RenderContext::kDataBufferCount] = {};
+  uint32_t mMaterialSceneId[RenderContext::kDataBufferCount] = {};
+  // Scene and hierarchy version each frame's node matrices were written
+  // from.
+  uint32_t mNodeSceneId[RenderContext::kDataBufferCount] = {};
+  uint32_t mNodeVersion[RenderContext::kDataBufferCount] = {};
+  // Last scene whose materials were found past kMaxMaterialCount.
+  uint32_t mTruncatedMaterialSceneId = 0;
+  // Scene whose geometry buffers each frame's descriptors refer to, for the
+  // visibility buffer's resolve.
+  uint32_t mGeometrySceneId[RenderContext::kDataBufferCount] = {};
 
   struct SceneUniformBlock {
     CameraMatrix mModelProjectView;
+    mat4 mModelView;
 
-    vec4 mLightPosition;
-    vec4 mLightColor;
+    vec4 mClusterScale;
+    uint32_t mClusterParams[4];
+    vec4 mAmbientColor;
+    mat4 mViewToWorld;
+    uint32_t mShadingParams[4];
+    vec4 mIrradianceSh[9];
+    vec4 mViewportParams;
   };
 
   struct SkyBoxUniformBlock {
     CameraMatrix mProjectView;
   };
 
+  struct MaterialRootConstant {
+    float4 mDiffuseColor;
+    uint32_t mNode;
+    float mMetallic;
+    float mRoughness;
+    /// Only read by the visibility pass.
+    uint32_t mDrawIndex;
+  };
+
+  /// The resolve's copy of \c SceneMaterial, see MaterialData in
+  /// basic.h.fsl.
+  struct GpuMaterial {
+    float4 mDiffuseColor;
+    float mMetallic;
+    float mRoughness;
+    float mPadding[2];
+  };
+
+  struct VisibilityDraw {
+    uint32_t mFirstIndex;
+    uint32_t mBaseVertex;
+    uint32_t mNode;
+    uint32_t mMaterial;
+  };
+
+  DrawList mDrawList;
+  /// The draws the visibility buffer leaves to forward shading.
+  DrawList mForwardDrawList;
+  DrawListStats mDrawListStats = {};
+  mat4 mSceneViewMat;
+
   SceneUniformBlock mSceneUniformData;
   SkyBoxUniformBlock mSkyBoxUniformData;
   Buffer *pSceneUniformBuffer[RenderContext::kDataBufferCount] = {NULL};
   Buffer *pSkyboxUniformBuffer[RenderContext::kDataBufferCount] = {NULL};
+  Buffer *pLightBuffer[RenderContext::kDataBufferCount] = {NULL};
+  Buffer *pClusterRangeBuffer[RenderContext::kDataBufferCount] = {NULL};
+  Buffer *pLightIndexBuffer[RenderContext::kDataBufferCount] = {NULL};
+  Buffer *pSkinningBuffer[RenderContext::kDataBufferCount] = {NULL};
+  Buffer *pNodeBuffer[RenderContext::kDataBufferCount] = {NULL};
+  Buffer *pMaterialBuffer[RenderContext::kDataBufferCount] = {NULL};
+  Buffer *pVisibilityDrawBuffer[RenderContext::kDataBufferCount] = {NULL};
+  /// Bound as \c SceneTangents for scenes without tangents, so that the
+  /// descriptor never keeps a previous scene's destroyed buffer.
+  Buffer *pEmptyTangentBuffer = NULL;
 
   void UpdateUniformBuffers(RenderContext::Frame &frame);
   void DrawSkyBox(RenderContext::Frame &frame, const SkyBox &skyBox);
-  void DrawScene(RenderContext::Frame &frame, const Scene &scene);
+  void BuildDrawList(const Scene &scene);
+  void DrawScene(RenderContext &renderContext, RenderContext::Frame &frame,
+                 const Scene &scene, const GeometryPool &geometryPool,
+                 const DrawList &drawList);
+  /// Points this frame's descriptors at the scene's vertex, index and
+  /// tangent buffers. Must run before the frame binds them.
+  void UpdateGeometryDescriptors(RenderContext &renderContext,
+                                 RenderContext::Frame &frame,
+                                 const Scene &scene);
+  /// Draws \c mDrawList's IDs and depth into the frame's visibility buffer,
+  /// then resolves it into the scene color, where the sky box is already
+  /// drawn. Draws it can't hold are then shaded forward, depth tested
+  /// against the rest. Each of the three passes is timed.
+  void DrawVisibilityBuffer(RenderContext &renderContext,
+                            RenderContext::Frame &frame, const Scene &scene,
+                            const GeometryPool &geometryPool,
+                            ProfileToken gpuProfileToken);
+  /// Creates the variant's pipeline on first use.
+  Pipeline *GetScenePipeline(RenderContext &renderContext, uint32_t variant);
+  Pipeline *GetResolvePipeline(RenderContext &renderContext, uint32_t variant);
+  /// See ShaderList.fsl. Vertex shaders only depend on the vertex features,
+  /// and fragment shaders on every feature but skinning.
+  static void GetSceneShaderFileNames(uint32_t variant, char *pVertName,
+                                      char *pFragName, size_t size);
+  /// The resolve's fragment shader, named like the scene's.
+  static void GetResolveShaderFileName(uint32_t variant, char *pFragName,
+                                       size_t size);
 
   void AddDescriptorSets(RenderContext &renderContext);
   void RemoveDescriptorSets(RenderContext &renderContext);
@@ -1,5 +1,15 @@
 #include "SkyBox.hpp"
 
+#include <stdio.h>
+#include <string.h>
+
+#include "Utilities/Interfaces/ILog.h"
+#include "Utilities/Interfaces/ITime.h"
+
+#include "TextureStreamer.hpp"
+
+#include "Utilities/Interfaces/IMemory.h"
+
 const float kSkyBoxVertices[4 * 6 * SkyBox::kSideCount] = {
     10.0f,  -10.0f, -10.0f, 6.0f, // -z
     -10.0f, -10.0f, -10.0f, 6.0f,   -10.0f, 10.0f,  -10.0f,
@@ -36,14 +46,145 @@ const char *const kDefaultSkyBoxImageFileNames[SkyBox::kSideCount] = {
     "Skybox_right1.tex",  "Skybox_left2.tex",  "Skybox_top3.tex",
     "Skybox_bottom4.tex", "Skybox_front5.tex", "Skybox_back6.tex"};
 
+/// Tried in order in place of a face's extension to find its image.
+const char *const kSkyBoxImageExtensions[] = {"png", "jpg", "tga"};
+
+/// sRGB, lit about as much as the ambient term of Lambert shading.
+const uint8_t kFallbackSkyColor[4] = {96, 96, 96, 255};
+
+/// Names the uncompressed image of \c pFaceFileName in \c fileName and
+/// returns its modification time, or 0 if it has none.
+static time_t FindFaceImage(const char *pFaceFileName,
+                            char (&fileName)[FS_MAX_PATH]) {
+  const char *pExtension = strrchr(pFaceFileName, '.');
+  int stemLength = pExtension ? (int)(pExtension - pFaceFileName)
+                              : (int)strlen(pFaceFileName);
+  for (uint32_t i = 0; i < TF_ARRAY_COUNT(kSkyBoxImageExtensions); ++i) {
+    snprintf(fileName, FS_MAX_PATH, "%.*s.%s", stemLength, pFaceFileName,
+             kSkyBoxImageExtensions[i]);
+    time_t modifiedTime = fsGetLastModifiedTime(RD_TEXTURES, fileName);
+    if (modifiedTime > 0) {
+      return modifiedTime;
+    }
+  }
+  return 0;
+}
+
+static Texture *CreateLightingTexture(RenderContext &renderContext,
+                                      TextureDesc &desc) {
+  Texture *pTexture = NULL;
+  desc.mDepth = 1;
+  desc.mSampleCount = SAMPLE_COUNT_1;
+  desc.mStartState = RESOURCE_STATE_SHADER_RESOURCE;
+  TextureLoadDesc loadDesc = {};
+  loadDesc.pDesc = &desc;
+  loadDesc.ppTexture = &pTexture;
+  addResource(&loadDesc, NULL);
+  renderContext.TrackResource(kMemoryCategorySkyBox, pTexture);
+  return pTexture;
+}
+
+static void CopyRows(const TextureSubresourceUpdate &subresource,
+                     const void *pSrc) {
+  for (uint32_t row = 0; row < subresource.mRowCount; ++row) {
+    memcpy(subresource.pMappedData + row * subresource.mDstRowStride,
+           reinterpret_cast<const uint8_t *>(pSrc) +
+               row * subresource.mSrcRowStride,
+           subresource.mSrcRowStride);
+  }
+}
+
+void SkyBox::BakeLighting(TaskSystem *pTaskSystem) {
+  char cacheFileName[FS_MAX_PATH] = {};
+  snprintf(cacheFileName, FS_MAX_PATH, "%s.ibl", ppTextureFilenames[0]);
+  char imageFileNames[kSideCount][FS_MAX_PATH] = {};
+  bool hasImages = true;
+  time_t imagesTime = 0;
+  for (uint32_t i = 0; i < kSideCount; ++i) {
+    time_t modifiedTime =
+        FindFaceImage(ppTextureFilenames[i], imageFileNames[i]);
+    hasImages = hasImages && modifiedTime > 0;
+    imagesTime = max(imagesTime, modifiedTime);
+  }
+
+  int64_t start = getUSec(false);
+  if ((!hasImages ||
+       fsGetLastModifiedTime(RD_TEXTURES, cacheFileName) >= imagesTime) &&
+      mLighting.Read(RD_TEXTURES, cacheFileName)) {
+    LOGF(eINFO, "Loaded image-based lighting from %s in %.1f ms",
+         cacheFileName, (double)(getUSec(false) - start) / 1000.0);
+    return;
+  }
+  uint8_t *pPixels[kSideCount] = {};
+  IblSourceFace faces[kSideCount] = {};
+  bool decoded = hasImages;
+  for (uint32_t i = 0; i < kSideCount && decoded; ++i) {
+    pPixels[i] = DecodeTextureFile(imageFileNames[i], faces[i].mWidth,
+                                   faces[i].mHeight);
+    faces[i].pPixels = pPixels[i];
+    decoded = pPixels[i] != NULL;
+  }
+  if (!decoded) {
+    LOGF(eWARNING,
+         "No PNG, JPEG or TGA copy of every sky box face was found next "
+         "to %s, so image-based lighting falls back to a uniform sky",
+         ppTextureFilenames[0]);
+    for (uint32_t i = 0; i < kSideCount; ++i) {
+      faces[i] = {kFallbackSkyColor, 1, 1};
+    }
+  }
+  mLighting.Bake(faces, pTaskSystem);
+  LOGF(eINFO, "Baked image-based lighting on %u threads in %.1f ms",
+       pTaskSystem ? pTaskSystem->GetThreadCount() : 1,
+       (double)(getUSec(false) - start) / 1000.0);
+  // The fallback isn't cached, so that images added later are picked up.
+  if (decoded) {
+    mLighting.Write(RD_TEXTURES, cacheFileName);
+  }
+  for (uint32_t i = 0; i < kSideCount; ++i) {
+    tf_free(pPixels[i]);
+  }
+}
+
+void SkyBox::UploadLighting() {
+  memcpy(mIrradianceSh, mLighting.GetIrradianceSh(), sizeof(mIrradianceSh));
+
+  TextureUpdateDesc updateDesc = {};
+  updateDesc.pTexture = pSpecularTexture;
+  updateDesc.mMipLevels = ImageBasedLighting::kSpecularMipCount;
+  updateDesc.mLayerCount = ImageBasedLighting::kFaceCount;
+  updateDesc.mCurrentState = RESOURCE_STATE_SHADER_RESOURCE;
+  beginUpdateResource(&updateDesc);
+  for (uint32_t mip = 0; mip < ImageBasedLighting::kSpecularMipCount; ++mip) {
+    for (uint32_t face = 0; face < ImageBasedLighting::kFaceCount; ++face) {
+      CopyRows(getTextureSubresourceUpdate(&updateDesc, mip, face),
+               mLighting.GetSpecularFace(mip, face));
+    }
+  }
+  endUpdateResource(&updateDesc);
+
+  updateDesc = {};
+  updateDesc.pTexture = pBrdfLutTexture;
+  updateDesc.mMipLevels = 1;
+  updateDesc.mLayerCount = 1;
+  updateDesc.mCurrentState = RESOURCE_STATE_SHADER_RESOURCE;
+  beginUpdateResource(&updateDesc);
+  CopyRows(getTextureSubresourceUpdate(&updateDesc, 0, 0),
+           mLighting.GetBrdfLut());
+  endUpdateResource(&updateDesc);
+  mLighting.Destroy();
+  mLightingReady = true;
+}
+
 void SkyBox::Load(RenderContext &renderContext,
                   const char *const pTextureFilenames[kSideCount]) {
+  ppTextureFilenames = pTextureFilenames;
   for (int i = 0; i < 6; ++i) {
     TextureLoadDesc textureDesc = {};
     textureDesc.pFileName = pTextureFilenames[i];
     textureDesc.ppTexture = &pTextures[i];
     textureDesc.mCreationFlag = TEXTURE_CREATION_FLAG_SRGB;
-    addResource(&textureDesc, NULL);
+    addResource(&textureDesc, &mFacesToken);
   }
 
   SamplerDesc samplerDesc = {FILTER_LINEAR,
@@ -62,17 +203,62 @@ void SkyBox::Load(RenderContext &renderContext,
   skyboxVbDesc.pData = kSkyBoxVertices;
   skyboxVbDesc.ppBuffer = &pVertexBuffer;
   addResource(&skyboxVbDesc, NULL);
+  renderContext.TrackResource(kMemoryCategorySkyBox, pVertexBuffer);
+
+  // The lighting textures' sizes are fixed, so they're created right away
+  // and bound before the bake finishes.
+  TextureDesc desc = {};
+  desc.mWidth = ImageBasedLighting::kSpecularSize;
+  desc.mHeight = ImageBasedLighting::kSpecularSize;
+  desc.mArraySize = ImageBasedLighting::kFaceCount;
+  desc.mMipLevels = ImageBasedLighting::kSpecularMipCount;
+  desc.mFormat = TinyImageFormat_R8G8B8A8_SRGB;
+  desc.mDescriptors = DESCRIPTOR_TYPE_TEXTURE_CUBE;
+  desc.pName = "SkyBoxSpecular";
+  pSpecularTexture = CreateLightingTexture(renderContext, desc);
+
+  desc = {};
+  desc.mWidth = ImageBasedLighting::kBrdfLutSize;
+  desc.mHeight = ImageBasedLighting::kBrdfLutSize;
+  desc.mArraySize = 1;
+  desc.mMipLevels = 1;
+  desc.mFormat = TinyImageFormat_R16G16_UNORM;
+  desc.mDescriptors = DESCRIPTOR_TYPE_TEXTURE;
+  desc.pName = "SkyBoxBrdfLut";
+  pBrdfLutTexture = CreateLightingTexture(renderContext, desc);
+
+  SamplerDesc lightingSamplerDesc = {FILTER_LINEAR,
+                                     FILTER_LINEAR,
+                                     MIPMAP_MODE_LINEAR,
+                                     ADDRESS_MODE_CLAMP_TO_EDGE,
+                                     ADDRESS_MODE_CLAMP_TO_EDGE,
+                                     ADDRESS_MODE_CLAMP_TO_EDGE};
+  pLightingSampler = renderContext.CreateSampler(&lightingSamplerDesc);
 }
 
 void SkyBox::LoadDefault(RenderContext &renderContext) {
   Load(renderContext, kDefaultSkyBoxImageFileNames);
 }
 
+void SkyBox::WaitForFaces(RenderContext &renderContext) {
+  // Textures loaded from files are only created by the resource loader, so
+  // their size is known once they're loaded.
+  waitForToken(&mFacesToken);
+  for (uint32_t i = 0; i < kSideCount; ++i) {
+    renderContext.TrackResource(kMemoryCategorySkyBox, pTextures[i]);
+  }
+}
+
 void SkyBox::Destroy(RenderContext &renderContext) {
-  removeResource(pVertexBuffer);
+  mLighting.Destroy();
+  mLightingReady = false;
+  renderContext.DeferDestroy(pVertexBuffer, kMemoryCategorySkyBox);
 
   renderContext.DestroySampler(pSampler);
+  renderContext.DestroySampler(pLightingSampler);
+  renderContext.DeferDestroy(pSpecularTexture, kMemoryCategorySkyBox);
+  renderContext.DeferDestroy(pBrdfLutTexture, kMemoryCategorySkyBox);
 
   for (uint i = 0; i < kSideCount; ++i)
-    removeResource(pTextures[i]);
+    renderContext.DeferDestroy(pTextures[i], kMemoryCategorySkyBox);
 }
\ No newline at end of file
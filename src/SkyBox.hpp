@@ -3,24 +3,71 @@
 #include "Graphics/Interfaces/IGraphics.h"
 #include "Resources/ResourceLoader/Interfaces/IResourceLoader.h"
 
+#include "ImageBasedLighting.hpp"
 #include "RenderContext.hpp"
+#include "TaskSystem.hpp"
 
+/// The sky box's faces, and the image-based lighting derived from them.
+///
+/// Lighting is baked on the CPU from uncompressed copies of the faces, as
+/// \c .tex files are block compressed for the GPU. The bake is cached in
+/// \c <first face>.ibl next to the faces, and redone whenever a face's image
+/// is newer. Without the images, the cache is used as is, or the lighting
+/// falls back to a uniform grey sky.
+///
+/// Loading is split so that nothing waits on the bake: \c Load creates every
+/// resource, the lighting textures empty, \c BakeLighting runs on any
+/// thread, and \c UploadLighting fills the textures once it returned.
 class SkyBox {
 public:
   static const size_t kSideCount = 6;
 
+  /// Starts loading the faces. \c pTextureFilenames must stay valid until
+  /// \c BakeLighting returned.
   void Load(RenderContext &renderContext,
             const char *const pTextureFilenames[SkyBox::kSideCount]);
   void LoadDefault(RenderContext &renderContext);
+  /// Blocks until the faces are loaded. Must be called before the faces are
+  /// bound.
+  void WaitForFaces(RenderContext &renderContext);
+  /// Reads the cached lighting, or bakes it in parallel on \c pTaskSystem, or
+  /// on the calling thread alone if it's \c NULL. Only touches the CPU. Off
+  /// the main thread, pass \c TaskSystem::GetLoadTasks.
+  void BakeLighting(TaskSystem *pTaskSystem);
+  /// Must be called from the main thread after \c BakeLighting.
+  void UploadLighting();
   void Destroy(RenderContext &renderContext);
 
   inline Sampler *const &GetSampler() const { return pSampler; }
   inline Texture *const &GetTexture(size_t i) const { return pTextures[i]; }
   inline Buffer *const &GetVertexBuffer() const { return pVertexBuffer; };
 
+  /// False until \c UploadLighting, the lighting textures holding garbage
+  /// until then.
+  inline bool IsLightingReady() const { return mLightingReady; }
+  /// See \c ImageBasedLighting for the layouts.
+  inline const float *GetIrradianceSh() const { return &mIrradianceSh[0][0]; }
+  inline Texture *const &GetSpecularTexture() const {
+    return pSpecularTexture;
+  }
+  inline Texture *const &GetBrdfLutTexture() const { return pBrdfLutTexture; }
+  /// Trilinear and clamped, for both textures above.
+  inline Sampler *const &GetLightingSampler() const {
+    return pLightingSampler;
+  }
+
 private:
   Buffer *pVertexBuffer = NULL;
 
   Texture *pTextures[kSideCount] = {};
   Sampler *pSampler = NULL;
-};
\ No newline at end of file
+  SyncToken mFacesToken = {};
+  const char *const *ppTextureFilenames = NULL;
+
+  ImageBasedLighting mLighting;
+  bool mLightingReady = false;
+  float mIrradianceSh[9][4] = {};
+  Texture *pSpecularTexture = NULL;
+  Texture *pBrdfLutTexture = NULL;
+  Sampler *pLightingSampler = NULL;
+};
@@ -0,0 +1,476 @@
+#include "TangentSpace.hpp"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Trace.hpp"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+/// Triangles or positions per batch.
+static const uint32_t kMinBatchSize = 4096;
+/// Positions with more corners are sorted with \c qsort.
+static const uint32_t kMaxInsertionSortSize = 32;
+
+static inline uint32_t GetVertex(const TangentSpaceMesh &mesh,
+                                 uint32_t corner) {
+  return mesh.pIndices ? mesh.pIndices[corner] - mesh.mBaseVertex : corner;
+}
+
+static inline uint32_t GetGroup(const TangentSpaceMesh &mesh,
+                                uint32_t vertex) {
+  return mesh.pPositionIds ? mesh.pPositionIds[vertex] : vertex;
+}
+
+static inline const float *GetPosition(const TangentSpaceMesh &mesh,
+                                       uint32_t vertex) {
+  return reinterpret_cast<const float *>(
+      reinterpret_cast<const uint8_t *>(mesh.pPositions) +
+      (size_t)vertex * mesh.mPositionStride);
+}
+
+static inline void GetUv(const TangentSpaceMesh &mesh, uint32_t vertex,
+                         float uv[2]) {
+  if (mesh.pUvs == NULL) {
+    uv[0] = uv[1] = 0.0f;
+    return;
+  }
+  memcpy(uv,
+         reinterpret_cast<const uint8_t *>(mesh.pUvs) +
+             (size_t)vertex * mesh.mUvStride,
+         2 * sizeof(float));
+}
+
+static inline void Sub3(const float *a, const float *b, float out[3]) {
+  out[0] = a[0] - b[0];
+  out[1] = a[1] - b[1];
+  out[2] = a[2] - b[2];
+}
+
+static inline float Dot3(const float *a, const float *b) {
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static inline void Cross3(const float *a, const float *b, float out[3]) {
+  out[0] = a[1] * b[2] - a[2] * b[1];
+  out[1] = a[2] * b[0] - a[0] * b[2];
+  out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+/// Leaves zero vectors as they are.
+static inline void Normalize3(float v[3]) {
+  float lengthSquared = Dot3(v, v);
+  if (lengthSquared > 0.0f) {
+    float scale = 1.0f / sqrtf(lengthSquared);
+    v[0] *= scale;
+    v[1] *= scale;
+    v[2] *= scale;
+  }
+}
+
+/// Abramowitz and Stegun's approximation of \c acosf, within 7e-5 radians,
+/// which is plenty for weights.
+static inline float GetAngle(const float *a, const float *b) {
+  float lengths = sqrtf(Dot3(a, a) * Dot3(b, b));
+  if (lengths <= 0.0f) {
+    return 0.0f;
+  }
+  float cosAngle = Dot3(a, b) / lengths;
+  float x = fminf(fabsf(cosAngle), 1.0f);
+  float angle =
+      sqrtf(1.0f - x) *
+      (1.5707288f + x * (-0.2121144f + x * (0.0742610f - 0.0187293f * x)));
+  return cosAngle < 0.0f ? 3.14159265f - angle : angle;
+}
+
+static void RunRanges(TaskSystem *pTaskSystem, uint32_t count,
+                      TaskSystem::RangeFunc pFunc, void *pUserData) {
+  if (pTaskSystem && count >= 2 * kMinBatchSize) {
+    pTaskSystem->ParallelFor(count, kMinBatchSize, pFunc, pUserData);
+  } else {
+    pFunc(pUserData, 0, count);
+  }
+}
+
+struct CornerListing {
+  const TangentSpaceMesh *pMesh;
+  uint32_t mGroupCount;
+  float *pFaceNormals;
+  float *pCornerAngles;
+  /// Corners counted per position, then the next free slot of each.
+  tfrg_atomic32_t *pGroupCursors;
+  const uint32_t *pGroupOffsets;
+  uint32_t *pGroupCorners;
+  tfrg_atomic32_t mInvalid;
+};
+
+static void ComputeFaces(void *pUserData, uint32_t begin, uint32_t end) {
+  CornerListing &listing = *reinterpret_cast<CornerListing *>(pUserData);
+  const TangentSpaceMesh &mesh = *listing.pMesh;
+  bool invalid = false;
+  for (uint32_t t = begin; t < end; ++t) {
+    float *pNormal = listing.pFaceNormals + t * 3;
+    float *pAngles = listing.pCornerAngles + t * 3;
+    memset(pNormal, 0, 3 * sizeof(float));
+    memset(pAngles, 0, 3 * sizeof(float));
+    uint32_t vertices[3];
+    uint32_t groups[3];
+    bool valid = true;
+    for (uint32_t k = 0; k < 3 && valid; ++k) {
+      vertices[k] = GetVertex(mesh, t * 3 + k);
+      valid = vertices[k] < mesh.mVertexCount;
+      if (valid) {
+        groups[k] = GetGroup(mesh, vertices[k]);
+        valid = groups[k] < listing.mGroupCount;
+      }
+    }
+    if (!valid) {
+      invalid = true;
+      continue;
+    }
+    const float *p0 = GetPosition(mesh, vertices[0]);
+    const float *p1 = GetPosition(mesh, vertices[1]);
+    const float *p2 = GetPosition(mesh, vertices[2]);
+    float e01[3], e02[3], e12[3], e10[3], e20[3], e21[3];
+    Sub3(p1, p0, e01);
+    Sub3(p2, p0, e02);
+    Sub3(p2, p1, e12);
+    Sub3(p0, p1, e10);
+    Sub3(p0, p2, e20);
+    Sub3(p1, p2, e21);
+    Cross3(e01, e02, pNormal);
+    Normalize3(pNormal);
+    // Degenerate triangles are listed, but weigh nothing.
+    if (Dot3(pNormal, pNormal) > 0.0f) {
+      pAngles[0] = GetAngle(e01, e02);
+      pAngles[1] = GetAngle(e12, e10);
+      pAngles[2] = GetAngle(e20, e21);
+    }
+    for (uint32_t k = 0; k < 3; ++k) {
+      tfrg_atomic32_add_relaxed(&listing.pGroupCursors[groups[k]], 1);
+    }
+  }
+  if (invalid) {
+    tfrg_atomic32_store_relaxed(&listing.mInvalid, 1);
+  }
+}
+
+static void ListCorners(void *pUserData, uint32_t begin, uint32_t end) {
+  CornerListing &listing = *reinterpret_cast<CornerListing *>(pUserData);
+  const TangentSpaceMesh &mesh = *listing.pMesh;
+  for (uint32_t corner = begin * 3; corner < end * 3; ++corner) {
+    uint32_t group = GetGroup(mesh, GetVertex(mesh, corner));
+    uint32_t slot =
+        tfrg_atomic32_add_relaxed(&listing.pGroupCursors[group], 1);
+    listing.pGroupCorners[listing.pGroupOffsets[group] + slot] = corner;
+  }
+}
+
+static int CompareCorners(const void *pA, const void *pB) {
+  uint32_t a = *reinterpret_cast<const uint32_t *>(pA);
+  uint32_t b = *reinterpret_cast<const uint32_t *>(pB);
+  return a < b ? -1 : a > b ? 1 : 0;
+}
+
+/// Corners were listed in whatever order threads reached them.
+static void SortCorners(void *pUserData, uint32_t begin, uint32_t end) {
+  CornerListing &listing = *reinterpret_cast<CornerListing *>(pUserData);
+  for (uint32_t group = begin; group < end; ++group) {
+    uint32_t *pCorners = listing.pGroupCorners + listing.pGroupOffsets[group];
+    uint32_t count =
+        listing.pGroupOffsets[group + 1] - listing.pGroupOffsets[group];
+    if (count > kMaxInsertionSortSize) {
+      qsort(pCorners, count, sizeof(uint32_t), CompareCorners);
+      continue;
+    }
+    for (uint32_t i = 1; i < count; ++i) {
+      uint32_t corner = pCorners[i];
+      uint32_t j = i;
+      for (; j > 0 && pCorners[j - 1] > corner; --j) {
+        pCorners[j] = pCorners[j - 1];
+      }
+      pCorners[j] = corner;
+    }
+  }
+}
+
+bool TangentSpaceGenerator::Init(const TangentSpaceMesh &mesh,
+                                 TaskSystem *pTaskSystem) {
+  TRACE_SCOPE("List Corners");
+  mMesh = mesh;
+  this->pTaskSystem = pTaskSystem;
+  mGroupCount = mesh.pPositionIds ? mesh.mPositionIdCount : mesh.mVertexCount;
+  uint32_t triangleCount = mesh.mIndexCount / 3;
+  pFaceNormals = reinterpret_cast<float *>(
+      tf_malloc(((size_t)triangleCount * 3 + 1) * sizeof(float)));
+  pCornerAngles = reinterpret_cast<float *>(
+      tf_malloc(((size_t)triangleCount * 3 + 1) * sizeof(float)));
+  pGroupOffsets = reinterpret_cast<uint32_t *>(
+      tf_malloc(((size_t)mGroupCount + 1) * sizeof(uint32_t)));
+  pGroupCorners = reinterpret_cast<uint32_t *>(
+      tf_malloc(((size_t)triangleCount * 3 + 1) * sizeof(uint32_t)));
+
+  CornerListing listing = {};
+  listing.pMesh = &mMesh;
+  listing.mGroupCount = mGroupCount;
+  listing.pFaceNormals = pFaceNormals;
+  listing.pCornerAngles = pCornerAngles;
+  listing.pGroupCursors = reinterpret_cast<tfrg_atomic32_t *>(
+      tf_calloc((size_t)mGroupCount + 1, sizeof(tfrg_atomic32_t)));
+  listing.pGroupOffsets = pGroupOffsets;
+  listing.pGroupCorners = pGroupCorners;
+  RunRanges(pTaskSystem, triangleCount, ComputeFaces, &listing);
+  if (tfrg_atomic32_load_relaxed(&listing.mInvalid)) {
+    tf_free(listing.pGroupCursors);
+    Destroy();
+    return false;
+  }
+  pGroupOffsets[0] = 0;
+  for (uint32_t group = 0; group < mGroupCount; ++group) {
+    pGroupOffsets[group + 1] =
+        pGroupOffsets[group] +
+        tfrg_atomic32_load_relaxed(&listing.pGroupCursors[group]);
+    tfrg_atomic32_store_relaxed(&listing.pGroupCursors[group], 0);
+  }
+  RunRanges(pTaskSystem, triangleCount, ListCorners, &listing);
+  RunRanges(pTaskSystem, mGroupCount, SortCorners, &listing);
+  tf_free(listing.pGroupCursors);
+  return true;
+}
+
+void TangentSpaceGenerator::Destroy() {
+  tf_free(pFaceNormals);
+  tf_free(pCornerAngles);
+  tf_free(pGroupOffsets);
+  tf_free(pGroupCorners);
+  *this = TangentSpaceGenerator();
+}
+
+struct VertexSums {
+  const TangentSpaceMesh *pMesh;
+  const float *pFaceNormals;
+  const float *pCornerAngles;
+  const uint32_t *pGroupOffsets;
+  const uint32_t *pGroupCorners;
+  float mCosSmoothingAngle;
+  const float *pFaceTangents;
+  const float *pNormals;
+  float *pOut;
+};
+
+/// True if a corner of \c vertex precedes \c last in the position's list,
+/// which then handled it already.
+static inline bool IsListedBefore(const TangentSpaceMesh &mesh,
+                                  const uint32_t *pCorners, uint32_t first,
+                                  uint32_t last, uint32_t vertex) {
+  for (uint32_t i = first; i < last; ++i) {
+    if (GetVertex(mesh, pCorners[i]) == vertex) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void SumNormals(void *pUserData, uint32_t begin, uint32_t end) {
+  VertexSums &sums = *reinterpret_cast<VertexSums *>(pUserData);
+  const TangentSpaceMesh &mesh = *sums.pMesh;
+  const uint32_t *pCorners = sums.pGroupCorners;
+  for (uint32_t group = begin; group < end; ++group) {
+    uint32_t first = sums.pGroupOffsets[group];
+    uint32_t last = sums.pGroupOffsets[group + 1];
+    for (uint32_t i = first; i < last; ++i) {
+      uint32_t vertex = GetVertex(mesh, pCorners[i]);
+      if (IsListedBefore(mesh, pCorners, first, i, vertex)) {
+        continue;
+      }
+      float own[3] = {};
+      for (uint32_t j = first; j < last; ++j) {
+        uint32_t corner = pCorners[j];
+        if (GetVertex(mesh, corner) == vertex) {
+          const float *pFace = sums.pFaceNormals + corner / 3 * 3;
+          float angle = sums.pCornerAngles[corner];
+          own[0] += pFace[0] * angle;
+          own[1] += pFace[1] * angle;
+          own[2] += pFace[2] * angle;
+        }
+      }
+      Normalize3(own);
+      // Summed again in list order, so that vertices smoothed together get
+      // the exact same normal, which tangents rely on to weld them.
+      float *pNormal = sums.pOut + (size_t)vertex * 3;
+      memset(pNormal, 0, 3 * sizeof(float));
+      for (uint32_t j = first; j < last; ++j) {
+        uint32_t corner = pCorners[j];
+        const float *pFace = sums.pFaceNormals + corner / 3 * 3;
+        if (GetVertex(mesh, corner) != vertex &&
+            Dot3(pFace, own) < sums.mCosSmoothingAngle) {
+          continue;
+        }
+        float angle = sums.pCornerAngles[corner];
+        pNormal[0] += pFace[0] * angle;
+        pNormal[1] += pFace[1] * angle;
+        pNormal[2] += pFace[2] * angle;
+      }
+      Normalize3(pNormal);
+    }
+  }
+}
+
+void TangentSpaceGenerator::GenerateNormals(float smoothingAngle,
+                                            float *pNormals) const {
+  TRACE_SCOPE("Generate Normals");
+  memset(pNormals, 0, (size_t)mMesh.mVertexCount * 3 * sizeof(float));
+  VertexSums sums = {&mMesh,         pFaceNormals,  pCornerAngles,
+                     pGroupOffsets,  pGroupCorners, cosf(smoothingAngle),
+                     NULL,           NULL,          pNormals};
+  RunRanges(pTaskSystem, mGroupCount, SumNormals, &sums);
+}
+
+struct FaceTangents {
+  const TangentSpaceMesh *pMesh;
+  float *pTangents;
+};
+
+/// Each triangle's direction of increasing U, made independent of the UV
+/// orientation, then +1 if the orientation is positive and -1 otherwise.
+/// Triangles without UV area, which MikkTSpace skips too, get zeros.
+static void ComputeFaceTangents(void *pUserData, uint32_t begin,
+                                uint32_t end) {
+  FaceTangents &faces = *reinterpret_cast<FaceTangents *>(pUserData);
+  const TangentSpaceMesh &mesh = *faces.pMesh;
+  for (uint32_t t = begin; t < end; ++t) {
+    float *pTangent = faces.pTangents + (size_t)t * 4;
+    memset(pTangent, 0, 4 * sizeof(float));
+    uint32_t v0 = GetVertex(mesh, t * 3);
+    uint32_t v1 = GetVertex(mesh, t * 3 + 1);
+    uint32_t v2 = GetVertex(mesh, t * 3 + 2);
+    float uv0[2], uv1[2], uv2[2];
+    GetUv(mesh, v0, uv0);
+    GetUv(mesh, v1, uv1);
+    GetUv(mesh, v2, uv2);
+    float s1[2] = {uv1[0] - uv0[0], uv1[1] - uv0[1]};
+    float s2[2] = {uv2[0] - uv0[0], uv2[1] - uv0[1]};
+    float signedArea = s1[0] * s2[1] - s1[1] * s2[0];
+    if (signedArea == 0.0f) {
+      continue;
+    }
+    float d1[3], d2[3];
+    Sub3(GetPosition(mesh, v1), GetPosition(mesh, v0), d1);
+    Sub3(GetPosition(mesh, v2), GetPosition(mesh, v0), d2);
+    float sign = signedArea > 0.0f ? 1.0f : -1.0f;
+    for (uint32_t k = 0; k < 3; ++k) {
+      pTangent[k] = (s2[1] * d1[k] - s1[1] * d2[k]) * sign;
+    }
+    Normalize3(pTangent);
+    if (Dot3(pTangent, pTangent) > 0.0f) {
+      pTangent[3] = sign;
+    }
+  }
+}
+
+/// For vertices whose triangles have no UV area.
+static void GetAnyTangent(const float normal[3], float tangent[3]) {
+  const float x[3] = {1.0f, 0.0f, 0.0f};
+  const float y[3] = {0.0f, 1.0f, 0.0f};
+  Cross3(fabsf(normal[0]) < 0.9f ? x : y, normal, tangent);
+  Normalize3(tangent);
+}
+
+/// MikkTSpace merges vertices with the same position, normal and UV.
+/// \c other shares \c vertex's position.
+static inline bool IsWelded(const TangentSpaceMesh &mesh,
+                            const float *pNormals, uint32_t vertex,
+                            const float uv[2], uint32_t other) {
+  if (other == vertex) {
+    return true;
+  }
+  float otherUv[2];
+  GetUv(mesh, other, otherUv);
+  return memcmp(pNormals + (size_t)other * 3, pNormals + (size_t)vertex * 3,
+                3 * sizeof(float)) == 0 &&
+         memcmp(otherUv, uv, sizeof(otherUv)) == 0;
+}
+
+static void SumTangents(void *pUserData, uint32_t begin, uint32_t end) {
+  VertexSums &sums = *reinterpret_cast<VertexSums *>(pUserData);
+  const TangentSpaceMesh &mesh = *sums.pMesh;
+  const uint32_t *pCorners = sums.pGroupCorners;
+  for (uint32_t group = begin; group < end; ++group) {
+    uint32_t first = sums.pGroupOffsets[group];
+    uint32_t last = sums.pGroupOffsets[group + 1];
+    for (uint32_t i = first; i < last; ++i) {
+      uint32_t vertex = GetVertex(mesh, pCorners[i]);
+      if (IsListedBefore(mesh, pCorners, first, i, vertex)) {
+        continue;
+      }
+      const float *pNormal = sums.pNormals + (size_t)vertex * 3;
+      float uv[2];
+      GetUv(mesh, vertex, uv);
+      float *pTangent = sums.pOut + (size_t)vertex * 4;
+      // Identical vertices sum the exact same faces, so the first one's
+      // tangent is copied.
+      bool copied = false;
+      for (uint32_t j = first; j < i && !copied; ++j) {
+        uint32_t other = GetVertex(mesh, pCorners[j]);
+        if (IsWelded(mesh, sums.pNormals, vertex, uv, other)) {
+          memcpy(pTangent, sums.pOut + (size_t)other * 4, 4 * sizeof(float));
+          copied = true;
+        }
+      }
+      if (copied) {
+        continue;
+      }
+      // Per UV orientation; mirrored triangles sharing the vertex would
+      // cancel out otherwise.
+      float sum[2][3] = {};
+      float weight[2] = {};
+      for (uint32_t j = first; j < last; ++j) {
+        uint32_t corner = pCorners[j];
+        if (!IsWelded(mesh, sums.pNormals, vertex, uv,
+                      GetVertex(mesh, corner))) {
+          continue;
+        }
+        const float *pFace = sums.pFaceTangents + (size_t)(corner / 3) * 4;
+        if (pFace[3] == 0.0f) {
+          continue;
+        }
+        float face[3] = {pFace[0], pFace[1], pFace[2]};
+        float projected = Dot3(pNormal, face);
+        for (uint32_t k = 0; k < 3; ++k) {
+          face[k] -= pNormal[k] * projected;
+        }
+        Normalize3(face);
+        float angle = sums.pCornerAngles[corner];
+        uint32_t side = pFace[3] > 0.0f ? 0 : 1;
+        sum[side][0] += face[0] * angle;
+        sum[side][1] += face[1] * angle;
+        sum[side][2] += face[2] * angle;
+        weight[side] += angle;
+      }
+      uint32_t side = weight[1] > weight[0] ? 1 : 0;
+      memcpy(pTangent, sum[side], 3 * sizeof(float));
+      Normalize3(pTangent);
+      if (Dot3(pTangent, pTangent) == 0.0f) {
+        GetAnyTangent(pNormal, pTangent);
+      }
+      pTangent[3] = side == 0 ? 1.0f : -1.0f;
+    }
+  }
+}
+
+void TangentSpaceGenerator::GenerateTangents(const float *pNormals,
+                                             float *pTangents) const {
+  TRACE_SCOPE("Generate Tangents");
+  memset(pTangents, 0, (size_t)mMesh.mVertexCount * 4 * sizeof(float));
+  uint32_t triangleCount = mMesh.mIndexCount / 3;
+  FaceTangents faces = {&mMesh, reinterpret_cast<float *>(tf_malloc(
+                                    ((size_t)triangleCount * 4 + 1) *
+                                    sizeof(float)))};
+  RunRanges(pTaskSystem, triangleCount, ComputeFaceTangents, &faces);
+  VertexSums sums = {&mMesh,        pFaceNormals,  pCornerAngles,
+                     pGroupOffsets, pGroupCorners, 0.0f,
+                     faces.pTangents, pNormals,    pTangents};
+  RunRanges(pTaskSystem, mGroupCount, SumTangents, &sums);
+  tf_free(faces.pTangents);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "TaskSystem.hpp"
+
+/// A triangle list whose attributes are read in place, each with a stride in
+/// bytes, so that interleaved vertices don't need to be split first.
+struct TangentSpaceMesh {
+  /// \c NULL for unindexed lists, where every three vertices form a
+  /// triangle, like unrolled FBX polygons.
+  const uint32_t *pIndices;
+  /// Subtracted from every index.
+  uint32_t mBaseVertex;
+  /// A multiple of 3.
+  uint32_t mIndexCount;
+  uint32_t mVertexCount;
+  /// Three floats per vertex.
+  const void *pPositions;
+  uint32_t mPositionStride;
+  /// Two floats per vertex, with their origin at the bottom left as
+  /// MikkTSpace, and the bakers using it, expect. Only read by
+  /// \c GenerateTangents; without them, tangents are arbitrary.
+  const void *pUvs;
+  uint32_t mUvStride;
+  /// Vertices sharing an id are smoothed together although they're separate
+  /// vertices, such as unrolled FBX vertices of one control point. Ids are
+  /// below \c mPositionIdCount. \c NULL only smooths triangles sharing a
+  /// vertex.
+  const uint32_t *pPositionIds;
+  uint32_t mPositionIdCount;
+};
+
+/// Generates vertex normals and tangents for meshes that lack them. Every
+/// corner is listed under its vertex's position, so that each vertex gathers
+/// the triangles around it without locks:
+///
+/// - Normals sum the face normals around a position, weighted by the
+///   corner's angle so that they don't depend on how polygons were
+///   triangulated. Faces of other vertices at the same position only
+///   contribute if within the smoothing angle of the vertex's own faces, so
+///   hard edges stay hard.
+/// - Tangents follow MikkTSpace: each face's tangent comes from its UV
+///   derivatives, is projected onto the vertex normal and weighted by the
+///   corner's angle, and is shared by every vertex with the same position,
+///   normal and UV. The bitangent's sign is the UV orientation.
+///
+/// Triangles and positions are spread over the task system in ranges.
+/// Corners are sorted within each position, so every sum runs in the same
+/// order whatever the thread count and results are identical between runs.
+class TangentSpaceGenerator {
+public:
+  /// Lists the mesh's corners and computes its face normals. \c mesh's
+  /// arrays must outlive the generator. Runs on the calling thread when
+  /// \c pTaskSystem is \c NULL. Returns false if an index or a position id
+  /// is out of range.
+  bool Init(const TangentSpaceMesh &mesh, TaskSystem *pTaskSystem);
+  void Destroy();
+
+  /// Three floats per vertex. \c smoothingAngle is in radians. Vertices no
+  /// triangle uses, or only degenerate ones, get a zero normal.
+  void GenerateNormals(float smoothingAngle, float *pNormals) const;
+  /// Four floats per vertex: a unit tangent perpendicular to the vertex's
+  /// normal, then the sign such that the bitangent is
+  /// sign * cross(normal, tangent). \c pNormals holds three floats per
+  /// vertex, of unit length, from \c GenerateNormals or from the file.
+  /// Vertices no triangle uses get a zero tangent.
+  void GenerateTangents(const float *pNormals, float *pTangents) const;
+
+private:
+  TangentSpaceMesh mMesh = {};
+  TaskSystem *pTaskSystem = NULL;
+  uint32_t mGroupCount = 0;
+  /// Three floats per triangle, zero for degenerate ones.
+  float *pFaceNormals = NULL;
+  /// One per corner, zero for degenerate triangles.
+  float *pCornerAngles = NULL;
+  /// \c mGroupCount + 1 entries, the first of each position's corners.
+  uint32_t *pGroupOffsets = NULL;
+  uint32_t *pGroupCorners = NULL;
+};
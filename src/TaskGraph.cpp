@@ -0,0 +1,171 @@
+#include "TaskGraph.hpp"
+
+#include "Utilities/Interfaces/ILog.h"
+
+#include "Trace.hpp"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+void TaskGraph::Init(TaskSystem &taskSystem) {
+  pTaskSystem = &taskSystem;
+  mOriginUSec = getUSec(false);
+  mTaskCount = 0;
+  mSpanCount = 0;
+}
+
+uint32_t TaskGraph::Add(const char *pName, TaskFunc pFunc, void *pUserData,
+                        bool mainThread) {
+  ASSERT(mTaskCount < kMaxTaskCount);
+  uint32_t task = mTaskCount++;
+  Task &t = mTasks[task];
+  t.pGraph = this;
+  t.pName = pName;
+  t.pFunc = pFunc;
+  t.pUserData = pUserData;
+  t.mMainThread = mainThread;
+  t.mDependentCount = 0;
+  tfrg_atomic32_store_relaxed(&t.mPendingDependencies, 0);
+  tfrg_atomic32_store_relaxed(&t.mState, kTaskWaiting);
+  t.mBegin = 0;
+  t.mEnd = 0;
+  return task;
+}
+
+void TaskGraph::AddDependency(uint32_t task, uint32_t dependency) {
+  ASSERT(task < mTaskCount && dependency < mTaskCount);
+  Task &parent = mTasks[dependency];
+  ASSERT(parent.mDependentCount < kMaxDependentCount);
+  parent.mDependents[parent.mDependentCount++] = task;
+  tfrg_atomic32_store_relaxed(
+      &mTasks[task].mPendingDependencies,
+      tfrg_atomic32_load_relaxed(&mTasks[task].mPendingDependencies) + 1);
+}
+
+void TaskGraph::Start() {
+  // Roots are gathered first, as a background task may finish and release
+  // its dependents while the others are still being released.
+  uint32_t roots[kMaxTaskCount];
+  uint32_t rootCount = 0;
+  for (uint32_t i = 0; i < mTaskCount; ++i) {
+    if (tfrg_atomic32_load_relaxed(&mTasks[i].mPendingDependencies) == 0) {
+      roots[rootCount++] = i;
+    }
+  }
+  for (uint32_t i = 0; i < rootCount; ++i) {
+    Release(roots[i]);
+  }
+}
+
+void TaskGraph::Release(uint32_t task) {
+  if (mTasks[task].mMainThread) {
+    tfrg_atomic32_store_release(&mTasks[task].mState, kTaskReady);
+  } else {
+    pTaskSystem->Async(RunAsync, &mTasks[task]);
+  }
+}
+
+void TaskGraph::RunAsync(void *pUserData) {
+  Task *pTask = reinterpret_cast<Task *>(pUserData);
+  pTask->pGraph->Run((uint32_t)(pTask - pTask->pGraph->mTasks));
+}
+
+void TaskGraph::Run(uint32_t task) {
+  Task &t = mTasks[task];
+  tfrg_atomic32_store_relaxed(&t.mState, kTaskRunning);
+  t.mBegin = GetTime();
+  TraceBeginScope(t.pName);
+  t.pFunc(t.pUserData);
+  TraceEndScope();
+  t.mEnd = GetTime();
+  tfrg_atomic32_store_release(&t.mState, kTaskFinished);
+  for (uint32_t i = 0; i < t.mDependentCount; ++i) {
+    Task &dependent = mTasks[t.mDependents[i]];
+    // Every dependency releases its writes as it counts down, so the last
+    // one to finish sees all of them before starting the dependent.
+    if (tfrg_atomic32_add_release(&dependent.mPendingDependencies,
+                                  (uint32_t)-1) == 1) {
+      tfrg_atomic32_load_acquire(&dependent.mPendingDependencies);
+      Release(t.mDependents[i]);
+    }
+  }
+}
+
+void TaskGraph::RunMainThreadTasks() {
+  bool ran = true;
+  while (ran) {
+    ran = false;
+    for (uint32_t i = 0; i < mTaskCount; ++i) {
+      if (tfrg_atomic32_load_acquire(&mTasks[i].mState) == kTaskReady) {
+        Run(i);
+        ran = true;
+      }
+    }
+  }
+}
+
+bool TaskGraph::IsFinished(uint32_t task) const {
+  return tfrg_atomic32_load_acquire(&mTasks[task].mState) == kTaskFinished;
+}
+
+bool TaskGraph::IsFinished() const {
+  for (uint32_t i = 0; i < mTaskCount; ++i) {
+    if (!IsFinished(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int64_t TaskGraph::GetFinishTime(uint32_t task) const {
+  ASSERT(IsFinished(task));
+  return mTasks[task].mEnd;
+}
+
+void TaskGraph::AddSpan(const char *pName, int64_t begin, int64_t end) {
+  ASSERT(mSpanCount < kMaxSpanCount);
+  mSpans[mSpanCount++] = {pName, begin, end};
+}
+
+void TaskGraph::LogTimeline(const char *pTitle) const {
+  struct TimelineEntry {
+    const char *pName;
+    int64_t mBegin;
+    int64_t mEnd;
+    bool mMainThread;
+  };
+  TimelineEntry entries[kMaxTaskCount + kMaxSpanCount];
+  uint32_t entryCount = 0;
+  for (uint32_t i = 0; i < mTaskCount; ++i) {
+    if (IsFinished(i)) {
+      entries[entryCount++] = {mTasks[i].pName, mTasks[i].mBegin,
+                               mTasks[i].mEnd, mTasks[i].mMainThread};
+    }
+  }
+  for (uint32_t i = 0; i < mSpanCount; ++i) {
+    entries[entryCount++] = {mSpans[i].pName, mSpans[i].mBegin,
+                             mSpans[i].mEnd, true};
+  }
+  // A handful of entries, so an insertion sort by start time does.
+  for (uint32_t i = 1; i < entryCount; ++i) {
+    TimelineEntry entry = entries[i];
+    uint32_t j = i;
+    for (; j > 0 && entries[j - 1].mBegin > entry.mBegin; --j) {
+      entries[j] = entries[j - 1];
+    }
+    entries[j] = entry;
+  }
+
+  int64_t end = 0;
+  int64_t work = 0;
+  for (uint32_t i = 0; i < entryCount; ++i) {
+    end = max(end, entries[i].mEnd);
+    work += entries[i].mEnd - entries[i].mBegin;
+  }
+  LOGF(eINFO, "%s in %.1f ms, %.1f ms of work overlapped %.2fx", pTitle,
+       end / 1000.0, work / 1000.0, end > 0 ? (double)work / end : 0.0);
+  for (uint32_t i = 0; i < entryCount; ++i) {
+    LOGF(eINFO, "  %8.1f - %8.1f ms  %-28s %s", entries[i].mBegin / 1000.0,
+         entries[i].mEnd / 1000.0, entries[i].pName,
+         entries[i].mMainThread ? "main" : "background");
+  }
+}
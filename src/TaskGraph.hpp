@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "Utilities/Interfaces/ITime.h"
+
+#include "TaskSystem.hpp"
+
+/// A fixed set of jobs, each started as soon as every job it depends on
+/// finished: on the task system's background pool, or, for jobs that must
+/// touch the renderer, on the main thread from \c RunMainThreadTasks, which
+/// never blocks. Tasks are added and wired up front, then \c Start releases
+/// the ones without dependencies. When each task started and finished is
+/// kept, along with spans that ran outside the graph, for \c LogTimeline.
+class TaskGraph {
+public:
+  static const uint32_t kMaxTaskCount = 16;
+  static const uint32_t kMaxDependentCount = 4;
+  static const uint32_t kMaxSpanCount = 16;
+
+  typedef TaskSystem::AsyncFunc TaskFunc;
+
+  /// Times are relative to this call.
+  void Init(TaskSystem &taskSystem);
+  /// Returns the task's index. \c pName must outlive the graph.
+  uint32_t Add(const char *pName, TaskFunc pFunc, void *pUserData,
+               bool mainThread);
+  /// \c task only starts once \c dependency finished. Both must have been
+  /// added before.
+  void AddDependency(uint32_t task, uint32_t dependency);
+  /// Releases the tasks without dependencies. No task can be added after.
+  void Start();
+
+  /// Runs the main thread tasks that are ready, including those released by
+  /// the ones it runs. Must be called from the main thread.
+  void RunMainThreadTasks();
+  bool IsFinished(uint32_t task) const;
+  bool IsFinished() const;
+  /// In microseconds since \c Init.
+  int64_t GetFinishTime(uint32_t task) const;
+  inline int64_t GetTime() const { return getUSec(false) - mOriginUSec; }
+
+  /// Records work done outside the graph, in microseconds since \c Init.
+  /// Must be called from the main thread.
+  void AddSpan(const char *pName, int64_t begin, int64_t end);
+  /// Logs every task and span by start time, and how much of their total
+  /// duration overlapped.
+  void LogTimeline(const char *pTitle) const;
+
+private:
+  enum : uint32_t {
+    kTaskWaiting,
+    kTaskReady,
+    kTaskRunning,
+    kTaskFinished,
+  };
+  struct Task {
+    TaskGraph *pGraph;
+    const char *pName;
+    TaskFunc pFunc;
+    void *pUserData;
+    bool mMainThread;
+    uint32_t mDependents[kMaxDependentCount];
+    uint32_t mDependentCount;
+    tfrg_atomic32_t mPendingDependencies;
+    tfrg_atomic32_t mState;
+    int64_t mBegin;
+    int64_t mEnd;
+  };
+  struct Span {
+    const char *pName;
+    int64_t mBegin;
+    int64_t mEnd;
+  };
+
+  TaskSystem *pTaskSystem = NULL;
+  int64_t mOriginUSec = 0;
+  Task mTasks[kMaxTaskCount] = {};
+  uint32_t mTaskCount = 0;
+  Span mSpans[kMaxSpanCount] = {};
+  uint32_t mSpanCount = 0;
+
+  void Release(uint32_t task);
+  void Run(uint32_t task);
+  static void RunAsync(void *pUserData);
+};
@@ -0,0 +1,164 @@
+#include "TaskSystem.hpp"
+
+#include "OS/Interfaces/IOperatingSystem.h"
+#include "Utilities/Interfaces/ILog.h"
+#include "Utilities/Interfaces/IThread.h"
+
+#include "Trace.hpp"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+struct ParallelForBatch {
+  const char *pWorkerName;
+  TaskSystem::RangeFunc pFunc;
+  void *pUserData;
+  uint32_t mCount;
+  uint32_t mBatchSize;
+  uint32_t mBatchCount;
+  tfrg_atomic32_t mNextBatch;
+  tfrg_atomic32_t mFinishedWorkers;
+};
+
+static void RunBatches(ParallelForBatch *pBatch) {
+  for (;;) {
+    uint32_t batch = tfrg_atomic32_add_relaxed(&pBatch->mNextBatch, 1);
+    if (batch >= pBatch->mBatchCount) {
+      return;
+    }
+    uint32_t begin = batch * pBatch->mBatchSize;
+    uint32_t end = min(begin + pBatch->mBatchSize, pBatch->mCount);
+    pBatch->pFunc(pBatch->pUserData, begin, end);
+  }
+}
+
+static void ParallelForWorker(void *pUserData, uint64_t) {
+  ParallelForBatch *pBatch = reinterpret_cast<ParallelForBatch *>(pUserData);
+  TraceSetThreadName(pBatch->pWorkerName);
+  TRACE_SCOPE("Parallel For");
+  RunBatches(pBatch);
+  tfrg_atomic32_add_release(&pBatch->mFinishedWorkers, 1);
+}
+
+struct AsyncJob {
+  const char *pWorkerName;
+  TaskSystem::AsyncFunc pFunc;
+  void *pUserData;
+};
+
+static void AsyncWorker(void *pUserData, uint64_t) {
+  AsyncJob job = *reinterpret_cast<AsyncJob *>(pUserData);
+  tf_free(pUserData);
+  TraceSetThreadName(job.pWorkerName);
+  TRACE_SCOPE("Async Job");
+  job.pFunc(job.pUserData);
+}
+
+static void AddAsyncJob(ThreadSystem pool, const char *pWorkerName,
+                        TaskSystem::AsyncFunc pFunc, void *pUserData) {
+  AsyncJob *pJob = reinterpret_cast<AsyncJob *>(tf_malloc(sizeof(AsyncJob)));
+  pJob->pWorkerName = pWorkerName;
+  pJob->pFunc = pFunc;
+  pJob->pUserData = pUserData;
+  threadSystemAddTaskGroup(pool, AsyncWorker, 1, pJob);
+}
+
+bool TaskSystem::Init() {
+  ThreadSystemInitDesc desc = {};
+  // Leave one core to the main thread, which joins every ParallelFor.
+  desc.mThreadCount = max(getNumCPUCores(), 2u) - 1;
+  initThreadSystem(&desc, &mForeground);
+  if (!mForeground) {
+    return false;
+  }
+  mForegroundThreadCount = threadSystemGetNumThreads(mForeground);
+  pWorkerName = "Foreground Worker";
+
+  desc.mThreadCount = 2;
+  initThreadSystem(&desc, &mBackground);
+  if (!mBackground) {
+    return false;
+  }
+
+  desc.mThreadCount = 1;
+  initThreadSystem(&desc, &mRead);
+  if (!mRead) {
+    return false;
+  }
+
+  // The load workers compete with the foreground pool for cores, so they only
+  // get half of them; frames never wait for them though.
+  pLoadTasks =
+      reinterpret_cast<TaskSystem *>(tf_calloc(1, sizeof(TaskSystem)));
+  desc.mThreadCount = max(getNumCPUCores() / 2, 1u);
+  initThreadSystem(&desc, &pLoadTasks->mForeground);
+  if (!pLoadTasks->mForeground) {
+    return false;
+  }
+  pLoadTasks->mForegroundThreadCount =
+      threadSystemGetNumThreads(pLoadTasks->mForeground);
+  pLoadTasks->pWorkerName = "Load Worker";
+  return true;
+}
+
+void TaskSystem::Exit() {
+  threadSystemWaitIdle(mBackground);
+  exitThreadSystem(mBackground);
+  threadSystemWaitIdle(mRead);
+  exitThreadSystem(mRead);
+  // Background jobs were the load workers' only callers.
+  exitThreadSystem(pLoadTasks->mForeground);
+  tf_free(pLoadTasks);
+  exitThreadSystem(mForeground);
+  mBackground = NULL;
+  mRead = NULL;
+  mForeground = NULL;
+  pLoadTasks = NULL;
+}
+
+void TaskSystem::ParallelFor(uint32_t count, uint32_t minBatchSize,
+                             RangeFunc pFunc, void *pUserData) {
+  if (count == 0) {
+    return;
+  }
+  minBatchSize = max(minBatchSize, 1u);
+  // Aim for a few batches per thread so uneven batches even out.
+  uint32_t batchSize =
+      max(minBatchSize, (count + GetThreadCount() * 4 - 1) /
+                            (GetThreadCount() * 4));
+  uint32_t batchCount = (count + batchSize - 1) / batchSize;
+  if (batchCount == 1) {
+    pFunc(pUserData, 0, count);
+    return;
+  }
+
+  ParallelForBatch batch = {};
+  batch.pWorkerName = pWorkerName;
+  batch.pFunc = pFunc;
+  batch.pUserData = pUserData;
+  batch.mCount = count;
+  batch.mBatchSize = batchSize;
+  batch.mBatchCount = batchCount;
+
+  uint32_t workerCount = min(batchCount - 1, mForegroundThreadCount);
+  threadSystemAddTaskGroup(mForeground, ParallelForWorker, workerCount,
+                           &batch);
+  RunBatches(&batch);
+
+  // Workers that start late still touch `batch`, which lives on this stack, so
+  // wait for every one of them rather than just for the last batch.
+  while (tfrg_atomic32_load_acquire(&batch.mFinishedWorkers) < workerCount) {
+    threadSleep(0);
+  }
+}
+
+void TaskSystem::Async(AsyncFunc pFunc, void *pUserData) {
+  ASSERT(mBackground);
+  AddAsyncJob(mBackground, "Background Worker", pFunc, pUserData);
+}
+
+void TaskSystem::AsyncRead(AsyncFunc pFunc, void *pUserData) {
+  ASSERT(mRead);
+  AddAsyncJob(mRead, "Read Worker", pFunc, pUserData);
+}
+
+void TaskSystem::WaitBackgroundIdle() { threadSystemWaitIdle(mBackground); }
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Utilities/Threading/Atomics.h"
+#include "Utilities/Threading/ThreadSystem.h"
+
+/// \c TaskSystem wraps The Forge's thread system in two pools: a foreground
+/// one for frame-critical data-parallel loops (\c ParallelFor) and a
+/// background one for long-running jobs such as asset conversion (\c Async),
+/// so that a slow import never delays a frame. Background jobs spread their
+/// own loops over a third pool of load workers, see \c GetLoadTasks.
+class TaskSystem {
+public:
+  typedef void (*RangeFunc)(void *pUserData, uint32_t begin, uint32_t end);
+  typedef void (*AsyncFunc)(void *pUserData);
+
+  bool Init();
+  void Exit();
+
+  uint32_t GetThreadCount() const { return mForegroundThreadCount + 1; }
+
+  /// Splits [0, count) into batches of at least \c minBatchSize elements and
+  /// blocks until all of them ran. The calling thread works on batches too.
+  /// Must not be nested. Background jobs call it on \c GetLoadTasks instead.
+  void ParallelFor(uint32_t count, uint32_t minBatchSize, RangeFunc pFunc,
+                   void *pUserData);
+
+  /// Runs \c pFunc on the background pool. Ownership of \c pUserData stays
+  /// with the caller, which must keep it alive until the job signals back.
+  void Async(AsyncFunc pFunc, void *pUserData);
+  void WaitBackgroundIdle();
+
+  /// Like \c Async, but on a read worker of its own, for short reads that
+  /// must not queue behind the background pool's imports and conversions,
+  /// such as streamed chunks.
+  void AsyncRead(AsyncFunc pFunc, void *pUserData);
+
+  /// Task system whose \c ParallelFor runs on the load workers, for loops of
+  /// background jobs: frames would wait behind them in the foreground pool.
+  /// Several jobs may use it at once. It has no background pool, so it can't
+  /// \c Async.
+  TaskSystem *GetLoadTasks() { return pLoadTasks; }
+
+private:
+  /// The pool \c ParallelFor uses, the load workers' in \c pLoadTasks.
+  ThreadSystem mForeground = NULL;
+  ThreadSystem mBackground = NULL;
+  ThreadSystem mRead = NULL;
+  uint32_t mForegroundThreadCount = 0;
+  const char *pWorkerName = NULL;
+  TaskSystem *pLoadTasks = NULL;
+};
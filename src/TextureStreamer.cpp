@@ -0,0 +1,568 @@
+#include "TextureStreamer.hpp"
+
+#include "Utilities/Interfaces/ILog.h"
+
+#include "RenderStats.hpp"
+#include "Trace.hpp"
+
+#include "Tools/ThirdParty/OpenSource/ISPCTextureCompressor/ispc_texcomp/ispc_texcomp.h"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_STATIC
+#define STBI_NO_STDIO
+#define STBI_MALLOC(size) tf_malloc(size)
+#define STBI_REALLOC(p, size) tf_realloc(p, size)
+#define STBI_FREE(p) tf_free(p)
+#include "Utilities/ThirdParty/OpenSource/Nothings/stb_image.h"
+
+enum StreamedTextureState : uint32_t {
+  kStatePending = 0,
+  kStateReady,
+  kStateFailed,
+  /// Released, and free for another request.
+  kStateFree,
+};
+
+// BC5 and BC7 both encode 4x4 texel blocks into 16 bytes.
+static const uint32_t kBlockBytes = 16;
+// Mips up to this size are made resident as soon as a texture is converted,
+// regardless of demand or budget.
+static const uint32_t kMinResidentMipSize = 64;
+// Each transition re-uploads the whole resident chain, so they are rationed.
+static const uint32_t kMaxTransitionsPerFrame = 2;
+
+struct TextureStreamer::StreamedTexture {
+  char mFileName[FS_MAX_PATH];
+  StreamedTextureKind mKind;
+  tfrg_atomic32_t mState;
+  /// Requests not released yet. Only touched on the main thread.
+  uint32_t mRefCount;
+
+  // Written by the conversion job before `mState` is released as ready.
+  uint32_t mWidth;
+  uint32_t mHeight;
+  uint32_t mMipCount;
+  uint8_t *pMipData[kMaxMipCount];
+  uint32_t mMipBytes[kMaxMipCount];
+
+  Texture *pTexture;
+  uint32_t mResidentMips;
+  uint32_t mWantedMips;
+  float mDemand;
+};
+
+static inline float Lerp(float a, float b, float t) { return a + (b - a) * t; }
+
+static uint32_t FloorPowerOfTwo(uint32_t value) {
+  uint32_t result = 1;
+  while (result * 2 <= value) {
+    result *= 2;
+  }
+  return result;
+}
+
+/// Bilinear resample into a power-of-two image, so that every mip halves
+/// cleanly and stays a multiple of the 4x4 block size.
+static uint8_t *ResampleRGBA8(const uint8_t *pSrc, uint32_t srcWidth,
+                              uint32_t srcHeight, uint32_t dstWidth,
+                              uint32_t dstHeight) {
+  uint8_t *pDst =
+      reinterpret_cast<uint8_t *>(tf_malloc(dstWidth * dstHeight * 4));
+  float scaleX = (float)srcWidth / (float)dstWidth;
+  float scaleY = (float)srcHeight / (float)dstHeight;
+  for (uint32_t y = 0; y < dstHeight; ++y) {
+    float srcY = max((y + 0.5f) * scaleY - 0.5f, 0.0f);
+    uint32_t y0 = min((uint32_t)srcY, srcHeight - 1);
+    uint32_t y1 = min(y0 + 1, srcHeight - 1);
+    float fy = srcY - (float)y0;
+    for (uint32_t x = 0; x < dstWidth; ++x) {
+      float srcX = max((x + 0.5f) * scaleX - 0.5f, 0.0f);
+      uint32_t x0 = min((uint32_t)srcX, srcWidth - 1);
+      uint32_t x1 = min(x0 + 1, srcWidth - 1);
+      float fx = srcX - (float)x0;
+      for (uint32_t c = 0; c < 4; ++c) {
+        float top = Lerp((float)pSrc[(y0 * srcWidth + x0) * 4 + c],
+                         (float)pSrc[(y0 * srcWidth + x1) * 4 + c], fx);
+        float bottom = Lerp((float)pSrc[(y1 * srcWidth + x0) * 4 + c],
+                            (float)pSrc[(y1 * srcWidth + x1) * 4 + c], fx);
+        pDst[(y * dstWidth + x) * 4 + c] =
+            (uint8_t)(Lerp(top, bottom, fy) + 0.5f);
+      }
+    }
+  }
+  return pDst;
+}
+
+/// 2x2 box filter. Normal maps are renormalized so that lower mips don't
+/// flatten the surface.
+static void DownsampleRGBA8(const uint8_t *pSrc, uint32_t srcWidth,
+                            uint32_t srcHeight, uint8_t *pDst,
+                            bool renormalize) {
+  uint32_t dstWidth = srcWidth / 2;
+  uint32_t dstHeight = srcHeight / 2;
+  for (uint32_t y = 0; y < dstHeight; ++y) {
+    const uint8_t *pRow0 = pSrc + (2 * y) * srcWidth * 4;
+    const uint8_t *pRow1 = pRow0 + srcWidth * 4;
+    for (uint32_t x = 0; x < dstWidth; ++x) {
+      uint8_t *pOut = pDst + (y * dstWidth + x) * 4;
+      for (uint32_t c = 0; c < 4; ++c) {
+        uint32_t sum = pRow0[8 * x + c] + pRow0[8 * x + 4 + c] +
+                       pRow1[8 * x + c] + pRow1[8 * x + 4 + c];
+        pOut[c] = (uint8_t)((sum + 2) / 4);
+      }
+      if (renormalize) {
+        float n[3];
+        for (uint32_t c = 0; c < 3; ++c) {
+          n[c] = pOut[c] / 127.5f - 1.0f;
+        }
+        float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (len > 0.0f) {
+          for (uint32_t c = 0; c < 3; ++c) {
+            pOut[c] = (uint8_t)((n[c] / len * 0.5f + 0.5f) * 255.0f + 0.5f);
+          }
+        }
+      }
+    }
+  }
+}
+
+static void CompressMip(uint8_t *pPixels, uint32_t width, uint32_t height,
+                        StreamedTextureKind kind, uint8_t *pDst) {
+  TRACE_SCOPE("Compress Mip");
+  rgba_surface surface = {};
+  surface.ptr = pPixels;
+  surface.width = (int32_t)width;
+  surface.height = (int32_t)height;
+  surface.stride = (int32_t)width * 4;
+  switch (kind) {
+  case StreamedTextureKind::Diffuse: {
+    bc7_enc_settings settings;
+    GetProfile_alpha_veryfast(&settings);
+    CompressBlocksBC7(&surface, pDst, &settings);
+    return;
+  }
+  case StreamedTextureKind::Normal:
+    CompressBlocksBC5(&surface, pDst);
+    return;
+  }
+}
+
+static TinyImageFormat GetStreamedFormat(StreamedTextureKind kind) {
+  switch (kind) {
+  case StreamedTextureKind::Diffuse:
+    return TinyImageFormat_BC7_SRGB_BLOCK;
+  case StreamedTextureKind::Normal:
+    return TinyImageFormat_BC5_UNORM_BLOCK;
+  }
+  return TinyImageFormat_UNDEFINED;
+}
+
+uint8_t *DecodeTextureFile(const char *pFileName, uint32_t &width,
+                           uint32_t &height) {
+  FileStream file = {};
+  if (!fsOpenStreamFromPath(RD_TEXTURES, pFileName, FileMode::FM_READ,
+                            &file)) {
+    LOGF(eWARNING, "Failed to open texture %s", pFileName);
+    return NULL;
+  }
+  size_t fileSize = fsGetStreamFileSize(&file);
+  stbi_uc *pFileData = reinterpret_cast<stbi_uc *>(tf_malloc(fileSize));
+  fsReadFromStream(&file, pFileData, fileSize);
+  fsCloseStream(&file);
+
+  int decodedWidth, decodedHeight, channels;
+  stbi_uc *pPixels = stbi_load_from_memory(
+      pFileData, (int)fileSize, &decodedWidth, &decodedHeight, &channels, 4);
+  tf_free(pFileData);
+  if (pPixels == NULL) {
+    LOGF(eWARNING, "Failed to decode texture %s: %s", pFileName,
+         stbi_failure_reason());
+    return NULL;
+  }
+  width = (uint32_t)decodedWidth;
+  height = (uint32_t)decodedHeight;
+  return pPixels;
+}
+
+static void ConvertTexture(void *pUserData) {
+  TRACE_SCOPE("Convert Texture");
+  TextureStreamer::StreamedTexture &texture =
+      *reinterpret_cast<TextureStreamer::StreamedTexture *>(pUserData);
+
+  uint32_t width, height;
+  uint8_t *pPixels = DecodeTextureFile(texture.mFileName, width, height);
+  if (pPixels == NULL) {
+    tfrg_atomic32_store_release(&texture.mState, kStateFailed);
+    return;
+  }
+
+  uint32_t levelWidth = max(FloorPowerOfTwo(width), 4u);
+  uint32_t levelHeight = max(FloorPowerOfTwo(height), 4u);
+  uint8_t *pLevel =
+      ResampleRGBA8(pPixels, width, height, levelWidth, levelHeight);
+  tf_free(pPixels);
+
+  texture.mWidth = levelWidth;
+  texture.mHeight = levelHeight;
+  texture.mMipCount = 0;
+  for (;;) {
+    uint32_t mip = texture.mMipCount++;
+    texture.mMipBytes[mip] = (levelWidth / 4) * (levelHeight / 4) * kBlockBytes;
+    texture.pMipData[mip] = reinterpret_cast<uint8_t *>(MemoryAlloc(
+        kMemoryCategoryTextureStreamer, texture.mMipBytes[mip]));
+    CompressMip(pLevel, levelWidth, levelHeight, texture.mKind,
+                texture.pMipData[mip]);
+
+    if (texture.mMipCount == TextureStreamer::kMaxMipCount ||
+        levelWidth == 4 || levelHeight == 4) {
+      break;
+    }
+    uint8_t *pNextLevel = reinterpret_cast<uint8_t *>(
+        tf_malloc((levelWidth / 2) * (levelHeight / 2) * 4));
+    DownsampleRGBA8(pLevel, levelWidth, levelHeight, pNextLevel,
+                    texture.mKind == StreamedTextureKind::Normal);
+    tf_free(pLevel);
+    pLevel = pNextLevel;
+    levelWidth /= 2;
+    levelHeight /= 2;
+  }
+  tf_free(pLevel);
+
+  tfrg_atomic32_store_release(&texture.mState, kStateReady);
+}
+
+static uint64_t GetChainBytes(const TextureStreamer::StreamedTexture &texture,
+                              uint32_t mipCount) {
+  uint64_t bytes = 0;
+  for (uint32_t i = texture.mMipCount - mipCount; i < texture.mMipCount; ++i) {
+    bytes += texture.mMipBytes[i];
+  }
+  return bytes;
+}
+
+static uint32_t
+GetMinResidentMips(const TextureStreamer::StreamedTexture &texture) {
+  uint32_t mips = 1;
+  while (mips < texture.mMipCount) {
+    uint32_t mip = texture.mMipCount - mips - 1;
+    if (max(texture.mWidth >> mip, texture.mHeight >> mip) >
+        kMinResidentMipSize) {
+      break;
+    }
+    ++mips;
+  }
+  return mips;
+}
+
+/// Picks the smallest chain whose top mip still covers the on-screen size.
+static uint32_t
+GetWantedMips(const TextureStreamer::StreamedTexture &texture) {
+  uint32_t wanted = GetMinResidentMips(texture);
+  while (wanted < texture.mMipCount) {
+    uint32_t topMip = texture.mMipCount - wanted;
+    float topSize = (float)max(texture.mWidth >> topMip,
+                               texture.mHeight >> topMip);
+    if (topSize >= texture.mDemand) {
+      break;
+    }
+    ++wanted;
+  }
+  return wanted;
+}
+
+static Texture *CreatePlaceholder(TinyImageFormat format, const char *pName,
+                                  const uint8_t rgba[4]) {
+  Texture *pTexture = NULL;
+  TextureDesc desc = {};
+  desc.mWidth = 1;
+  desc.mHeight = 1;
+  desc.mDepth = 1;
+  desc.mArraySize = 1;
+  desc.mMipLevels = 1;
+  desc.mSampleCount = SAMPLE_COUNT_1;
+  desc.mFormat = format;
+  desc.mStartState = RESOURCE_STATE_SHADER_RESOURCE;
+  desc.mDescriptors = DESCRIPTOR_TYPE_TEXTURE;
+  desc.pName = pName;
+  TextureLoadDesc loadDesc = {};
+  loadDesc.pDesc = &desc;
+  loadDesc.ppTexture = &pTexture;
+  addResource(&loadDesc, NULL);
+
+  TextureUpdateDesc updateDesc = {};
+  updateDesc.pTexture = pTexture;
+  updateDesc.mMipLevels = 1;
+  updateDesc.mLayerCount = 1;
+  updateDesc.mCurrentState = RESOURCE_STATE_SHADER_RESOURCE;
+  beginUpdateResource(&updateDesc);
+  TextureSubresourceUpdate subresource =
+      getTextureSubresourceUpdate(&updateDesc, 0, 0);
+  memcpy(subresource.pMappedData, rgba, 4);
+  endUpdateResource(&updateDesc);
+  return pTexture;
+}
+
+void TextureStreamer::Init(RenderContext &renderContext,
+                           TaskSystem &taskSystem) {
+  pTaskSystem = &taskSystem;
+  pTextures = reinterpret_cast<StreamedTexture *>(MemoryCalloc(
+      kMemoryCategoryTextureStreamer, kMaxTextureCount,
+      sizeof(StreamedTexture)));
+
+  const uint8_t white[4] = {255, 255, 255, 255};
+  const uint8_t flatNormal[4] = {128, 128, 255, 255};
+  pPlaceholders[(uint32_t)StreamedTextureKind::Diffuse] = CreatePlaceholder(
+      TinyImageFormat_R8G8B8A8_SRGB, "PlaceholderDiffuse", white);
+  pPlaceholders[(uint32_t)StreamedTextureKind::Normal] = CreatePlaceholder(
+      TinyImageFormat_R8G8B8A8_UNORM, "PlaceholderNormal", flatNormal);
+  for (uint32_t i = 0; i < TF_ARRAY_COUNT(pPlaceholders); ++i) {
+    renderContext.TrackResource(kMemoryCategoryTextureStreamer,
+                                pPlaceholders[i]);
+  }
+}
+
+void TextureStreamer::Exit(RenderContext &renderContext) {
+  // Conversion jobs write into `pTextures`.
+  pTaskSystem->WaitBackgroundIdle();
+
+  for (uint32_t i = 0; i < mTextureCount; ++i) {
+    StreamedTexture &texture = pTextures[i];
+    renderContext.DeferDestroy(texture.pTexture,
+                               kMemoryCategoryTextureStreamer);
+    for (uint32_t mip = 0; mip < texture.mMipCount; ++mip) {
+      MemoryFree(texture.pMipData[mip]);
+    }
+  }
+  for (uint32_t i = 0; i < TF_ARRAY_COUNT(pPlaceholders); ++i) {
+    renderContext.DeferDestroy(pPlaceholders[i],
+                               kMemoryCategoryTextureStreamer);
+  }
+  MemoryFree(pTextures);
+  pTextures = NULL;
+  mTextureCount = 0;
+}
+
+uint32_t TextureStreamer::Request(const char *pFileName,
+                                  StreamedTextureKind kind) {
+  uint32_t handle = kInvalidHandle;
+  // Released textures still converting are taken back as they are, the
+  // first free slot otherwise.
+  for (uint32_t i = 0; i < mTextureCount; ++i) {
+    if (tfrg_atomic32_load_relaxed(&pTextures[i].mState) == kStateFree) {
+      handle = handle == kInvalidHandle ? i : handle;
+    } else if (pTextures[i].mKind == kind &&
+               strcmp(pTextures[i].mFileName, pFileName) == 0) {
+      pTextures[i].mRefCount++;
+      return i;
+    }
+  }
+  if (handle == kInvalidHandle) {
+    if (mTextureCount == kMaxTextureCount) {
+      LOGF(eWARNING, "Too many streamed textures, ignoring %s", pFileName);
+      return kInvalidHandle;
+    }
+    handle = mTextureCount++;
+  }
+
+  StreamedTexture &texture = pTextures[handle];
+  strncpy(texture.mFileName, pFileName, sizeof(texture.mFileName) - 1);
+  texture.mKind = kind;
+  texture.mRefCount = 1;
+  tfrg_atomic32_store_relaxed(&texture.mState, kStatePending);
+  pTaskSystem->Async(ConvertTexture, &texture);
+  return handle;
+}
+
+void TextureStreamer::Release(RenderContext &renderContext, uint32_t handle) {
+  if (handle == kInvalidHandle) {
+    return;
+  }
+  StreamedTexture &texture = pTextures[handle];
+  ASSERT(texture.mRefCount > 0);
+  if (--texture.mRefCount > 0 ||
+      tfrg_atomic32_load_acquire(&texture.mState) == kStatePending) {
+    return;
+  }
+  FreeTexture(renderContext, texture);
+}
+
+void TextureStreamer::FreeTexture(RenderContext &renderContext,
+                                  StreamedTexture &texture) {
+  renderContext.DeferDestroy(texture.pTexture, kMemoryCategoryTextureStreamer);
+  if (texture.mResidentMips > 0) {
+    mResidentBytes -= GetChainBytes(texture, texture.mResidentMips);
+  }
+  for (uint32_t mip = 0; mip < texture.mMipCount; ++mip) {
+    MemoryFree(texture.pMipData[mip]);
+  }
+  memset(&texture, 0, sizeof(texture));
+  tfrg_atomic32_store_relaxed(&texture.mState, kStateFree);
+  ++mGeneration;
+}
+
+void TextureStreamer::ResetDemand() {
+  for (uint32_t i = 0; i < mTextureCount; ++i) {
+    pTextures[i].mDemand = 0.0f;
+  }
+}
+
+void TextureStreamer::AddDemand(uint32_t handle, float screenSizePx) {
+  if (handle == kInvalidHandle) {
+    return;
+  }
+  pTextures[handle].mDemand = max(pTextures[handle].mDemand, screenSizePx);
+}
+
+Texture *TextureStreamer::GetTexture(uint32_t handle,
+                                     StreamedTextureKind kind) const {
+  if (handle == kInvalidHandle || pTextures[handle].pTexture == NULL) {
+    return pPlaceholders[(uint32_t)kind];
+  }
+  return pTextures[handle].pTexture;
+}
+
+void TextureStreamer::Update(RenderContext &renderContext,
+                             uint64_t budgetBytes) {
+  TRACE_SCOPE("Update Texture Streaming");
+  mRequestedBytes = 0;
+  for (uint32_t i = 0; i < mTextureCount; ++i) {
+    StreamedTexture &texture = pTextures[i];
+    uint32_t state = tfrg_atomic32_load_acquire(&texture.mState);
+    // Released while converting.
+    if (texture.mRefCount == 0 && state != kStatePending &&
+        state != kStateFree) {
+      FreeTexture(renderContext, texture);
+      continue;
+    }
+    if (state != kStateReady) {
+      continue;
+    }
+    if (texture.mResidentMips == 0) {
+      SetResidentMips(renderContext, texture, GetMinResidentMips(texture));
+    }
+    texture.mWantedMips = GetWantedMips(texture);
+    mRequestedBytes += GetChainBytes(texture, texture.mWantedMips);
+  }
+
+  // Least demanded texture that can give up its top mip, or NULL. A texture
+  // only gives way to a more demanded one, unless it holds more than it needs.
+  auto findVictim = [&](const StreamedTexture *pFor) -> StreamedTexture * {
+    StreamedTexture *pVictim = NULL;
+    for (uint32_t i = 0; i < mTextureCount; ++i) {
+      StreamedTexture &texture = pTextures[i];
+      if (&texture == pFor ||
+          texture.mResidentMips <= GetMinResidentMips(texture)) {
+        continue;
+      }
+      bool surplus = texture.mResidentMips > texture.mWantedMips;
+      if (!surplus && pFor && texture.mDemand >= pFor->mDemand) {
+        continue;
+      }
+      if (!pVictim || texture.mDemand < pVictim->mDemand) {
+        pVictim = &texture;
+      }
+    }
+    return pVictim;
+  };
+
+  uint32_t transitions = 0;
+  while (transitions < kMaxTransitionsPerFrame &&
+         mResidentBytes > budgetBytes) {
+    StreamedTexture *pVictim = findVictim(NULL);
+    if (!pVictim) {
+      break;
+    }
+    SetResidentMips(renderContext, *pVictim, pVictim->mResidentMips - 1);
+    ++transitions;
+  }
+
+  while (transitions < kMaxTransitionsPerFrame) {
+    StreamedTexture *pGrow = NULL;
+    for (uint32_t i = 0; i < mTextureCount; ++i) {
+      StreamedTexture &texture = pTextures[i];
+      if (texture.mResidentMips == 0 ||
+          texture.mResidentMips >= texture.mWantedMips) {
+        continue;
+      }
+      if (!pGrow || texture.mDemand > pGrow->mDemand) {
+        pGrow = &texture;
+      }
+    }
+    if (!pGrow) {
+      break;
+    }
+
+    uint64_t growBytes =
+        pGrow->mMipBytes[pGrow->mMipCount - pGrow->mResidentMips - 1];
+    while (transitions < kMaxTransitionsPerFrame &&
+           mResidentBytes + growBytes > budgetBytes) {
+      StreamedTexture *pVictim = findVictim(pGrow);
+      if (!pVictim) {
+        break;
+      }
+      SetResidentMips(renderContext, *pVictim, pVictim->mResidentMips - 1);
+      ++transitions;
+    }
+    if (transitions == kMaxTransitionsPerFrame ||
+        mResidentBytes + growBytes > budgetBytes) {
+      break;
+    }
+    SetResidentMips(renderContext, *pGrow, pGrow->mResidentMips + 1);
+    ++transitions;
+  }
+}
+
+void TextureStreamer::SetResidentMips(RenderContext &renderContext,
+                                      StreamedTexture &texture,
+                                      uint32_t residentMips) {
+  uint32_t baseMip = texture.mMipCount - residentMips;
+
+  Texture *pTexture = NULL;
+  TextureDesc desc = {};
+  desc.mWidth = texture.mWidth >> baseMip;
+  desc.mHeight = texture.mHeight >> baseMip;
+  desc.mDepth = 1;
+  desc.mArraySize = 1;
+  desc.mMipLevels = residentMips;
+  desc.mSampleCount = SAMPLE_COUNT_1;
+  desc.mFormat = GetStreamedFormat(texture.mKind);
+  desc.mStartState = RESOURCE_STATE_SHADER_RESOURCE;
+  desc.mDescriptors = DESCRIPTOR_TYPE_TEXTURE;
+  desc.pName = texture.mFileName;
+  TextureLoadDesc loadDesc = {};
+  loadDesc.pDesc = &desc;
+  loadDesc.ppTexture = &pTexture;
+  addResource(&loadDesc, NULL);
+  renderContext.TrackResource(kMemoryCategoryTextureStreamer, pTexture);
+
+  TextureUpdateDesc updateDesc = {};
+  updateDesc.pTexture = pTexture;
+  updateDesc.mMipLevels = residentMips;
+  updateDesc.mLayerCount = 1;
+  updateDesc.mCurrentState = RESOURCE_STATE_SHADER_RESOURCE;
+  beginUpdateResource(&updateDesc);
+  for (uint32_t mip = 0; mip < residentMips; ++mip) {
+    TextureSubresourceUpdate subresource =
+        getTextureSubresourceUpdate(&updateDesc, mip, 0);
+    const uint8_t *pSrc = texture.pMipData[baseMip + mip];
+    for (uint32_t row = 0; row < subresource.mRowCount; ++row) {
+      memcpy(subresource.pMappedData + row * subresource.mDstRowStride,
+             pSrc + row * subresource.mSrcRowStride,
+             subresource.mSrcRowStride);
+    }
+  }
+  endUpdateResource(&updateDesc);
+
+  renderContext.DeferDestroy(texture.pTexture, kMemoryCategoryTextureStreamer);
+  mResidentBytes -= texture.mResidentMips
+                        ? GetChainBytes(texture, texture.mResidentMips)
+                        : 0;
+  mResidentBytes += GetChainBytes(texture, residentMips);
+  RenderStatsAdd(kRenderCounterUploadedBytes,
+                 GetChainBytes(texture, residentMips));
+  texture.pTexture = pTexture;
+  texture.mResidentMips = residentMips;
+  ++mGeneration;
+}
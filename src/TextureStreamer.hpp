@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Graphics/Interfaces/IGraphics.h"
+#include "Resources/ResourceLoader/Interfaces/IResourceLoader.h"
+#include "Utilities/Interfaces/IFileSystem.h"
+#include "Utilities/Threading/Atomics.h"
+
+#include "RenderContext.hpp"
+#include "TaskSystem.hpp"
+
+enum class StreamedTextureKind {
+  Diffuse,
+  Normal,
+};
+
+/// Decodes a PNG, JPEG or TGA file in \c RD_TEXTURES into RGBA8 texels,
+/// freed with \c tf_free. Returns \c NULL, after logging why, on failure.
+uint8_t *DecodeTextureFile(const char *pFileName, uint32_t &width,
+                           uint32_t &height);
+
+/// \c TextureStreamer imports material textures in the background, converts
+/// them into block-compressed mip chains (BC7 for diffuse, BC5 for normal
+/// maps) and keeps a subset of each chain resident on the GPU under a VRAM
+/// budget.
+///
+/// Residency always grows from the smallest mips up, one mip per transition.
+/// The Forge cannot alias a texture's mip range, so a transition recreates the
+/// texture with its new mip count and defers the destruction of the previous
+/// one to the render context. Until a texture has any mip resident, a 1x1
+/// placeholder is returned in its place.
+class TextureStreamer {
+public:
+  static const uint32_t kInvalidHandle = ~0u;
+  static const uint32_t kMaxTextureCount = 1024;
+  static const uint32_t kMaxMipCount = 14;
+
+  void Init(RenderContext &renderContext, TaskSystem &taskSystem);
+  void Exit(RenderContext &renderContext);
+
+  /// Queues \c pFileName (relative to \c RD_TEXTURES) for conversion and
+  /// returns immediately. Requesting the same file twice returns the same
+  /// handle, and each request is matched by a \c Release.
+  uint32_t Request(const char *pFileName, StreamedTextureKind kind);
+  /// Once every request of a texture is released, its mips and its slot are
+  /// freed, and its GPU texture goes through the render context's deletion
+  /// queue. A texture still converting is freed once its conversion ends.
+  /// Ignores \c kInvalidHandle.
+  void Release(RenderContext &renderContext, uint32_t handle);
+
+  /// Demand is the on-screen size, in pixels, that the texture covers. It is
+  /// reset every frame and the largest reported value wins.
+  void ResetDemand();
+  void AddDemand(uint32_t handle, float screenSizePx);
+
+  /// Consumes finished conversions and performs residency transitions within
+  /// \c budgetBytes. Must be called once per frame from the main thread.
+  void Update(RenderContext &renderContext, uint64_t budgetBytes);
+
+  Texture *GetTexture(uint32_t handle, StreamedTextureKind kind) const;
+  /// Incremented whenever a texture returned by \c GetTexture may have
+  /// changed, so that descriptor sets referencing them can be refreshed.
+  inline uint32_t GetGeneration() const { return mGeneration; }
+  inline uint64_t GetResidentBytes() const { return mResidentBytes; }
+  inline uint64_t GetRequestedBytes() const { return mRequestedBytes; }
+
+  struct StreamedTexture;
+
+private:
+  TaskSystem *pTaskSystem = NULL;
+
+  StreamedTexture *pTextures = NULL;
+  uint32_t mTextureCount = 0;
+
+  Texture *pPlaceholders[2] = {};
+
+  uint32_t mGeneration = 0;
+  uint64_t mResidentBytes = 0;
+  uint64_t mRequestedBytes = 0;
+
+  void SetResidentMips(RenderContext &renderContext, StreamedTexture &texture,
+                       uint32_t residentMips);
+  void FreeTexture(RenderContext &renderContext, StreamedTexture &texture);
+};
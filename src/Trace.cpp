@@ -0,0 +1,174 @@
+#include "Trace.hpp"
+
+#include "Utilities/Interfaces/IFileSystem.h"
+#include "Utilities/Interfaces/ILog.h"
+#include "Utilities/Interfaces/ITime.h"
+#include "Utilities/Threading/Atomics.h"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+struct TraceEvent {
+  const char *pName;
+  int64_t mBeginUSec;
+  int64_t mEndUSec;
+  uint32_t mDepth;
+};
+
+struct TraceRing {
+  TraceEvent mEvents[kTraceRingEventCount];
+  /// Only grows; the ring size divides 2^32, so wrapping keeps the indices.
+  tfrg_atomic32_t mWriteCount;
+  const char *pThreadName;
+  // Open scopes, only touched by the owning thread.
+  const char *pScopeNames[kTraceMaxDepth];
+  int64_t mScopeBeginUSec[kTraceMaxDepth];
+  uint32_t mDepth;
+};
+
+static TraceRing *gTraceRings[kTraceMaxThreadCount] = {};
+static tfrg_atomic32_t gTraceRingCount = 0;
+static TraceRing *gGpuTraceRing = NULL;
+static int64_t gTraceStartUSec = 0;
+static thread_local TraceRing *tTraceRing = NULL;
+
+static TraceRing *GetThreadRing() {
+  if (tTraceRing) {
+    return tTraceRing;
+  }
+  uint32_t index = tfrg_atomic32_add_relaxed(&gTraceRingCount, 1);
+  if (index >= kTraceMaxThreadCount) {
+    return NULL;
+  }
+  TraceRing *pRing =
+      reinterpret_cast<TraceRing *>(tf_calloc(1, sizeof(TraceRing)));
+  // Published once its fields are zeroed, for TraceDump.
+  tfrg_atomicptr_store_release((tfrg_atomicptr_t *)&gTraceRings[index],
+                               (tfrg_atomicptr_t)pRing);
+  tTraceRing = pRing;
+  return pRing;
+}
+
+static void PushEvent(TraceRing *pRing, const char *pName, int64_t beginUSec,
+                      int64_t endUSec, uint32_t depth) {
+  uint32_t count = tfrg_atomic32_load_relaxed(&pRing->mWriteCount);
+  pRing->mEvents[count % kTraceRingEventCount] = {pName, beginUSec, endUSec,
+                                                  depth};
+  tfrg_atomic32_store_release(&pRing->mWriteCount, count + 1);
+}
+
+void TraceInit() {
+  gTraceStartUSec = getUSec(true);
+  gGpuTraceRing =
+      reinterpret_cast<TraceRing *>(tf_calloc(1, sizeof(TraceRing)));
+  gGpuTraceRing->pThreadName = "GPU";
+}
+
+void TraceExit() {
+  uint32_t ringCount =
+      min(tfrg_atomic32_load_acquire(&gTraceRingCount), kTraceMaxThreadCount);
+  for (uint32_t i = 0; i < ringCount; ++i) {
+    tf_free(gTraceRings[i]);
+    gTraceRings[i] = NULL;
+  }
+  tf_free(gGpuTraceRing);
+  gGpuTraceRing = NULL;
+  tTraceRing = NULL;
+  tfrg_atomic32_store_relaxed(&gTraceRingCount, 0);
+}
+
+void TraceSetThreadName(const char *pName) {
+  TraceRing *pRing = GetThreadRing();
+  if (pRing && pRing->pThreadName == NULL) {
+    pRing->pThreadName = pName;
+  }
+}
+
+void TraceBeginScope(const char *pName) {
+  TraceRing *pRing = GetThreadRing();
+  if (pRing == NULL) {
+    return;
+  }
+  if (pRing->mDepth < kTraceMaxDepth) {
+    pRing->pScopeNames[pRing->mDepth] = pName;
+    pRing->mScopeBeginUSec[pRing->mDepth] = getUSec(true);
+  }
+  pRing->mDepth++;
+}
+
+void TraceEndScope() {
+  TraceRing *pRing = tTraceRing;
+  if (pRing == NULL || pRing->mDepth == 0) {
+    return;
+  }
+  uint32_t depth = --pRing->mDepth;
+  if (depth < kTraceMaxDepth) {
+    PushEvent(pRing, pRing->pScopeNames[depth], pRing->mScopeBeginUSec[depth],
+              getUSec(true), depth);
+  }
+}
+
+void TraceAddGpuEvent(const char *pName, int64_t beginUSec, int64_t endUSec) {
+  if (gGpuTraceRing) {
+    PushEvent(gGpuTraceRing, pName, beginUSec, endUSec, 0);
+  }
+}
+
+static void DumpRing(FileStream &file, const TraceRing &ring, uint32_t tid,
+                     bool &first) {
+  if (ring.pThreadName) {
+    fsPrintToStream(&file,
+                    "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                    "\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                    first ? "" : ",\n", tid, ring.pThreadName);
+  } else {
+    fsPrintToStream(&file,
+                    "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                    "\"tid\":%u,\"args\":{\"name\":\"Thread %u\"}}",
+                    first ? "" : ",\n", tid, tid);
+  }
+  first = false;
+
+  // The owning thread keeps writing while this runs, so the oldest slots,
+  // which it's about to overwrite, are skipped.
+  const uint32_t kSafetyMargin = 256;
+  uint32_t count =
+      tfrg_atomic32_load_acquire((tfrg_atomic32_t *)&ring.mWriteCount);
+  uint32_t available = min(count, kTraceRingEventCount - kSafetyMargin);
+  for (uint32_t i = count - available; i != count; ++i) {
+    const TraceEvent &event = ring.mEvents[i % kTraceRingEventCount];
+    fsPrintToStream(&file,
+                    ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                    "\"ts\":%lld,\"dur\":%lld,\"args\":{\"depth\":%u}}",
+                    event.pName, tid,
+                    (long long)(event.mBeginUSec - gTraceStartUSec),
+                    (long long)(event.mEndUSec - event.mBeginUSec),
+                    event.mDepth);
+  }
+}
+
+bool TraceDump(const char *pFileName) {
+  FileStream file = {};
+  if (!fsOpenStreamFromPath(RD_LOG, pFileName, FM_WRITE, &file)) {
+    LOGF(eERROR, "Failed to open trace file %s", pFileName);
+    return false;
+  }
+  fsPrintToStream(&file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  bool first = true;
+  uint32_t ringCount =
+      min(tfrg_atomic32_load_acquire(&gTraceRingCount), kTraceMaxThreadCount);
+  for (uint32_t i = 0; i < ringCount; ++i) {
+    TraceRing *pRing = (TraceRing *)tfrg_atomicptr_load_acquire(
+        (tfrg_atomicptr_t *)&gTraceRings[i]);
+    // NULL while registered but not published yet.
+    if (pRing) {
+      DumpRing(file, *pRing, i + 1, first);
+    }
+  }
+  if (gGpuTraceRing) {
+    DumpRing(file, *gGpuTraceRing, 0, first);
+  }
+  fsPrintToStream(&file, "\n]}\n");
+  fsCloseStream(&file);
+  LOGF(eINFO, "Wrote trace to %s", pFileName);
+  return true;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+/// CPU scopes are recorded into one event ring per thread, which only that
+/// thread writes, so recording takes no lock. The rings are registered on
+/// first use and read back by \c TraceDump into a Chrome trace JSON file,
+/// which chrome://tracing and Perfetto open. Scope names must outlive the
+/// trace, so string literals are expected.
+static const uint32_t kTraceMaxThreadCount = 64;
+static const uint32_t kTraceRingEventCount = 8192;
+static const uint32_t kTraceMaxDepth = 32;
+
+void TraceInit();
+void TraceExit();
+
+/// Names the calling thread's track. Only the first call per thread counts.
+void TraceSetThreadName(const char *pName);
+
+void TraceBeginScope(const char *pName);
+void TraceEndScope();
+
+/// Adds a completed GPU scope, already converted to the CPU clock, to the
+/// GPU track. Must always be called from the same thread.
+void TraceAddGpuEvent(const char *pName, int64_t beginUSec, int64_t endUSec);
+
+/// Writes the events still held by the rings, relative to \c TraceInit, to
+/// \c pFileName in \c RD_LOG.
+bool TraceDump(const char *pFileName);
+
+struct TraceScope {
+  inline TraceScope(const char *pName) { TraceBeginScope(pName); }
+  inline ~TraceScope() { TraceEndScope(); }
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
@@ -0,0 +1,229 @@
+#include "TransformHierarchy.hpp"
+
+#include "Utilities/Interfaces/ILog.h"
+
+#include "Trace.hpp"
+
+#include "Utilities/Interfaces/IMemory.h"
+
+static const uint32_t kUnknownDepth = ~0u;
+/// Nodes per batch, small levels run on the calling thread.
+static const uint32_t kMinBatchSize = 1024;
+
+bool TransformHierarchy::Build(const int32_t *pInputParents,
+                               const JointPose *pLocals, uint32_t count,
+                               uint32_t *pNodeIndices) {
+  Destroy();
+  uint32_t *pDepths =
+      reinterpret_cast<uint32_t *>(tf_malloc(count * sizeof(uint32_t)));
+  uint32_t *pStack =
+      reinterpret_cast<uint32_t *>(tf_malloc(count * sizeof(uint32_t)));
+  for (uint32_t i = 0; i < count; ++i) {
+    pDepths[i] = kUnknownDepth;
+  }
+
+  // Walks up to the first ancestor of known depth, then numbers the nodes
+  // walked through on the way back, so each node is visited once.
+  uint32_t levelCount = 0;
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t stackSize = 0;
+    uint32_t depth = 0;
+    uint32_t node = i;
+    for (;;) {
+      if (pDepths[node] != kUnknownDepth) {
+        depth = pDepths[node] + 1;
+        break;
+      }
+      int32_t parent = pInputParents[node];
+      if (stackSize == count || parent >= (int32_t)count) {
+        LOGF(eERROR, "Node %u has an invalid ancestry", i);
+        tf_free(pStack);
+        tf_free(pDepths);
+        return false;
+      }
+      pStack[stackSize++] = node;
+      if (parent < 0) {
+        break;
+      }
+      node = (uint32_t)parent;
+    }
+    while (stackSize > 0) {
+      pDepths[pStack[--stackSize]] = depth++;
+    }
+    levelCount = max(levelCount, pDepths[i] + 1);
+  }
+
+  mNodeCount = count;
+  mLevelCount = levelCount;
+  pLevelOffsets = reinterpret_cast<uint32_t *>(
+      tf_calloc(levelCount + 1, sizeof(uint32_t)));
+  pParents = reinterpret_cast<int32_t *>(tf_malloc(count * sizeof(int32_t)));
+  pTranslations = reinterpret_cast<vec3 *>(tf_malloc(count * sizeof(vec3)));
+  pRotations = reinterpret_cast<Quat *>(tf_malloc(count * sizeof(Quat)));
+  pScales = reinterpret_cast<vec3 *>(tf_malloc(count * sizeof(vec3)));
+  pWorlds = reinterpret_cast<mat4 *>(tf_malloc(count * sizeof(mat4)));
+  pDirty = reinterpret_cast<uint8_t *>(tf_malloc(count));
+  pUpdatedVersions =
+      reinterpret_cast<uint32_t *>(tf_calloc(count, sizeof(uint32_t)));
+
+  // Counting sort by depth, stable within a level.
+  for (uint32_t i = 0; i < count; ++i) {
+    pLevelOffsets[pDepths[i] + 1]++;
+  }
+  for (uint32_t level = 0; level < levelCount; ++level) {
+    pLevelOffsets[level + 1] += pLevelOffsets[level];
+  }
+  // pStack now holds the next free slot of each level, then the new index of
+  // each input node.
+  for (uint32_t level = 0; level < levelCount; ++level) {
+    pStack[level] = pLevelOffsets[level];
+  }
+  for (uint32_t i = 0; i < count; ++i) {
+    pDepths[i] = pStack[pDepths[i]]++;
+  }
+  for (uint32_t i = 0; i < count; ++i) {
+    uint32_t node = pDepths[i];
+    int32_t parent = pInputParents[i];
+    pParents[node] = parent < 0 ? -1 : (int32_t)pDepths[parent];
+    pTranslations[node] = pLocals[i].mTranslation;
+    pRotations[node] = pLocals[i].mRotation;
+    pScales[node] = pLocals[i].mScale;
+    pDirty[node] = 1;
+    if (pNodeIndices) {
+      pNodeIndices[i] = node;
+    }
+  }
+  mFirstDirtyLevel = 0;
+  mLastDirtyLevel = levelCount > 0 ? levelCount - 1 : 0;
+
+  tf_free(pStack);
+  tf_free(pDepths);
+  return true;
+}
+
+void TransformHierarchy::Destroy() {
+  tf_free(pLevelOffsets);
+  tf_free(pParents);
+  tf_free(pTranslations);
+  tf_free(pRotations);
+  tf_free(pScales);
+  tf_free(pWorlds);
+  tf_free(pDirty);
+  tf_free(pUpdatedVersions);
+  *this = TransformHierarchy();
+}
+
+JointPose TransformHierarchy::GetLocal(uint32_t node) const {
+  return {pRotations[node], pTranslations[node], pScales[node]};
+}
+
+void TransformHierarchy::SetLocal(uint32_t node, const JointPose &local) {
+  pTranslations[node] = local.mTranslation;
+  pRotations[node] = local.mRotation;
+  pScales[node] = local.mScale;
+  pDirty[node] = 1;
+  uint32_t level = FindLevel(node);
+  if (mFirstDirtyLevel > mLastDirtyLevel) {
+    mFirstDirtyLevel = level;
+    mLastDirtyLevel = level;
+  } else {
+    mFirstDirtyLevel = min(mFirstDirtyLevel, level);
+    mLastDirtyLevel = max(mLastDirtyLevel, level);
+  }
+}
+
+uint32_t TransformHierarchy::FindLevel(uint32_t node) const {
+  // Last level starting at or before the node.
+  uint32_t first = 0;
+  uint32_t last = mLevelCount - 1;
+  while (first < last) {
+    uint32_t middle = (first + last + 1) / 2;
+    if (pLevelOffsets[middle] <= node) {
+      first = middle;
+    } else {
+      last = middle - 1;
+    }
+  }
+  return first;
+}
+
+struct TransformLevelUpdate {
+  uint32_t mBegin;
+  uint32_t mVersion;
+  const int32_t *pParents;
+  const vec3 *pTranslations;
+  const Quat *pRotations;
+  const vec3 *pScales;
+  mat4 *pWorlds;
+  uint8_t *pDirty;
+  uint32_t *pUpdatedVersions;
+  tfrg_atomic32_t mUpdatedCount;
+};
+
+static void UpdateLevelRange(void *pUserData, uint32_t begin, uint32_t end) {
+  TransformLevelUpdate &update =
+      *reinterpret_cast<TransformLevelUpdate *>(pUserData);
+  uint32_t updatedCount = 0;
+  for (uint32_t node = update.mBegin + begin; node < update.mBegin + end;
+       ++node) {
+    int32_t parent = update.pParents[node];
+    bool parentUpdated =
+        parent >= 0 && update.pUpdatedVersions[parent] == update.mVersion;
+    if (!update.pDirty[node] && !parentUpdated) {
+      continue;
+    }
+    mat4 local(Matrix3(update.pRotations[node]) *
+                   Matrix3::scale(update.pScales[node]),
+               update.pTranslations[node]);
+    update.pWorlds[node] =
+        parent < 0 ? local : update.pWorlds[parent] * local;
+    update.pDirty[node] = 0;
+    update.pUpdatedVersions[node] = update.mVersion;
+    ++updatedCount;
+  }
+  if (updatedCount > 0) {
+    tfrg_atomic32_add_relaxed(&update.mUpdatedCount, updatedCount);
+  }
+}
+
+uint32_t TransformHierarchy::Update(TaskSystem *pTaskSystem) {
+  if (mFirstDirtyLevel > mLastDirtyLevel || mNodeCount == 0) {
+    return 0;
+  }
+  TRACE_SCOPE("Update Transforms");
+  ++mVersion;
+  uint32_t totalCount = 0;
+  for (uint32_t level = mFirstDirtyLevel; level < mLevelCount; ++level) {
+    uint32_t begin = pLevelOffsets[level];
+    uint32_t count = pLevelOffsets[level + 1] - begin;
+    TransformLevelUpdate update = {
+        begin,   mVersion,    pParents, pTranslations,    pRotations,
+        pScales, pWorlds,     pDirty,   pUpdatedVersions, 0};
+    // Levels depend on the ones above, so each is a separate parallel loop.
+    if (pTaskSystem && count >= 2 * kMinBatchSize) {
+      pTaskSystem->ParallelFor(count, kMinBatchSize, UpdateLevelRange,
+                               &update);
+    } else {
+      UpdateLevelRange(&update, 0, count);
+    }
+    uint32_t updatedCount = tfrg_atomic32_load_relaxed(&update.mUpdatedCount);
+    totalCount += updatedCount;
+    // Below the last dirty level, only children of updated nodes change.
+    if (updatedCount == 0 && level >= mLastDirtyLevel) {
+      break;
+    }
+  }
+  mFirstDirtyLevel = mLevelCount;
+  mLastDirtyLevel = 0;
+  return totalCount;
+}
+
+uint64_t TransformHierarchy::GetSizeBytes() const {
+  if (mNodeCount == 0) {
+    return 0;
+  }
+  return (uint64_t)(mLevelCount + 1) * sizeof(uint32_t) +
+         (uint64_t)mNodeCount *
+             (sizeof(int32_t) + 2 * sizeof(vec3) + sizeof(Quat) +
+              sizeof(mat4) + sizeof(uint8_t) + sizeof(uint32_t));
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Utilities/Math/MathTypes.h"
+
+#include "Animation.hpp"
+#include "TaskSystem.hpp"
+
+/// A node hierarchy flattened into arrays sorted by depth, so that every
+/// level is a contiguous range whose parents all lie in the levels before
+/// it. Local transforms are split into one array per component, and world
+/// matrices are only recomputed for the subtrees below nodes whose local
+/// transform changed, one level at a time, each level spread over the task
+/// system.
+class TransformHierarchy {
+public:
+  /// \c pParents gives each node's parent, -1 for roots, in any order as
+  /// long as there is no cycle. Nodes are reordered by depth, keeping their
+  /// relative order within a level; if \c pNodeIndices isn't \c NULL, it
+  /// receives the new index of each input node. Every world matrix is dirty
+  /// until the first \c Update. Returns false on a cycle.
+  bool Build(const int32_t *pParents, const JointPose *pLocals,
+             uint32_t count, uint32_t *pNodeIndices);
+  void Destroy();
+
+  inline uint32_t GetNodeCount() const { return mNodeCount; }
+  inline uint32_t GetLevelCount() const { return mLevelCount; }
+  /// Parents precede their children, so -1 or lower than \c node.
+  inline int32_t GetParent(uint32_t node) const { return pParents[node]; }
+  JointPose GetLocal(uint32_t node) const;
+  void SetLocal(uint32_t node, const JointPose &local);
+
+  /// Valid for the nodes' state as of the last \c Update.
+  inline const mat4 &GetWorld(uint32_t node) const { return pWorlds[node]; }
+  inline const mat4 *GetWorlds() const { return pWorlds; }
+  /// Incremented by every \c Update that recomputed a world matrix, so that
+  /// copies of the matrices can tell whether they're stale.
+  inline uint32_t GetVersion() const { return mVersion; }
+
+  /// Runs on the calling thread when \c pTaskSystem is \c NULL. Returns the
+  /// number of world matrices recomputed.
+  uint32_t Update(TaskSystem *pTaskSystem);
+
+  uint64_t GetSizeBytes() const;
+
+private:
+  uint32_t mNodeCount = 0;
+  uint32_t mLevelCount = 0;
+  /// \c mLevelCount + 1 entries, the first node of each level.
+  uint32_t *pLevelOffsets = NULL;
+
+  int32_t *pParents = NULL;
+  vec3 *pTranslations = NULL;
+  Quat *pRotations = NULL;
+  vec3 *pScales = NULL;
+  mat4 *pWorlds = NULL;
+  /// Non-zero while the local transform changed since the last update.
+  uint8_t *pDirty = NULL;
+  /// The \c mVersion of the update that last recomputed each world matrix,
+  /// which also tells the children to recompute theirs.
+  uint32_t *pUpdatedVersions = NULL;
+
+  uint32_t mVersion = 0;
+  /// Range of levels holding dirty nodes, empty when \c mFirstDirtyLevel is
+  /// past \c mLastDirtyLevel.
+  uint32_t mFirstDirtyLevel = 0;
+  uint32_t mLastDirtyLevel = 0;
+
+  uint32_t FindLevel(uint32_t node) const;
+};
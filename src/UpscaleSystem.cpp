@@ -0,0 +1,108 @@
+#include "UpscaleSystem.hpp"
+
+#include "RenderStats.hpp"
+
+void UpscaleSystem::Init(RenderContext &renderContext) {
+  SamplerDesc samplerDesc = {FILTER_LINEAR,
+                             FILTER_LINEAR,
+                             MIPMAP_MODE_NEAREST,
+                             ADDRESS_MODE_CLAMP_TO_EDGE,
+                             ADDRESS_MODE_CLAMP_TO_EDGE,
+                             ADDRESS_MODE_CLAMP_TO_EDGE};
+  pLinearSampler = renderContext.CreateSampler(&samplerDesc);
+}
+void UpscaleSystem::Exit(RenderContext &renderContext) {
+  renderContext.DestroySampler(pLinearSampler);
+}
+
+void UpscaleSystem::Load(RenderContext &renderContext,
+                         ReloadDesc *pReloadDesc) {
+  if (pReloadDesc->mType & RELOAD_TYPE_SHADER) {
+    ShaderLoadDesc upscaleShader = {};
+    upscaleShader.mVert.pFileName = "upscale.vert";
+    upscaleShader.mFrag.pFileName = "upscale.frag";
+    pUpscaleShader = renderContext.LoadShader(&upscaleShader);
+
+    RootSignatureDesc rootDesc = {};
+    rootDesc.mShaderCount = 1;
+    rootDesc.ppShaders = &pUpscaleShader;
+    pRootSignature = renderContext.CreateRootSignature(&rootDesc);
+    mRootConstantIndex =
+        getDescriptorIndexFromName(pRootSignature, "upscaleRootConstant");
+
+    DescriptorSetDesc desc = {pRootSignature, DESCRIPTOR_UPDATE_FREQ_NONE, 1};
+    pDescriptorSetTexture = renderContext.CreateDescriptorSet(&desc);
+  }
+
+  if (pReloadDesc->mType & (RELOAD_TYPE_SHADER | RELOAD_TYPE_RENDERTARGET)) {
+    RasterizerStateDesc rasterizerStateDesc = {};
+    rasterizerStateDesc.mCullMode = CULL_MODE_NONE;
+
+    TinyImageFormat swapChainFormat = renderContext.GetSwapChainFormat();
+    PipelineDesc desc = {};
+    desc.mType = PIPELINE_TYPE_GRAPHICS;
+    GraphicsPipelineDesc &pipelineSettings = desc.mGraphicsDesc;
+    pipelineSettings.mPrimitiveTopo = PRIMITIVE_TOPO_TRI_LIST;
+    pipelineSettings.mRenderTargetCount = 1;
+    pipelineSettings.pColorFormats = &swapChainFormat;
+    pipelineSettings.mSampleCount = renderContext.GetSwapChainSampleCount();
+    pipelineSettings.mSampleQuality = renderContext.GetSwapChainSampleQuality();
+    pipelineSettings.mDepthStencilFormat = TinyImageFormat_UNDEFINED;
+    pipelineSettings.pRootSignature = pRootSignature;
+    pipelineSettings.pShaderProgram = pUpscaleShader;
+    pipelineSettings.pVertexLayout = NULL;
+    pipelineSettings.pRasterizerState = &rasterizerStateDesc;
+    pUpscalePipeline = renderContext.CreatePipeline(&desc);
+  }
+
+  // The scene color target is recreated with the swapchain.
+  RenderTarget *pSceneColor = renderContext.GetSceneColor();
+  DescriptorData params[2] = {};
+  params[0].pName = "SceneColor";
+  params[0].ppTextures = &pSceneColor->pTexture;
+  params[1].pName = "uLinearSampler";
+  params[1].ppSamplers = &pLinearSampler;
+  renderContext.UpdateDescriptorSet(pDescriptorSetTexture, 0, 2, params);
+}
+void UpscaleSystem::Unload(RenderContext &renderContext,
+                           ReloadDesc *pReloadDesc) {
+  if (pReloadDesc->mType & (RELOAD_TYPE_SHADER | RELOAD_TYPE_RENDERTARGET)) {
+    renderContext.DestroyPipeline(pUpscalePipeline);
+  }
+  if (pReloadDesc->mType & RELOAD_TYPE_SHADER) {
+    renderContext.DestroyDescriptorSet(pDescriptorSetTexture);
+    renderContext.DestroyRootSignature(pRootSignature);
+    renderContext.DestroyShader(pUpscaleShader);
+  }
+}
+
+void UpscaleSystem::Draw(RenderContext::Frame &frame) {
+  Cmd *cmd = frame.mCmdRingElement.pCmds[0];
+
+  BindRenderTargetsDesc bindRenderTargets = {};
+  bindRenderTargets.mRenderTargetCount = 1;
+  bindRenderTargets.mRenderTargets[0] = {frame.pImage, LOAD_ACTION_DONTCARE};
+  bindRenderTargets.mDepthStencil = {NULL, LOAD_ACTION_DONTCARE};
+  cmdBindRenderTargets(cmd, &bindRenderTargets);
+  cmdSetViewport(cmd, 0.0f, 0.0f, (float)frame.pImage->mWidth,
+                 (float)frame.pImage->mHeight, 0.0f, 1.0f);
+  cmdSetScissor(cmd, 0, 0, frame.pImage->mWidth, frame.pImage->mHeight);
+
+  float width = (float)frame.pSceneColor->mWidth;
+  float height = (float)frame.pSceneColor->mHeight;
+  UpscaleRootConstant constant = {};
+  constant.mUVScale = float2(frame.mSceneWidth / width,
+                             frame.mSceneHeight / height);
+  constant.mUVClamp = float2((frame.mSceneWidth - 0.5f) / width,
+                             (frame.mSceneHeight - 0.5f) / height);
+
+  cmdBindPipeline(cmd, pUpscalePipeline);
+  cmdBindDescriptorSet(cmd, 0, pDescriptorSetTexture);
+  cmdBindPushConstants(cmd, pRootSignature, mRootConstantIndex, &constant);
+  cmdDraw(cmd, 3, 0);
+  RenderStatsAdd(kRenderCounterDrawCalls, 1);
+  RenderStatsAdd(kRenderCounterTriangles, 1);
+  RenderStatsAdd(kRenderCounterVertices, 3);
+  RenderStatsAdd(kRenderCounterPipelineBinds, 1);
+  RenderStatsAdd(kRenderCounterDescriptorBinds, 1);
+}
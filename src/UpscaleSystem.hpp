@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Graphics/Interfaces/IGraphics.h"
+#include "Resources/ResourceLoader/Interfaces/IResourceLoader.h"
+
+#include "RenderContext.hpp"
+
+/// Bilinearly stretches the scaled scene viewport of the scene color target
+/// over the whole swapchain image.
+class UpscaleSystem {
+public:
+  void Init(RenderContext &renderContext);
+  void Exit(RenderContext &renderContext);
+
+  void Load(RenderContext &renderContext, ReloadDesc *pReloadDesc);
+  void Unload(RenderContext &renderContext, ReloadDesc *pReloadDesc);
+
+  /// Expects the scene color target in the shader resource state and leaves
+  /// the swapchain image bound.
+  void Draw(RenderContext::Frame &frame);
+
+private:
+  RootSignature *pRootSignature = NULL;
+  Shader *pUpscaleShader = NULL;
+  Pipeline *pUpscalePipeline = NULL;
+  DescriptorSet *pDescriptorSetTexture = NULL;
+  Sampler *pLinearSampler = NULL;
+  uint32_t mRootConstantIndex = 0;
+
+  struct UpscaleRootConstant {
+    /// Fraction of the target covered by the scene viewport.
+    float2 mUVScale;
+    /// Last texel center inside the viewport, so filtering never reads
+    /// outside of it.
+    float2 mUVClamp;
+  };
+};
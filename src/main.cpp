@@ -19,63 +19,304 @@
 #include "Utilities/Math/MathTypes.h"
 
 // Systems
+#include "AmbientOcclusionSystem.hpp"
+#include "BlendShapeSystem.hpp"
+#include "CameraPath.hpp"
+#include "ClusteredLighting.hpp"
+#include "DynamicResolution.hpp"
 #include "GuiSystem.hpp"
 #include "OrbitCameraController.hpp"
 #include "RenderContext.hpp"
+#include "RenderStats.hpp"
 #include "SceneRenderSystem.hpp"
+#include "TaskGraph.hpp"
+#include "TaskSystem.hpp"
+#include "TextureStreamer.hpp"
+#include "Trace.hpp"
+#include "UpscaleSystem.hpp"
 
 // Resources
+#include "Animation.hpp"
+#include "LightRig.hpp"
 #include "Scene.hpp"
 #include "SkyBox.hpp"
 
 class ModelViewer : public IApp {
 public:
+  /// Startup is a task graph, so that the window presents its first frame,
+  /// the sky box and a loading indicator, as soon as the renderer and its
+  /// pipelines are ready:
+  ///
+  /// - The model is imported on the background pool, into the spare scene,
+  ///   and swapped in by \c UpdateSceneLoading like any later model, while
+  ///   the main thread defines the fonts, waits for the sky box's faces and
+  ///   creates the shaders and pipelines in \c Load.
+  /// - The sky's lighting is baked on the background pool meanwhile, and
+  ///   uploaded from the main thread by \c UpdateStartup once it's done.
+  ///
+  /// Both background tasks spread their loops over the load workers, so
+  /// frames never wait for them. The main thread's steps are only timed as
+  /// spans rather than added as tasks: the framework calls \c Load right
+  /// after \c Init, and it binds the fonts and the faces, so those steps
+  /// neither wait for a task nor have one wait for them.
   bool Init() {
-    if (!mRenderContext.Init(GetName())) {
+    TraceInit();
+    TraceSetThreadName("Main");
+    if (!mTaskSystem.Init()) {
+      return false;
+    }
+    mStartup.Init(mTaskSystem);
+    uint64_t geometryPoolBytes = kDefaultGeometryPoolBytes;
+    for (int i = 1; i + 1 < argc; ++i) {
+      if (strcmp(argv[i], "--geometry-pool") == 0) {
+        geometryPoolBytes = (uint64_t)max(atoi(argv[i + 1]), 3) * 1024 * 1024;
+      }
+    }
+    // Indices take about half the bytes of the vertices they draw.
+    GeometryPoolDesc geometryPoolDesc = {};
+    geometryPoolDesc.mVertexStride = Scene::kVertexStride;
+    geometryPoolDesc.mVertexBytes = geometryPoolBytes / 3 * 2;
+    geometryPoolDesc.mIndexBytes = geometryPoolBytes / 3;
+    geometryPoolDesc.mMaxAllocationCount = kMaxGeometryAllocationCount;
+    if (!mRenderContext.Init(GetName(), geometryPoolDesc)) {
       ShowUnsupportedMessage("Failed To Initialize renderer!");
       return false;
     }
     mRenderSystem.Init(mRenderContext);
-    mGuiSystem.Init();
+    mUpscaleSystem.Init(mRenderContext);
+    mAmbientOcclusionSystem.Init(mRenderContext);
+    mTextureStreamer.Init(mRenderContext, mTaskSystem);
+    mClusteredLighting.Init(&mTaskSystem);
+    mStartup.AddSpan("Init renderer", 0, mStartup.GetTime());
+
+    const char *pModelFileName = "castle.fbx";
+    for (int i = 1; i < argc; ++i) {
+      mPackModel |= strcmp(argv[i], "--packed") == 0;
+      mVisibilityBuffer |= strcmp(argv[i], "--visibility-buffer") == 0;
+    }
+    for (int i = 1; i + 1 < argc; ++i) {
+      if (strcmp(argv[i], "--model") == 0) {
+        pModelFileName = argv[i + 1];
+      }
+      if (strcmp(argv[i], "--stats-stream") == 0) {
+        strncpy(mRenderStatsFileName, argv[i + 1], FS_MAX_PATH - 1);
+        mStreamRenderStats = true;
+      }
+      if (strcmp(argv[i], "--record-camera") == 0) {
+        strncpy(mCameraPathFileName, argv[i + 1], FS_MAX_PATH - 1);
+        mRecordCamera = true;
+      }
+      if (strcmp(argv[i], "--benchmark") == 0) {
+        strncpy(mCameraPathFileName, argv[i + 1], FS_MAX_PATH - 1);
+        mBenchmarkRequested = true;
+      }
+      if (strcmp(argv[i], "--benchmark-warmup") == 0) {
+        mBenchmarkDesc.mWarmupPassCount = (uint32_t)atoi(argv[i + 1]);
+      }
+      if (strcmp(argv[i], "--benchmark-passes") == 0) {
+        mBenchmarkDesc.mPassCount = (uint32_t)max(atoi(argv[i + 1]), 1);
+      }
+      if (strcmp(argv[i], "--benchmark-output") == 0) {
+        strncpy(mBenchmarkFileName, argv[i + 1], FS_MAX_PATH - 1);
+      }
+      if (strcmp(argv[i], "--stream") == 0) {
+        mStreamDesc.mGpuBudgetBytes =
+            (uint64_t)max(atoi(argv[i + 1]), 1) * 1024 * 1024;
+        mStreamModel = true;
+      }
+      if (strcmp(argv[i], "--stream-cpu") == 0) {
+        mStreamDesc.mCpuBudgetBytes =
+            (uint64_t)max(atoi(argv[i + 1]), 1) * 1024 * 1024;
+      }
+    }
+    if (strlen(pModelFileName) >= FS_MAX_PATH) {
+      LOGF(eERROR, "Model file name is too long: %s", pModelFileName);
+      return false;
+    }
+    balloc(&mModelFileName, FS_MAX_PATH);
+    bassigncstr(&mModelFileName, pModelFileName);
 
-    mScene.LoadRawFBX(mRenderContext, "castle.fbx");
+    // Only creates resources; the faces load on the resource loader's thread.
     mSkyBox.LoadDefault(mRenderContext);
+    uint32_t bakeTask =
+        mStartup.Add("Bake sky lighting", BakeSkyLighting, this, false);
+    uint32_t uploadTask =
+        mStartup.Add("Upload sky lighting", UploadSkyLighting, this, true);
+    mStartup.AddDependency(uploadTask, bakeTask);
+    // Streamed and packed models load on the main thread, as they're meant
+    // to load quickly anyway and decode with ParallelFor.
+    bool importModel = !mStreamModel && !mPackModel;
+    if (importModel) {
+      PrepareSceneLoad(pModelFileName, false);
+      mImportTask =
+          mStartup.Add("Import model", LoadSceneAsync, &mSceneLoad, false);
+    }
+    mStartup.Start();
+
+    int64_t spanBegin = mStartup.GetTime();
+    mGuiSystem.Init();
+    mStartup.AddSpan("Define fonts", spanBegin, mStartup.GetTime());
+
+    spanBegin = mStartup.GetTime();
+    if (mStreamModel) {
+      if (!LoadStreamedModel(pModelFileName)) {
+        return false;
+      }
+      // Reimports would load the whole model again.
+      mWatchModel = false;
+    } else if (mPackModel && !LoadPackedModel(pModelFileName)) {
+      // Falls back to the FBX.
+      PrepareSceneLoad(pModelFileName, false);
+      mTaskSystem.Async(LoadSceneAsync, &mSceneLoad);
+      importModel = true;
+    }
+    if (importModel) {
+      mGuiSystem.SetSceneStatus("Loading", pModelFileName);
+    } else {
+      strncpy(mCurrentModel, pModelFileName, FS_MAX_PATH - 1);
+      mCurrentModelTime = fsGetLastModifiedTime(RD_MESHES, mCurrentModel);
+      GetScene().RequestTextures(mTextureStreamer);
+      GetScene().AllowGeometryMoves();
+      mStartup.AddSpan(mStreamModel ? "Load streamed model"
+                                    : "Load packed model",
+                       spanBegin, mStartup.GetTime());
+    }
 
     mGpuProfileToken = mRenderContext.CreateGpuProfiler("Graphics");
 
+    spanBegin = mStartup.GetTime();
+    mSkyBox.WaitForFaces(mRenderContext);
+    // Buffers and textures created above must exist before Load binds them.
     waitForAllResourceLoads();
+    mStartup.AddSpan("Wait for sky box faces", spanBegin, mStartup.GetTime());
+    OnSceneChanged();
 
     vec3 camPos{0.0f, 0.0f, 10.0f};
     vec3 lookAt{vec3(0)};
     pCameraController = initOrbitCameraController(camPos, lookAt);
 
+    if (mBenchmarkRequested) {
+      if (!mCameraPath.Load(mCameraPathFileName)) {
+        return false;
+      }
+      // Every run must render at the same resolution. The benchmark itself
+      // starts once the model is shown, see UpdateStartup.
+      mDynamicResolution = false;
+      mRecordCamera = false;
+    }
+
     AddCustomInputBindings();
 
     return true;
   }
 
+  static void BakeSkyLighting(void *pUserData) {
+    ModelViewer *pApp = reinterpret_cast<ModelViewer *>(pUserData);
+    pApp->mSkyBox.BakeLighting(pApp->mTaskSystem.GetLoadTasks());
+  }
+
+  static void UploadSkyLighting(void *pUserData) {
+    reinterpret_cast<ModelViewer *>(pUserData)->mSkyBox.UploadLighting();
+  }
+
+  /// Runs the startup graph's main thread tasks, and logs its timeline once
+  /// it's done and the first model is shown or failed to load.
+  void UpdateStartup() {
+    if (mStartupFinished) {
+      return;
+    }
+    mStartup.RunMainThreadTasks();
+    if (!mStartup.IsFinished() ||
+        mSpareSceneState != SceneSlotState::Free || !mFirstFramePresented) {
+      return;
+    }
+    mStartupFinished = true;
+    if (mImportTask != kNoStartupTask) {
+      mStartup.AddSpan("Upload and show model",
+                       mStartup.GetFinishTime(mImportTask),
+                       mStartup.GetTime());
+    }
+    mStartup.LogTimeline("Started up");
+    if (!mBenchmarkRequested) {
+      return;
+    }
+    if (mCurrentModel[0] == '\0') {
+      LOGF(eERROR, "The benchmark needs a model, but none could be loaded");
+      requestShutdown();
+      return;
+    }
+    mBenchmark.Start(mCameraPath, mBenchmarkDesc);
+  }
+
   void Exit() {
+    LogMemoryReport(false);
     exitCameraController(pCameraController);
+    if (mRecordCamera) {
+      mCameraPath.Save(mCameraPathFileName);
+    }
+    mBenchmark.Destroy();
+    mCameraPath.Destroy();
 
-    mScene.Destroy(mRenderContext);
+    // A model may still be loading in the background.
+    mTaskSystem.WaitBackgroundIdle();
+    waitForAllResourceLoads();
+    if (mSpareSceneState == SceneSlotState::Loading &&
+        tfrg_atomic32_load_acquire(&mSceneLoad.mResult) ==
+            kSceneLoadSucceeded) {
+      GetSpareScene().Destroy(mRenderContext);
+    }
+    tf_free(mAnimation.pSkinningMatrices);
+    GetScene().Destroy(mRenderContext);
+    bdestroy(&mModelFileName);
     mSkyBox.Destroy(mRenderContext);
+    mTextureStreamer.Exit(mRenderContext);
+    mLightRig.Destroy();
+    mClusteredLighting.Exit();
 
     mGuiSystem.Exit();
+    mAmbientOcclusionSystem.Exit(mRenderContext);
+    mUpscaleSystem.Exit(mRenderContext);
     mRenderSystem.Exit(mRenderContext);
 
+    mRenderStatsStream.Close();
     mRenderContext.Exit();
+    mTaskSystem.Exit();
+    // Everything was released, so whatever is still live leaked.
+    LogMemoryReport(true);
+    RenderStatsExit();
+    TraceExit();
   }
 
   bool Load(ReloadDesc *pReloadDesc) {
+    int64_t loadBegin = mStartup.GetTime();
     if (!mRenderContext.Load(pWindow->handle, mSettings.mWidth,
                              mSettings.mHeight, mSettings.mVSyncEnabled,
                              pReloadDesc)) {
       return false;
     }
     mRenderSystem.Load(mRenderContext, mSkyBox, pReloadDesc);
+    mUpscaleSystem.Load(mRenderContext, pReloadDesc);
+    mAmbientOcclusionSystem.Load(mRenderContext, pReloadDesc);
+    mBlendShapeSystem.Load(mRenderContext, pReloadDesc);
     mGuiSystem.Load({&mSceneScale, &mCameraAcceleration, &mCameraBraking,
-                     &mCameraZoomSpeed, &mCameraOrbitSpeed},
+                     &mCameraZoomSpeed, &mCameraOrbitSpeed, &mTextureBudgetMB,
+                     &mDynamicResolution, &mResolutionScale,
+                     &mDynamicResolutionSettings.mTargetFrameMs,
+                     &mDynamicResolutionSettings.mMinScale,
+                     &mDynamicResolutionSettings.mMaxScale, &mLightCount,
+                     &mLightRadius, &mLightIntensity, &mAnimateLights,
+                     &mClusterHeatmap, &mPbrShading, &mVisibilityBuffer,
+                     &mAmbientOcclusion, &mAmbientOcclusionSettings.mQuality,
+                     &mAmbientOcclusionRadius,
+                     &mAmbientOcclusionSettings.mIntensity, &mPlayAnimation,
+                     &mAnimationSpeed, &mAnimateBlendShapes, &mModelFileName,
+                     &mWatchModel, &mStreamRenderStats, LoadModelFromGui,
+                     this},
                     mSettings.mWidth, mSettings.mHeight, pReloadDesc);
+    if (!mFirstFramePresented) {
+      mStartup.AddSpan("Load shaders and pipelines", loadBegin,
+                       mStartup.GetTime());
+    }
 
     return true;
   }
@@ -84,10 +325,26 @@ public:
     mRenderContext.WaitIdle();
     mRenderContext.Unload(pReloadDesc);
     mRenderSystem.Unload(mRenderContext, pReloadDesc);
+    mUpscaleSystem.Unload(mRenderContext, pReloadDesc);
+    mAmbientOcclusionSystem.Unload(mRenderContext, pReloadDesc);
+    mBlendShapeSystem.Unload(mRenderContext, pReloadDesc);
     mGuiSystem.Unload(pReloadDesc);
   }
 
   void Update(float deltaTime) {
+    TRACE_SCOPE("Update");
+    mDeltaTime = deltaTime;
+    if (mBenchmark.IsRunning()) {
+      deltaTime = mBenchmark.GetTimeStep();
+      if (mBenchmark.IsPassStart()) {
+        mLightTime = 0.0f;
+        mAnimation.mTime = 0.0f;
+        mBlendShapeTime = 0.0f;
+      }
+    }
+    UpdateModelWatch(deltaTime);
+    UpdateSceneLoading();
+    UpdateStartup();
     if (!uiIsFocused()) {
       CameraMotionParameters cmp{{},
                                  mCameraAcceleration,
@@ -112,6 +369,7 @@ public:
       }
       if (inputGetValue(0, CUSTOM_DUMP_PROFILE)) {
         dumpProfileData(GetName());
+        TraceDump("ModelViewer.trace.json");
       }
       if (inputGetValue(0, CUSTOM_EXIT)) {
         requestShutdown();
@@ -121,13 +379,342 @@ public:
     pCameraController->update(deltaTime);
 
     mat4 sceneMat = mat4::scale(vec3(mSceneScale));
-    mat4 viewMat = pCameraController->getViewMatrix();
+    mat4 viewMat = mBenchmark.IsRunning() ? mBenchmark.GetView()
+                                          : pCameraController->getViewMatrix();
+    if (mRecordCamera) {
+      mCameraPath.Record(viewMat);
+    }
     const float horizontal_fov = PI / 2.0f;
     const float aspectInverse =
         (float)mSettings.mHeight / (float)mSettings.mWidth;
     CameraMatrix projMat = CameraMatrix::perspectiveReverseZ(
-        horizontal_fov, aspectInverse, 0.1f, 1000.0f);
+        horizontal_fov, aspectInverse, kNearZ, kFarZ);
     mRenderSystem.UpdateSceneViewProj(sceneMat, viewMat, projMat);
+    mAmbientOcclusionSystem.UpdateProjection(projMat);
+    mAmbientOcclusionSettings.mRadius =
+        mAmbientOcclusionRadius * mSceneSize * mSceneScale;
+
+    UpdateLights(deltaTime, viewMat, projMat);
+    UpdateAnimation(deltaTime);
+    // Only nodes moved since the previous frame, and their subtrees, update.
+    GetScene().GetTransforms().Update(&mTaskSystem);
+    UpdateBlendShapeWeights(deltaTime);
+    // Chunks are streamed in model space, which the scene matrix scales.
+    GetScene().UpdateStreaming(mRenderContext,
+                               inverse(viewMat).getTranslation() / mSceneScale);
+
+    mTextureStreamer.ResetDemand();
+    GetScene().ReportTextureDemand(mTextureStreamer, viewMat * sceneMat,
+                               projMat.getPrimaryMatrix().getCol1().getY(),
+                               mSettings.mHeight * mResolutionScale);
+    mTextureStreamer.Update(mRenderContext,
+                            (uint64_t)(mTextureBudgetMB * 1024.0f * 1024.0f));
+    mGuiSystem.SetTextureStats(mTextureStreamer.GetResidentBytes(),
+                               mTextureStreamer.GetRequestedBytes());
+    mGuiSystem.SetDrawListStats(mRenderSystem.GetDrawListStats());
+    mGuiSystem.SetBlendShapeStats(mBlendShapeSystem.GetStats());
+    mGuiSystem.SetDeletionQueueStats(mRenderContext.GetDeletionQueueStats());
+    mGuiSystem.SetGeometryPoolStats(
+        mRenderContext.GetGeometryPool().GetStats());
+    mGuiSystem.UpdateMemoryStats();
+
+    UpdateResolutionScale();
+  }
+
+  void UpdateLights(float deltaTime, const mat4 &viewMat,
+                    const CameraMatrix &projMat) {
+    TRACE_SCOPE("Update Lights");
+    if (mLightCount != mGeneratedLights.mCount ||
+        mLightRadius != mGeneratedLights.mRadius ||
+        mLightIntensity != mGeneratedLights.mIntensity ||
+        mSceneScale != mGeneratedLights.mSceneScale) {
+      vec3 boundsMin, boundsMax;
+      GetScene().ComputeBounds(boundsMin, boundsMax);
+      mLightRig.Generate(mLightCount, mLightRadius, mLightIntensity,
+                         boundsMin * mSceneScale, boundsMax * mSceneScale);
+      mGeneratedLights = {mLightCount, mLightRadius, mLightIntensity,
+                          mSceneScale};
+    }
+    if (mAnimateLights) {
+      mLightTime += deltaTime;
+    }
+    mLightRig.Animate(mLightTime);
+
+    const mat4 &primaryProj = projMat.getPrimaryMatrix();
+    mClusteredLighting.SetProjection(primaryProj.getCol0().getX(),
+                                     primaryProj.getCol1().getY(), kNearZ,
+                                     kFarZ);
+    mClusteredLighting.Bin(mLightRig.GetLights(), mLightRig.GetLightCount(),
+                           viewMat);
+    mGuiSystem.SetLightingStats(mClusteredLighting.GetStats());
+  }
+
+  /// Queues \c pFileName, relative to \c RD_MESHES, to replace the current
+  /// model once it's loaded. Only the latest request is kept.
+  void RequestModel(const char *pFileName) {
+    if (strlen(pFileName) >= FS_MAX_PATH) {
+      LOGF(eERROR, "Model file name is too long: %s", pFileName);
+      return;
+    }
+    strncpy(mQueuedModel, pFileName, FS_MAX_PATH - 1);
+    mQueuedModel[FS_MAX_PATH - 1] = '\0';
+    mModelQueued = true;
+  }
+
+  /// Streams \c pFileName from its chunk file, converting it first if the
+  /// chunk file is missing or older than the model.
+  bool LoadStreamedModel(const char *pFileName) {
+    char chunkFileName[FS_MAX_PATH] = {};
+    snprintf(chunkFileName, FS_MAX_PATH, "%s.chunks", pFileName);
+    if (fsGetLastModifiedTime(RD_MESHES, chunkFileName) <
+            fsGetLastModifiedTime(RD_MESHES, pFileName) &&
+        !Scene::ConvertFBXToChunks(pFileName, chunkFileName)) {
+      return false;
+    }
+    return GetScene().LoadStreamed(mRenderContext, mTaskSystem, chunkFileName,
+                                   mStreamDesc);
+  }
+
+  /// Loads \c pFileName from its packed file, packing it first if the packed
+  /// file is missing or older than the model.
+  bool LoadPackedModel(const char *pFileName) {
+    char packedFileName[FS_MAX_PATH] = {};
+    snprintf(packedFileName, FS_MAX_PATH, "%s.packed", pFileName);
+    if (fsGetLastModifiedTime(RD_MESHES, packedFileName) <
+        fsGetLastModifiedTime(RD_MESHES, pFileName)) {
+      // The spare scene stays free until the first model is shown.
+      Scene &imported = GetSpareScene();
+      if (!imported.ImportRaw(pFileName, &mTaskSystem)) {
+        return false;
+      }
+      bool packed = imported.WritePacked(packedFileName);
+      imported.Destroy(mRenderContext);
+      if (!packed) {
+        return false;
+      }
+    }
+    return GetScene().LoadPacked(mRenderContext, mTaskSystem, packedFileName);
+  }
+
+  static void LoadModelFromGui(void *pUserData) {
+    ModelViewer *pApp = reinterpret_cast<ModelViewer *>(pUserData);
+    pApp->RequestModel((const char *)pApp->mModelFileName.data);
+  }
+
+  static void LoadSceneAsync(void *pUserData) {
+    SceneLoad &load = *reinterpret_cast<SceneLoad *>(pUserData);
+    // Reimports are only uploaded if they can't be patched into the current
+    // scene.
+    bool succeeded =
+        load.mReimport
+            ? load.pScene->ImportRaw(load.mFileName, load.pTaskSystem)
+            : load.pScene->LoadRaw(*load.pRenderContext, load.mFileName,
+                                   load.pTaskSystem);
+    tfrg_atomic32_store_release(&load.mResult, succeeded
+                                                   ? kSceneLoadSucceeded
+                                                   : kSceneLoadFailed);
+  }
+
+  /// Polls the current model's modification time, and reimports it when it
+  /// changes.
+  void UpdateModelWatch(float deltaTime) {
+    mWatchTimer += deltaTime;
+    if (!mWatchModel || mWatchTimer < kWatchIntervalSeconds ||
+        mSpareSceneState != SceneSlotState::Free || mModelQueued) {
+      return;
+    }
+    mWatchTimer = 0.0f;
+    time_t modifiedTime = fsGetLastModifiedTime(RD_MESHES, mCurrentModel);
+    if (modifiedTime == mCurrentModelTime) {
+      return;
+    }
+    // Set now, so that a file caught mid-write is only retried once it's
+    // modified again.
+    mCurrentModelTime = modifiedTime;
+    StartSceneLoad(mCurrentModel, true);
+    mGuiSystem.SetSceneStatus("Reimporting", mCurrentModel);
+  }
+
+  /// Sets up the load of \c pFileName into the spare scene, for
+  /// \c LoadSceneAsync.
+  void PrepareSceneLoad(const char *pFileName, bool reimport) {
+    mSceneLoad.pScene = &GetSpareScene();
+    mSceneLoad.pRenderContext = &mRenderContext;
+    mSceneLoad.pTaskSystem = mTaskSystem.GetLoadTasks();
+    strncpy(mSceneLoad.mFileName, pFileName, FS_MAX_PATH - 1);
+    mSceneLoad.mFileName[FS_MAX_PATH - 1] = '\0';
+    mSceneLoad.mReimport = reimport;
+    mSceneLoad.mModifiedTime = fsGetLastModifiedTime(RD_MESHES, pFileName);
+    mSceneLoad.mStartUSec = getUSec(false);
+    tfrg_atomic32_store_relaxed(&mSceneLoad.mResult, kSceneLoadPending);
+    mTexturesRequested = false;
+    mSpareSceneState = SceneSlotState::Loading;
+  }
+
+  void StartSceneLoad(const char *pFileName, bool reimport) {
+    PrepareSceneLoad(pFileName, reimport);
+    mTaskSystem.Async(LoadSceneAsync, &mSceneLoad);
+  }
+
+  /// Models are parsed on the background pool into the spare scene, which
+  /// keeps rendering the current one, and swapped in at the start of a frame
+  /// once their buffers are on the GPU. The previous scene's resources go
+  /// through the render context's deletion queue.
+  void UpdateSceneLoading() {
+    TRACE_SCOPE("Update Scene Loading");
+    switch (mSpareSceneState) {
+    case SceneSlotState::Free:
+      if (mModelQueued) {
+        mModelQueued = false;
+        StartSceneLoad(mQueuedModel, false);
+        mGuiSystem.SetSceneStatus("Loading", mSceneLoad.mFileName);
+      }
+      break;
+    case SceneSlotState::Loading: {
+      uint32_t result = tfrg_atomic32_load_acquire(&mSceneLoad.mResult);
+      if (result == kSceneLoadFailed) {
+        mSpareSceneState = SceneSlotState::Free;
+        mGuiSystem.SetSceneStatus("Failed to load", mSceneLoad.mFileName);
+        break;
+      }
+      if (result != kSceneLoadSucceeded) {
+        break;
+      }
+      if (!mTexturesRequested) {
+        if (mSceneLoad.mReimport) {
+          if (GetScene().CanPatch(GetSpareScene())) {
+            ScenePatchStats stats = GetScene().Patch(GetSpareScene());
+            GetSpareScene().Destroy(mRenderContext);
+            mSpareSceneState = SceneSlotState::Free;
+            OnSceneChanged();
+            OnReimported(&stats);
+            mGuiSystem.SetSceneStatus("Showing", mSceneLoad.mFileName);
+            break;
+          }
+          GetSpareScene().UploadRaw(mRenderContext);
+        }
+        GetSpareScene().RequestTextures(mTextureStreamer);
+        // Every write to the geometry was issued by now, UploadRaw running on
+        // the loading thread or above.
+        GetSpareScene().AllowGeometryMoves();
+        mTexturesRequested = true;
+      }
+      if (GetSpareScene().IsUploaded()) {
+        mCurrentScene ^= 1;
+        // Textures shared with the new scene were requested again above, and
+        // stay resident.
+        GetSpareScene().ReleaseTextures(mRenderContext, mTextureStreamer);
+        GetSpareScene().Destroy(mRenderContext);
+        mSpareSceneState = SceneSlotState::Free;
+        strncpy(mCurrentModel, mSceneLoad.mFileName, FS_MAX_PATH - 1);
+        mCurrentModel[FS_MAX_PATH - 1] = '\0';
+        mCurrentModelTime = mSceneLoad.mModifiedTime;
+        OnSceneChanged();
+        if (mSceneLoad.mReimport) {
+          OnReimported(NULL);
+        }
+        mGuiSystem.SetSceneStatus("Showing", mSceneLoad.mFileName);
+      }
+      break;
+    }
+    }
+    // Reimports are patched in quickly, or the previous version stays shown.
+    if (mSpareSceneState == SceneSlotState::Loading && !mSceneLoad.mReimport) {
+      mGuiSystem.SetLoadingIndicator(
+          mSceneLoad.mFileName,
+          (float)(getUSec(false) - mSceneLoad.mStartUSec) / 1000000.0f);
+    } else {
+      mGuiSystem.SetLoadingIndicator(NULL, 0.0f);
+    }
+  }
+
+  /// \c pPatchStats is \c NULL if the reimported model replaced the current
+  /// one instead of being patched into it.
+  void OnReimported(const ScenePatchStats *pPatchStats) {
+    float latencyMs =
+        (float)(getUSec(false) - mSceneLoad.mStartUSec) / 1000.0f;
+    if (pPatchStats) {
+      LOGF(eINFO, "Reimported %s in %.1f ms: %u of %u meshes patched",
+           mSceneLoad.mFileName, latencyMs, pPatchStats->mPatchedMeshCount,
+           pPatchStats->mMeshCount);
+    } else {
+      LOGF(eINFO, "Reimported %s in %.1f ms: layout changed, reloaded",
+           mSceneLoad.mFileName, latencyMs);
+    }
+    mGuiSystem.SetReimportStatus(latencyMs, pPatchStats);
+  }
+
+  /// Resets everything derived from the previous scene.
+  void OnSceneChanged() {
+    vec3 boundsMin, boundsMax;
+    GetScene().ComputeBounds(boundsMin, boundsMax);
+    mSceneSize = max(length(boundsMax - boundsMin), 1e-3f);
+    mGeneratedLights = {};
+
+    tf_free(mAnimation.pSkinningMatrices);
+    mAnimation = {};
+    InitAnimation();
+
+    const BlendShapeSet &blendShapes = GetScene().GetBlendShapes();
+    for (uint32_t i = 0; i < blendShapes.GetTargetCount(); ++i) {
+      mBlendShapeWeights[i] = blendShapes.GetTarget(i).mDefaultWeight;
+    }
+    mBlendShapeTime = 0.0f;
+  }
+
+  /// Plays the scene's first clip, if any. Without one, skinned meshes stay
+  /// in their bind pose.
+  void InitAnimation() {
+    const Skeleton &skeleton = GetScene().GetSkeleton();
+    if (skeleton.mJointCount == 0) {
+      return;
+    }
+    mAnimation.pSkeleton = &skeleton;
+    mAnimation.pClip =
+        GetScene().GetClipCount() > 0 ? &GetScene().GetClip(0) : NULL;
+    mAnimation.mTime = 0.0f;
+    mAnimation.pSkinningMatrices = reinterpret_cast<mat4 *>(
+        tf_malloc(skeleton.mJointCount * sizeof(mat4)));
+    for (uint32_t i = 0; i < skeleton.mJointCount; ++i) {
+      mAnimation.pSkinningMatrices[i] = mat4::identity();
+    }
+  }
+
+  void UpdateAnimation(float deltaTime) {
+    if (mAnimation.pClip == NULL || !mPlayAnimation) {
+      return;
+    }
+    mAnimation.mSpeed = mAnimationSpeed;
+    UpdateAnimationInstances(&mTaskSystem, &mAnimation, 1, deltaTime);
+  }
+
+  /// Previews the blend shapes by sweeping through them, one per second, so
+  /// that only the one or two targets around the sweep are active.
+  void UpdateBlendShapeWeights(float deltaTime) {
+    uint32_t targetCount = GetScene().GetBlendShapes().GetTargetCount();
+    if (!mAnimateBlendShapes || targetCount == 0) {
+      return;
+    }
+    mBlendShapeTime = fmodf(mBlendShapeTime + deltaTime, (float)targetCount);
+    for (uint32_t i = 0; i < targetCount; ++i) {
+      mBlendShapeWeights[i] = max(1.0f - fabsf(mBlendShapeTime - i), 0.0f);
+    }
+  }
+
+  void UpdateResolutionScale() {
+    mDynamicResolutionSettings.mMaxScale =
+        max(mDynamicResolutionSettings.mMaxScale,
+            mDynamicResolutionSettings.mMinScale);
+    if (mDynamicResolution) {
+      // The whole GPU frame, including the UI, is what has to fit the target.
+      mResolutionScale =
+          mResolutionController.Update(getGpuProfileTime(mGpuProfileToken),
+                                       mResolutionScale,
+                                       mDynamicResolutionSettings);
+    } else {
+      mResolutionController.Reset();
+    }
+    mRenderContext.SetRenderScale(mResolutionScale);
   }
 
   void Draw() {
@@ -136,36 +723,131 @@ public:
       mRenderContext.ToggleVSync();
     }
 
+    TRACE_SCOPE("Draw");
+    int64_t drawBegin = mStartup.GetTime();
     RenderContext::Frame frame = mRenderContext.BeginFrame();
     Cmd *cmd = frame.mCmdRingElement.pCmds[0];
 
+    TraceBeginScope("Record Commands");
     beginCmd(cmd);
-    cmdBeginGpuFrameProfile(cmd, mGpuProfileToken);
+    mRenderContext.BeginGpuFrameProfile(cmd, mGpuProfileToken);
+    mRenderContext.BeginGpuScope(cmd, mGpuProfileToken, "Compact Geometry");
+    mRenderContext.CompactGeometry(cmd);
+    mRenderContext.EndGpuScope(cmd, mGpuProfileToken);
+    if (GetScene().GetMorphedVertexBuffer()) {
+      mRenderContext.BeginGpuScope(cmd, mGpuProfileToken, "Blend Shapes");
+      mBlendShapeSystem.Draw(mRenderContext, frame, GetScene(),
+                             mBlendShapeWeights);
+      mRenderContext.EndGpuScope(cmd, mGpuProfileToken);
+    }
     RenderTargetBarrier barriers[] = {
         {frame.pImage, RESOURCE_STATE_PRESENT, RESOURCE_STATE_RENDER_TARGET},
+        {frame.pSceneColor, RESOURCE_STATE_SHADER_RESOURCE,
+         RESOURCE_STATE_RENDER_TARGET},
     };
-    cmdResourceBarrier(cmd, 0, NULL, 0, NULL, 1, barriers);
+    cmdResourceBarrier(cmd, 0, NULL, 0, NULL, 2, barriers);
     ClearScreen(frame);
 
-    cmdBeginGpuTimestampQuery(cmd, mGpuProfileToken, "Draw Canvas");
-    mRenderSystem.Draw(frame, mScene, mSkyBox, mGpuProfileToken);
-    cmdEndGpuTimestampQuery(cmd, mGpuProfileToken);
+    mRenderSystem.UpdateMaterials(mRenderContext, frame, GetScene(),
+                                  mTextureStreamer);
+    mRenderSystem.UpdateLights(frame, mClusteredLighting, mClusterHeatmap);
+    mRenderSystem.UpdateShading(mSkyBox, mPbrShading);
+    mRenderSystem.UpdateNodes(frame, GetScene());
+    if (mAnimation.pSkeleton) {
+      mRenderSystem.UpdateSkinning(frame, mAnimation.pSkinningMatrices,
+                                   mAnimation.pSkeleton->mJointCount);
+    }
+    mRenderContext.BeginGpuScope(cmd, mGpuProfileToken, "Draw Canvas");
+    mRenderSystem.Draw(mRenderContext, frame, GetScene(), mSkyBox,
+                       mVisibilityBuffer, mGpuProfileToken);
+    mRenderContext.EndGpuScope(cmd, mGpuProfileToken);
+
+    cmdBindRenderTargets(cmd, NULL);
+
+    if (mAmbientOcclusion) {
+      mRenderContext.BeginGpuScope(cmd, mGpuProfileToken,
+                                   "Ambient Occlusion");
+      mAmbientOcclusionSystem.Draw(frame, mAmbientOcclusionSettings);
+      mRenderContext.EndGpuScope(cmd, mGpuProfileToken);
+    }
+
+    barriers[0] = {frame.pSceneColor, RESOURCE_STATE_RENDER_TARGET,
+                   RESOURCE_STATE_SHADER_RESOURCE};
+    cmdResourceBarrier(cmd, 0, NULL, 0, NULL, 1, barriers);
+
+    mRenderContext.BeginGpuScope(cmd, mGpuProfileToken, "Upscale");
+    mUpscaleSystem.Draw(frame);
+    mRenderContext.EndGpuScope(cmd, mGpuProfileToken);
 
     cmdBindRenderTargets(cmd, NULL);
 
-    cmdBeginGpuTimestampQuery(cmd, mGpuProfileToken, "Draw UI");
+    mRenderContext.BeginGpuScope(cmd, mGpuProfileToken, "Draw UI");
     mGuiSystem.Draw(frame, mGpuProfileToken);
-    cmdEndGpuTimestampQuery(cmd, mGpuProfileToken);
+    mRenderContext.EndGpuScope(cmd, mGpuProfileToken);
 
     cmdBindRenderTargets(cmd, NULL);
 
     barriers[0] = {frame.pImage, RESOURCE_STATE_RENDER_TARGET,
                    RESOURCE_STATE_PRESENT};
     cmdResourceBarrier(cmd, 0, NULL, 0, NULL, 1, barriers);
-    cmdEndGpuFrameProfile(cmd, mGpuProfileToken);
+    mRenderContext.EndGpuFrameProfile(cmd, mGpuProfileToken);
     endCmd(cmd);
+    TraceEndScope();
 
     mRenderContext.EndFrame(std::move(frame));
+    if (!mFirstFramePresented) {
+      mFirstFramePresented = true;
+      mStartup.AddSpan("First frame", drawBegin, mStartup.GetTime());
+    }
+    UpdateRenderStats();
+    UpdateBenchmark();
+  }
+
+  void UpdateBenchmark() {
+    if (!mBenchmark.IsRunning()) {
+      return;
+    }
+    uint32_t gpuScopeCount = 0;
+    const RenderContext::GpuScopeTiming *pGpuScopes =
+        mRenderContext.GetGpuScopeTimings(gpuScopeCount);
+    mBenchmark.EndFrame(mRenderStats, pGpuScopes, gpuScopeCount);
+    if (mBenchmark.IsFinished()) {
+      mBenchmark.WriteReport(mBenchmarkFileName, mCurrentModel);
+      mBenchmark.Destroy();
+      requestShutdown();
+    }
+  }
+
+  /// Merges the counters of the frame just submitted, along with anything
+  /// the loading threads counted meanwhile, and shows and streams them.
+  void UpdateRenderStats() {
+    if (mStreamRenderStats != mRenderStatsStream.IsOpen()) {
+      if (!mStreamRenderStats) {
+        mRenderStatsStream.Close();
+      } else if (!mRenderStatsStream.Open(mRenderStatsFileName)) {
+        mStreamRenderStats = false;
+      }
+    }
+
+    RenderStatsCollect(mRenderStats);
+    mRenderStats.mFrame++;
+    mRenderStats.mCpuMs = mDeltaTime * 1000.0f;
+    mRenderStats.mGpuMs = getGpuProfileTime(mGpuProfileToken);
+    uint64_t geometryBytes = GetScene().GetGpuBytes();
+    // The spare scene only holds buffers once its upload started.
+    if (mSpareSceneState == SceneSlotState::Loading && mTexturesRequested) {
+      geometryBytes += GetSpareScene().GetGpuBytes();
+    }
+    mRenderStats.mResidentBytes[kGpuMemoryGeometry] = geometryBytes;
+    mRenderStats.mResidentBytes[kGpuMemoryTextures] =
+        mTextureStreamer.GetResidentBytes();
+    mRenderStats.mResidentBytes[kGpuMemoryRenderTargets] =
+        mRenderContext.GetRenderTargetBytes();
+    mRenderStats.mResidentBytes[kGpuMemoryPendingDeletion] =
+        mRenderContext.GetDeletionQueueStats().mPendingBytes;
+
+    mGuiSystem.SetRenderStats(mRenderStats);
+    mRenderStatsStream.Write(mRenderStats);
   }
 
   void ClearScreen(RenderContext::Frame &frame) {
@@ -173,12 +855,13 @@ public:
 
     BindRenderTargetsDesc bindRenderTargets = {};
     bindRenderTargets.mRenderTargetCount = 1;
-    bindRenderTargets.mRenderTargets[0] = {frame.pImage, LOAD_ACTION_CLEAR};
+    bindRenderTargets.mRenderTargets[0] = {frame.pSceneColor,
+                                           LOAD_ACTION_CLEAR};
     bindRenderTargets.mDepthStencil = {frame.pDepthBuffer, LOAD_ACTION_CLEAR};
     cmdBindRenderTargets(cmd, &bindRenderTargets);
-    cmdSetViewport(cmd, 0.0f, 0.0f, (float)frame.pImage->mWidth,
-                   (float)frame.pImage->mHeight, 0.0f, 1.0f);
-    cmdSetScissor(cmd, 0, 0, frame.pImage->mWidth, frame.pImage->mHeight);
+    cmdSetViewport(cmd, 0.0f, 0.0f, (float)frame.mSceneWidth,
+                   (float)frame.mSceneHeight, 0.0f, 1.0f);
+    cmdSetScissor(cmd, 0, 0, frame.mSceneWidth, frame.mSceneHeight);
   }
 
   const char *GetName() { return "ModelViewer"; }
@@ -189,14 +872,125 @@ public:
   }
 
 private:
+  TaskSystem mTaskSystem;
   RenderContext mRenderContext;
   SceneRenderSystem mRenderSystem;
+  UpscaleSystem mUpscaleSystem;
+  AmbientOcclusionSystem mAmbientOcclusionSystem;
+  BlendShapeSystem mBlendShapeSystem;
   GuiSystem mGuiSystem;
 
+  bool mDynamicResolution = true;
+  float mResolutionScale = 1.0f;
+  DynamicResolutionSettings mDynamicResolutionSettings = {16.6f, 0.5f, 1.0f};
+  DynamicResolutionController mResolutionController;
+
   SkyBox mSkyBox;
+  TextureStreamer mTextureStreamer;
+  float mTextureBudgetMB = 256.0f;
 
   float mSceneScale = 1.0f;
-  Scene mScene;
+  // The current scene and a spare one, into which the next model loads.
+  Scene mScenes[2];
+  uint32_t mCurrentScene = 0;
+  inline Scene &GetScene() { return mScenes[mCurrentScene]; }
+  inline Scene &GetSpareScene() { return mScenes[mCurrentScene ^ 1]; }
+
+  enum class SceneSlotState {
+    Free,
+    Loading,
+  };
+  SceneSlotState mSpareSceneState = SceneSlotState::Free;
+
+  enum : uint32_t {
+    kSceneLoadPending,
+    kSceneLoadSucceeded,
+    kSceneLoadFailed,
+  };
+  struct SceneLoad {
+    Scene *pScene;
+    RenderContext *pRenderContext;
+    /// The load workers, which the import spreads its loops over.
+    TaskSystem *pTaskSystem;
+    char mFileName[FS_MAX_PATH];
+    /// Reimports of the current model are patched into it when possible.
+    bool mReimport;
+    time_t mModifiedTime;
+    int64_t mStartUSec;
+    tfrg_atomic32_t mResult;
+  };
+  SceneLoad mSceneLoad = {};
+  bool mTexturesRequested = false;
+
+  // Logged once the first model is shown, see Init.
+  TaskGraph mStartup;
+  static constexpr uint32_t kNoStartupTask = ~0u;
+  uint32_t mImportTask = kNoStartupTask;
+  bool mFirstFramePresented = false;
+  bool mStartupFinished = false;
+
+  bstring mModelFileName = bempty();
+  char mQueuedModel[FS_MAX_PATH] = {};
+  bool mModelQueued = false;
+  // The model shown, watched for changes while mWatchModel is set.
+  char mCurrentModel[FS_MAX_PATH] = {};
+  time_t mCurrentModelTime = 0;
+  bool mWatchModel = true;
+  float mWatchTimer = 0.0f;
+  static constexpr float kWatchIntervalSeconds = 0.5f;
+  // Set with --stream, which gives the GPU budget in MB, and --stream-cpu.
+  // Only the initial model is streamed; models loaded from the UI aren't.
+  bool mStreamModel = false;
+  ChunkStreamerDesc mStreamDesc = {256ull * 1024 * 1024, 16ull * 1024 * 1024};
+  // Shared by every scene and streamed chunk. Set in MB with
+  // --geometry-pool, two thirds of which hold vertices.
+  static constexpr uint64_t kDefaultGeometryPoolBytes = 384ull * 1024 * 1024;
+  static constexpr uint32_t kMaxGeometryAllocationCount = 32768;
+  // Set with --packed. The initial model then loads from its packed file,
+  // falling back to the FBX if it can't be packed. Reimports still go
+  // through the FBX.
+  bool mPackModel = false;
+  // Diagonal of the scene's bounds, before scaling.
+  float mSceneSize = 1.0f;
+
+  static constexpr float kNearZ = 0.1f;
+  static constexpr float kFarZ = 1000.0f;
+
+  ClusteredLighting mClusteredLighting;
+  LightRig mLightRig;
+  uint32_t mLightCount = 256;
+  float mLightRadius = 0.05f;
+  float mLightIntensity = 1.0f;
+  bool mAnimateLights = true;
+  bool mClusterHeatmap = false;
+  float mLightTime = 0.0f;
+  // Metallic/roughness shading lit by the sky box, instead of Lambert.
+  bool mPbrShading = true;
+  // Shades each pixel once, after rasterizing triangle IDs, instead of
+  // shading every fragment drawn.
+  bool mVisibilityBuffer = false;
+
+  bool mAmbientOcclusion = true;
+  // Relative to the scene's size.
+  float mAmbientOcclusionRadius = 0.02f;
+  AmbientOcclusionSettings mAmbientOcclusionSettings = {
+      kAmbientOcclusionMedium, 0.0f, 1.0f};
+
+  AnimationInstance mAnimation = {};
+  bool mPlayAnimation = true;
+  float mAnimationSpeed = 1.0f;
+
+  float mBlendShapeWeights[BlendShapeSet::kMaxTargetCount] = {};
+  bool mAnimateBlendShapes = true;
+  float mBlendShapeTime = 0.0f;
+
+  // Parameters the light rig was last generated with.
+  struct {
+    uint32_t mCount;
+    float mRadius;
+    float mIntensity;
+    float mSceneScale;
+  } mGeneratedLights = {};
 
   float mCameraAcceleration = 600.0f;
   float mCameraBraking = 200.0f;
@@ -205,6 +999,23 @@ private:
   ICameraController *pCameraController = NULL;
 
   ProfileToken mGpuProfileToken = PROFILE_INVALID_TOKEN;
+
+  float mDeltaTime = 0.0f;
+  RenderStatsFrame mRenderStats = {};
+  RenderStatsStream mRenderStatsStream;
+  bool mStreamRenderStats = false;
+  // Relative to RD_LOG, set with --stats-stream.
+  char mRenderStatsFileName[FS_MAX_PATH] = "ModelViewer.stats.jsonl";
+
+  // Both files are relative to RD_LOG. The camera path is recorded with
+  // --record-camera and replayed with --benchmark.
+  CameraPath mCameraPath;
+  char mCameraPathFileName[FS_MAX_PATH] = {};
+  bool mRecordCamera = false;
+  bool mBenchmarkRequested = false;
+  CameraPathBenchmarkDesc mBenchmarkDesc = {1, 3, 1.0f / 60.0f};
+  CameraPathBenchmark mBenchmark;
+  char mBenchmarkFileName[FS_MAX_PATH] = "ModelViewer.benchmark.json";
 };
 
 DEFINE_APPLICATION_MAIN(ModelViewer)